@@ -0,0 +1,207 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+AsyncEvent.cpp - An implementation file for Asynchronous Event Requests and the controller side event queue
+*/
+
+#include "AsyncEvent.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cnvme
+{
+	namespace events
+	{
+		AsyncEvents::AsyncEvents()
+		{
+			memset(MaskedUntilRead, 0, sizeof(MaskedUntilRead));
+			ErrorCount = 0;
+			ChangedNamespacesOverflowed = false;
+		}
+
+		bool AsyncEvents::park(UINT_16 commandId)
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			if (ParkedRequests.size() >= ASYNC_EVENT_REQUEST_LIMIT)
+			{
+				return false;
+			}
+			ParkedRequests.push_back(commandId);
+			return true;
+		}
+
+		bool AsyncEvents::cancel(UINT_16 commandId)
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			auto request = std::find(ParkedRequests.begin(), ParkedRequests.end(), commandId);
+			if (request == ParkedRequests.end())
+			{
+				return false;
+			}
+			ParkedRequests.erase(request);
+			return true;
+		}
+
+		void AsyncEvents::raise(UINT_8 type, UINT_8 information, UINT_8 logPageIdentifier)
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			for (const AsyncEvent &event : Events)
+			{
+				if (event.Type == type && event.Information == information && event.LogPageIdentifier == logPageIdentifier)
+				{
+					return; // Already waiting. The log page has the details of both.
+				}
+			}
+
+			if (Events.size() < ASYNC_EVENT_QUEUE_ENTRIES)
+			{
+				Events.push_back({ type, information, logPageIdentifier });
+			}
+		}
+
+		bool AsyncEvents::hasCompletion()
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			return !ParkedRequests.empty() && findDeliverableEvent() != Events.size();
+		}
+
+		bool AsyncEvents::takeCompletion(UINT_16 &commandId, UINT_32 &dword0)
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			size_t eventIndex = findDeliverableEvent();
+			if (ParkedRequests.empty() || eventIndex == Events.size())
+			{
+				return false;
+			}
+
+			AsyncEvent event = Events[eventIndex];
+			Events.erase(Events.begin() + eventIndex);
+			commandId = ParkedRequests.front();
+			ParkedRequests.pop_front();
+
+			MaskedUntilRead[event.Type & 0x7] = event.LogPageIdentifier;
+			dword0 = (event.Type & 0x7) | ((UINT_32)event.Information << 8) | ((UINT_32)event.LogPageIdentifier << 16);
+			return true;
+		}
+
+		void AsyncEvents::logPageRead(UINT_8 logPageIdentifier, bool retainAsynchronousEvent)
+		{
+			if (retainAsynchronousEvent)
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(EventMutex);
+			for (UINT_8 &maskedUntilRead : MaskedUntilRead)
+			{
+				if (maskedUntilRead == logPageIdentifier)
+				{
+					maskedUntilRead = 0;
+				}
+			}
+
+			if (logPageIdentifier == constants::log_pages::CHANGED_NAMESPACE_LIST)
+			{
+				ChangedNamespaces.clear();
+				ChangedNamespacesOverflowed = false;
+			}
+		}
+
+		void AsyncEvents::reset()
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			ParkedRequests.clear();
+			Events.clear();
+			memset(MaskedUntilRead, 0, sizeof(MaskedUntilRead));
+		}
+
+		bool AsyncEvents::reportInvalidDoorbell(UINT_16 queueId, bool completionQueue, UINT_16 value)
+		{
+			{
+				std::lock_guard<std::mutex> lock(EventMutex);
+				UINT_32 doorbell = (UINT_32)queueId * 2 + (completionQueue ? 1 : 0);
+				auto reported = InvalidDoorbellValues.find(doorbell);
+				if (reported != InvalidDoorbellValues.end() && reported->second == value)
+				{
+					return false; // Still the same write
+				}
+				InvalidDoorbellValues[doorbell] = value;
+
+				logpages::ERROR_INFORMATION_ENTRY entry = { 0 };
+				entry.ERRCNT = ++ErrorCount;
+				entry.SQID = queueId; // For a completion queue, the CQID: there's no one submission queue it's for
+				entry.CMDID = 0xFFFF; // Not for a command
+				entry.PEL = 0xFFFF;
+				entry.CSI = value;
+				ErrorLog.push_front(entry);
+				if (ErrorLog.size() > ERROR_LOG_ENTRIES)
+				{
+					ErrorLog.pop_back();
+				}
+			}
+
+			// Error events can't be turned off
+			raise(constants::async_events::TYPE_ERROR_STATUS, constants::async_events::ERROR_INVALID_DOORBELL_WRITE_VALUE, constants::log_pages::ERROR_INFORMATION);
+			return true;
+		}
+
+		void AsyncEvents::noteNamespaceChanged(UINT_32 namespaceId)
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			if (ChangedNamespaces.size() < CHANGED_NAMESPACE_LIST_ENTRIES)
+			{
+				ChangedNamespaces.insert(namespaceId);
+			}
+			else if (ChangedNamespaces.find(namespaceId) == ChangedNamespaces.end())
+			{
+				ChangedNamespacesOverflowed = true;
+			}
+		}
+
+		std::vector<logpages::ERROR_INFORMATION_ENTRY> AsyncEvents::getErrorLog()
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			std::vector<logpages::ERROR_INFORMATION_ENTRY> entries(ErrorLog.begin(), ErrorLog.end());
+			entries.resize(ERROR_LOG_ENTRIES, logpages::ERROR_INFORMATION_ENTRY());
+			return entries;
+		}
+
+		UINT_64 AsyncEvents::getErrorCount()
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			return ErrorCount;
+		}
+
+		logpages::CHANGED_NAMESPACE_LIST_LOG AsyncEvents::getChangedNamespaceList()
+		{
+			std::lock_guard<std::mutex> lock(EventMutex);
+			logpages::CHANGED_NAMESPACE_LIST_LOG log = { 0 };
+			if (ChangedNamespacesOverflowed)
+			{
+				log.NSID[0] = 0xFFFFFFFF;
+				return log;
+			}
+
+			UINT_32 i = 0;
+			for (UINT_32 namespaceId : ChangedNamespaces)
+			{
+				log.NSID[i++] = namespaceId; // A set, so already ascending
+			}
+			return log;
+		}
+
+		size_t AsyncEvents::findDeliverableEvent()
+		{
+			for (size_t i = 0; i < Events.size(); i++)
+			{
+				if (MaskedUntilRead[Events[i].Type & 0x7] == 0)
+				{
+					return i;
+				}
+			}
+			return Events.size();
+		}
+	}
+}
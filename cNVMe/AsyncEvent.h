@@ -0,0 +1,185 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+AsyncEvent.h - A header file for Asynchronous Event Requests and the controller side event queue
+*/
+
+#pragma once
+
+#include "LogPage.h"
+#include "Types.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#define ASYNC_EVENT_REQUEST_LIMIT 4 // Most Asynchronous Event Requests outstanding at once (AERL + 1)
+#define ASYNC_EVENT_QUEUE_ENTRIES 16 // Most events waiting for a request. Past this, new events are dropped (their log pages still have them).
+#define ERROR_LOG_ENTRIES 16 // Error Information log page entries kept (ELPE + 1)
+
+namespace cnvme
+{
+	namespace events
+	{
+		/// <summary>
+		/// An event waiting for an Asynchronous Event Request to complete
+		/// </summary>
+		struct AsyncEvent
+		{
+			UINT_8 Type; // constants::async_events TYPE_*
+			UINT_8 Information; // Asynchronous Event Information
+			UINT_8 LogPageIdentifier; // Log page the host reads (without RAE) to clear it
+		};
+
+		/// <summary>
+		/// Asynchronous Event Requests parked until something happens, the events waiting for them,
+		///   and the Error Information and Changed Namespace List log pages they point the host at.
+		/// Once an event of a type is handed out, the type is masked until the host reads the event's log page
+		///   without Retain Asynchronous Event, so a condition that keeps happening completes one request, not all of them.
+		/// Safe to use from many threads at once. Completions are only taken by the admin thread, which posts them.
+		/// </summary>
+		class AsyncEvents
+		{
+		public:
+			/// <summary>
+			/// Constructor. No requests, no events, empty logs.
+			/// </summary>
+			AsyncEvents();
+
+			/// <summary>
+			/// Parks an Asynchronous Event Request until there's an event for it
+			/// </summary>
+			/// <param name="commandId">Its CID (it's always from the admin queue)</param>
+			/// <returns>False if ASYNC_EVENT_REQUEST_LIMIT are already parked</returns>
+			bool park(UINT_16 commandId);
+
+			/// <summary>
+			/// Takes back a parked request without an event (it's being aborted)
+			/// </summary>
+			/// <param name="commandId">Its CID</param>
+			/// <returns>True if it was parked</returns>
+			bool cancel(UINT_16 commandId);
+
+			/// <summary>
+			/// Queues an event for the next request. An identical event already waiting is not queued twice.
+			/// </summary>
+			/// <param name="type">constants::async_events TYPE_*</param>
+			/// <param name="information">Asynchronous Event Information</param>
+			/// <param name="logPageIdentifier">Log page the host reads to clear it</param>
+			void raise(UINT_8 type, UINT_8 information, UINT_8 logPageIdentifier);
+
+			/// <summary>
+			/// Returns true if a parked request and an event whose type isn't masked are both waiting
+			/// </summary>
+			bool hasCompletion();
+
+			/// <summary>
+			/// Pairs the oldest parked request with the oldest event whose type isn't masked, and masks that type
+			/// </summary>
+			/// <param name="commandId">Set to the request's CID</param>
+			/// <param name="dword0">Set to the completion's DW0 (type, information and log page identifier)</param>
+			/// <returns>False if there's nothing to complete</returns>
+			bool takeCompletion(UINT_16 &commandId, UINT_32 &dword0);
+
+			/// <summary>
+			/// Called once the host has read a log page. Without Retain Asynchronous Event, this unmasks the types
+			///   whose events pointed at it, and clears the Changed Namespace List if that's the one read.
+			/// </summary>
+			/// <param name="logPageIdentifier">The log page read</param>
+			/// <param name="retainAsynchronousEvent">RAE from the Get Log Page</param>
+			void logPageRead(UINT_8 logPageIdentifier, bool retainAsynchronousEvent);
+
+			/// <summary>
+			/// Drops the parked requests (a controller reset ends them without completions), waiting events and masks.
+			/// The log pages are kept.
+			/// </summary>
+			void reset();
+
+			/// <summary>
+			/// Adds an entry to the Error Information log page and raises an error event for it.
+			/// A doorbell left at the same invalid value is only reported once.
+			/// </summary>
+			/// <param name="queueId">Queue whose doorbell it is</param>
+			/// <param name="completionQueue">True for the completion queue head doorbell, false for the submission queue tail one</param>
+			/// <param name="value">What the host wrote</param>
+			/// <returns>True if it hadn't been reported yet</returns>
+			bool reportInvalidDoorbell(UINT_16 queueId, bool completionQueue, UINT_16 value);
+
+			/// <summary>
+			/// Notes that a namespace's Identify Namespace data changed, for the Changed Namespace List log page.
+			/// The caller raises the event, if Namespace Attribute Notices are enabled.
+			/// </summary>
+			/// <param name="namespaceId">The NSID</param>
+			void noteNamespaceChanged(UINT_32 namespaceId);
+
+			/// <summary>
+			/// Returns the Error Information log page: ERROR_LOG_ENTRIES entries, newest first, unused ones zero
+			/// </summary>
+			std::vector<logpages::ERROR_INFORMATION_ENTRY> getErrorLog();
+
+			/// <summary>
+			/// Returns the number of errors ever logged (including ones since pushed out of the log page)
+			/// </summary>
+			UINT_64 getErrorCount();
+
+			/// <summary>
+			/// Returns the Changed Namespace List log page
+			/// </summary>
+			logpages::CHANGED_NAMESPACE_LIST_LOG getChangedNamespaceList();
+
+		private:
+			/// <summary>
+			/// Guards everything below
+			/// </summary>
+			std::mutex EventMutex;
+
+			/// <summary>
+			/// CIDs of the parked requests, oldest first
+			/// </summary>
+			std::deque<UINT_16> ParkedRequests;
+
+			/// <summary>
+			/// Events waiting for a request, oldest first
+			/// </summary>
+			std::deque<AsyncEvent> Events;
+
+			/// <summary>
+			/// By event type: the log page that unmasks it, or 0 if it isn't masked (LID 0 is reserved)
+			/// </summary>
+			UINT_8 MaskedUntilRead[8];
+
+			/// <summary>
+			/// Error Information log page entries, newest first
+			/// </summary>
+			std::deque<logpages::ERROR_INFORMATION_ENTRY> ErrorLog;
+
+			/// <summary>
+			/// Errors ever logged
+			/// </summary>
+			UINT_64 ErrorCount;
+
+			/// <summary>
+			/// Last invalid value reported for each doorbell (queue ID * 2, plus 1 for the completion queue head)
+			/// </summary>
+			std::map<UINT_32, UINT_16> InvalidDoorbellValues;
+
+			/// <summary>
+			/// NSIDs that changed since the Changed Namespace List was last read
+			/// </summary>
+			std::set<UINT_32> ChangedNamespaces;
+
+			/// <summary>
+			/// True if more namespaces changed than the Changed Namespace List has room for
+			/// </summary>
+			bool ChangedNamespacesOverflowed;
+
+			/// <summary>
+			/// Returns the index in Events of the oldest event whose type isn't masked. Needs EventMutex.
+			/// </summary>
+			/// <returns>The index, or Events.size() if there isn't one</returns>
+			size_t findDeliverableEvent();
+		};
+	}
+}
@@ -0,0 +1,1331 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Benchmarks.cpp - An implementation file for the performance benchmarks
+*/
+
+#include "Benchmarks.h"
+#include "Checksum.h"
+#include "Constants.h"
+#include "Journal.h"
+#include "PRP.h"
+#include "Tests.h"
+#include "Tier.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace cnvme
+{
+	namespace benchmarks
+	{
+		namespace helpers
+		{
+			void runBenchmarks()
+			{
+				nvm::copyBandwidth();
+				nvm::volatileWriteCache();
+				nvm::readCache();
+				nvm::formatLatency();
+				nvm::cloneLatency();
+				nvm::journaledFlush();
+				nvm::dedupRatio();
+				nvm::tieredLatency();
+				nvm::noisyNeighbor();
+				nvm::queueDepthScaling();
+				nvm::sharedCompletionQueue();
+				nvm::arbitrationBurst();
+				nvm::pipelineStages();
+				nvm::workStealing();
+				nvm::adminStorm();
+				nvm::predictableLatency();
+				nvm::filterOffload();
+				ftl::writeAmplification();
+				ftl::streamWriteAmplification();
+				zns::zoneAppendScaling();
+			}
+
+			double getSecondsSince(std::chrono::steady_clock::time_point start)
+			{
+				return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+
+			void printResult(std::string benchmark, std::string configuration, double operationsPerSecond, double bytesPerSecond)
+			{
+				std::cout << std::left << std::setw(28) << benchmark << " " << std::setw(24) << configuration << std::right << std::fixed << std::setprecision(0)
+					<< std::setw(12) << operationsPerSecond << " ops/s " << std::setprecision(1) << std::setw(10) << bytesPerSecond / (1024 * 1024) << " MiB/s" << std::endl;
+			}
+		}
+
+		namespace nvm
+		{
+			void copyBandwidth()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_64 copyBlocks = 128 * 1024; // 64 MiB
+				const UINT_32 blocksPerCommand = 256; // 128 KiB per command for the host side copy
+				const std::string filePath = "cNVMe_copy_benchmark.bin";
+
+				Payload pattern(blocksPerCommand * blockSize);
+				memset(pattern.getBuffer(), 0xA5, pattern.getSize());
+
+				auto runCopy = [&](media::MediaBackend &media, std::string configuration, UINT_64 destinationLba, bool hostSide) {
+					for (UINT_64 lba = 0; lba < copyBlocks; lba += blocksPerCommand)
+					{
+						media.write(lba, blocksPerCommand, pattern.getBuffer());
+					}
+
+					auto start = std::chrono::steady_clock::now();
+					if (hostSide)
+					{
+						// What a host has to do without Copy: the data crosses the PRPs twice
+						PRP prp(Payload(blocksPerCommand * blockSize), 4096);
+						Payload transferPayload(prp.getNumBytes());
+						for (UINT_64 done = 0; done < copyBlocks; done += blocksPerCommand)
+						{
+							media.read(done, blocksPerCommand, transferPayload.getBuffer());
+							prp.placePayloadInExistingPRPs(transferPayload);
+							Payload writePayload = prp.getPayloadCopy();
+							media.write(destinationLba + done, blocksPerCommand, writePayload.getBuffer());
+						}
+					}
+					else
+					{
+						media.copy(0, destinationLba, copyBlocks);
+					}
+					double seconds = helpers::getSecondsSince(start);
+
+					UINT_64 operations = hostSide ? copyBlocks / blocksPerCommand : 1;
+					helpers::printResult("Copy (64 MiB)", configuration, operations / seconds, copyBlocks * blockSize / seconds);
+				};
+
+				{
+					media::RamMedia ramMedia(blockSize, copyBlocks * 3);
+					runCopy(ramMedia, "RAM host side", copyBlocks, true);
+				}
+				{
+					media::RamMedia ramMedia(blockSize, copyBlocks * 3);
+					runCopy(ramMedia, "RAM chunk aligned", copyBlocks, false);
+				}
+				{
+					media::RamMedia ramMedia(blockSize, copyBlocks * 3);
+					runCopy(ramMedia, "RAM unaligned", copyBlocks + 1, false);
+				}
+				{
+					media::FileMedia fileMedia(filePath, blockSize, copyBlocks * 3);
+					runCopy(fileMedia, "File host side", copyBlocks, true);
+				}
+				std::remove(filePath.c_str());
+				{
+					media::FileMedia fileMedia(filePath, blockSize, copyBlocks * 3);
+					runCopy(fileMedia, "File", copyBlocks, false);
+				}
+				std::remove(filePath.c_str());
+			}
+		}
+
+		namespace nvm
+		{
+			void volatileWriteCache()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_32 blocksPerWrite = 8; // 4 KiB
+				const UINT_64 numberOfBlocks = 64 * 1024; // 32 MiB
+				const UINT_64 numberOfWrites = 4096; // 16 MiB, fits in the cache
+				const std::string filePath = "cNVMe_cache_benchmark.bin";
+
+				std::mt19937_64 generator(0);
+				std::uniform_int_distribution<UINT_64> randomWrite(0, numberOfBlocks / blocksPerWrite - 1);
+				Payload data(blocksPerWrite * blockSize);
+
+				for (int sequential = 1; sequential >= 0; sequential--)
+				{
+					for (int cached = 0; cached < 2; cached++)
+					{
+						controller::Namespace theNamespace(1, new media::FileMedia(filePath, blockSize, numberOfBlocks));
+						theNamespace.getWriteCache()->setEnabled(cached != 0);
+
+						auto start = std::chrono::steady_clock::now();
+						for (UINT_64 i = 0; i < numberOfWrites; i++)
+						{
+							UINT_64 lba = (sequential ? i : randomWrite(generator)) * blocksPerWrite;
+							theNamespace.getMedia()->write(lba, blocksPerWrite, data.getBuffer());
+						}
+						double writeSeconds = helpers::getSecondsSince(start);
+
+						auto flushStart = std::chrono::steady_clock::now();
+						theNamespace.getMedia()->flush();
+						double flushSeconds = helpers::getSecondsSince(flushStart);
+
+						std::string configuration = std::string(sequential ? "sequential" : "random") + (cached ? " cache on" : " cache off");
+						helpers::printResult("4 KiB writes + Flush", configuration, numberOfWrites / writeSeconds, numberOfWrites * data.getSize() / writeSeconds);
+						std::cout << "    avg write " << std::fixed << std::setprecision(1) << writeSeconds * 1000000 / numberOfWrites << " us, flush "
+							<< flushSeconds * 1000 << " ms, coalesced writes " << theNamespace.getWriteCache()->getCoalescedWrites()
+							<< ", total with flush " << (writeSeconds + flushSeconds) * 1000 << " ms" << std::endl;
+					}
+					std::remove(filePath.c_str());
+				}
+			}
+
+			void readCache()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_64 numberOfBlocks = 128 * 1024; // 64 MiB
+				const UINT_32 readSizes[] = { 4096, 32 * 1024, 128 * 1024, 0 }; // 0: random 4 KiB
+
+				const std::string filePath = "cNVMe_read_cache_benchmark.bin";
+				controller::Namespace theNamespace(1, new media::FileMedia(filePath, blockSize, numberOfBlocks));
+				media::ReadCacheMedia* readCache = theNamespace.getReadCache(); // Off by default, like it would be with a controller
+				Payload data(1024 * 1024);
+				for (UINT_64 lba = 0; lba < numberOfBlocks; lba += data.getSize() / blockSize)
+				{
+					theNamespace.getMedia()->write(lba, (UINT_32)(data.getSize() / blockSize), data.getBuffer());
+				}
+
+				std::mt19937_64 generator(0);
+				for (UINT_32 readSize : readSizes)
+				{
+					bool random = readSize == 0;
+					UINT_32 blocksPerRead = (random ? 4096 : readSize) / blockSize;
+					UINT_64 numberOfReads = numberOfBlocks / blocksPerRead;
+					std::uniform_int_distribution<UINT_64> randomRead(0, numberOfReads - 1);
+
+					for (int cached = 0; cached < 2; cached++)
+					{
+						readCache->setEnabled(cached != 0); // Disabling drops everything, so each pass starts cold
+						logpages::READ_CACHE_STATISTICS_LOG before = readCache->getStatistics();
+
+						auto start = std::chrono::steady_clock::now();
+						for (UINT_64 i = 0; i < numberOfReads; i++)
+						{
+							UINT_64 lba = (random ? randomRead(generator) : i) * blocksPerRead;
+							readCache->read(1, lba, blocksPerRead, data.getBuffer());
+						}
+						double seconds = helpers::getSecondsSince(start);
+
+						std::string configuration = (random ? std::string("random 4K") : "seq " + std::to_string(readSize / 1024) + "K") + (cached ? " cache on" : " cache off");
+						helpers::printResult("Reads (64 MiB, file)", configuration, numberOfReads / seconds, numberOfReads * blocksPerRead * blockSize / seconds);
+						if (cached)
+						{
+							logpages::READ_CACHE_STATISTICS_LOG after = readCache->getStatistics();
+							UINT_64 hits = after.CHB - before.CHB;
+							UINT_64 useful = after.UPL - before.UPL;
+							UINT_64 wasted = after.WPL - before.WPL;
+							std::cout << "    hit ratio " << std::fixed << std::setprecision(3) << (double)hits / (after.HRB - before.HRB)
+								<< ", prefetched lines " << after.PL - before.PL << ", prefetch accuracy "
+								<< (useful + wasted ? (double)useful / (useful + wasted) : 0.0) << std::endl;
+						}
+					}
+				}
+			}
+		}
+
+		namespace nvm
+		{
+			void formatLatency()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_64 writtenBlocks = 512 * 1024; // 256 MiB
+				const UINT_64 namespaceSizes[] = { 1ull << 27, 1ull << 31, 1ull << 34 }; // 64 GiB, 1 TiB, 8 TiB
+
+				Payload data(1024 * 1024);
+				for (UINT_64 numberOfBlocks : namespaceSizes)
+				{
+					for (int deallocate = 0; deallocate < 2; deallocate++)
+					{
+						if (deallocate && numberOfBlocks > namespaceSizes[0])
+						{
+							continue; // Walking every chunk of a TiB scale namespace takes too long to be worth waiting for
+						}
+
+						// Spread the data out over the whole namespace
+						media::RamMedia media(blockSize, numberOfBlocks);
+						UINT_32 blocksPerWrite = (UINT_32)(data.getSize() / blockSize);
+						UINT_64 numberOfWrites = writtenBlocks / blocksPerWrite;
+						for (UINT_64 i = 0; i < numberOfWrites; i++)
+						{
+							media.write(i * (numberOfBlocks / numberOfWrites), blocksPerWrite, data.getBuffer());
+						}
+
+						auto start = std::chrono::steady_clock::now();
+						if (deallocate)
+						{
+							media.deallocate(0, numberOfBlocks);
+						}
+						else
+						{
+							media.format();
+						}
+						double seconds = helpers::getSecondsSince(start);
+
+						while (media.getNumberOfAllocatedChunks() != 0)
+						{
+							std::this_thread::sleep_for(std::chrono::milliseconds(1));
+						}
+						double reclaimSeconds = helpers::getSecondsSince(start);
+
+						std::cout << std::left << std::setw(28) << "Format (256 MiB written)" << " " << std::setw(24)
+							<< (std::to_string((numberOfBlocks * blockSize) >> 30) + " GiB " + (deallocate ? "deallocate" : "format")) << std::right << std::fixed
+							<< std::setprecision(3) << std::setw(12) << seconds * 1000 << " ms, all memory freed after " << reclaimSeconds * 1000 << " ms" << std::endl;
+					}
+				}
+			}
+
+			void cloneLatency()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_64 numberOfBlocks = 1ull << 22; // 2 GiB
+				const UINT_64 writtenBlocks = 2 * 1024 * 1024; // 1 GiB
+				const int numberOfClones = 100;
+
+				media::RamMedia golden(blockSize, numberOfBlocks);
+				Payload data(1024 * 1024);
+				UINT_32 blocksPerWrite = (UINT_32)(data.getSize() / blockSize);
+				for (UINT_64 lba = 0; lba < writtenBlocks; lba += blocksPerWrite)
+				{
+					golden.write(lba, blocksPerWrite, data.getBuffer());
+				}
+
+				// What restoring the image costs without clones: reading it all and writing it to fresh media
+				auto start = std::chrono::steady_clock::now();
+				{
+					media::RamMedia copy(blockSize, numberOfBlocks);
+					for (UINT_64 lba = 0; lba < writtenBlocks; lba += blocksPerWrite)
+					{
+						golden.read(lba, blocksPerWrite, data.getBuffer());
+						copy.write(lba, blocksPerWrite, data.getBuffer());
+					}
+				}
+				double copySeconds = helpers::getSecondsSince(start);
+
+				std::vector<std::unique_ptr<media::MediaBackend>> clones;
+				start = std::chrono::steady_clock::now();
+				for (int i = 0; i < numberOfClones; i++)
+				{
+					clones.emplace_back(golden.clone());
+				}
+				double cloneSeconds = helpers::getSecondsSince(start);
+
+				// Each clone then writes a little of its own. Anything a clone doesn't share is private to it.
+				size_t chunks = golden.getNumberOfAllocatedChunks();
+				for (auto &clone : clones)
+				{
+					clone->write(0, blocksPerWrite, data.getBuffer());
+					media::RamMedia* ramClone = dynamic_cast<media::RamMedia*>(clone.get());
+					chunks += ramClone->getNumberOfAllocatedChunks() - ramClone->getNumberOfSharedChunks();
+				}
+
+				std::cout << std::left << std::setw(28) << "Clone (1 GiB image)" << " " << std::setw(24) << "full copy" << std::right << std::fixed
+					<< std::setprecision(3) << std::setw(12) << copySeconds * 1000 << " ms" << std::endl;
+				std::cout << std::left << std::setw(28) << "Clone (1 GiB image)" << " " << std::setw(24) << "copy-on-write clone" << std::right << std::fixed
+					<< std::setprecision(3) << std::setw(12) << cloneSeconds * 1000 / numberOfClones << " ms, " << numberOfClones << " clones each 1 MiB written use "
+					<< chunks * MEDIA_CHUNK_SIZE / (1024 * 1024) << " MiB (with the image)" << std::endl;
+			}
+
+			void journaledFlush()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_32 blocksPerWrite = 8; // 4 KiB
+				const UINT_64 numberOfBlocks = 256 * 1024; // 128 MiB
+				const int writesPerThread = 256;
+				const int threadCounts[] = { 1, 4, 16 };
+				const std::string filePath = "cNVMe_journal_benchmark.bin";
+				const std::string journalPath = "cNVMe_journal_benchmark.journal";
+				Payload data(blocksPerWrite * blockSize);
+
+				// Every thread does a write then a flush (what a FUA write costs), to plain file media and to journaled media
+				for (int journaled = 0; journaled < 2; journaled++)
+				{
+					for (int numberOfThreads : threadCounts)
+					{
+						std::unique_ptr<media::MediaBackend> theMedia;
+						if (journaled)
+						{
+							theMedia.reset(new media::JournaledMedia(new media::FileMedia(filePath, blockSize, numberOfBlocks), journalPath));
+						}
+						else
+						{
+							theMedia.reset(new media::FileMedia(filePath, blockSize, numberOfBlocks));
+						}
+
+						auto start = std::chrono::steady_clock::now();
+						std::vector<std::thread> threads;
+						for (int t = 0; t < numberOfThreads; t++)
+						{
+							threads.emplace_back([&, t]() {
+								std::mt19937_64 generator(t);
+								std::uniform_int_distribution<UINT_64> randomWrite(0, numberOfBlocks / blocksPerWrite - 1);
+								for (int i = 0; i < writesPerThread; i++)
+								{
+									theMedia->write(randomWrite(generator) * blocksPerWrite, blocksPerWrite, data.getBuffer());
+									theMedia->flush();
+								}
+							});
+						}
+						for (auto &thread : threads)
+						{
+							thread.join();
+						}
+						double seconds = helpers::getSecondsSince(start);
+
+						UINT_64 writes = (UINT_64)numberOfThreads * writesPerThread;
+						std::string configuration = std::string(journaled ? "journaled" : "file") + ", " + std::to_string(numberOfThreads) + " threads";
+						helpers::printResult("4 KiB write + Flush", configuration, writes / seconds, writes * data.getSize() / seconds);
+						if (journaled)
+						{
+							media::JournaledMedia* journaledMedia = dynamic_cast<media::JournaledMedia*>(theMedia.get());
+							std::cout << "    " << journaledMedia->getNumberOfCommitRequests() << " flushes took " << journaledMedia->getNumberOfCommits() << " journal syncs" << std::endl;
+						}
+						theMedia.reset();
+						std::remove(filePath.c_str());
+						std::remove(journalPath.c_str());
+					}
+				}
+
+				// Recovery time with a nearly full journal: a kill is simulated by copying the files while the media is still open
+				const std::string crashedFilePath = "cNVMe_journal_benchmark_crash.bin";
+				const std::string crashedJournalPath = "cNVMe_journal_benchmark_crash.journal";
+				{
+					media::JournaledMedia journaledMedia(new media::FileMedia(filePath, blockSize, numberOfBlocks), journalPath);
+					UINT_64 writes = JOURNAL_DEFAULT_SIZE / (data.getSize() + sizeof(media::JOURNAL_RECORD)) - 1;
+					for (UINT_64 i = 0; i < writes; i++)
+					{
+						journaledMedia.write((i * blocksPerWrite) % numberOfBlocks, blocksPerWrite, data.getBuffer());
+					}
+					journaledMedia.flush();
+
+					std::ofstream(crashedFilePath, std::ios::binary) << std::ifstream(filePath, std::ios::binary).rdbuf();
+					std::ofstream(crashedJournalPath, std::ios::binary) << std::ifstream(journalPath, std::ios::binary).rdbuf();
+				}
+
+				auto start = std::chrono::steady_clock::now();
+				UINT_64 recoveredRecords;
+				{
+					media::JournaledMedia recovered(new media::FileMedia(crashedFilePath, blockSize, numberOfBlocks), crashedJournalPath);
+					recoveredRecords = recovered.getNumberOfRecoveredRecords();
+				}
+				double seconds = helpers::getSecondsSince(start);
+				std::cout << std::left << std::setw(28) << "Journal recovery" << " " << std::setw(24) << std::to_string(JOURNAL_DEFAULT_SIZE >> 20) + " MiB journal" << std::right
+					<< std::fixed << std::setprecision(3) << std::setw(12) << seconds * 1000 << " ms for " << recoveredRecords << " records (replay and checkpoint)" << std::endl;
+
+				for (const std::string &path : { filePath, journalPath, crashedFilePath, crashedJournalPath })
+				{
+					std::remove(path.c_str());
+				}
+			}
+
+			void dedupRatio()
+			{
+				const UINT_32 blockSize = 4096;
+				const UINT_64 numberOfBlocks = 256 * 1024; // 1 GiB
+				const UINT_32 blocksPerWrite = 32; // 128 KiB
+				const UINT_32 distinctPatterns = 4096;
+
+				// A synthetic image: half zero blocks, the rest drawn from a small set of patterns
+				std::mt19937_64 generator(0);
+				std::vector<BYTE> patterns((size_t)distinctPatterns * blockSize);
+				for (auto &byte : patterns)
+				{
+					byte = (BYTE)generator();
+				}
+				std::vector<BYTE> image((size_t)blocksPerWrite * 256 * blockSize); // 32 MiB, written over and over
+				for (size_t block = 0; block < image.size() / blockSize; block++)
+				{
+					if (generator() % 2)
+					{
+						memcpy(image.data() + block * blockSize, patterns.data() + (generator() % distinctPatterns) * blockSize, blockSize);
+					}
+				}
+
+				// Raw CRC32C speed, as that's what every dedup write pays
+				auto start = std::chrono::steady_clock::now();
+				UINT_32 crc = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					crc = checksum::crc32c(image.data(), image.size(), crc);
+				}
+				double seconds = helpers::getSecondsSince(start);
+				helpers::printResult("CRC32C", "32 MiB x 8", 8 / seconds, 8 * image.size() / seconds);
+
+				UINT_64 imageBlocks = image.size() / blockSize;
+				for (int dedup = 0; dedup < 2; dedup++)
+				{
+					std::unique_ptr<media::MediaBackend> theMedia;
+					if (dedup)
+					{
+						theMedia.reset(new media::DedupMedia(blockSize, numberOfBlocks));
+					}
+					else
+					{
+						theMedia.reset(new media::RamMedia(blockSize, numberOfBlocks));
+					}
+
+					start = std::chrono::steady_clock::now();
+					for (UINT_64 lba = 0; lba < numberOfBlocks; lba += blocksPerWrite)
+					{
+						theMedia->write(lba, blocksPerWrite, image.data() + (lba % imageBlocks) * blockSize);
+					}
+					seconds = helpers::getSecondsSince(start);
+
+					UINT_64 storedBytes;
+					std::string extra;
+					if (dedup)
+					{
+						logpages::DEDUP_STATISTICS_LOG statistics = dynamic_cast<media::DedupMedia*>(theMedia.get())->getStatistics();
+						storedBytes = statistics.SB;
+						std::stringstream ratio;
+						ratio << ", dedup ratio " << std::fixed << std::setprecision(2) << statistics.DR / 1000.0 << ", zero blocks " << statistics.ZBW;
+						extra = ratio.str();
+					}
+					else
+					{
+						storedBytes = dynamic_cast<media::RamMedia*>(theMedia.get())->getNumberOfAllocatedChunks() * MEDIA_CHUNK_SIZE;
+					}
+
+					helpers::printResult("1 GiB synthetic image", dedup ? "dedup" : "RAM", (numberOfBlocks / blocksPerWrite) / seconds, numberOfBlocks * blockSize / seconds);
+					std::cout << "    " << storedBytes / (1024 * 1024) << " MiB stored" << extra << std::endl;
+				}
+			}
+
+			void tieredLatency()
+			{
+				const UINT_32 blockSize = 4096;
+				const UINT_64 numberOfBlocks = 64 * 1024; // 256 MiB
+				const UINT_64 fastCapacityInBlocks = 8 * 1024; // 32 MiB
+				const UINT_64 hotBlocks = 4 * 1024; // 16 MiB
+				const UINT_64 hotLba = numberOfBlocks - hotBlocks; // Written last, so it starts out in the slow tier
+				const UINT_32 blocksPerWrite = 32; // 128 KiB
+				const int numberOfReads = 200000;
+				const std::string filePath = "cNVMe_tier_benchmark.bin";
+				Payload data(blocksPerWrite * blockSize);
+
+				const char* configurations[] = { "file only", "tiered, heat", "tiered, DSM hint" };
+				for (int configuration = 0; configuration < 3; configuration++)
+				{
+					std::unique_ptr<media::MediaBackend> theMedia;
+					media::TieredMedia* tiered = nullptr;
+					if (configuration == 0)
+					{
+						theMedia.reset(new media::FileMedia(filePath, blockSize, numberOfBlocks));
+					}
+					else
+					{
+						tiered = new media::TieredMedia(new media::RamMedia(blockSize, numberOfBlocks), new media::FileMedia(filePath, blockSize, numberOfBlocks), fastCapacityInBlocks);
+						theMedia.reset(tiered);
+					}
+
+					for (UINT_64 lba = 0; lba < numberOfBlocks; lba += blocksPerWrite)
+					{
+						theMedia->write(lba, blocksPerWrite, data.getBuffer());
+					}
+					if (configuration == 2)
+					{
+						theMedia->hint(hotLba, hotBlocks, 0x30); // Low latency
+					}
+
+					std::mt19937_64 generator(0);
+					auto start = std::chrono::steady_clock::now();
+					for (int i = 0; i < numberOfReads; i++)
+					{
+						UINT_64 lba = generator() % 10 ? hotLba + generator() % hotBlocks : generator() % numberOfBlocks;
+						theMedia->read(lba, 1, data.getBuffer());
+					}
+					double seconds = helpers::getSecondsSince(start);
+
+					helpers::printResult("Hot/cold random 4 KiB reads", configurations[configuration], numberOfReads / seconds, numberOfReads * (double)blockSize / seconds);
+					std::cout << "    " << std::setprecision(2) << seconds * 1000000 / numberOfReads << " us average";
+					if (tiered)
+					{
+						logpages::TIERING_STATISTICS_LOG statistics = tiered->getStatistics();
+						std::cout << ", " << std::setprecision(1) << 100.0 * statistics.FRB / (statistics.FRB + statistics.SRB) << "% from the fast tier, "
+							<< statistics.PS << " promotions, " << statistics.DS << " demotions";
+					}
+					std::cout << std::endl;
+
+					theMedia.reset();
+					std::remove(filePath.c_str());
+				}
+			}
+
+			void noisyNeighbor()
+			{
+				const UINT_32 blockSize = DEFAULT_NAMESPACE_BLOCK_SIZE;
+				const UINT_32 noisyBlocks = 512; // 256 KiB writes
+				const UINT_32 noisyQueueDepth = 8;
+				const UINT_32 victimBlocks = 4096 / blockSize;
+				const double secondsPerRun = 2;
+
+				struct Run
+				{
+					std::string Configuration;
+					UINT_32 Iops;
+					UINT_32 KibPerSecond;
+				};
+				const Run runs[] = { { "no limits", 0, 0 }, { "noisy 4 MiB/s", 0, 4 * 1024 }, { "noisy 16 IOPS", 16, 0 } };
+
+				for (const Run &run : runs)
+				{
+					Controller controller;
+					tests::helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+					tests::helpers::HostQueuePair noisyQueuePair(controller, 1, 16);
+					tests::helpers::HostQueuePair victimQueuePair(controller, 2, 16);
+					if (!tests::helpers::enableController(controller, adminQueuePair) || !tests::helpers::createIoQueuePair(adminQueuePair, noisyQueuePair) ||
+						!tests::helpers::createIoQueuePair(adminQueuePair, victimQueuePair))
+					{
+						LOG_ERROR("Unable to set up the controller for the noisy neighbor benchmark");
+						return;
+					}
+
+					command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.DWord10 = constants::features::QOS_LIMITS;
+					setFeatures.DWord11 = 1; // The noisy queue
+					setFeatures.DWord12 = run.Iops;
+					setFeatures.DWord13 = run.KibPerSecond;
+					adminQueuePair.sendCommand(setFeatures, completion);
+
+					// The noisy neighbor keeps its own queue full of big writes the whole time
+					std::atomic<bool> done(false);
+					UINT_64 noisyWrites = 0;
+					std::thread noisyThread([&] {
+						PRP noisyPrp(Payload(noisyBlocks * blockSize), 4096);
+						command::NVME_COMMAND noisyWrite = tests::helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, 0, noisyBlocks, noisyPrp);
+						command::COMPLETION_QUEUE_ENTRY noisyCompletion = { 0 };
+						noisyQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(noisyQueueDepth, noisyWrite));
+						while (!done && noisyQueuePair.waitForCompletion(noisyCompletion))
+						{
+							noisyWrites++;
+							noisyQueuePair.submitCommands({ noisyWrite });
+						}
+						for (UINT_32 i = 0; i < noisyQueueDepth; i++)
+						{
+							noisyQueuePair.waitForCompletion(noisyCompletion); // Drain before the queues go away
+						}
+					});
+
+					PRP victimPrp(Payload(victimBlocks * blockSize), 4096);
+					UINT_64 victimReads = 0;
+					auto start = std::chrono::steady_clock::now();
+					while (helpers::getSecondsSince(start) < secondsPerRun)
+					{
+						victimReads += victimQueuePair.sendCommand(tests::helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, victimBlocks, victimPrp), completion);
+					}
+					double seconds = helpers::getSecondsSince(start);
+					done = true;
+					noisyThread.join();
+
+					helpers::printResult("Noisy neighbor (victim 4K)", run.Configuration, victimReads / seconds, victimReads * victimBlocks * blockSize / seconds);
+					std::cout << "    victim average latency " << std::fixed << std::setprecision(1) << seconds * 1000000 / victimReads << " us, noisy neighbor "
+						<< noisyWrites * noisyBlocks * blockSize / seconds / (1024 * 1024) << " MiB/s" << std::endl;
+				}
+			}
+
+			void queueDepthScaling()
+			{
+				const UINT_16 queueSize = 64;
+				const UINT_32 blocksPerRead = 4096 / DEFAULT_NAMESPACE_BLOCK_SIZE;
+				const double secondsPerRun = 1;
+
+				for (UINT_16 queueDepth : { 1, 4, 16, queueSize - 1 })
+				{
+					Controller controller;
+					tests::helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+					tests::helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+					if (!tests::helpers::enableController(controller, adminQueuePair) || !tests::helpers::createIoQueuePair(adminQueuePair, ioQueuePair))
+					{
+						LOG_ERROR("Unable to set up the controller for the queue depth benchmark");
+						return;
+					}
+
+					PRP readPrp(Payload(blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+					command::NVME_COMMAND read = tests::helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, blocksPerRead, readPrp);
+					command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+
+					UINT_64 reads = 0;
+					ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueDepth, read));
+					auto start = std::chrono::steady_clock::now();
+					while (helpers::getSecondsSince(start) < secondsPerRun && ioQueuePair.waitForCompletion(completion))
+					{
+						reads++;
+						ioQueuePair.submitCommands({ read });
+					}
+					double seconds = helpers::getSecondsSince(start);
+					for (UINT_16 i = 0; i < queueDepth; i++)
+					{
+						ioQueuePair.waitForCompletion(completion); // Drain before the queues go away
+					}
+
+					helpers::printResult("Queue depth 4K reads", "QD " + std::to_string(queueDepth), reads / seconds, reads * blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE / seconds);
+					std::cout << "    average latency " << std::fixed << std::setprecision(1) << (reads ? seconds * queueDepth * 1000000 / reads : 0) << " us" << std::endl;
+				}
+			}
+
+			void arbitrationBurst()
+			{
+				const UINT_16 queueSize = 64;
+				const double secondsPerRun = 1;
+
+				for (UINT_8 burst : { 0, 3, 6 })
+				{
+					Controller controller;
+					tests::helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+					tests::helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+					if (!tests::helpers::enableController(controller, adminQueuePair) || !tests::helpers::createIoQueuePair(adminQueuePair, ioQueuePair))
+					{
+						LOG_ERROR("Unable to set up the controller for the arbitration burst benchmark");
+						return;
+					}
+
+					command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.DWord10 = constants::features::ARBITRATION;
+					setFeatures.DWord11 = burst;
+					if (!adminQueuePair.sendCommand(setFeatures, completion) || completion.SF != 0)
+					{
+						LOG_ERROR("Unable to set the Arbitration feature");
+						return;
+					}
+
+					command::NVME_COMMAND flush = { 0 };
+					flush.DWord0Breakdown.OPC = constants::opcodes::nvm::FLUSH;
+					flush.NSID = DEFAULT_NAMESPACE_ID;
+
+					UINT_64 flushes = 0;
+					ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueSize - 1, flush));
+					auto start = std::chrono::steady_clock::now();
+					while (helpers::getSecondsSince(start) < secondsPerRun && ioQueuePair.waitForCompletion(completion))
+					{
+						flushes++;
+						ioQueuePair.submitCommands({ flush });
+					}
+					double seconds = helpers::getSecondsSince(start);
+					for (UINT_16 i = 0; i < queueSize - 1; i++)
+					{
+						ioQueuePair.waitForCompletion(completion); // Drain before the queues go away
+					}
+
+					helpers::printResult("Arbitration burst flushes", "burst " + std::to_string(1 << burst), flushes / seconds, 0);
+				}
+			}
+
+			void pipelineStages()
+			{
+				const UINT_16 queueSize = 64;
+				const UINT_32 blocksPerRead = 4096 / DEFAULT_NAMESPACE_BLOCK_SIZE;
+				const double secondsPerRun = 1;
+				const char* stageNames[PIPELINE_STAGES] = { "fetch", "execute", "complete" };
+
+				Controller controller;
+				tests::helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				tests::helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+				if (!tests::helpers::enableController(controller, adminQueuePair) || !tests::helpers::createIoQueuePair(adminQueuePair, ioQueuePair))
+				{
+					LOG_ERROR("Unable to set up the controller for the pipeline stages benchmark");
+					return;
+				}
+
+				PRP readPrp(Payload(blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND read = tests::helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, blocksPerRead, readPrp);
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+
+				UINT_64 reads = 0;
+				ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueSize - 1, read));
+				auto start = std::chrono::steady_clock::now();
+				while (helpers::getSecondsSince(start) < secondsPerRun && ioQueuePair.waitForCompletion(completion))
+				{
+					reads++;
+					ioQueuePair.submitCommands({ read });
+				}
+				double seconds = helpers::getSecondsSince(start);
+				for (UINT_16 i = 0; i < queueSize - 1; i++)
+				{
+					ioQueuePair.waitForCompletion(completion); // Drain before the queues go away
+				}
+
+				PRP logPrp(Payload(4096), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::PIPELINE_STATISTICS | ((sizeof(logpages::PIPELINE_STATISTICS_LOG) / sizeof(UINT_32) - 1) << 16);
+				if (!adminQueuePair.sendCommand(getLogPage, completion) || completion.SF != 0)
+				{
+					LOG_ERROR("Unable to get the Pipeline Statistics log page");
+					return;
+				}
+
+				helpers::printResult("Pipeline 4K reads", "QD " + std::to_string(queueSize - 1), reads / seconds, reads * blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE / seconds);
+				Payload logPayload = logPrp.getPayloadCopy();
+				logpages::PPIPELINE_STATISTICS_LOG statistics = (logpages::PPIPELINE_STATISTICS_LOG)logPayload.getBuffer();
+				for (UINT_32 stage = 0; stage < statistics->NS; stage++)
+				{
+					const logpages::PIPELINE_STAGE_STATISTICS &stageStatistics = statistics->STG[stage];
+					std::cout << "    " << std::left << std::setw(9) << stageNames[stage] << std::right << std::fixed << std::setprecision(0)
+						<< std::setw(8) << (stageStatistics.CMDS ? (double)stageStatistics.STNS / stageStatistics.CMDS : 0) << " ns/command, occupancy average "
+						<< std::setprecision(1) << (stageStatistics.SVCS ? (double)stageStatistics.OCCS / stageStatistics.SVCS : 0) << " max " << stageStatistics.MOCC
+						<< (stageStatistics.ICAP ? " of " + std::to_string(stageStatistics.ICAP) : "") << std::endl;
+				}
+			}
+
+			void workStealing()
+			{
+				const UINT_16 queueSize = 64;
+				const UINT_32 blocksPerRead = 32768 / DEFAULT_NAMESPACE_BLOCK_SIZE;
+				const double secondsPerRun = 1;
+
+				for (UINT_32 workers : { 1, 2, 4 })
+				{
+					Controller controller;
+					tests::helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+					tests::helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+					if (!tests::helpers::enableController(controller, adminQueuePair) || !tests::helpers::createIoQueuePair(adminQueuePair, ioQueuePair))
+					{
+						LOG_ERROR("Unable to set up the controller for the work stealing benchmark");
+						return;
+					}
+
+					command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.DWord10 = constants::features::EXECUTOR_WORKERS;
+					setFeatures.DWord11 = workers;
+					if (!adminQueuePair.sendCommand(setFeatures, completion) || completion.SF != 0)
+					{
+						LOG_ERROR("Unable to set the Executor Workers feature");
+						return;
+					}
+
+					PRP readPrp(Payload(blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+					command::NVME_COMMAND read = tests::helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, blocksPerRead, readPrp);
+
+					UINT_64 reads = 0;
+					ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueSize - 1, read));
+					auto start = std::chrono::steady_clock::now();
+					while (helpers::getSecondsSince(start) < secondsPerRun && ioQueuePair.waitForCompletion(completion))
+					{
+						reads++;
+						ioQueuePair.submitCommands({ read });
+					}
+					double seconds = helpers::getSecondsSince(start);
+					for (UINT_16 i = 0; i < queueSize - 1; i++)
+					{
+						ioQueuePair.waitForCompletion(completion); // Drain before the queues go away
+					}
+
+					PRP logPrp(Payload(4096), 4096);
+					command::NVME_COMMAND getLogPage = { 0 };
+					getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+					getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+					getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+					getLogPage.DWord10 = constants::log_pages::EXECUTOR_STATISTICS | ((sizeof(logpages::EXECUTOR_STATISTICS_LOG) / sizeof(UINT_32) - 1) << 16);
+					if (!adminQueuePair.sendCommand(getLogPage, completion) || completion.SF != 0)
+					{
+						LOG_ERROR("Unable to get the Executor Statistics log page");
+						return;
+					}
+
+					logpages::EXECUTOR_STATISTICS_LOG statistics = { 0 };
+					memcpy(&statistics, logPrp.getPayloadCopy().getBuffer(), sizeof(statistics));
+					UINT_64 executed = 0;
+					UINT_64 steals = 0;
+					for (const auto &worker : statistics.WRK)
+					{
+						executed += worker.CMDS;
+						steals += worker.STLS;
+					}
+
+					helpers::printResult("Work stealing 32K reads", std::to_string(workers) + " worker(s), 1 queue", reads / seconds, reads * blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE / seconds);
+					std::cout << "    stolen " << steals << " of " << executed << " reads" << std::endl;
+				}
+			}
+
+			void adminStorm()
+			{
+				const UINT_32 otherNamespaceId = DEFAULT_NAMESPACE_ID + 1;
+				const double secondsPerRun = 1;
+
+				for (const char* storm : { "none", "Identify + 1M log page", "Format NVM" })
+				{
+					Controller controller;
+					controller.addNamespace(new Namespace(otherNamespaceId, new media::RamMedia(DEFAULT_NAMESPACE_BLOCK_SIZE, 1024 * 1024)));
+					tests::helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+					tests::helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+					if (!tests::helpers::enableController(controller, adminQueuePair) || !tests::helpers::createIoQueuePair(adminQueuePair, ioQueuePair))
+					{
+						LOG_ERROR("Unable to set up the controller for the admin storm benchmark");
+						return;
+					}
+
+					PRP identifyPrp(Payload(4096), 4096);
+					command::NVME_COMMAND identify = { 0 };
+					identify.DWord0Breakdown.OPC = constants::opcodes::admin::IDENTIFY;
+					identify.DWord10 = constants::identify::CNS_CONTROLLER;
+					identify.DPTR.DPTR1 = identifyPrp.getPRP1();
+					identify.DPTR.DPTR2 = identifyPrp.getPRP2();
+					PRP logPrp(Payload(MAX_LOG_PAGE_TRANSFER_SIZE), 4096);
+					command::NVME_COMMAND getLogPage = { 0 }; // As big as it gets: all but the start reads as zero
+					getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+					getLogPage.NSID = DEFAULT_NAMESPACE_ID;
+					getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+					getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+					getLogPage.DWord10 = constants::log_pages::READ_CACHE_STATISTICS | (((MAX_LOG_PAGE_TRANSFER_SIZE / sizeof(UINT_32) - 1) & 0xFFFF) << 16);
+					getLogPage.DWord11 = (MAX_LOG_PAGE_TRANSFER_SIZE / sizeof(UINT_32) - 1) >> 16;
+					command::NVME_COMMAND formatNvm = { 0 };
+					formatNvm.DWord0Breakdown.OPC = constants::opcodes::admin::FORMAT_NVM;
+					formatNvm.NSID = otherNamespaceId;
+					std::vector<command::NVME_COMMAND> adminCommands;
+					if (std::string(storm) == "Identify + 1M log page")
+					{
+						adminCommands = { identify, getLogPage };
+					}
+					else if (std::string(storm) == "Format NVM")
+					{
+						adminCommands = { formatNvm };
+					}
+
+					std::atomic<bool> readsDone(false);
+					std::atomic<UINT_64> adminCompleted(0);
+					std::thread adminThread([&] {
+						command::COMPLETION_QUEUE_ENTRY adminCompletion = { 0 };
+						while (!readsDone && !adminCommands.empty())
+						{
+							for (auto &command : adminCommands)
+							{
+								if (!adminQueuePair.sendCommand(command, adminCompletion))
+								{
+									return;
+								}
+								adminCompleted++;
+							}
+						}
+					});
+
+					PRP readPrp(Payload(DEFAULT_NAMESPACE_BLOCK_SIZE * 8), 4096);
+					command::NVME_COMMAND read = tests::helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, 8, readPrp);
+					command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+					std::vector<double> latencies;
+					auto start = std::chrono::steady_clock::now();
+					while (helpers::getSecondsSince(start) < secondsPerRun)
+					{
+						auto readStart = std::chrono::steady_clock::now();
+						if (!ioQueuePair.sendCommand(read, completion))
+						{
+							break;
+						}
+						latencies.push_back(helpers::getSecondsSince(readStart));
+					}
+					double seconds = helpers::getSecondsSince(start);
+					readsDone = true;
+					adminThread.join();
+
+					std::sort(latencies.begin(), latencies.end());
+					double averageLatency = 0;
+					for (double latency : latencies)
+					{
+						averageLatency += latency;
+					}
+					averageLatency /= std::max<size_t>(1, latencies.size());
+
+					helpers::printResult("4K reads during admin", storm, latencies.size() / seconds, latencies.size() * DEFAULT_NAMESPACE_BLOCK_SIZE * 8 / seconds);
+					std::cout << "    " << adminCompleted << " admin commands, read latency avg " << std::fixed << std::setprecision(1) << averageLatency * 1000000 << " us, p99 "
+						<< (latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100] * 1000000) << " us, max "
+						<< (latencies.empty() ? 0 : latencies.back() * 1000000) << " us" << std::endl;
+				}
+			}
+
+			void sharedCompletionQueue()
+			{
+				const UINT_16 numberOfSubmissionQueues = 8;
+				const UINT_16 queueDepth = 4;
+				const UINT_32 blocksPerRead = 4096 / DEFAULT_NAMESPACE_BLOCK_SIZE;
+				const double secondsPerRun = 1;
+
+				for (bool shared : { false, true })
+				{
+					Controller controller;
+					tests::helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+					std::vector<std::unique_ptr<tests::helpers::HostQueuePair>> ioQueuePairs;
+					for (UINT_16 queueId = 1; queueId <= numberOfSubmissionQueues; queueId++)
+					{
+						ioQueuePairs.emplace_back(new tests::helpers::HostQueuePair(controller, queueId, shared ? numberOfSubmissionQueues * queueDepth + 1 : queueDepth + 1));
+					}
+
+					bool created = tests::helpers::enableController(controller, adminQueuePair) && tests::helpers::createIoQueuePair(adminQueuePair, *ioQueuePairs.front());
+					for (size_t i = 1; i < ioQueuePairs.size() && created; i++)
+					{
+						created = shared ? tests::helpers::createIoSubmissionQueue(adminQueuePair, *ioQueuePairs[i], ioQueuePairs.front()->getQueueId()) :
+							tests::helpers::createIoQueuePair(adminQueuePair, *ioQueuePairs[i]);
+					}
+					if (!created)
+					{
+						LOG_ERROR("Unable to set up the controller for the shared completion queue benchmark");
+						return;
+					}
+
+					PRP readPrp(Payload(blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+					command::NVME_COMMAND read = tests::helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, blocksPerRead, readPrp);
+					command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+					size_t completionQueues = shared ? 1 : ioQueuePairs.size();
+
+					UINT_64 reads = 0;
+					UINT_64 polls = 0;
+					for (auto &ioQueuePair : ioQueuePairs)
+					{
+						ioQueuePair->submitCommands(std::vector<command::NVME_COMMAND>(queueDepth, read));
+					}
+					auto start = std::chrono::steady_clock::now();
+					while (helpers::getSecondsSince(start) < secondsPerRun)
+					{
+						for (size_t i = 0; i < completionQueues; i++)
+						{
+							polls++;
+							while (ioQueuePairs[i]->hasCompletion() && ioQueuePairs[i]->waitForCompletion(completion))
+							{
+								reads++;
+								ioQueuePairs[completion.SQID - 1]->submitCommands({ read }); // Queue ids start at 1
+							}
+						}
+					}
+					double seconds = helpers::getSecondsSince(start);
+					// Drain before the queues go away
+					UINT_32 outstanding = numberOfSubmissionQueues * queueDepth;
+					auto drainStart = std::chrono::steady_clock::now();
+					while (outstanding && helpers::getSecondsSince(drainStart) < secondsPerRun)
+					{
+						for (size_t i = 0; i < completionQueues; i++)
+						{
+							while (ioQueuePairs[i]->hasCompletion() && ioQueuePairs[i]->waitForCompletion(completion))
+							{
+								outstanding--;
+							}
+						}
+					}
+
+					helpers::printResult("SQ:CQ 4K reads", shared ? "8:1" : "1:1", reads / seconds, reads * blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE / seconds);
+					std::cout << "    " << std::fixed << std::setprecision(2) << (reads ? (double)polls / reads : 0) << " polls per completion" << std::endl;
+				}
+			}
+
+			void predictableLatency()
+			{
+				const UINT_32 blockSize = 4096;
+				const UINT_64 numberOfBlocks = 16 * 1024; // 64 MiB
+				const UINT_64 numberOfWrites = 2 * 1024; // 8 MiB: well within a deterministic window's typical writes
+
+				for (int deterministic = 0; deterministic < 2; deterministic++)
+				{
+					// Age the FTL with a pass of random overwrites so garbage collection has valid pages to move
+					controller::Namespace theNamespace(DEFAULT_NAMESPACE_ID, new media::FtlMedia(blockSize, numberOfBlocks, 64, 4));
+					media::MediaBackend* backingMedia = theNamespace.getBackingMedia();
+					std::mt19937_64 generator(0);
+					Payload block(blockSize);
+					for (UINT_64 lba = 0; lba < numberOfBlocks; lba++)
+					{
+						backingMedia->write(lba, 1, block.getBuffer());
+					}
+					for (UINT_64 i = 0; i < numberOfBlocks; i++)
+					{
+						backingMedia->write(generator() % numberOfBlocks, 1, block.getBuffer());
+					}
+					theNamespace.getWriteCache()->setEnabled(true);
+
+					plm::PredictableLatency* predictableLatency = theNamespace.getPredictableLatency();
+					if (deterministic)
+					{
+						predictableLatency->setEnabled(true);
+						std::this_thread::sleep_for(std::chrono::milliseconds(PLM_NDWIN_TIME_MINIMUM_LOW_MS));
+						predictableLatency->requestWindow(constants::predictable_latency::WINDOW_DETERMINISTIC);
+					}
+					logpages::FTL_STATISTICS_LOG before = dynamic_cast<media::FtlMedia*>(backingMedia)->getStatistics();
+
+					std::atomic<bool> done(false);
+					std::thread writer([&] {
+						std::mt19937_64 writerGenerator(1);
+						Payload data(blockSize);
+						for (UINT_64 i = 0; i < numberOfWrites; i++)
+						{
+							predictableLatency->countWrite(blockSize);
+							theNamespace.getMedia()->write(writerGenerator() % numberOfBlocks, 1, data.getBuffer());
+						}
+						done = true;
+					});
+
+					std::vector<double> latencies;
+					Payload readData(blockSize);
+					auto start = std::chrono::steady_clock::now();
+					while (!done)
+					{
+						auto readStart = std::chrono::steady_clock::now();
+						predictableLatency->countRead(blockSize);
+						theNamespace.getMedia()->read(generator() % numberOfBlocks, 1, readData.getBuffer());
+						latencies.push_back(helpers::getSecondsSince(readStart));
+					}
+					double seconds = helpers::getSecondsSince(start);
+					writer.join();
+					logpages::FTL_STATISTICS_LOG after = dynamic_cast<media::FtlMedia*>(backingMedia)->getStatistics();
+
+					// Time for the destager to drain what the writer left behind (deferred until now in the deterministic window)
+					bool stillDeterministic = predictableLatency->getWindow() == constants::predictable_latency::WINDOW_DETERMINISTIC;
+					auto catchUpStart = std::chrono::steady_clock::now();
+					predictableLatency->requestWindow(constants::predictable_latency::WINDOW_NON_DETERMINISTIC);
+					while (theNamespace.getWriteCache()->getDirtyBytes())
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+					double catchUpSeconds = helpers::getSecondsSince(catchUpStart);
+
+					std::sort(latencies.begin(), latencies.end());
+					double averageLatency = 0;
+					for (double latency : latencies)
+					{
+						averageLatency += latency;
+					}
+					averageLatency /= std::max<size_t>(1, latencies.size());
+
+					std::string configuration = deterministic ? (stillDeterministic ? "DTWIN" : "DTWIN (ended early)") : "PLM off";
+					helpers::printResult("Random 4K reads during writes", configuration, latencies.size() / seconds, latencies.size() * blockSize / seconds);
+					std::cout << "    read latency avg " << std::fixed << std::setprecision(1) << averageLatency * 1000000 << " us, p99 "
+						<< (latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100] * 1000000) << " us, max "
+						<< (latencies.empty() ? 0 : latencies.back() * 1000000) << " us, GC pages moved during reads " << after.GCPR - before.GCPR
+						<< ", catch up " << catchUpSeconds * 1000 << " ms" << std::endl;
+				}
+			}
+
+			void filterOffload()
+			{
+				const UINT_32 blocksPerCommand = 2048; // 1 MiB
+				const UINT_32 numberOfCommands = 64; // 64 MiB scanned
+				const UINT_32 recordsPerCommand = blocksPerCommand * DEFAULT_NAMESPACE_BLOCK_SIZE / sizeof(UINT_64);
+
+				Controller controller;
+				if (!controller.loadPlugin(SAMPLE_FILTER_PLUGIN))
+				{
+					std::cout << "Filter offload: " << SAMPLE_FILTER_PLUGIN << " wasn't built (see build.sh), skipping" << std::endl;
+					return;
+				}
+				tests::helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				tests::helpers::HostQueuePair ioQueuePair(controller, 1, 8);
+				if (!tests::helpers::enableController(controller, adminQueuePair) || !tests::helpers::createIoQueuePair(adminQueuePair, ioQueuePair))
+				{
+					LOG_ERROR("Unable to set up the controller for the filter offload benchmark");
+					return;
+				}
+
+				// Uniformly random records, so the key sets the selectivity
+				std::mt19937_64 generator(0);
+				std::vector<UINT_64> records(recordsPerCommand);
+				for (UINT_32 i = 0; i < numberOfCommands; i++)
+				{
+					std::generate(records.begin(), records.end(), std::ref(generator));
+					controller.getNamespace(DEFAULT_NAMESPACE_ID)->getMedia()->write((UINT_64)i * blocksPerCommand, blocksPerCommand, (BYTE*)records.data());
+				}
+
+				PRP dataPrp(Payload(blocksPerCommand * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				for (double selectivity : { 0.01, 0.5 })
+				{
+					UINT_64 key = (UINT_64)((1 - selectivity) * (double)UINT64_MAX);
+					for (bool offloaded : { false, true })
+					{
+						UINT_64 matches = 0;
+						UINT_64 checksum = 0; // Every match is looked at, so neither side gets away with not moving it
+						auto start = std::chrono::steady_clock::now();
+						for (UINT_32 i = 0; i < numberOfCommands; i++)
+						{
+							UINT_8 opcode = offloaded ? SAMPLE_FILTER_OPCODE : constants::opcodes::nvm::READ;
+							command::NVME_COMMAND command = tests::helpers::makeIoCommand(opcode, DEFAULT_NAMESPACE_ID, (UINT_64)i * blocksPerCommand, blocksPerCommand, dataPrp);
+							if (offloaded)
+							{
+								command.DWord14 = (UINT_32)key;
+								command.DWord15 = (UINT_32)(key >> 32);
+							}
+							if (!ioQueuePair.sendCommand(command, completion) || completion.SF != 0)
+							{
+								LOG_ERROR("Filter offload command failed: " + completion.toString());
+								return;
+							}
+
+							// The host filters what it read, or just takes the records the device placed at the start
+							UINT_32 recordsToCheck = offloaded ? completion.DWord0 : recordsPerCommand;
+							for (auto &segment : dataPrp.getSegments())
+							{
+								UINT_64* segmentRecords = (UINT_64*)segment.first;
+								UINT_32 segmentRecordCount = std::min(recordsToCheck, (UINT_32)(segment.second / sizeof(UINT_64)));
+								for (UINT_32 j = 0; j < segmentRecordCount; j++)
+								{
+									if (segmentRecords[j] >= key)
+									{
+										matches++;
+										checksum += segmentRecords[j];
+									}
+								}
+								recordsToCheck -= segmentRecordCount;
+								if (!recordsToCheck)
+								{
+									break;
+								}
+							}
+						}
+						double seconds = helpers::getSecondsSince(start);
+
+						std::stringstream configuration;
+						configuration << (offloaded ? "on device " : "host side ") << selectivity * 100 << "% match";
+						helpers::printResult("Filter (64 MiB)", configuration.str(), numberOfCommands / seconds, (double)numberOfCommands * blocksPerCommand * DEFAULT_NAMESPACE_BLOCK_SIZE / seconds);
+						LOG_INFO("Matched " + std::to_string(matches) + " records. Checksum: " + std::to_string(checksum));
+					}
+				}
+			}
+		}
+
+		namespace ftl
+		{
+			void writeAmplification()
+			{
+				const UINT_32 blockSize = 4096;
+				const UINT_64 numberOfBlocks = 16 * 1024; // 64 MiB
+				const UINT_64 overwrites = numberOfBlocks * 4;
+
+				std::mt19937_64 generator(0);
+				for (int skewed = 0; skewed < 2; skewed++)
+				{
+					for (int policy = media::FTL_GC_POLICY_GREEDY; policy <= media::FTL_GC_POLICY_COST_BENEFIT; policy++)
+					{
+						media::FtlMedia ftlMedia(blockSize, numberOfBlocks, 64, 4, FTL_DEFAULT_OVERPROVISIONING_PERCENT, (media::FTL_GC_POLICY)policy);
+						Payload block(blockSize);
+						for (UINT_64 lba = 0; lba < numberOfBlocks; lba++)
+						{
+							ftlMedia.write(lba, 1, block.getBuffer());
+						}
+						logpages::FTL_STATISTICS_LOG before = ftlMedia.getStatistics();
+
+						// Skewed: 80% of writes go to 20% of the LBAs
+						std::uniform_int_distribution<UINT_64> allLbas(0, numberOfBlocks - 1);
+						std::uniform_int_distribution<UINT_64> hotLbas(0, numberOfBlocks / 5 - 1);
+						std::uniform_int_distribution<int> percent(0, 99);
+
+						double maxLatency = 0;
+						auto start = std::chrono::steady_clock::now();
+						for (UINT_64 i = 0; i < overwrites; i++)
+						{
+							UINT_64 lba = (skewed && percent(generator) < 80) ? hotLbas(generator) : allLbas(generator);
+							auto writeStart = std::chrono::steady_clock::now();
+							ftlMedia.write(lba, 1, block.getBuffer());
+							maxLatency = std::max(maxLatency, helpers::getSecondsSince(writeStart));
+						}
+						double seconds = helpers::getSecondsSince(start);
+						logpages::FTL_STATISTICS_LOG after = ftlMedia.getStatistics();
+
+						std::string configuration = std::string(skewed ? "80/20" : "uniform") + (policy == media::FTL_GC_POLICY_GREEDY ? " greedy" : " cost-benefit");
+						helpers::printResult("FTL random overwrite", configuration, overwrites / seconds, overwrites * blockSize / seconds);
+
+						UINT_64 hostPages = after.HPW - before.HPW;
+						UINT_64 nandPages = after.NPW - before.NPW;
+						UINT_64 stalls = after.FGCS - before.FGCS;
+						std::cout << "    write amplification " << std::setprecision(2) << (double)nandPages / hostPages
+							<< ", GC stalls " << stalls << " (" << std::setprecision(1) << 100.0 * stalls / overwrites << "% of writes, avg "
+							<< (stalls ? (double)(after.FGCST - before.FGCST) / stalls : 0) << " us, max " << after.MFGCST << " us)"
+							<< ", avg write " << seconds * 1000000 / overwrites << " us, max write " << maxLatency * 1000000 << " us" << std::endl;
+					}
+				}
+			}
+
+			void streamWriteAmplification()
+			{
+				const UINT_32 blockSize = 4096;
+				const UINT_64 numberOfBlocks = 16 * 1024; // 64 MiB
+				const UINT_64 hotBlocks = numberOfBlocks / 5;
+				const UINT_64 overwrites = numberOfBlocks * 4;
+				const UINT_16 hotStream = 1;
+				const UINT_16 coldStream = 2;
+
+				for (int streams = 0; streams < 2; streams++)
+				{
+					media::FtlMedia ftlMedia(blockSize, numberOfBlocks, 64, 4, FTL_DEFAULT_OVERPROVISIONING_PERCENT, media::FTL_GC_POLICY_GREEDY, streams ? 2 : 0);
+
+					// The tags stick to the LBAs, which is the same as the host tagging every write
+					ftlMedia.setStream(0, hotBlocks, hotStream);
+					ftlMedia.setStream(hotBlocks, numberOfBlocks - hotBlocks, coldStream);
+
+					Payload block(blockSize);
+					for (UINT_64 lba = 0; lba < numberOfBlocks; lba++)
+					{
+						ftlMedia.write(lba, 1, block.getBuffer());
+					}
+					logpages::FTL_STATISTICS_LOG before = ftlMedia.getStatistics();
+					logpages::STREAM_STATISTICS_LOG streamsBefore = ftlMedia.getStreamStatistics();
+
+					// 80% of writes go to the hot 20% of the LBAs
+					std::mt19937_64 generator(0);
+					std::uniform_int_distribution<UINT_64> allLbas(0, numberOfBlocks - 1);
+					std::uniform_int_distribution<UINT_64> hotLbas(0, hotBlocks - 1);
+					std::uniform_int_distribution<int> percent(0, 99);
+					auto start = std::chrono::steady_clock::now();
+					for (UINT_64 i = 0; i < overwrites; i++)
+					{
+						ftlMedia.write(percent(generator) < 80 ? hotLbas(generator) : allLbas(generator), 1, block.getBuffer());
+					}
+					double seconds = helpers::getSecondsSince(start);
+					logpages::FTL_STATISTICS_LOG after = ftlMedia.getStatistics();
+					logpages::STREAM_STATISTICS_LOG streamsAfter = ftlMedia.getStreamStatistics();
+
+					helpers::printResult("FTL 80/20 overwrite", streams ? "hot/cold streams" : "no streams", overwrites / seconds, overwrites * blockSize / seconds);
+					std::cout << "    write amplification " << std::setprecision(2) << (double)(after.NPW - before.NPW) / (after.HPW - before.HPW);
+					if (streams)
+					{
+						for (UINT_16 stream : { hotStream, coldStream })
+						{
+							std::cout << (stream == hotStream ? ", hot stream " : ", cold stream ")
+								<< (double)(streamsAfter.SE[stream].NPW - streamsBefore.SE[stream].NPW) / (streamsAfter.SE[stream].HPW - streamsBefore.SE[stream].HPW);
+						}
+					}
+					std::cout << std::endl;
+				}
+			}
+		}
+
+		namespace zns
+		{
+			void zoneAppendScaling()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_64 zoneSize = 256 * 1024; // 128 MiB zone
+				controller::Namespace theNamespace(1, new media::RamMedia(blockSize, zoneSize), zoneSize);
+				cnvme::zns::Zone* zone = theNamespace.getZone(0);
+
+				for (int numberOfThreads = 1; numberOfThreads <= 8; numberOfThreads *= 2)
+				{
+					theNamespace.zoneAction(zone, cnvme::zns::ZONE_SEND_ACTION_RESET);
+
+					std::vector<std::thread> threads;
+					auto start = std::chrono::steady_clock::now();
+					for (int t = 0; t < numberOfThreads; t++)
+					{
+						threads.emplace_back([&] {
+							Payload block(blockSize);
+							UINT_64 assignedLba = 0;
+							while (theNamespace.zoneAppend(zone, 1, block.getBuffer(), assignedLba) == constants::status::codes::generic::SUCCESSFUL_COMPLETION)
+							{
+							}
+						});
+					}
+					for (auto &thread : threads)
+					{
+						thread.join();
+					}
+					double seconds = helpers::getSecondsSince(start);
+
+					helpers::printResult("Zone Append (1 zone)", std::to_string(numberOfThreads) + " writer thread(s)", zoneSize / seconds, zoneSize * blockSize / seconds);
+				}
+			}
+		}
+	}
+}
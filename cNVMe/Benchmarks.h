@@ -0,0 +1,171 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Benchmarks.h - A header file for the performance benchmarks
+*/
+#pragma once
+
+#include "Controller.h"
+#include "Ftl.h"
+#include "Namespace.h"
+
+namespace cnvme
+{
+	namespace benchmarks
+	{
+		namespace helpers
+		{
+			/// <summary>
+			/// Runs all benchmarks, printing results to stdout
+			/// </summary>
+			void runBenchmarks();
+
+			/// <summary>
+			/// Gets the seconds elapsed since start
+			/// </summary>
+			double getSecondsSince(std::chrono::steady_clock::time_point start);
+
+			/// <summary>
+			/// Prints a single benchmark result line
+			/// </summary>
+			/// <param name="benchmark">Name of the benchmark</param>
+			/// <param name="configuration">What was varied for this run</param>
+			/// <param name="operationsPerSecond">Operations (commands) per second</param>
+			/// <param name="bytesPerSecond">Bytes moved per second</param>
+			void printResult(std::string benchmark, std::string configuration, double operationsPerSecond, double bytesPerSecond);
+		}
+
+		namespace nvm
+		{
+			/// <summary>
+			/// Copy bandwidth for each media backend, compared to a host side copy (read through PRPs then write back).
+			/// </summary>
+			void copyBandwidth();
+
+			/// <summary>
+			/// 4 KiB writes to a file backed namespace with the volatile write cache off and on.
+			/// Reports write throughput and the cost of the Flush that follows.
+			/// </summary>
+			void volatileWriteCache();
+
+			/// <summary>
+			/// Sequential reads of several sizes (and random 4 KiB reads) from an FTL namespace with the read cache off and on.
+			/// Reports throughput, hit ratio and prefetch accuracy.
+			/// </summary>
+			void readCache();
+
+			/// <summary>
+			/// Time to format sparse RAM namespaces of growing size holding 256 MiB of data: the generation bump,
+			///   the background reclaim that follows, and (for comparison) deallocating the whole namespace instead.
+			/// </summary>
+			void formatLatency();
+
+			/// <summary>
+			/// Time to clone a sparse RAM namespace holding a 1 GiB image versus copying the image to fresh media,
+			///   and the memory 100 lightly written clones end up using
+			/// </summary>
+			void cloneLatency();
+
+			/// <summary>
+			/// 4 KiB writes each followed by a flush from 1 to 16 threads, to file media (a sync per flush) and to journaled media
+			///   (group committed), then the time to recover a nearly full journal after a simulated kill
+			/// </summary>
+			void journaledFlush();
+
+			/// <summary>
+			/// CRC32C throughput, then a 1 GiB synthetic image (half zero blocks, the rest repeats of a few patterns) written to
+			///   sparse RAM media and to deduplicating media. Reports write throughput, memory used and the dedup ratio.
+			/// </summary>
+			void dedupRatio();
+
+			/// <summary>
+			/// 4 KiB random reads, 90% of them to a 16 MiB hot region, against 256 MiB of file media alone and behind a 32 MiB
+			///   RAM tier (placed by heat alone, then also by a Dataset Management hint on the hot region). Reports the read rate,
+			///   average latency and how many reads the fast tier served.
+			/// </summary>
+			void tieredLatency();
+
+			/// <summary>
+			/// A victim queue doing 4 KiB reads while a noisy neighbor keeps 8 256 KiB writes queued, with no QoS limits and then
+			///   with the neighbor's queue limited by bandwidth and by IOPS. Reports the victim's read rate and latency and the neighbor's bandwidth.
+			/// </summary>
+			void noisyNeighbor();
+
+			/// <summary>
+			/// 4 KiB reads through the controller at queue depths up to the whole queue (63 on a 64 entry queue pair), the host
+			///   consuming each completion as it arrives. Reports the read rate and the average latency (from Little's law).
+			/// </summary>
+			void queueDepthScaling();
+
+			/// <summary>
+			/// 4 KiB reads kept outstanding on 8 submission queues, with each on its own completion queue (1:1) and
+			///   all on one shared completion queue (N:1). The host polls every completion queue it has, so this
+			///   reports the read rate and how many completion queue polls it took per completion.
+			/// </summary>
+			void sharedCompletionQueue();
+
+			/// <summary>
+			/// Flushes (no data transfer, so mostly fetch and dispatch cost) kept outstanding at a queue depth of 63,
+			///   fetched in bursts of 1, 8 and 64 commands (set with the Arbitration feature). Reports the command rate.
+			/// </summary>
+			void arbitrationBurst();
+
+			/// <summary>
+			/// 4 KiB reads at queue depth 63, then the Pipeline Statistics log page. Reports the read rate, and for each stage its
+			///   service time per command and average / max input occupancy. The stage with the full input and the longest time is the bottleneck.
+			/// </summary>
+			void pipelineStages();
+
+			/// <summary>
+			/// 32 KiB reads at queue depth 63 all from one submission queue (so all to one execute stage worker), with 1, 2 and 4 workers.
+			///   Reports the read rate and how many of the reads other workers stole.
+			/// </summary>
+			void workStealing();
+
+			/// <summary>
+			/// 4 KiB reads at queue depth 1 while another host thread sends admin commands back to back: none, Identify and 1 MiB Get Log Page
+			///   (which run alongside I/O), then Format NVM of another namespace (a synchronization point, which drains the pipeline).
+			///   Reports the read rate, the admin commands completed, and average / 99th percentile / maximum read latency.
+			/// </summary>
+			void adminStorm();
+
+			/// <summary>
+			/// 4 KiB random reads of an aged FTL namespace while another thread writes 8 MiB of 4 KiB random writes through the
+			///   write cache, with Predictable Latency Mode off and then inside a deterministic window. Reports the read rate,
+			///   average / 99th percentile / maximum read latency, and how long the deferred work took to catch up afterwards.
+			/// </summary>
+			void predictableLatency();
+
+			/// <summary>
+			/// Scans 64 MiB of random 64 bit records for those at least a key (1% and 50% match), reading it all and filtering
+			///   on the host, then with the sample filter plugin's vendor specific command filtering on the device.
+			///   Skipped if build.sh didn't build the plugin.
+			/// </summary>
+			void filterOffload();
+		}
+
+		namespace ftl
+		{
+			/// <summary>
+			/// Random overwrites of an FTL namespace (uniform and 80/20 hot/cold) for each GC policy.
+			/// Reports write amplification, GC stalls and the resulting foreground write latency.
+			/// </summary>
+			void writeAmplification();
+
+			/// <summary>
+			/// 80/20 hot/cold random overwrites of an FTL namespace with every write in one stream, then with the hot and cold
+			///   LBAs written as two streams (each with its own open superblock). Reports overall and per stream write amplification.
+			/// </summary>
+			void streamWriteAmplification();
+		}
+
+		namespace zns
+		{
+			/// <summary>
+			/// Many threads Zone Appending into the same zone with no coordination.
+			/// Reports throughput as the number of appending threads grows.
+			/// </summary>
+			void zoneAppendScaling();
+		}
+	}
+}
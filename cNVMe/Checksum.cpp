@@ -0,0 +1,108 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Checksum.cpp - An implementation file for the Checksum (helper) functions
+*/
+
+#include "Checksum.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CHECKSUM_HARDWARE_CRC32C
+#define CHECKSUM_TARGET_SSE42
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define CHECKSUM_HARDWARE_CRC32C
+#define CHECKSUM_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+
+#define CRC32C_POLYNOMIAL 0x82F63B78 // Reflected
+
+namespace cnvme
+{
+	namespace checksum
+	{
+		/// <summary>
+		/// Byte at a time lookup table for crc32c()
+		/// </summary>
+		struct Crc32cTable
+		{
+			Crc32cTable()
+			{
+				for (UINT_32 i = 0; i < 256; i++)
+				{
+					UINT_32 crc = i;
+					for (int bit = 0; bit < 8; bit++)
+					{
+						crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLYNOMIAL : 0);
+					}
+					Entries[i] = crc;
+				}
+			}
+
+			UINT_32 Entries[256];
+		};
+
+		/// <summary>
+		/// Table driven CRC32C, for CPUs without the SSE4.2 CRC32 instruction. crc is already inverted.
+		/// </summary>
+		static UINT_32 crc32cSoftware(const BYTE* data, size_t size, UINT_32 crc)
+		{
+			static const Crc32cTable table;
+			for (size_t i = 0; i < size; i++)
+			{
+				crc = (crc >> 8) ^ table.Entries[(crc ^ data[i]) & 0xFF];
+			}
+			return crc;
+		}
+
+#ifdef CHECKSUM_HARDWARE_CRC32C
+		/// <summary>
+		/// CRC32C using the SSE4.2 CRC32 instruction, 8 bytes at a time. crc is already inverted.
+		/// </summary>
+		CHECKSUM_TARGET_SSE42 static UINT_32 crc32cHardware(const BYTE* data, size_t size, UINT_32 crc)
+		{
+			UINT_64 crc64 = crc;
+			for (; size >= sizeof(UINT_64); size -= sizeof(UINT_64), data += sizeof(UINT_64))
+			{
+				UINT_64 word;
+				memcpy(&word, data, sizeof(word));
+				crc64 = _mm_crc32_u64(crc64, word);
+			}
+			crc = (UINT_32)crc64;
+			for (; size; size--, data++)
+			{
+				crc = _mm_crc32_u8(crc, *data);
+			}
+			return crc;
+		}
+
+		/// <summary>
+		/// Returns true if the CPU has the SSE4.2 CRC32 instruction
+		/// </summary>
+		static bool hasHardwareCrc32c()
+		{
+#ifdef _MSC_VER
+			int registers[4];
+			__cpuid(registers, 1);
+			return (registers[2] & (1 << 20)) != 0;
+#else
+			return __builtin_cpu_supports("sse4.2");
+#endif
+		}
+#endif
+
+		UINT_32 crc32c(const BYTE* data, size_t size, UINT_32 crc)
+		{
+#ifdef CHECKSUM_HARDWARE_CRC32C
+			static const bool hardware = hasHardwareCrc32c();
+			if (hardware)
+			{
+				return ~crc32cHardware(data, size, ~crc);
+			}
+#endif
+			return ~crc32cSoftware(data, size, ~crc);
+		}
+	}
+}
@@ -0,0 +1,24 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Checksum.h - A header file for the Checksum (helper) functions
+*/
+
+#pragma once
+
+#include "Types.h"
+
+namespace cnvme
+{
+	namespace checksum
+	{
+		/// <summary>
+		/// Computes the CRC32C (Castagnoli) of the given data
+		/// </summary>
+		/// <param name="data">Data to checksum</param>
+		/// <param name="size">Number of bytes</param>
+		/// <param name="crc">CRC of any data before this (to checksum in pieces), or 0 to start</param>
+		/// <returns>CRC32C</returns>
+		UINT_32 crc32c(const BYTE* data, size_t size, UINT_32 crc = 0);
+	}
+}
@@ -85,5 +85,27 @@ namespace cnvme
 			return retStr;
 		}
 
+		std::string COPY_SOURCE_RANGE_DESCRIPTOR::toString() const
+		{
+			std::string retStr;
+			retStr += "Copy Source Range Descriptor\n";
+			retStr += strings::toString(ToStringParams(SLBA, "Starting LBA"));
+			retStr += strings::toString(ToStringParams(NLB, "Number of Logical Blocks"));
+			retStr += strings::toString(ToStringParams(ELBT, "Expected Initial Logical Block Reference Tag"));
+			retStr += strings::toString(ToStringParams(ELBAT, "Expected Logical Block Application Tag"));
+			retStr += strings::toString(ToStringParams(ELBATM, "Expected Logical Block Application Tag Mask"));
+			return retStr;
+		}
+
+		std::string DATASET_MANAGEMENT_RANGE::toString() const
+		{
+			std::string retStr;
+			retStr += "Dataset Management Range\n";
+			retStr += strings::toString(ToStringParams(CATTR, "Context Attributes"));
+			retStr += strings::toString(ToStringParams(NLB, "Length in Logical Blocks"));
+			retStr += strings::toString(ToStringParams(SLBA, "Starting LBA"));
+			return retStr;
+		}
+
 	}
 }
\ No newline at end of file
@@ -166,5 +166,30 @@ namespace cnvme
 		}COMPLETION_QUEUE_ENTRY, *PCOMPLETION_QUEUE_ENTRY;
 		static_assert(sizeof(COMPLETION_QUEUE_ENTRY) == 16, "COMPLETION_QUEUE_ENTRY should be 16 byte(s) in size.");
 
+		typedef struct COPY_SOURCE_RANGE_DESCRIPTOR
+		{
+			UINT_64 RSVD0; // Reserved
+			UINT_64 SLBA; // Starting LBA
+			UINT_16 NLB; // Number of Logical Blocks (0's based)
+			UINT_16 RSVD1; // Reserved
+			UINT_32 RSVD2; // Reserved
+			UINT_32 ELBT; // Expected Initial Logical Block Reference Tag / Storage Tag
+			UINT_16 ELBAT; // Expected Logical Block Application Tag
+			UINT_16 ELBATM; // Expected Logical Block Application Tag Mask
+
+			std::string toString() const;
+		}COPY_SOURCE_RANGE_DESCRIPTOR, *PCOPY_SOURCE_RANGE_DESCRIPTOR;
+		static_assert(sizeof(COPY_SOURCE_RANGE_DESCRIPTOR) == 32, "COPY_SOURCE_RANGE_DESCRIPTOR should be 32 byte(s) in size.");
+
+		typedef struct DATASET_MANAGEMENT_RANGE
+		{
+			UINT_32 CATTR; // Context Attributes
+			UINT_32 NLB; // Length in Logical Blocks (not 0's based)
+			UINT_64 SLBA; // Starting LBA
+
+			std::string toString() const;
+		}DATASET_MANAGEMENT_RANGE, *PDATASET_MANAGEMENT_RANGE;
+		static_assert(sizeof(DATASET_MANAGEMENT_RANGE) == 16, "DATASET_MANAGEMENT_RANGE should be 16 byte(s) in size.");
+
 	}
 }
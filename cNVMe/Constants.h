@@ -31,9 +31,12 @@ namespace cnvme
 				const UINT_8 FIRMWARE_IMAGE_DOWNLOAD = 0x11;
 				const UINT_8 NAMESPACE_ATTACHMENT = 0x15;
 				const UINT_8 KEEP_ALIVE = 0x18;
+				const UINT_8 DIRECTIVE_SEND = 0x19;
+				const UINT_8 DIRECTIVE_RECEIVE = 0x1A;
 				const UINT_8 FORMAT_NVM = 0x80;
 				const UINT_8 SECURITY_SEND = 0x81;
 				const UINT_8 SECURITY_RECEIVE = 0x82;
+				const UINT_8 SANITIZE = 0x84;
 			}
 
 			namespace nvm
@@ -49,7 +52,152 @@ namespace cnvme
 				const UINT_8 RESERVATION_REPORT = 0x0E;
 				const UINT_8 RESERVATION_ACQUIRE = 0x11;
 				const UINT_8 RESERVATION_RELEASE = 0x15;
+				const UINT_8 COPY = 0x19;
 			}
+
+			namespace zns
+			{
+				const UINT_8 ZONE_MANAGEMENT_SEND = 0x79;
+				const UINT_8 ZONE_MANAGEMENT_RECEIVE = 0x7A;
+				const UINT_8 ZONE_APPEND = 0x7D;
+			}
+		}
+
+		namespace data_transfer // An opcode's low 2 bits
+		{
+			const UINT_8 NONE = 0x0;
+			const UINT_8 HOST_TO_CONTROLLER = 0x1;
+			const UINT_8 CONTROLLER_TO_HOST = 0x2;
+			const UINT_8 BIDIRECTIONAL = 0x3;
+		}
+
+		namespace command_sets // I/O Command Set Identifier (CSI)
+		{
+			const UINT_8 NVM = 0x00;
+			const UINT_8 ZONED_NAMESPACE = 0x02;
+		}
+
+		namespace features
+		{
+			const UINT_8 ARBITRATION = 0x01;
+			const UINT_8 POWER_MANAGEMENT = 0x02;
+			const UINT_8 TEMPERATURE_THRESHOLD = 0x04;
+			const UINT_8 ERROR_RECOVERY = 0x05;
+			const UINT_8 VOLATILE_WRITE_CACHE = 0x06;
+			const UINT_8 NUMBER_OF_QUEUES = 0x07;
+			const UINT_8 ASYNCHRONOUS_EVENT_CONFIGURATION = 0x0B;
+			const UINT_8 PREDICTABLE_LATENCY_MODE_CONFIG = 0x13;
+			const UINT_8 PREDICTABLE_LATENCY_MODE_WINDOW = 0x14;
+
+			// Vendor Specific
+			const UINT_8 READ_CACHE = 0xC0;
+			const UINT_8 QOS_LIMITS = 0xC1;
+			const UINT_8 EXECUTOR_WORKERS = 0xC2;
+
+			// Get Features Select (CDW10 bits 10:8)
+			const UINT_8 SELECT_CURRENT = 0x0;
+			const UINT_8 SELECT_DEFAULT = 0x1;
+			const UINT_8 SELECT_SAVED = 0x2;
+			const UINT_8 SELECT_SUPPORTED_CAPABILITIES = 0x3;
+		}
+
+		namespace format_nvm
+		{
+			// Secure Erase Settings (CDW10 bits 11:9)
+			const UINT_8 SES_NONE = 0x0;
+			const UINT_8 SES_USER_DATA_ERASE = 0x1;
+			const UINT_8 SES_CRYPTOGRAPHIC_ERASE = 0x2;
+		}
+
+		namespace directives
+		{
+			// Directive Type (DTYPE)
+			const UINT_8 TYPE_IDENTIFY = 0x00;
+			const UINT_8 TYPE_STREAMS = 0x01;
+
+			// Directive Operations (DOPER) for the Identify directive
+			const UINT_8 IDENTIFY_RETURN_PARAMETERS = 0x01; // Receive
+			const UINT_8 IDENTIFY_ENABLE_DIRECTIVE = 0x01; // Send
+
+			// Directive Operations (DOPER) for the Streams directive
+			const UINT_8 STREAMS_RETURN_PARAMETERS = 0x01; // Receive
+			const UINT_8 STREAMS_GET_STATUS = 0x02; // Receive
+			const UINT_8 STREAMS_ALLOCATE_RESOURCES = 0x03; // Receive
+			const UINT_8 STREAMS_RELEASE_IDENTIFIER = 0x01; // Send
+			const UINT_8 STREAMS_RELEASE_RESOURCES = 0x02; // Send
+		}
+
+		namespace predictable_latency
+		{
+			// Predictable Latency Mode Window: Window Select (CDW12 bits 2:0) and the log page's Status (bits 2:0)
+			const UINT_8 WINDOW_NONE = 0x0; // Status only: Predictable Latency Mode is not enabled
+			const UINT_8 WINDOW_DETERMINISTIC = 0x1; // DTWIN
+			const UINT_8 WINDOW_NON_DETERMINISTIC = 0x2; // NDWIN
+
+			// Predictable Latency Per NVM Set log page: Event Type
+			const UINT_16 EVENT_DTWIN_EXCEEDED = 0x4000; // Autonomous transition to NDWIN: a typical or maximum value was exceeded
+		}
+
+		namespace sanitize
+		{
+			// Sanitize Action (CDW10 bits 2:0)
+			const UINT_8 EXIT_FAILURE_MODE = 0x1;
+			const UINT_8 BLOCK_ERASE = 0x2;
+			const UINT_8 OVERWRITE = 0x3;
+			const UINT_8 CRYPTO_ERASE = 0x4;
+
+			// Sanitize Status log page: Sanitize Operation Status
+			const UINT_8 STATUS_NEVER_SANITIZED = 0x0;
+			const UINT_8 STATUS_COMPLETED = 0x1;
+			const UINT_8 STATUS_IN_PROGRESS = 0x2;
+			const UINT_8 STATUS_FAILED = 0x3;
+		}
+
+		namespace identify // Controller or Namespace Structure (CNS)
+		{
+			const UINT_8 CNS_NAMESPACE = 0x00;
+			const UINT_8 CNS_CONTROLLER = 0x01;
+			const UINT_8 CNS_ACTIVE_NAMESPACE_ID_LIST = 0x02;
+		}
+
+		namespace async_events
+		{
+			// Asynchronous Event Type (completion DW0 bits 2:0)
+			const UINT_8 TYPE_ERROR_STATUS = 0x0;
+			const UINT_8 TYPE_SMART_HEALTH_STATUS = 0x1;
+			const UINT_8 TYPE_NOTICE = 0x2;
+
+			// Asynchronous Event Information (completion DW0 bits 15:8), by type
+			const UINT_8 ERROR_WRITE_TO_INVALID_DOORBELL_REGISTER = 0x00;
+			const UINT_8 ERROR_INVALID_DOORBELL_WRITE_VALUE = 0x01;
+			const UINT_8 SMART_TEMPERATURE_THRESHOLD = 0x01;
+			const UINT_8 NOTICE_NAMESPACE_ATTRIBUTE_CHANGED = 0x00;
+
+			// Asynchronous Event Configuration feature (and SMART Critical Warning) bits
+			const UINT_32 CONFIGURATION_TEMPERATURE_WARNING = 1 << 1;
+			const UINT_32 CONFIGURATION_NAMESPACE_ATTRIBUTE_NOTICES = 1 << 8;
+		}
+
+		namespace log_pages
+		{
+			const UINT_8 ERROR_INFORMATION = 0x01;
+			const UINT_8 SMART_HEALTH_INFORMATION = 0x02;
+			const UINT_8 FIRMWARE_SLOT_INFORMATION = 0x03;
+			const UINT_8 CHANGED_NAMESPACE_LIST = 0x04;
+			const UINT_8 PREDICTABLE_LATENCY_PER_NVM_SET = 0x0A;
+			const UINT_8 PREDICTABLE_LATENCY_EVENT_AGGREGATE = 0x0B;
+			const UINT_8 SANITIZE_STATUS = 0x81;
+
+			// Vendor Specific
+			const UINT_8 FTL_STATISTICS = 0xC0;
+			const UINT_8 READ_CACHE_STATISTICS = 0xC1;
+			const UINT_8 DEDUP_STATISTICS = 0xC2;
+			const UINT_8 TIERING_STATISTICS = 0xC3;
+			const UINT_8 STREAM_STATISTICS = 0xC4;
+			const UINT_8 QOS_STATISTICS = 0xC5;
+			const UINT_8 PIPELINE_STATISTICS = 0xC6;
+			const UINT_8 EXECUTOR_STATISTICS = 0xC7;
+			const UINT_8 SUBMISSION_QUEUE_STATISTICS = 0xC8;
 		}
 
 		namespace status
@@ -134,6 +282,17 @@ namespace cnvme
 					const UINT_8 CONFLICTING_ATTRIBUTES = 0x80;
 					const UINT_8 INVALID_PROTECTION_INFORMATION = 0x81;
 					const UINT_8 ATTEMPTED_WRITE_TO_READ_ONLY_RANGE = 0x82;
+					const UINT_8 COMMAND_SIZE_LIMIT_EXCEEDED = 0x83;
+
+					// Zoned Namespace Specific
+					const UINT_8 ZONE_BOUNDARY_ERROR = 0xB8;
+					const UINT_8 ZONE_IS_FULL = 0xB9;
+					const UINT_8 ZONE_IS_READ_ONLY = 0xBA;
+					const UINT_8 ZONE_IS_OFFLINE = 0xBB;
+					const UINT_8 ZONE_INVALID_WRITE = 0xBC;
+					const UINT_8 TOO_MANY_ACTIVE_ZONES = 0xBD;
+					const UINT_8 TOO_MANY_OPEN_ZONES = 0xBE;
+					const UINT_8 INVALID_ZONE_STATE_TRANSITION = 0xBF;
 				}
 
 				namespace integrity
@@ -12,14 +12,86 @@ Controller.cpp - An implementation file for the NVMe Controller
 #include "PRP.h"
 #include "Strings.h"
 
+#include <algorithm>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define PREFETCH(address) _mm_prefetch((const char*)(address), _MM_HINT_T0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address)
+#endif
+
 using namespace cnvme::command;
+using namespace cnvme::constants::status;
+
+/// <summary>
+/// Gets the SLBA from CDW10/11 of an NVM command
+/// </summary>
+static UINT_64 getStartingLba(const NVME_COMMAND* command)
+{
+	return ((UINT_64)command->DWord11 << 32) | command->DWord10;
+}
+
+/// <summary>
+/// Gets the (1 based) NLB from CDW12 of an NVM command
+/// </summary>
+static UINT_32 getNumberOfLogicalBlocks(const NVME_COMMAND* command)
+{
+	return (command->DWord12 & 0xFFFF) + 1;
+}
+
+/// <summary>
+/// Gets the Force Unit Access bit from CDW12 of an NVM command
+/// </summary>
+static bool isForceUnitAccess(const NVME_COMMAND* command)
+{
+	return (command->DWord12 >> 30) & 1;
+}
+
+/// <summary>
+/// Gets the Directive Type (DTYPE) from CDW12 of a write
+/// </summary>
+static UINT_8 getDirectiveType(const NVME_COMMAND* command)
+{
+	return (command->DWord12 >> 20) & 0xF;
+}
+
+/// <summary>
+/// Gets the Directive Specific field (DSPEC) from CDW13 of a write
+/// </summary>
+static UINT_16 getDirectiveSpecific(const NVME_COMMAND* command)
+{
+	return command->DWord13 >> 16;
+}
 
 namespace cnvme
 {
 	namespace controller
 	{
-		Controller::Controller()
+		Controller::Controller() : AdminCounters(1), InFlight(MAX_QUEUE_IDENTIFIER + 1)
 		{
+			// Before the registers exist: their reset callback drains the pipeline
+			NextSequence = 0;
+			CompletedSequence = 0;
+			for (UINT_32 slot = 0; slot < PIPELINE_RING_ENTRIES; slot++)
+			{
+				PipelineSlotExecuted[slot] = false;
+				PipelineSlotPosted[slot] = false;
+			}
+			ExecutedBatches = 0;
+			ExecutedBatchesSeen = 0;
+			NumberOfExecutorWorkers = 0;
+			StagesRunning = true;
+			AdminDoorbellRung = false;
+			AdminRunning = true;
+			AdminDoorbellsSeen = { 0 };
+			AdminSubmissionQueue = nullptr;
+			AdminCompletionQueue = nullptr;
+			DataPathSynchronizationRequested = false;
+			registerCommands();
+
 			PCIExpressRegisters = new pci::PCIExpressRegisters();
 			PCIExpressRegisters->waitForChangeLoop();
 
@@ -27,30 +99,70 @@ namespace cnvme
 			UINT_64 BAR0Address = (UINT_64)PciHeader->MLBAR.BA + ((UINT_64)PciHeader->MUBAR.BA << 18);
 			ControllerRegisters = new controller::registers::ControllerRegisters(BAR0Address, this); // Put the controller registers in BAR0/BAR1
 			ControllerRegisters->waitForChangeLoop();
+			buildIdentifyControllerData();
+			buildActiveNamespaceIds();
+			AsyncEventConfiguration = 0; // No SMART or notice events until the host asks for them
+			OverTemperatureThreshold = IdentifyControllerData.WCTEMP;
+			UnderTemperatureThreshold = 0;
+
+			VolatileWriteCacheEnabled = false;
+			ReadCacheEnabled = false;
+			Arbitration = DEFAULT_ARBITRATION_BURST;
+			SanitizeStatus = { 0 };
+			SanitizeStatus.SPROG = 0xFFFF; // Nothing in progress
+			PowerOnTime = std::chrono::steady_clock::now();
 
 #ifndef SINGLE_THREADED
 			DoorbellWatcher = LoopingThread([&] {Controller::checkForChanges(); }, CHANGE_CHECK_SLEEP_MS);
 			DoorbellWatcher.start();
+
+			// The admin queue and the later stages sleep only while they have nothing to do, and are woken as work comes in
+			AdminWatcher = LoopingThread([&] {Controller::checkAdminQueue(); },
+				[&] {AdminWaker.wait([&] {return AdminDoorbellRung || !AdminRunning || AsyncEvents.hasCompletion(); }); });
+			AdminWatcher.start();
+			CompleteStage = LoopingThread([&] {Controller::runCompleteStage(); },
+				[&] {CompleteWaker.wait([&] {return ExecutedBatches != ExecutedBatchesSeen || !StagesRunning; }); });
+			CompleteStage.start();
 #endif
+			setExecutorWorkers(DEFAULT_EXECUTOR_WORKERS);
 
-			// Todo: in the end, we'll need some form of media bank
+			addNamespace(new Namespace(DEFAULT_NAMESPACE_ID, new media::RamMedia(DEFAULT_NAMESPACE_BLOCK_SIZE, DEFAULT_NAMESPACE_SIZE_IN_BLOCKS)));
 		}
 
 		Controller::~Controller()
 		{
+			AdminRunning = false; // First, as an admin command may be waiting on the pipeline to drain
+			AdminWaker.wake();
+			AdminWatcher.end();
 			DoorbellWatcher.end();
+			setExecutorWorkers(0);
+			StagesRunning = false;
+			CompleteWaker.wake();
+			CompleteStage.end();
 
-			if (PCIExpressRegisters)
+			// Handlers may be (or hold) plugin code, so they go before the plugins
+			for (CommandDescriptor* table : { AdminCommands, NvmCommands, ZonedNamespaceCommands })
 			{
-				delete PCIExpressRegisters;
-				PCIExpressRegisters = nullptr;
+				std::fill(table, table + COMMAND_TABLE_ENTRIES, CommandDescriptor());
+			}
+			for (plugins::Plugin* plugin : Plugins)
+			{
+				delete plugin;
 			}
+			Plugins.clear();
 
+			// The controller registers live in BAR0 memory owned by the PCIe registers, so they (and their watcher thread) go first
 			if (ControllerRegisters)
 			{
 				delete ControllerRegisters;
 				ControllerRegisters = nullptr;
 			}
+
+			if (PCIExpressRegisters)
+			{
+				delete PCIExpressRegisters;
+				PCIExpressRegisters = nullptr;
+			}
 		}
 
 		cnvme::controller::registers::ControllerRegisters* Controller::getControllerRegisters()
@@ -64,11 +176,101 @@ namespace cnvme
 		}
 
 		void Controller::checkForChanges()
+		{
+			auto controllerRegisters = ControllerRegisters->getControllerRegisters();
+			controller::registers::QUEUE_DOORBELLS* doorbells = getControllerRegisters()->getQueueDoorbells();
+
+			if (controllerRegisters->CSTS.RDY == 0)
+			{
+				return; // Not ready... Don't do anything.
+			}
+
+			// The admin queue is AdminWatcher's. Let it know when the host rings one of its doorbells.
+			if (doorbells[ADMIN_QUEUE_ID].SQTDBL.SQT != AdminDoorbellsSeen.SQTDBL.SQT || doorbells[ADMIN_QUEUE_ID].CQHDBL.CQH != AdminDoorbellsSeen.CQHDBL.CQH)
+			{
+				AdminDoorbellsSeen = doorbells[ADMIN_QUEUE_ID];
+				AdminDoorbellRung = true;
+				AdminWaker.wake();
+			}
+
+			UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
+			if (memoryPageSize == 0)
+			{
+				LOG_ERROR("Unable to get memory page size. Did we lose the controller registers?");
+				return;
+			}
+
+			// An admin command changing what I/O sees waits for this, so it never happens partway through a pass
+			std::lock_guard<std::mutex> lock(DataPathMutex);
+
+			// The host owns completion queue heads: pick up whatever it has consumed since the last pass
+			for (auto &cq : ValidCompletionQueues)
+			{
+				if (cq.getQueueId() == ADMIN_QUEUE_ID)
+				{
+					continue; // AdminWatcher's
+				}
+
+				std::lock_guard<std::mutex> lock(cq.getMutex());
+				if (doorbells[cq.getQueueId()].CQHDBL.CQH != cq.getHeadPointer() && !cq.setHeadPointer(doorbells[cq.getQueueId()].CQHDBL.CQH))
+				{
+					reportInvalidDoorbell(cq.getQueueId(), true, doorbells[cq.getQueueId()].CQHDBL.CQH);
+				}
+			}
+
+			// Round robin: each turn a queue gets a burst, and turns go on until none has anything it can dispatch.
+			// A queue whose completion queue is full, or whose next command is over its QoS limits, stays parked there
+			//   until a later pass (after the host rings the head doorbell / tokens refill), so the others aren't held up
+			// An admin command waiting to change what I/O sees cuts the pass short
+			bool dispatched = true;
+			while (dispatched && !DataPathSynchronizationRequested)
+			{
+				dispatched = false;
+				for (auto &sq : ValidSubmissionQueues)
+				{
+					if (sq.getQueueId() == ADMIN_QUEUE_ID)
+					{
+						continue; // AdminWatcher's
+					}
+
+					if (doorbells[sq.getQueueId()].SQTDBL.SQT != sq.getTailPointer())
+					{
+						if (!sq.setTailPointer(doorbells[sq.getQueueId()].SQTDBL.SQT)) // Set our internal Queue instance's tail
+						{
+							reportInvalidDoorbell(sq.getQueueId(), false, doorbells[sq.getQueueId()].SQTDBL.SQT); // Stop early.
+							continue;
+						}
+					}
+
+					auto start = std::chrono::steady_clock::now();
+					UINT_32 occupancy = (sq.getTailPointer() + sq.getQueueSize() - sq.getHeadPointer()) % sq.getQueueSize();
+					UINT_32 fetched = fetchBurst(sq, FetchBuffer);
+					for (UINT_32 i = 0; i < fetched; i++)
+					{
+						submitToPipeline(sq, &FetchBuffer[i], memoryPageSize);
+					}
+
+					if (fetched)
+					{
+						StageStatistics[PIPELINE_STAGE_FETCH].record(fetched, occupancy, start);
+						dispatched = true;
+					}
+				}
+			}
+
+#ifdef SINGLE_THREADED
+			drainPipeline(); // No other threads to run the later stages
+#endif
+		}
+
+		void Controller::checkAdminQueue()
 		{
 			auto controllerRegisters = ControllerRegisters->getControllerRegisters();
 			// Admin doorbell is right after the Controller Registers... though we may not have it yet
 			controller::registers::QUEUE_DOORBELLS* doorbells = getControllerRegisters()->getQueueDoorbells();
 
+			AdminDoorbellRung = false; // Before looking, so a ring from here on means another look
+
 			if (controllerRegisters->CSTS.RDY == 0)
 			{
 				return; // Not ready... Don't do anything.
@@ -80,16 +282,15 @@ namespace cnvme
 			}
 
 			// Now that we have a SQ address, make it valid
-			if (ValidSubmissionQueues.size() == 0)
+			if (!AdminSubmissionQueue)
 			{
+				std::lock_guard<std::mutex> lock(DataPathMutex); // The queue lists are shared with the fetch stage
 				ValidSubmissionQueues.push_back(Queue(controllerRegisters->AQA.ASQS + 1, ADMIN_QUEUE_ID, &doorbells[ADMIN_QUEUE_ID].SQTDBL.SQT, controllerRegisters->ASQ.ASQB));
+				AdminSubmissionQueue = &ValidSubmissionQueues.back();
 			}
 			else
 			{
-				// Check if ASQB matches ValidSubmissionQueues
-				Queue* adminQueue = getQueueWithId(ValidSubmissionQueues, ADMIN_QUEUE_ID);
-				ASSERT_IF(!adminQueue, "Couldn't find the admin submission queue! Though ValidSubmissionQueue size is not 0.");
-				adminQueue->setMemoryAddress(controllerRegisters->ASQ.ASQB);
+				AdminSubmissionQueue->setMemoryAddress(controllerRegisters->ASQ.ASQB); // Check if ASQB changed
 			}
 
 			if (controllerRegisters->ACQ.ACQB == 0)
@@ -98,251 +299,2216 @@ namespace cnvme
 			}
 
 			// Now that we have a CQ address, make it valid
-			if (ValidCompletionQueues.size() == 0)
+			if (!AdminCompletionQueue)
 			{
-				Queue AdminCompletionQueue(controllerRegisters->AQA.ACQS + 1, ADMIN_QUEUE_ID, &doorbells[ADMIN_QUEUE_ID].CQHDBL.CQH, controllerRegisters->ACQ.ACQB);
-				AdminCompletionQueue.setMappedQueue(&ValidSubmissionQueues[ADMIN_QUEUE_ID]); // Map CQ -> SQ
-				ValidCompletionQueues.push_back(AdminCompletionQueue);
-
-				Queue* adminSubQ = getQueueWithId(ValidSubmissionQueues, ADMIN_QUEUE_ID);
-				ASSERT_IF(!adminSubQ, "Couldn't find the admin submission queue, to link it to the admin completion queue!");
-				adminSubQ->setMappedQueue(&ValidCompletionQueues[ADMIN_QUEUE_ID]); // Map SQ -> CQ
+				doorbells[ADMIN_QUEUE_ID].CQHDBL.CQH = 0; // Nothing has been posted yet, so nothing can have been consumed
+				std::lock_guard<std::mutex> lock(DataPathMutex);
+				ValidCompletionQueues.push_back(Queue(controllerRegisters->AQA.ACQS + 1, ADMIN_QUEUE_ID, &doorbells[ADMIN_QUEUE_ID].CQHDBL.CQH, controllerRegisters->ACQ.ACQB));
+				AdminCompletionQueue = &ValidCompletionQueues.back();
+				AdminSubmissionQueue->setMappedQueue(AdminCompletionQueue); // Map SQ -> CQ
 			}
 			else
 			{
-				// Check if ACQB matches ValidCompletionQueues
-				Queue* adminQueue = getQueueWithId(ValidCompletionQueues, ADMIN_QUEUE_ID);
-				ASSERT_IF(!adminQueue, "Couldn't find the admin completion queue! Though ValidCompletionQueues size is not 0.");
-				adminQueue->setMemoryAddress(controllerRegisters->ACQ.ACQB);
+				AdminCompletionQueue->setMemoryAddress(controllerRegisters->ACQ.ACQB); // Check if ACQB changed
 			}
 
-			// Made it this far, we have at least the admin queue
-			// This is round-robin right now
-			for (auto &sq : ValidSubmissionQueues)
+			// Made it this far, we have the admin queues
 			{
-				if (doorbells[sq.getQueueId()].SQTDBL.SQT != sq.getTailPointer())
+				std::lock_guard<std::mutex> lock(AdminCompletionQueue->getMutex());
+				if (doorbells[ADMIN_QUEUE_ID].CQHDBL.CQH != AdminCompletionQueue->getHeadPointer() && !AdminCompletionQueue->setHeadPointer(doorbells[ADMIN_QUEUE_ID].CQHDBL.CQH))
 				{
-					if (!sq.setTailPointer(doorbells[sq.getQueueId()].SQTDBL.SQT)) // Set our internal Queue instance's tail
-					{
-						LOG_ERROR("Should trigger AER since the Tail pointer given was invalid"); // Stop early.
-						continue;
-					}
-					else
-					{
-						sq.getMappedQueue()->setTailPointer(sq.getTailPointer());  // Set in internal CQ as well
-					}
+					reportInvalidDoorbell(ADMIN_QUEUE_ID, true, doorbells[ADMIN_QUEUE_ID].CQHDBL.CQH);
+				}
+			}
 
-					while (sq.getHeadPointer() != sq.getTailPointer())
-					{
-						processCommandAndPostCompletion(sq);
-						sq.incrementAndGetHeadCloserToTail();
-					}
+			if (doorbells[ADMIN_QUEUE_ID].SQTDBL.SQT != AdminSubmissionQueue->getTailPointer() && !AdminSubmissionQueue->setTailPointer(doorbells[ADMIN_QUEUE_ID].SQTDBL.SQT))
+			{
+				reportInvalidDoorbell(ADMIN_QUEUE_ID, false, doorbells[ADMIN_QUEUE_ID].SQTDBL.SQT);
+				postAsyncEventCompletions(); // The host hears about it, if it has a request parked
+				return;
+			}
+
+			UINT_32 fetched = 0;
+			while ((fetched = fetchBurst(*AdminSubmissionQueue, AdminFetchBuffer)) != 0)
+			{
+				for (UINT_32 i = 0; i < fetched; i++)
+				{
+					processAdminCommandAndPostCompletion(*AdminSubmissionQueue, &AdminFetchBuffer[i]);
 				}
 			}
+
+			// After the commands, so events they raised (or unmasked by reading a log page) go to requests parked just now
+			postAsyncEventCompletions();
 		}
 
-		void Controller::processCommandAndPostCompletion(Queue &submissionQueue)
+		UINT_32 Controller::fetchBurst(Queue &submissionQueue, NVME_COMMAND* buffer)
 		{
-			Queue* theCompletionQueue = submissionQueue.getMappedQueue();
-			if (theCompletionQueue == nullptr)
+			UINT_32 head = submissionQueue.getHeadPointer();
+			UINT_32 tail = submissionQueue.getTailPointer();
+			if (head == tail)
+			{
+				return 0;
+			}
+
+			if (submissionQueue.getMappedQueue() == nullptr)
 			{
 				LOG_ERROR("Submission Queue " + std::to_string(submissionQueue.getQueueId()) + " doesn't have a mapped completion queue. And yet it recieved a command.");
-				return;
+				return 0;
+			}
+
+			UINT_8 arbitrationBurst = Arbitration & 0x7; // AB: 2^n commands, 7 for no limit
+			UINT_32 burst = tail > head ? tail - head : submissionQueue.getQueueSize() - head; // What's left after a wrap is the next burst
+			burst = std::min(burst, arbitrationBurst == 7 ? (UINT_32)FETCH_BUFFER_ENTRIES : std::min((UINT_32)FETCH_BUFFER_ENTRIES, 1u << arbitrationBurst));
+			burst = std::min(burst, getCompletionQueueSpace(submissionQueue));
+			if (submissionQueue.getQueueId() != ADMIN_QUEUE_ID)
+			{
+				burst = std::min(burst, getPipelineFreeEntries());
+			}
+
+			// Each entry is a cache line. Start them all coming in before looking at the first.
+			NVME_COMMAND* entries = (NVME_COMMAND*)submissionQueue.getMemoryAddress() + head;
+			for (UINT_32 i = 0; i < burst; i++)
+			{
+				PREFETCH(entries + i);
+			}
+
+			UINT_32 fetched = 0;
+			while (fetched < burst && admitCommand(submissionQueue.getQueueId(), entries + fetched))
+			{
+				fetched++;
 			}
 
-			UINT_8* subQPointer = (UINT_8*)submissionQueue.getMemoryAddress(); // This is the address of the 64 byte command
-			NVME_COMMAND* command = (NVME_COMMAND*)subQPointer;
+			memcpy(buffer, entries, fetched * sizeof(NVME_COMMAND));
+			submissionQueue.setHeadPointer((head + fetched) % submissionQueue.getQueueSize());
+
+			Queue* completionQueue = submissionQueue.getMappedQueue();
+			std::lock_guard<std::mutex> lock(completionQueue->getMutex());
+			completionQueue->reserveEntries(fetched); // Each one's completion will have somewhere to go
+			return fetched;
+		}
+
+		void Controller::submitToPipeline(Queue &submissionQueue, NVME_COMMAND* command, UINT_32 memoryPageSize)
+		{
+			UINT_64 sequence = NextSequence;
+			PipelineCommand &entry = PipelineSlots[sequence % PIPELINE_RING_ENTRIES];
+			entry.Command = *command;
+			entry.SubmissionQueue = &submissionQueue;
+			entry.SubmissionQueueHead = submissionQueue.getHeadPointer();
+			entry.MemoryPageSize = memoryPageSize;
+			entry.Execute = true;
+			entry.Completion = { 0 };
 
-			command += submissionQueue.getHeadPointer();            // Make sure we get the correct command
+			// Either way, fetching it uses up an Abort's mark
+			bool abortRequested = InFlight.get(submissionQueue.getQueueId(), command->DWord0Breakdown.CID) == IN_FLIGHT_ABORT_REQUESTED;
+			if (abortRequested)
+			{
+				InFlight.set(submissionQueue.getQueueId(), command->DWord0Breakdown.CID, IN_FLIGHT_NONE);
+			}
 
 			if (!isValidCommandIdentifier(command->DWord0Breakdown.CID, submissionQueue.getQueueId()))
 			{
-				COMPLETION_QUEUE_ENTRY cqe = { 0 };
-				cqe.SC = constants::status::codes::generic::COMMAND_ID_CONFLICT; // Command ID Conflict 
-				cqe.DNR = 1; // Do not retry
-				postCompletion(*theCompletionQueue, cqe, command);
-				return; // Do not process command since the CID/SQID combo was invalid;
+				entry.Completion.SC = constants::status::codes::generic::COMMAND_ID_CONFLICT; // Command ID Conflict
+				entry.Completion.DNR = 1; // Do not retry
+				entry.Execute = false; // Do not process command since the CID/SQID combo was invalid
+			}
+			else if (abortRequested)
+			{
+				entry.Completion.SC = constants::status::codes::generic::COMMAND_ABORT_REQUESTED;
+				entry.Execute = false;
+			}
+			else
+			{
+				InFlight.set(submissionQueue.getQueueId(), command->DWord0Breakdown.CID, (UINT_16)(sequence % PIPELINE_RING_ENTRIES + 1));
 			}
+			entry.Started.store(!entry.Execute, std::memory_order_relaxed); // Published to the worker by the inbox push
 
-			Payload transferPayload;
-			PRP prp;
-			bool validCommand = true;
-			COMPLETION_QUEUE_ENTRY completionQueueEntryToPost = { 0 };
-			UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
+			// Each submission queue has a home worker. A busy queue only spreads to the other workers by them stealing.
+			ExecutorWorker &worker = ExecutorWorkers[(submissionQueue.getQueueId() - 1) % NumberOfExecutorWorkers];
+			NextSequence = sequence + 1;
+			bool pushed = worker.Inbox.push(sequence);
+			ASSERT_IF(!pushed, "The worker's inbox is full. The fetch should have been held back.");
+			worker.Waker.wake();
+		}
 
-			if (memoryPageSize == 0)
+		UINT_32 Controller::getPipelineFreeEntries()
+		{
+			return PIPELINE_RING_ENTRIES - (UINT_32)(NextSequence - CompletedSequence);
+		}
+
+		void Controller::setExecutorWorkers(UINT_32 numberOfWorkers)
+		{
+			UINT_32 runningWorkers = NumberOfExecutorWorkers;
+
+#ifndef SINGLE_THREADED
+			// One at a time: a worker told to stop no longer sleeps, so it would spin until its turn to be joined
+			for (UINT_32 i = numberOfWorkers; i < runningWorkers; i++)
 			{
-				LOG_ERROR("Unable to get memory page size. Did we lose the controller registers?");
-				return;
+				ExecutorWorkers[i].Running = false;
+				ExecutorWorkers[i].Waker.wake();
+				ExecutorWorkers[i].Thread.end();
 			}
+#endif
+
+			NumberOfExecutorWorkers = numberOfWorkers; // Those still running may look for work to steal in the new ones: none yet
 
-			if (submissionQueue.getQueueId() == ADMIN_QUEUE_ID)
+#ifndef SINGLE_THREADED
+			for (UINT_32 i = runningWorkers; i < numberOfWorkers; i++)
 			{
-				// Admin command
-				LOG_INFO(command->toString());
+				ExecutorWorkers[i].Running = true;
+				ExecutorWorkers[i].Thread = LoopingThread([this, i] {Controller::runExecutorWorker(i); },
+					[this, i] {ExecutorWorkers[i].Waker.wait([this, i] {return executorWorkerHasWork(i); }); });
+				ExecutorWorkers[i].Thread.start();
+			}
+#endif
+		}
 
-				switch (command->DWord0Breakdown.OPC)
+		UINT_32 Controller::runExecutorWorker(UINT_32 workerIndex)
+		{
+			ExecutorWorker &worker = ExecutorWorkers[workerIndex];
+			auto start = std::chrono::steady_clock::now();
+			UINT_32 occupancy = worker.Inbox.size() + worker.Deque.size();
+			UINT_64 sequences[PIPELINE_STAGE_BATCH];
+			UINT_32 executed = 0;
+			while (executed < PIPELINE_STAGE_BATCH)
+			{
+				UINT_64 sequence;
+				if (!worker.Deque.pop(sequence))
 				{
-				case constants::opcodes::admin::IDENTIFY: // Identify
-					LOG_INFO("Got an identify call!");
+					// Out of work of its own: take the next batch out of the inbox, where other workers can steal from it.
+					// With more than one command there's something to spare, so let the next worker know.
+					UINT_32 moved = 0;
+					while (moved < PIPELINE_STAGE_BATCH && worker.Inbox.pop(sequence))
+					{
+						bool pushed = worker.Deque.push(sequence);
+						ASSERT_IF(!pushed, "The worker's deque is full, though it was just empty.");
+						moved++;
+					}
+					if (moved > 1)
+					{
+						ExecutorWorkers[(workerIndex + 1) % NumberOfExecutorWorkers].Waker.wake();
+					}
 
-					// TODO : Check if ControllerRegisters is valid.
-					prp = PRP(command->DPTR.DPTR1, command->DPTR.DPTR2, memoryPageSize, memoryPageSize);
-					transferPayload = prp.getPayloadCopy();
-					transferPayload.getBuffer()[0] = 1;
-					transferPayload.getBuffer()[1] = 0xff;
-					prp.placePayloadInExistingPRPs(transferPayload);
-					break;
-				case constants::opcodes::admin::KEEP_ALIVE: //Keep Alive... no data should be easiest
-					break;
+					if (!worker.Deque.pop(sequence))
+					{
+						// Still nothing: steal the oldest command of the first worker that has one to spare
+						bool stole = false;
+						for (UINT_32 i = 1; i < NumberOfExecutorWorkers && !stole; i++)
+						{
+							ExecutorWorker &victim = ExecutorWorkers[(workerIndex + i) % NumberOfExecutorWorkers];
+							stole = victim.Deque.steal(sequence);
+							if (stole)
+							{
+								worker.Steals++;
+								victim.Stolen++;
+							}
+						}
 
-				default:
-					validCommand = false;
+						if (!stole)
+						{
+							break;
+						}
+					}
 				}
 
-				if (validCommand)
-				{
-					postCompletion(*theCompletionQueue, completionQueueEntryToPost, command);
-				}
-				else
+				PipelineCommand &entry = PipelineSlots[sequence % PIPELINE_RING_ENTRIES];
+				if (entry.Execute)
 				{
-					assert(0); // kill for now. Need to return invalid command opcode
-					postCompletion(*theCompletionQueue, completionQueueEntryToPost, command);
+					if (!entry.Started.exchange(true, std::memory_order_acq_rel))
+					{
+						processNvmCommand(&entry.Command, entry.Completion, entry.MemoryPageSize, entry.SubmissionQueue->getQueueId(), worker.Counters);
+					}
+					else
+					{
+						entry.Completion.SC = constants::status::codes::generic::COMMAND_ABORT_REQUESTED; // An Abort got to it first
+					}
 				}
-
+				sequences[executed++] = sequence;
 			}
-			else
+
+			if (executed)
 			{
-				// NVM command
-				assert(0); // Don't send me NVM commands yet.
+				// Recorded before handing the batch on, so once the pipeline is drained the statistics include it
+				worker.Statistics.record(executed, occupancy, start);
+				for (UINT_32 i = 0; i < executed; i++)
+				{
+					PipelineSlotExecuted[sequences[i] % PIPELINE_RING_ENTRIES].store(true, std::memory_order_release);
+				}
+				ExecutedBatches++;
+				CompleteWaker.wake();
 			}
+			return executed;
 		}
 
-		Queue* Controller::getQueueWithId(std::vector<Queue> &queues, UINT_16 id)
+		bool Controller::executorWorkerHasWork(UINT_32 workerIndex)
 		{
-			for (size_t i = 0; i < queues.size(); i++)
+			if (!ExecutorWorkers[workerIndex].Running || ExecutorWorkers[workerIndex].Inbox.size() != 0)
+			{
+				return true;
+			}
+
+			for (UINT_32 i = 0; i < NumberOfExecutorWorkers; i++)
 			{
-				if (queues[i].getQueueId() == id)
+				if (ExecutorWorkers[i].Deque.size() != 0)
 				{
-					return &queues[i];
+					return true;
 				}
 			}
-
-			LOG_ERROR("Invalid queue id specified: " + std::to_string(id));
-			return nullptr;
+			return false;
 		}
 
-		void Controller::postCompletion(Queue &completionQueue, COMPLETION_QUEUE_ENTRY completionEntry, NVME_COMMAND* command)
+		UINT_32 Controller::runCompleteStage()
 		{
-			COMPLETION_QUEUE_ENTRY* completionQueueList = (COMPLETION_QUEUE_ENTRY*)MEMORY_ADDRESS_TO_8POINTER(completionQueue.getMemoryAddress());
-			ASSERT_IF(completionQueueList == nullptr, "completionQueueList cannot be NULL");
-			LOG_INFO("About to post completion to queue " + std::to_string(completionQueue.getQueueId()) + ". Head (just before moving): " + 
-				std::to_string(completionQueue.getHeadPointer()) + ". Tail: " + std::to_string(completionQueue.getTailPointer()));
+			auto start = std::chrono::steady_clock::now();
+			UINT_64 executedBatches = ExecutedBatches; // Before looking, so a batch executed while we do wakes us again
+			UINT_64 sequence = CompletedSequence;
+			UINT_64 nextSequence = NextSequence;
+			UINT_32 occupancy = (UINT_32)(nextSequence - sequence);
+			UINT_32 completed = 0;
 
-			completionQueueList += completionQueue.getHeadPointer(); // Move pointer to correct index
+			// A completion queue with a command still executing takes nothing more until it's done. The others carry on.
+			std::vector<Queue*> waitingCompletionQueues;
+			for (UINT_64 scan = sequence; scan != nextSequence && completed < PIPELINE_STAGE_BATCH; scan++)
+			{
+				UINT_32 slot = scan % PIPELINE_RING_ENTRIES;
+				if (PipelineSlotPosted[slot])
+				{
+					continue;
+				}
 
-			Queue* submissionQueue = completionQueue.getMappedQueue();
-			completionEntry.SQID = submissionQueue->getQueueId();
-			completionEntry.SQHD = submissionQueue->getHeadPointer();
-			completionEntry.CID = command->DWord0Breakdown.CID;
+				PipelineCommand &entry = PipelineSlots[slot];
+				Queue* completionQueue = entry.SubmissionQueue->getMappedQueue();
+				if (std::find(waitingCompletionQueues.begin(), waitingCompletionQueues.end(), completionQueue) != waitingCompletionQueues.end())
+				{
+					continue;
+				}
 
-			bool phaseTag = false;
-			auto node = QueueToPhaseTag.find(submissionQueue->getQueueId());
-			if (node == QueueToPhaseTag.end())
-			{
-				QueueToPhaseTag[submissionQueue->getQueueId()] = false;    // start at false if not there... though it will flip to true below
-			}
-			else
-			{
-				phaseTag = QueueToPhaseTag[submissionQueue->getQueueId()]; // use existing
+				if (!PipelineSlotExecuted[slot].load(std::memory_order_acquire))
+				{
+					waitingCompletionQueues.push_back(completionQueue);
+					continue;
+				}
+
+				if (InFlight.get(entry.SubmissionQueue->getQueueId(), entry.Command.DWord0Breakdown.CID) == slot + 1)
+				{
+					InFlight.set(entry.SubmissionQueue->getQueueId(), entry.Command.DWord0Breakdown.CID, IN_FLIGHT_NONE); // Before posting: then the host may reuse the CID
+				}
+				postCompletion(*entry.SubmissionQueue, entry.SubmissionQueueHead, entry.Completion, &entry.Command);
+				PipelineSlotExecuted[slot] = false;
+				PipelineSlotPosted[slot] = true;
+				completed++;
 			}
 
-			if (completionQueue.getHeadPointer() == 0) // need to flip
+			if (completed < PIPELINE_STAGE_BATCH)
 			{
-				bool oldPhaseTag = QueueToPhaseTag[submissionQueue->getQueueId()];
-				QueueToPhaseTag[submissionQueue->getQueueId()] = !oldPhaseTag;
-				LOG_INFO("Inverting Phase Tag. Now Phase Tag == " + strings::toString(!oldPhaseTag));
+				ExecutedBatchesSeen = executedBatches; // Everything postable was posted. A full batch may have left more.
 			}
-			phaseTag = QueueToPhaseTag[submissionQueue->getQueueId()]; // should be ready to be used (and flipped if needed).
-
-			completionEntry.P = (UINT_16)phaseTag;
-
-			UINT_32 completionQueueMemorySize = completionQueue.getQueueMemorySize();
-			completionQueueMemorySize -= (completionQueue.getHeadPointer() * sizeof(COMPLETION_QUEUE_ENTRY)); // calculate new remaining memory size
-			ASSERT_IF(completionQueueMemorySize < sizeof(COMPLETION_QUEUE_ENTRY), "completionQueueMemorySize must be greater than a single completion queue entry");
-			memcpy_s(completionQueueList, completionQueueMemorySize, &completionEntry, sizeof(completionEntry)); // Post
-			LOG_INFO(completionEntry.toString());
 
-			completionQueue.incrementAndGetHeadCloserToTail(); // Move up CQ head
+			if (completed)
+			{
+				StageStatistics[PIPELINE_STAGE_COMPLETE].record(completed, occupancy, start);
 
-			// ring doorbell after placing data in completion queue.
-			UINT_16* dbell = completionQueue.getDoorbell();
-			dbell[0] = completionQueue.getHeadPointer();
+				// Slots are only given back from the oldest, so their sequence numbers stay in the ring
+				while (sequence != nextSequence && PipelineSlotPosted[sequence % PIPELINE_RING_ENTRIES])
+				{
+					PipelineSlotPosted[sequence % PIPELINE_RING_ENTRIES] = false;
+					sequence++;
+				}
+				CompletedSequence = sequence; // After recording, so once the pipeline is drained the statistics include these
+			}
+			return completed;
 		}
 
-		bool Controller::isValidCommandIdentifier(UINT_16 commandId, UINT_16 submissionQueueId)
+		void Controller::drainPipeline()
 		{
-			if (SubmissionQueueIdToCommandIdentifiers.find(submissionQueueId) == SubmissionQueueIdToCommandIdentifiers.end())
-			{
-				// SQID hasn't been used yet?
-				std::set<UINT_16> tmp = { commandId };
-				SubmissionQueueIdToCommandIdentifiers[submissionQueueId] = tmp;
-				return true;
-			}
-			else
+			while (CompletedSequence != NextSequence)
 			{
-				// Have SQID in SubmissionQueueIdToCommandIdentifiers
-				std::set<UINT_16> &thisSubqsCids = SubmissionQueueIdToCommandIdentifiers[submissionQueueId];
-
-				if (thisSubqsCids.size() == MAX_COMMAND_IDENTIFIER)
+#ifdef SINGLE_THREADED
+				for (UINT_32 i = 0; i < NumberOfExecutorWorkers; i++)
 				{
-					LOG_INFO("Made it to the end of possible CIDs for SubQ " + std::to_string(submissionQueueId) + ". Resetting possibile CIDs.");
-					thisSubqsCids.clear();
+					runExecutorWorker(i);
 				}
+				runCompleteStage();
+#else
+				std::this_thread::yield();
+#endif
+			}
+		}
 
-				if (thisSubqsCids.find(commandId) == thisSubqsCids.end())
+		bool Controller::isDataPathSynchronizationPoint(NVME_COMMAND* command)
+		{
+			if (command->DWord0Breakdown.OPC == constants::opcodes::admin::GET_LOG_PAGE)
+			{
+				switch (command->DWord10 & 0xFF)
 				{
-					thisSubqsCids.insert(commandId);
+				case constants::log_pages::QOS_STATISTICS: // Kept by the fetch stage
+				case constants::log_pages::PIPELINE_STATISTICS: // Only adds up with nothing in flight
+				case constants::log_pages::EXECUTOR_STATISTICS:
 					return true;
+				default:
+					return false; // The rest are kept under their own locks, or (like SMART / Health Information) read as they are so monitoring never stalls I/O
 				}
 			}
-
-			LOG_ERROR("Invalid command identifier was sent (" + std::to_string(commandId) + "). Was it re-used?");
-			return false;
+			return AdminCommands[command->DWord0Breakdown.OPC].SynchronizationPoint; // Queues, namespaces, features or media change under I/O
 		}
 
-		void Controller::controllerResetCallback()
+		void Controller::processAdminCommandAndPostCompletion(Queue &submissionQueue, NVME_COMMAND* command)
 		{
-			LOG_INFO("Recv'd a controllerResetCallback request.");
+			std::lock_guard<std::mutex> adminCommandLock(AdminCommandMutex); // Namespaces aren't added while it runs
+			std::unique_lock<std::mutex> dataPathLock(DataPathMutex, std::defer_lock);
+			if (isDataPathSynchronizationPoint(command))
+			{
+				DataPathSynchronizationRequested = true;
+				dataPathLock.lock(); // The fetch stage stops between passes...
+				DataPathSynchronizationRequested = false;
+				drainPipeline(); // ...and I/O already fetched finishes before anything changes under it
+			}
 
-			for (size_t i = ValidSubmissionQueues.size() - 1; i != -1; i--)
+			if (!isValidCommandIdentifier(command->DWord0Breakdown.CID, submissionQueue.getQueueId()))
 			{
-				if (ValidSubmissionQueues[i].getQueueId() != ADMIN_QUEUE_ID)
-				{
-					ValidSubmissionQueues.erase(ValidSubmissionQueues.begin() + i);
-				}
+				COMPLETION_QUEUE_ENTRY cqe = { 0 };
+				cqe.SC = constants::status::codes::generic::COMMAND_ID_CONFLICT; // Command ID Conflict 
+				cqe.DNR = 1; // Do not retry
+				postCompletion(submissionQueue, submissionQueue.getHeadPointer(), cqe, command);
+				return; // Do not process command since the CID/SQID combo was invalid;
 			}
 
-			for (size_t i = ValidCompletionQueues.size() - 1; i != -1; i--)
+			COMPLETION_QUEUE_ENTRY completionQueueEntryToPost = { 0 };
+			LOG_INFO(command->toString());
+
+			const CommandDescriptor &descriptor = AdminCommands[command->DWord0Breakdown.OPC];
+			CommandContext context = { command, &completionQueueEntryToPost, ControllerRegisters->getMemoryPageSize(), (UINT_16)submissionQueue.getQueueId(), getNamespace(command->NSID) };
+			if (validateCommand(descriptor, context))
 			{
-				if (ValidCompletionQueues[i].getQueueId() != ADMIN_QUEUE_ID)
-				{
-					ValidCompletionQueues.erase(ValidCompletionQueues.begin() + i);
-				}
+				descriptor.Handler(context);
+			}
+			AdminCounters.record(submissionQueue.getQueueId(), pipeline::COMMAND_KIND_OTHER, 0, completionQueueEntryToPost.SCT, completionQueueEntryToPost.SC);
+			if (context.CompletionDeferred)
+			{
+				return;
 			}
 
-			// Clear the SubQ to CID listing.
-			this->SubmissionQueueIdToCommandIdentifiers.clear();
+			postCompletion(submissionQueue, submissionQueue.getHeadPointer(), completionQueueEntryToPost, command);
+		}
 
-			// Clear phase tags.
-			this->QueueToPhaseTag.clear();
+		void Controller::asynchronousEventRequest(CommandContext &context)
+		{
+			if (!AsyncEvents.park(context.Command->DWord0Breakdown.CID))
+			{
+				context.Completion->SCT = types::COMMAND_SPECIFIC;
+				context.Completion->SC = codes::specific::ASYNCHRONOUS_EVENT_REQUEST_LIMIT_EXCEEDED;
+				context.Completion->DNR = 1;
+				return;
+			}
+			context.CompletionDeferred = true; // Posted by postAsyncEventCompletions once there's an event
+
+			// A parked request doesn't hold on to the entry reserved when it was fetched: up to the limit of them could
+			//   otherwise take every free entry in a small admin queue, and nothing else would ever be fetched.
+			//   Its completion reserves one again once there's an event for it and room to post it.
+			Queue* completionQueue = AdminSubmissionQueue->getMappedQueue();
+			std::lock_guard<std::mutex> lock(completionQueue->getMutex());
+			completionQueue->releaseEntries(1);
+		}
+
+		void Controller::abort(CommandContext &context)
+		{
+			UINT_16 submissionQueueId = context.Command->DWord10 & 0xFFFF;
+			UINT_16 commandId = context.Command->DWord10 >> 16;
+			context.Completion->DWord0 = 1; // Not aborted, unless it's found below
+
+			if (submissionQueueId == ADMIN_QUEUE_ID)
+			{
+				// Other admin commands run one at a time on this thread, so by now they've completed.
+				// A parked request has no entry reserved. If there's no room to post it, it isn't aborted.
+				if (getCompletionQueueSpace(*AdminSubmissionQueue) && AsyncEvents.cancel(commandId))
+				{
+					reserveAdminCompletion();
+					NVME_COMMAND request = { 0 };
+					request.DWord0Breakdown.CID = commandId;
+					COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+					completionQueueEntry.SC = codes::generic::COMMAND_ABORT_REQUESTED;
+					postCompletion(*AdminSubmissionQueue, AdminSubmissionQueue->getHeadPointer(), completionQueueEntry, &request);
+					context.Completion->DWord0 = 0;
+				}
+				return;
+			}
+
+			// The fetch stage stops between passes, but the pipeline isn't drained: what's in it can still be aborted
+			DataPathSynchronizationRequested = true;
+			std::lock_guard<std::mutex> lock(DataPathMutex);
+			DataPathSynchronizationRequested = false;
+
+			Queue* submissionQueue = getQueueWithId(ValidSubmissionQueues, submissionQueueId, false);
+			if (submissionQueue && abortIoCommand(*submissionQueue, commandId))
+			{
+				LOG_INFO("Aborted command " + std::to_string(commandId) + " from submission queue " + std::to_string(submissionQueueId));
+				context.Completion->DWord0 = 0;
+			}
+		}
+
+		bool Controller::abortIoCommand(Queue &submissionQueue, UINT_16 commandId)
+		{
+			UINT_16 inFlight = InFlight.get(submissionQueue.getQueueId(), commandId);
+			if (inFlight == IN_FLIGHT_ABORT_REQUESTED)
+			{
+				return false; // Already being aborted
+			}
+
+			if (inFlight != IN_FLIGHT_NONE)
+			{
+				// In the pipeline. Only the fetch stage fills slots, so it's still this command. It's aborted unless a worker has claimed it.
+				PipelineCommand &entry = PipelineSlots[inFlight - 1];
+				return entry.SubmissionQueue == &submissionQueue && entry.Command.DWord0Breakdown.CID == commandId &&
+					!entry.Started.exchange(true, std::memory_order_acq_rel);
+			}
+
+			// Not fetched yet: waiting for arbitration, held back by QoS, or not even seen (the fetch stage picks up the tail doorbell)
+			UINT_32 tail = getControllerRegisters()->getQueueDoorbells()[submissionQueue.getQueueId()].SQTDBL.SQT;
+			if (tail >= submissionQueue.getQueueSize())
+			{
+				tail = submissionQueue.getTailPointer(); // Invalid: the fetch stage reports it
+			}
+
+			NVME_COMMAND* entries = (NVME_COMMAND*)submissionQueue.getMemoryAddress();
+			for (UINT_32 i = submissionQueue.getHeadPointer(); i != tail; i = (i + 1) % submissionQueue.getQueueSize())
+			{
+				if (entries[i].DWord0Breakdown.CID == commandId)
+				{
+					InFlight.set(submissionQueue.getQueueId(), commandId, IN_FLIGHT_ABORT_REQUESTED); // Completed as soon as it's fetched
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void Controller::postAsyncEventCompletions()
+		{
+			UINT_16 commandId;
+			UINT_32 dword0;
+			while (getCompletionQueueSpace(*AdminSubmissionQueue) && AsyncEvents.takeCompletion(commandId, dword0))
+			{
+				reserveAdminCompletion(); // Only this thread reserves admin entries, so the room just seen is still there
+				NVME_COMMAND command = { 0 };
+				command.DWord0Breakdown.CID = commandId;
+				COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+				completionQueueEntry.DWord0 = dword0;
+				postCompletion(*AdminSubmissionQueue, AdminSubmissionQueue->getHeadPointer(), completionQueueEntry, &command);
+			}
+		}
+
+		void Controller::reserveAdminCompletion()
+		{
+			Queue* completionQueue = AdminSubmissionQueue->getMappedQueue();
+			std::lock_guard<std::mutex> lock(completionQueue->getMutex());
+			completionQueue->reserveEntries(1); // Posting uses up a reservation if there is one, so it has to be this one
+		}
+
+		void Controller::raiseAsyncEvent(UINT_8 type, UINT_8 information, UINT_8 logPageIdentifier)
+		{
+			AsyncEvents.raise(type, information, logPageIdentifier);
+			AdminWaker.wake();
+		}
+
+		void Controller::reportInvalidDoorbell(UINT_16 queueId, bool completionQueue, UINT_16 value)
+		{
+			if (AsyncEvents.reportInvalidDoorbell(queueId, completionQueue, value))
+			{
+				LOG_ERROR("Invalid " + std::string(completionQueue ? "head" : "tail") + " doorbell value " + std::to_string(value) + " for queue " + std::to_string(queueId));
+				AdminWaker.wake();
+			}
+		}
+
+		bool Controller::isTemperatureOutsideThresholds() const
+		{
+			return SMART_COMPOSITE_TEMPERATURE > OverTemperatureThreshold || SMART_COMPOSITE_TEMPERATURE < UnderTemperatureThreshold;
+		}
+
+		void Controller::registerCommands()
+		{
+			namespace admin = constants::opcodes::admin;
+			namespace nvm = constants::opcodes::nvm;
+			namespace zns = constants::opcodes::zns;
+
+			// These only read state, so they run alongside I/O
+			registerCommand(AdminCommands, admin::IDENTIFY, CommandDescriptor([this](CommandContext &c) { identify(c.Command, *c.Completion, c.MemoryPageSize); }, true, false, false));
+			registerCommand(AdminCommands, admin::KEEP_ALIVE, CommandDescriptor([](CommandContext &c) {}, false, false, false)); // No data should be easiest
+			registerCommand(AdminCommands, admin::GET_LOG_PAGE, CommandDescriptor([this](CommandContext &c) { getLogPage(c.Command, *c.Completion, c.MemoryPageSize); }, true, false, false));
+			registerCommand(AdminCommands, admin::GET_FEATURES, CommandDescriptor([this](CommandContext &c) { getFeatures(c.Command, *c.Completion); }, false, false, false));
+			registerCommand(AdminCommands, admin::ASYNCHRONOUS_EVENT_REQUEST, CommandDescriptor([this](CommandContext &c) { asynchronousEventRequest(c); }, false, false, false));
+			registerCommand(AdminCommands, admin::ABORT, CommandDescriptor([this](CommandContext &c) { abort(c); }, false, false, false)); // Takes DataPathMutex itself, without draining the pipeline
+
+			registerCommand(AdminCommands, admin::SET_FEATURES, CommandDescriptor([this](CommandContext &c) { setFeatures(c.Command, *c.Completion); }, false, false));
+			registerCommand(AdminCommands, admin::FORMAT_NVM, CommandDescriptor([this](CommandContext &c) { formatNvm(c.Command, *c.Completion); }, false, false));
+			registerCommand(AdminCommands, admin::SANITIZE, CommandDescriptor([this](CommandContext &c) { sanitize(c.Command, *c.Completion); }, false, false));
+			registerCommand(AdminCommands, admin::DIRECTIVE_SEND, CommandDescriptor([this](CommandContext &c) { directiveSend(c.Command, *c.Completion); }, false, false));
+			registerCommand(AdminCommands, admin::DIRECTIVE_RECEIVE, CommandDescriptor([this](CommandContext &c) { directiveReceive(c.Command, *c.Completion, c.MemoryPageSize); }, false, false));
+			registerCommand(AdminCommands, admin::CREATE_IO_COMPLETION_QUEUE, CommandDescriptor([this](CommandContext &c) { createIoCompletionQueue(c.Command, *c.Completion); }, false, false));
+			registerCommand(AdminCommands, admin::CREATE_IO_SUBMISSION_QUEUE, CommandDescriptor([this](CommandContext &c) { createIoSubmissionQueue(c.Command, *c.Completion); }, false, false));
+			registerCommand(AdminCommands, admin::DELETE_IO_COMPLETION_QUEUE, CommandDescriptor([this](CommandContext &c) { deleteIoCompletionQueue(c.Command, *c.Completion); }, false, false));
+			registerCommand(AdminCommands, admin::DELETE_IO_SUBMISSION_QUEUE, CommandDescriptor([this](CommandContext &c) { deleteIoSubmissionQueue(c.Command, *c.Completion); }, false, false));
+
+			// The Zoned Namespace command set is the NVM one plus the zone commands
+			for (CommandDescriptor* table : { NvmCommands, ZonedNamespaceCommands })
+			{
+				registerCommand(table, nvm::FLUSH, CommandDescriptor([this](CommandContext &c) { flush(c.Command, *c.Completion); }, false, false)); // May be for every namespace
+				registerCommand(table, nvm::READ, CommandDescriptor([this](CommandContext &c) { readOrWrite(c.Command, *c.TheNamespace, *c.Completion, c.MemoryPageSize, c.SubmissionQueueId); }, true, true));
+				registerCommand(table, nvm::WRITE, CommandDescriptor([this](CommandContext &c) { readOrWrite(c.Command, *c.TheNamespace, *c.Completion, c.MemoryPageSize, c.SubmissionQueueId); }, true, true));
+				registerCommand(table, nvm::COPY, CommandDescriptor([this](CommandContext &c) { copy(c.Command, *c.TheNamespace, *c.Completion, c.MemoryPageSize); }, true, true));
+				registerCommand(table, nvm::DATASET_MANAGEMENT, CommandDescriptor([this](CommandContext &c) { datasetManagement(c.Command, *c.TheNamespace, *c.Completion, c.MemoryPageSize); }, true, true));
+			}
+			registerCommand(ZonedNamespaceCommands, zns::ZONE_APPEND, CommandDescriptor([this](CommandContext &c) { zoneAppend(c.Command, *c.TheNamespace, *c.Completion, c.MemoryPageSize); }, true, true));
+			registerCommand(ZonedNamespaceCommands, zns::ZONE_MANAGEMENT_SEND, CommandDescriptor([this](CommandContext &c) { zoneManagementSend(c.Command, *c.TheNamespace, *c.Completion); }, false, true));
+			registerCommand(ZonedNamespaceCommands, zns::ZONE_MANAGEMENT_RECEIVE, CommandDescriptor([this](CommandContext &c) { zoneManagementReceive(c.Command, *c.TheNamespace, *c.Completion, c.MemoryPageSize); }, true, true));
+		}
+
+		bool Controller::registerAdminCommand(UINT_8 opcode, CommandDescriptor descriptor)
+		{
+			return registerCommand(AdminCommands, opcode, descriptor);
+		}
+
+		bool Controller::registerIoCommand(UINT_8 commandSet, UINT_8 opcode, CommandDescriptor descriptor)
+		{
+			switch (commandSet)
+			{
+			case constants::command_sets::NVM:
+				return registerCommand(NvmCommands, opcode, descriptor);
+			case constants::command_sets::ZONED_NAMESPACE:
+				return registerCommand(ZonedNamespaceCommands, opcode, descriptor);
+			default:
+				LOG_ERROR("Unsupported command set: " + std::to_string(commandSet));
+				return false;
+			}
+		}
+
+		bool Controller::loadPlugin(std::string path)
+		{
+			plugins::Plugin* plugin = new plugins::Plugin(path);
+			plugins::PluginEntryPoint entryPoint = plugin->getEntryPoint();
+			if (!entryPoint)
+			{
+				delete plugin;
+				return false;
+			}
+
+			// If it fails part way, what it did register is taken out again while its code is still loaded.
+			// Registering only fills empty opcodes, so those are the only ones touched: the rest may be in use by other threads.
+			std::vector<std::pair<CommandDescriptor*, UINT_32>> emptyOpcodes;
+			for (CommandDescriptor* table : { AdminCommands, NvmCommands, ZonedNamespaceCommands })
+			{
+				for (UINT_32 opcode = 0; opcode < COMMAND_TABLE_ENTRIES; opcode++)
+				{
+					if (!table[opcode].Handler)
+					{
+						emptyOpcodes.push_back(std::make_pair(table, opcode));
+					}
+				}
+			}
+
+			if (!entryPoint(*this, PLUGIN_INTERFACE_VERSION))
+			{
+				LOG_ERROR("Plugin " + path + " failed to register");
+				for (auto &emptyOpcode : emptyOpcodes)
+				{
+					if (emptyOpcode.first[emptyOpcode.second].Handler)
+					{
+						emptyOpcode.first[emptyOpcode.second] = CommandDescriptor();
+					}
+				}
+				delete plugin;
+				return false;
+			}
+
+			Plugins.push_back(plugin);
+			LOG_INFO("Loaded plugin " + path);
+			return true;
+		}
+
+		bool Controller::registerCommand(CommandDescriptor* table, UINT_8 opcode, CommandDescriptor descriptor)
+		{
+			descriptor.DataTransfer = opcode & 0x3;
+			if (table[opcode].Handler || !descriptor.Handler || (descriptor.NeedsPrps && descriptor.DataTransfer == constants::data_transfer::NONE))
+			{
+				LOG_ERROR("Unable to register a handler for opcode " + std::to_string(opcode));
+				return false;
+			}
+
+			table[opcode] = descriptor;
+			return true;
+		}
+
+		bool Controller::validateCommand(const CommandDescriptor &descriptor, CommandContext &context)
+		{
+			UINT_8 statusCode = codes::generic::SUCCESSFUL_COMPLETION;
+			if (!descriptor.Handler)
+			{
+				statusCode = codes::generic::INVALID_COMMAND_OPCODE;
+			}
+			else if (descriptor.NeedsNamespace && !context.TheNamespace)
+			{
+				statusCode = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+			}
+			else if (descriptor.NeedsPrps && context.Command->DPTR.DPTR1 == 0)
+			{
+				statusCode = codes::generic::INVALID_FIELD_IN_COMMAND;
+			}
+			else if (descriptor.NeedsPrps && (context.Command->DPTR.DPTR1 & 0x3))
+			{
+				statusCode = codes::generic::PRP_OFFSET_INVALID; // Must be dword aligned
+			}
+
+			if (statusCode != codes::generic::SUCCESSFUL_COMPLETION)
+			{
+				context.Completion->SC = statusCode;
+				context.Completion->DNR = 1;
+				return false;
+			}
+			return true;
+		}
+
+		void Controller::identify(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize)
+		{
+			const void* identifyData = nullptr;
+			switch (command->DWord10 & 0xFF) // CNS
+			{
+			case constants::identify::CNS_NAMESPACE:
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				if (!theNamespace)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				identifyData = &theNamespace->getIdentifyData();
+				break;
+			}
+			case constants::identify::CNS_CONTROLLER:
+				identifyData = &IdentifyControllerData;
+				break;
+			case constants::identify::CNS_ACTIVE_NAMESPACE_ID_LIST:
+				if (command->NSID >= 0xFFFFFFFE)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				// The NSIDs greater than the one given, then zeros
+				identifyData = &*std::upper_bound(ActiveNamespaceIds.begin(), ActiveNamespaceIds.end() - ACTIVE_NAMESPACE_ID_LIST_ENTRIES, command->NSID);
+				break;
+			default:
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, IDENTIFY_DATA_SIZE, memoryPageSize);
+			prp.placeBufferInExistingPRPs((const BYTE*)identifyData, IDENTIFY_DATA_SIZE);
+		}
+
+		void Controller::buildIdentifyControllerData()
+		{
+			memset(&IdentifyControllerData, 0, sizeof(IdentifyControllerData));
+			pci::header::PCI_HEADER* pciHeader = PCIExpressRegisters->getPciExpressRegisters().PciHeader;
+			IdentifyControllerData.VID = pciHeader->ID.VID;
+			IdentifyControllerData.SSVID = pciHeader->SS.SSVID;
+			identify::setAsciiField(IdentifyControllerData.SN, sizeof(IdentifyControllerData.SN), "CNVME0000001");
+			identify::setAsciiField(IdentifyControllerData.MN, sizeof(IdentifyControllerData.MN), "cNVMe Simulated NVMe Controller");
+			identify::setAsciiField(IdentifyControllerData.FR, sizeof(IdentifyControllerData.FR), "1.0");
+			identify::setAsciiField(IdentifyControllerData.SUBNQN, sizeof(IdentifyControllerData.SUBNQN), "nqn.2017-01.cnvme:subsystem");
+			IdentifyControllerData.RAB = DEFAULT_ARBITRATION_BURST;
+			IdentifyControllerData.MDTS = 0; // PRPs of any length
+			IdentifyControllerData.CNTLID = 1;
+			memcpy(&IdentifyControllerData.VER, &ControllerRegisters->getControllerRegisters()->VS, sizeof(IdentifyControllerData.VER));
+			IdentifyControllerData.CTRATT = (1 << 2) | (1 << 5); // NVM Sets, Predictable Latency Mode
+			IdentifyControllerData.OAES = constants::async_events::CONFIGURATION_NAMESPACE_ATTRIBUTE_NOTICES;
+			IdentifyControllerData.OACS = (1 << 1) | (1 << 5); // Format NVM, Directives
+			IdentifyControllerData.AERL = ASYNC_EVENT_REQUEST_LIMIT - 1;
+			IdentifyControllerData.ACL = ABORT_COMMAND_LIMIT - 1;
+			IdentifyControllerData.ELPE = ERROR_LOG_ENTRIES - 1;
+			IdentifyControllerData.LPA = 1 << 2; // Extended data for Get Log Page (NUMDU and the offset)
+			IdentifyControllerData.WCTEMP = 343;
+			IdentifyControllerData.CCTEMP = 358;
+			IdentifyControllerData.SANICAP = 0x3; // Crypto Erase, Block Erase
+			IdentifyControllerData.NSETIDMAX = 0xFFFF; // Each namespace is its own NVM Set
+			IdentifyControllerData.SQES = 0x66; // 64 bytes
+			IdentifyControllerData.CQES = 0x44; // 16 bytes
+			IdentifyControllerData.NN = 0xFFFFFFFE; // Any NSID but the broadcast one
+			IdentifyControllerData.ONCS = (1 << 2) | (1 << 8); // Dataset Management, Copy
+			IdentifyControllerData.VWC = 0x7; // Present, and Flush takes the broadcast NSID
+			IdentifyControllerData.PSD[0].MP = 2500; // 25 W
+		}
+
+		void Controller::buildActiveNamespaceIds()
+		{
+			ActiveNamespaceIds.clear();
+			for (auto &theNamespace : Namespaces)
+			{
+				ActiveNamespaceIds.push_back(theNamespace.first); // Namespaces is ordered by NSID
+			}
+			ActiveNamespaceIds.resize(ActiveNamespaceIds.size() + ACTIVE_NAMESPACE_ID_LIST_ENTRIES, 0);
+		}
+
+		UINT_32 Controller::getCompletionQueueSpace(Queue &submissionQueue)
+		{
+			Queue* completionQueue = submissionQueue.getMappedQueue();
+			std::lock_guard<std::mutex> lock(completionQueue->getMutex());
+			return completionQueue->getFreeEntries();
+		}
+
+		bool Controller::admitCommand(UINT_16 submissionQueueId, NVME_COMMAND* command)
+		{
+			if (submissionQueueId == ADMIN_QUEUE_ID || !QosLimiter.isEnabled())
+			{
+				return true;
+			}
+
+			if (InFlight.get(submissionQueueId, command->DWord0Breakdown.CID) == IN_FLIGHT_ABORT_REQUESTED)
+			{
+				return true; // Only fetched to be completed, so it doesn't use up the limits
+			}
+
+			UINT_64 bytes = 0;
+			switch (command->DWord0Breakdown.OPC)
+			{
+			case constants::opcodes::nvm::READ:
+			case constants::opcodes::nvm::WRITE:
+			case constants::opcodes::zns::ZONE_APPEND:
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				if (theNamespace)
+				{
+					bytes = (UINT_64)getNumberOfLogicalBlocks(command) * theNamespace->getBlockSize();
+				}
+				break;
+			}
+			default:
+				break; // Nothing transferred (or, for Copy, nothing transferred from the host)
+			}
+			return QosLimiter.admit(submissionQueueId, command->NSID, bytes);
+		}
+
+		void Controller::processNvmCommand(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize, UINT_16 submissionQueueId,
+			pipeline::SubmissionQueueCounters &counters)
+		{
+			Namespace* theNamespace = getNamespace(command->NSID);
+			const CommandDescriptor &descriptor = (theNamespace && theNamespace->isZoned() ? ZonedNamespaceCommands : NvmCommands)[command->DWord0Breakdown.OPC];
+			CommandContext context = { command, &completionQueueEntry, memoryPageSize, submissionQueueId, theNamespace };
+			if (validateCommand(descriptor, context))
+			{
+				descriptor.Handler(context);
+			}
+
+			// What SMART / Health Information counts as host reads and writes
+			pipeline::COMMAND_KIND kind = pipeline::COMMAND_KIND_OTHER;
+			switch (command->DWord0Breakdown.OPC)
+			{
+			case constants::opcodes::nvm::READ:
+			case constants::opcodes::nvm::COMPARE:
+				kind = pipeline::COMMAND_KIND_READ;
+				break;
+			case constants::opcodes::nvm::WRITE:
+			case constants::opcodes::zns::ZONE_APPEND:
+				kind = pipeline::COMMAND_KIND_WRITE;
+				break;
+			}
+			UINT_64 bytes = (kind != pipeline::COMMAND_KIND_OTHER && theNamespace) ? ((UINT_64)(command->DWord12 & 0xFFFF) + 1) * theNamespace->getBlockSize() : 0;
+			counters.record(submissionQueueId, kind, bytes, completionQueueEntry.SCT, completionQueueEntry.SC);
+		}
+
+		std::vector<logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY> Controller::getSubmissionQueueStatistics() const
+		{
+			std::vector<logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY> entries;
+			for (UINT_32 submissionQueueId = 0; submissionQueueId < MAX_QUEUE_IDENTIFIER; submissionQueueId++)
+			{
+				logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY entry = { 0 };
+				entry.SQID = (UINT_16)submissionQueueId;
+				AdminCounters.addTo(entry);
+				for (const ExecutorWorker &worker : ExecutorWorkers)
+				{
+					worker.Counters.addTo(entry); // Stopped workers keep their counters
+				}
+
+				if (entry.RC || entry.WC || entry.OC)
+				{
+					entries.push_back(entry);
+				}
+			}
+			return entries;
+		}
+
+		logpages::SMART_HEALTH_INFORMATION_LOG Controller::getSmartHealthInformation()
+		{
+			logpages::SMART_HEALTH_INFORMATION_LOG log = { 0 };
+			log.CW = isTemperatureOutsideThresholds() ? constants::async_events::CONFIGURATION_TEMPERATURE_WARNING : 0;
+			log.CTEMP[0] = SMART_COMPOSITE_TEMPERATURE & 0xFF;
+			log.CTEMP[1] = SMART_COMPOSITE_TEMPERATURE >> 8;
+			log.AVSP = 100;
+			log.AVSPT = SMART_AVAILABLE_SPARE_THRESHOLD;
+
+			UINT_64 bytesRead = 0;
+			UINT_64 bytesWritten = 0;
+			for (const logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY &entry : getSubmissionQueueStatistics())
+			{
+				if (entry.SQID == 0)
+				{
+					continue; // Admin commands aren't host reads or writes, and their errors aren't media errors
+				}
+				bytesRead += entry.BR;
+				bytesWritten += entry.BW;
+				log.HRC[0] += entry.RC;
+				log.HWC[0] += entry.WC;
+				log.MEDERR[0] += entry.MEC;
+			}
+			log.DUR[0] = (bytesRead / 512 + 999) / 1000; // Thousands of 512 byte units, rounded up
+			log.DUW[0] = (bytesWritten / 512 + 999) / 1000;
+
+			// Busy is the time the execute stage spent on I/O commands
+			UINT_64 busyNanoseconds = 0;
+			for (const ExecutorWorker &worker : ExecutorWorkers)
+			{
+				busyNanoseconds += worker.Statistics.getStatistics(0).STNS;
+			}
+			log.CBT[0] = busyNanoseconds / 60000000000ull;
+			log.PWRC[0] = 1; // Created powered on, and never power cycled
+			log.POH[0] = std::chrono::duration_cast<std::chrono::hours>(std::chrono::steady_clock::now() - PowerOnTime).count();
+			log.NUMERR[0] = AsyncEvents.getErrorCount();
+			return log;
+		}
+
+		void Controller::getLogPage(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize)
+		{
+			UINT_8 logPageIdentifier = command->DWord10 & 0xFF;
+			UINT_32 numberOfDwords = ((command->DWord10 >> 16) | ((command->DWord11 & 0xFFFF) << 16)) + 1; // NUMDL / NUMDU, 0-based
+			UINT_64 logPageOffset = command->DWord12 | ((UINT_64)command->DWord13 << 32);
+
+			Payload logPayload;
+			switch (logPageIdentifier)
+			{
+			case constants::log_pages::PREDICTABLE_LATENCY_PER_NVM_SET:
+			{
+				Namespace* nvmSet = getNamespace(command->DWord11 >> 16); // LSI
+				if (!nvmSet)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				bool retainAsynchronousEvent = (command->DWord10 >> 15) & 1; // RAE
+				logpages::PREDICTABLE_LATENCY_PER_NVM_SET_LOG log = nvmSet->getPredictableLatency()->getLog(retainAsynchronousEvent);
+				logPayload = Payload((BYTE*)&log, sizeof(log));
+				break;
+			}
+			case constants::log_pages::PREDICTABLE_LATENCY_EVENT_AGGREGATE:
+			{
+				std::vector<UINT_16> nvmSetIds;
+				for (auto &theNamespace : Namespaces)
+				{
+					if (theNamespace.first <= 0xFFFF && theNamespace.second->getPredictableLatency()->hasEvents())
+					{
+						nvmSetIds.push_back((UINT_16)theNamespace.first);
+					}
+				}
+
+				logpages::PREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG header = { 0 };
+				header.NE = nvmSetIds.size();
+				logPayload = Payload((UINT_32)(sizeof(header) + nvmSetIds.size() * sizeof(UINT_16)));
+				memcpy(logPayload.getBuffer(), &header, sizeof(header));
+				if (!nvmSetIds.empty())
+				{
+					memcpy(logPayload.getBuffer() + sizeof(header), nvmSetIds.data(), nvmSetIds.size() * sizeof(UINT_16));
+				}
+				break;
+			}
+			case constants::log_pages::SANITIZE_STATUS:
+				logPayload = Payload((BYTE*)&SanitizeStatus, sizeof(SanitizeStatus));
+				break;
+			case constants::log_pages::FTL_STATISTICS:
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				media::FtlMedia* ftlMedia = theNamespace ? dynamic_cast<media::FtlMedia*>(theNamespace->getBackingMedia()) : nullptr;
+				if (!ftlMedia)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Only FTL backed namespaces have this log
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				logpages::FTL_STATISTICS_LOG statistics = ftlMedia->getStatistics();
+				logPayload = Payload((BYTE*)&statistics, sizeof(statistics));
+				break;
+			}
+			case constants::log_pages::READ_CACHE_STATISTICS:
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				if (!theNamespace)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				logpages::READ_CACHE_STATISTICS_LOG statistics = theNamespace->getReadCache()->getStatistics();
+				logPayload = Payload((BYTE*)&statistics, sizeof(statistics));
+				break;
+			}
+			case constants::log_pages::DEDUP_STATISTICS:
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				media::DedupMedia* dedupMedia = theNamespace ? dynamic_cast<media::DedupMedia*>(theNamespace->getBackingMedia()) : nullptr;
+				if (!dedupMedia)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Only deduplicating namespaces have this log
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				logpages::DEDUP_STATISTICS_LOG statistics = dedupMedia->getStatistics();
+				logPayload = Payload((BYTE*)&statistics, sizeof(statistics));
+				break;
+			}
+			case constants::log_pages::TIERING_STATISTICS:
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				media::TieredMedia* tieredMedia = theNamespace ? dynamic_cast<media::TieredMedia*>(theNamespace->getBackingMedia()) : nullptr;
+				if (!tieredMedia)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Only tiered namespaces have this log
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				logpages::TIERING_STATISTICS_LOG statistics = tieredMedia->getStatistics();
+				logPayload = Payload((BYTE*)&statistics, sizeof(statistics));
+				break;
+			}
+			case constants::log_pages::STREAM_STATISTICS:
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				media::FtlMedia* ftlMedia = theNamespace ? dynamic_cast<media::FtlMedia*>(theNamespace->getBackingMedia()) : nullptr;
+				if (!ftlMedia)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Only FTL backed namespaces have this log
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				logpages::STREAM_STATISTICS_LOG statistics = ftlMedia->getStreamStatistics();
+				logPayload = Payload((BYTE*)&statistics, sizeof(statistics));
+				break;
+			}
+			case constants::log_pages::QOS_STATISTICS:
+			{
+				std::vector<logpages::QOS_STATISTICS_ENTRY> entries = QosLimiter.getStatistics();
+				logpages::QOS_STATISTICS_LOG header = { 0 };
+				header.NE = (UINT_32)entries.size();
+				header.BMS = QOS_BURST_MS;
+
+				logPayload = Payload((UINT_32)(sizeof(header) + entries.size() * sizeof(logpages::QOS_STATISTICS_ENTRY)));
+				memcpy(logPayload.getBuffer(), &header, sizeof(header));
+				if (!entries.empty())
+				{
+					memcpy(logPayload.getBuffer() + sizeof(header), entries.data(), entries.size() * sizeof(logpages::QOS_STATISTICS_ENTRY));
+				}
+				break;
+			}
+			case constants::log_pages::PIPELINE_STATISTICS:
+			{
+				logpages::PIPELINE_STATISTICS_LOG statistics = { 0 };
+				statistics.NS = PIPELINE_STAGES;
+				statistics.STG[PIPELINE_STAGE_FETCH] = StageStatistics[PIPELINE_STAGE_FETCH].getStatistics(0);
+				for (auto &worker : ExecutorWorkers)
+				{
+					worker.Statistics.addTo(statistics.STG[PIPELINE_STAGE_EXECUTE]); // Including retired workers, so the counts never go backwards
+				}
+				statistics.STG[PIPELINE_STAGE_EXECUTE].ICAP = PIPELINE_RING_ENTRIES; // Each worker's inbox
+				statistics.STG[PIPELINE_STAGE_COMPLETE] = StageStatistics[PIPELINE_STAGE_COMPLETE].getStatistics(PIPELINE_RING_ENTRIES);
+				logPayload = Payload((BYTE*)&statistics, sizeof(statistics));
+				break;
+			}
+			case constants::log_pages::ERROR_INFORMATION:
+			{
+				std::vector<logpages::ERROR_INFORMATION_ENTRY> entries = AsyncEvents.getErrorLog();
+				logPayload = Payload((BYTE*)entries.data(), (UINT_32)(entries.size() * sizeof(logpages::ERROR_INFORMATION_ENTRY)));
+				break;
+			}
+			case constants::log_pages::CHANGED_NAMESPACE_LIST:
+			{
+				logpages::CHANGED_NAMESPACE_LIST_LOG log = AsyncEvents.getChangedNamespaceList();
+				logPayload = Payload((BYTE*)&log, sizeof(log));
+				break;
+			}
+			case constants::log_pages::SMART_HEALTH_INFORMATION:
+			{
+				if (command->NSID != 0 && command->NSID != NAMESPACE_ID_ALL)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Only kept for the whole controller (LPA bit 0 is clear)
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				logpages::SMART_HEALTH_INFORMATION_LOG log = getSmartHealthInformation();
+				logPayload = Payload((BYTE*)&log, sizeof(log));
+				break;
+			}
+			case constants::log_pages::SUBMISSION_QUEUE_STATISTICS:
+			{
+				std::vector<logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY> entries = getSubmissionQueueStatistics();
+				logpages::SUBMISSION_QUEUE_STATISTICS_LOG header = { 0 };
+				header.NE = (UINT_32)entries.size();
+
+				logPayload = Payload((UINT_32)(sizeof(header) + entries.size() * sizeof(logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY)));
+				memcpy(logPayload.getBuffer(), &header, sizeof(header));
+				if (!entries.empty())
+				{
+					memcpy(logPayload.getBuffer() + sizeof(header), entries.data(), entries.size() * sizeof(logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY));
+				}
+				break;
+			}
+			case constants::log_pages::EXECUTOR_STATISTICS:
+			{
+				logpages::EXECUTOR_STATISTICS_LOG statistics = { 0 };
+				statistics.NW = NumberOfExecutorWorkers;
+				for (UINT_32 i = 0; i < EXECUTOR_MAX_WORKERS; i++)
+				{
+					statistics.WRK[i].CMDS = ExecutorWorkers[i].Statistics.getStatistics(0).CMDS;
+					statistics.WRK[i].STLS = ExecutorWorkers[i].Steals;
+					statistics.WRK[i].STLN = ExecutorWorkers[i].Stolen;
+				}
+				logPayload = Payload((BYTE*)&statistics, sizeof(statistics));
+				break;
+			}
+			default:
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_LOG_PAGE;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (logPageOffset % sizeof(UINT_32) != 0 || logPageOffset >= logPayload.getSize() || (UINT_64)numberOfDwords * sizeof(UINT_32) > MAX_LOG_PAGE_TRANSFER_SIZE)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			// Anything asked for past the end of the log reads as zero
+			Payload transferPayload(numberOfDwords * sizeof(UINT_32));
+			memcpy(transferPayload.getBuffer(), logPayload.getBuffer() + logPageOffset, std::min<size_t>(transferPayload.getSize(), (size_t)(logPayload.getSize() - logPageOffset)));
+
+			PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, transferPayload.getSize(), memoryPageSize);
+			prp.placePayloadInExistingPRPs(transferPayload);
+
+			AsyncEvents.logPageRead(logPageIdentifier, (command->DWord10 >> 15) & 1); // RAE
+		}
+
+		void Controller::setFeatures(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_8 featureIdentifier = command->DWord10 & 0xFF;
+			bool save = (command->DWord10 >> 31) & 1;
+
+			if (save)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::FEATURE_IDENTIFIER_NOT_SAVEABLE;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			switch (featureIdentifier)
+			{
+			case constants::features::ARBITRATION:
+				Arbitration = command->DWord11; // Takes effect from the next burst
+				break;
+			case constants::features::TEMPERATURE_THRESHOLD:
+			{
+				UINT_8 thresholdSensor = (command->DWord11 >> 16) & 0xF; // TMPSEL
+				UINT_8 thresholdType = (command->DWord11 >> 20) & 0x3; // THSEL
+				if (thresholdSensor != 0 || thresholdType > 1)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // There's only the composite temperature
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+
+				bool wasOutside = isTemperatureOutsideThresholds();
+				(thresholdType == 0 ? OverTemperatureThreshold : UnderTemperatureThreshold) = command->DWord11 & 0xFFFF;
+				if (!wasOutside && isTemperatureOutsideThresholds() && (AsyncEventConfiguration & constants::async_events::CONFIGURATION_TEMPERATURE_WARNING))
+				{
+					raiseAsyncEvent(constants::async_events::TYPE_SMART_HEALTH_STATUS, constants::async_events::SMART_TEMPERATURE_THRESHOLD, constants::log_pages::SMART_HEALTH_INFORMATION);
+				}
+				break;
+			}
+			case constants::features::ASYNCHRONOUS_EVENT_CONFIGURATION:
+				AsyncEventConfiguration = command->DWord11 & (constants::async_events::CONFIGURATION_TEMPERATURE_WARNING | constants::async_events::CONFIGURATION_NAMESPACE_ATTRIBUTE_NOTICES);
+				break;
+			case constants::features::EXECUTOR_WORKERS:
+				if (command->DWord11 == 0 || command->DWord11 > EXECUTOR_MAX_WORKERS)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+
+				// A synchronization point, so the pipeline is drained and nothing is left in the workers
+				setExecutorWorkers(command->DWord11);
+				break;
+			case constants::features::VOLATILE_WRITE_CACHE:
+				VolatileWriteCacheEnabled = command->DWord11 & 1;
+				for (auto &theNamespace : Namespaces)
+				{
+					theNamespace.second->getWriteCache()->setEnabled(VolatileWriteCacheEnabled); // Disabling writes back first
+				}
+				break;
+			case constants::features::READ_CACHE:
+				ReadCacheEnabled = command->DWord11 & 1;
+				for (auto &theNamespace : Namespaces)
+				{
+					theNamespace.second->getReadCache()->setEnabled(ReadCacheEnabled); // Disabling drops every line
+				}
+				break;
+			case constants::features::PREDICTABLE_LATENCY_MODE_CONFIG:
+			case constants::features::PREDICTABLE_LATENCY_MODE_WINDOW:
+			{
+				Namespace* nvmSet = getNamespace(command->DWord11 & 0xFFFF); // Each namespace is its own NVM Set
+				if (!nvmSet)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+
+				if (featureIdentifier == constants::features::PREDICTABLE_LATENCY_MODE_CONFIG)
+				{
+					nvmSet->getPredictableLatency()->setEnabled(command->DWord12 & 1); // LPE
+					break;
+				}
+
+				UINT_8 window = command->DWord12 & 0x7; // WSEL
+				if (window != constants::predictable_latency::WINDOW_DETERMINISTIC && window != constants::predictable_latency::WINDOW_NON_DETERMINISTIC)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+				}
+				else if (!nvmSet->getPredictableLatency()->requestWindow(window))
+				{
+					completionQueueEntry.SC = codes::generic::COMMAND_SEQUENCE_ERROR; // Not enabled, or NDWIN hasn't lasted its minimum time
+				}
+				break;
+			}
+			case constants::features::QOS_LIMITS:
+			{
+				UINT_64 iops = command->DWord12;
+				UINT_64 bytesPerSecond = (UINT_64)command->DWord13 * 1024;
+				if (command->NSID == 0)
+				{
+					UINT_16 submissionQueueId = command->DWord11 & 0xFFFF;
+					if (submissionQueueId == ADMIN_QUEUE_ID || submissionQueueId > MAX_QUEUE_IDENTIFIER)
+					{
+						completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Admin commands are never limited
+						completionQueueEntry.DNR = 1;
+						return;
+					}
+					QosLimiter.setSubmissionQueueLimits(submissionQueueId, iops, bytesPerSecond);
+				}
+				else if (command->NSID == NAMESPACE_ID_ALL)
+				{
+					for (auto &theNamespace : Namespaces)
+					{
+						QosLimiter.setNamespaceLimits(theNamespace.first, iops, bytesPerSecond);
+					}
+				}
+				else if (getNamespace(command->NSID))
+				{
+					QosLimiter.setNamespaceLimits(command->NSID, iops, bytesPerSecond);
+				}
+				else
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+					completionQueueEntry.DNR = 1;
+				}
+				break;
+			}
+			default:
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+			}
+		}
+
+		void Controller::getFeatures(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_8 featureIdentifier = command->DWord10 & 0xFF;
+			UINT_8 select = (command->DWord10 >> 8) & 0x7;
+
+			switch (featureIdentifier)
+			{
+			case constants::features::ARBITRATION:
+			case constants::features::EXECUTOR_WORKERS:
+				if (select == constants::features::SELECT_CURRENT)
+				{
+					completionQueueEntry.DWord0 = featureIdentifier == constants::features::ARBITRATION ? Arbitration : NumberOfExecutorWorkers;
+				}
+				else if (select == constants::features::SELECT_SUPPORTED_CAPABILITIES)
+				{
+					completionQueueEntry.DWord0 = 1 << 2; // Changeable, not saveable, not namespace specific
+				}
+				else if (select == constants::features::SELECT_DEFAULT || select == constants::features::SELECT_SAVED)
+				{
+					completionQueueEntry.DWord0 = featureIdentifier == constants::features::ARBITRATION ? DEFAULT_ARBITRATION_BURST : DEFAULT_EXECUTOR_WORKERS;
+				}
+				else
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+				}
+				break;
+			case constants::features::TEMPERATURE_THRESHOLD:
+			case constants::features::ASYNCHRONOUS_EVENT_CONFIGURATION:
+			{
+				bool underThreshold = ((command->DWord11 >> 20) & 0x3) == 1; // THSEL
+				if (select == constants::features::SELECT_CURRENT)
+				{
+					completionQueueEntry.DWord0 = featureIdentifier == constants::features::ASYNCHRONOUS_EVENT_CONFIGURATION ? AsyncEventConfiguration.load() :
+						underThreshold ? UnderTemperatureThreshold : OverTemperatureThreshold;
+				}
+				else if (select == constants::features::SELECT_SUPPORTED_CAPABILITIES)
+				{
+					completionQueueEntry.DWord0 = 1 << 2; // Changeable, not saveable, not namespace specific
+				}
+				else if (select == constants::features::SELECT_DEFAULT || select == constants::features::SELECT_SAVED)
+				{
+					completionQueueEntry.DWord0 = featureIdentifier == constants::features::ASYNCHRONOUS_EVENT_CONFIGURATION ? 0 :
+						underThreshold ? 0 : IdentifyControllerData.WCTEMP;
+				}
+				else
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+				}
+				break;
+			}
+			case constants::features::VOLATILE_WRITE_CACHE:
+			case constants::features::READ_CACHE:
+				if (select == constants::features::SELECT_CURRENT)
+				{
+					completionQueueEntry.DWord0 = featureIdentifier == constants::features::VOLATILE_WRITE_CACHE ? VolatileWriteCacheEnabled : ReadCacheEnabled;
+				}
+				else if (select == constants::features::SELECT_SUPPORTED_CAPABILITIES)
+				{
+					completionQueueEntry.DWord0 = 1 << 2; // Changeable, not saveable, not namespace specific
+				}
+				else if (select == constants::features::SELECT_DEFAULT || select == constants::features::SELECT_SAVED)
+				{
+					completionQueueEntry.DWord0 = 0; // Off until the host turns it on
+				}
+				else
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+				}
+				break;
+			case constants::features::PREDICTABLE_LATENCY_MODE_CONFIG:
+			case constants::features::PREDICTABLE_LATENCY_MODE_WINDOW:
+			{
+				Namespace* nvmSet = getNamespace(command->DWord11 & 0xFFFF);
+				if (!nvmSet)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+				}
+				else if (select == constants::features::SELECT_CURRENT)
+				{
+					plm::PredictableLatency* predictableLatency = nvmSet->getPredictableLatency();
+					completionQueueEntry.DWord0 = featureIdentifier == constants::features::PREDICTABLE_LATENCY_MODE_CONFIG ?
+						predictableLatency->isEnabled() : predictableLatency->getWindow();
+				}
+				else if (select == constants::features::SELECT_SUPPORTED_CAPABILITIES)
+				{
+					completionQueueEntry.DWord0 = 1 << 2; // Changeable, not saveable, not namespace specific (it's per NVM Set)
+				}
+				else if (select == constants::features::SELECT_DEFAULT || select == constants::features::SELECT_SAVED)
+				{
+					completionQueueEntry.DWord0 = 0; // Disabled (no window) until the host enables it
+				}
+				else
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntry.DNR = 1;
+				}
+				break;
+			}
+			default:
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+			}
+		}
+
+		void Controller::formatNvm(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_8 lbaFormat = command->DWord10 & 0xF;
+			bool metadataSettings = (command->DWord10 >> 4) & 1;
+			UINT_8 protectionInformation = (command->DWord10 >> 5) & 0x7;
+			UINT_8 secureEraseSettings = (command->DWord10 >> 9) & 0x7;
+
+			if (lbaFormat != 0 || metadataSettings || protectionInformation)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_FORMAT;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (secureEraseSettings > constants::format_nvm::SES_CRYPTOGRAPHIC_ERASE)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			// Every setting erases the same way: once formatted, nothing written before can be read back
+			bool formatted = true;
+			if (command->NSID == NAMESPACE_ID_ALL)
+			{
+				for (auto &theNamespace : Namespaces)
+				{
+					formatted &= theNamespace.second->format();
+				}
+			}
+			else
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				if (!theNamespace)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				formatted = theNamespace->format();
+			}
+
+			if (!formatted)
+			{
+				completionQueueEntry.SC = codes::generic::INTERNAL_ERROR;
+			}
+		}
+
+		void Controller::sanitize(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_8 sanitizeAction = command->DWord10 & 0x7;
+
+			switch (sanitizeAction)
+			{
+			case constants::sanitize::EXIT_FAILURE_MODE:
+				return; // A sanitize here never fails, so there is no failure mode to leave
+			case constants::sanitize::BLOCK_ERASE:
+			case constants::sanitize::CRYPTO_ERASE:
+			{
+				// Both leave the old data unrecoverable. Here that is the same generation bump as Format NVM.
+				bool sanitized = true;
+				for (auto &theNamespace : Namespaces)
+				{
+					sanitized &= theNamespace.second->format();
+				}
+
+				SanitizeStatus.SPROG = 0xFFFF;
+				SanitizeStatus.SOS = sanitized ? constants::sanitize::STATUS_COMPLETED : constants::sanitize::STATUS_FAILED;
+				SanitizeStatus.SCDW10 = command->DWord10;
+				if (!sanitized)
+				{
+					completionQueueEntry.SC = codes::generic::INTERNAL_ERROR;
+				}
+				break;
+			}
+			default:
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Overwrite isn't supported
+				completionQueueEntry.DNR = 1;
+			}
+		}
+
+		void Controller::directiveSend(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_8 directiveOperation = command->DWord11 & 0xFF; // DOPER
+			UINT_8 directiveType = (command->DWord11 >> 8) & 0xFF; // DTYPE
+			UINT_16 directiveSpecific = command->DWord11 >> 16; // DSPEC
+
+			Namespace* theNamespace = getNamespace(command->NSID);
+			if (!theNamespace)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			directives::Streams* streams = theNamespace->getStreams();
+			if (directiveType == constants::directives::TYPE_IDENTIFY && directiveOperation == constants::directives::IDENTIFY_ENABLE_DIRECTIVE)
+			{
+				bool enable = command->DWord12 & 1; // ENDIR
+				UINT_8 targetType = (command->DWord12 >> 8) & 0xFF; // TDTYPE
+				if (targetType != constants::directives::TYPE_STREAMS)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Identify is always enabled. Nothing else exists.
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				streams->setEnabled(enable);
+				return;
+			}
+
+			if (directiveType == constants::directives::TYPE_STREAMS && streams->isEnabled())
+			{
+				switch (directiveOperation)
+				{
+				case constants::directives::STREAMS_RELEASE_IDENTIFIER:
+					streams->release(directiveSpecific);
+					return;
+				case constants::directives::STREAMS_RELEASE_RESOURCES:
+					streams->releaseResources();
+					return;
+				}
+			}
+
+			completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+			completionQueueEntry.DNR = 1;
+		}
+
+		void Controller::directiveReceive(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize)
+		{
+			UINT_64 numberOfBytes = ((UINT_64)command->DWord10 + 1) * sizeof(UINT_32); // NUMD, 0-based
+			UINT_8 directiveOperation = command->DWord11 & 0xFF; // DOPER
+			UINT_8 directiveType = (command->DWord11 >> 8) & 0xFF; // DTYPE
+
+			Namespace* theNamespace = getNamespace(command->NSID);
+			if (!theNamespace)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			directives::Streams* streams = theNamespace->getStreams();
+			Payload dataPayload;
+			if (directiveType == constants::directives::TYPE_IDENTIFY && directiveOperation == constants::directives::IDENTIFY_RETURN_PARAMETERS)
+			{
+				directives::IDENTIFY_RETURN_PARAMETERS parameters = { 0 };
+				parameters.DS[0] = (1 << constants::directives::TYPE_IDENTIFY) | (1 << constants::directives::TYPE_STREAMS);
+				parameters.DE[0] = (1 << constants::directives::TYPE_IDENTIFY) | (streams->isEnabled() ? 1 << constants::directives::TYPE_STREAMS : 0);
+				dataPayload = Payload((BYTE*)&parameters, sizeof(parameters));
+			}
+			else if (directiveType == constants::directives::TYPE_STREAMS && streams->isEnabled() && directiveOperation == constants::directives::STREAMS_RETURN_PARAMETERS)
+			{
+				directives::STREAMS_RETURN_PARAMETERS parameters = { 0 };
+				parameters.MSL = STREAMS_MAX_STREAMS;
+				parameters.NSSA = (UINT_16)(STREAMS_MAX_STREAMS - getStreamsAllocatedToOtherNamespaces(nullptr));
+				for (auto &otherNamespace : Namespaces)
+				{
+					parameters.NSSO += (UINT_16)otherNamespace.second->getStreams()->getOpenStreams().size();
+				}
+				parameters.SWS = STREAMS_WRITE_SIZE;
+				parameters.SGS = STREAMS_GRANULARITY_SIZE;
+				parameters.NSA = streams->getAllocatedStreams();
+				parameters.NSO = (UINT_16)streams->getOpenStreams().size();
+				dataPayload = Payload((BYTE*)&parameters, sizeof(parameters));
+			}
+			else if (directiveType == constants::directives::TYPE_STREAMS && streams->isEnabled() && directiveOperation == constants::directives::STREAMS_GET_STATUS)
+			{
+				// Open Stream Count, then each open stream identifier
+				std::vector<UINT_16> openStreams = streams->getOpenStreams();
+				openStreams.insert(openStreams.begin(), (UINT_16)openStreams.size());
+				dataPayload = Payload((BYTE*)openStreams.data(), openStreams.size() * sizeof(UINT_16));
+			}
+			else if (directiveType == constants::directives::TYPE_STREAMS && streams->isEnabled() && directiveOperation == constants::directives::STREAMS_ALLOCATE_RESOURCES)
+			{
+				// Whatever was allocated before goes back to the pool first. No data is transferred.
+				UINT_32 requestedStreams = command->DWord12 & 0xFFFF; // NSR
+				UINT_32 availableStreams = STREAMS_MAX_STREAMS - getStreamsAllocatedToOtherNamespaces(theNamespace);
+				UINT_16 allocatedStreams = (UINT_16)std::min(requestedStreams, availableStreams);
+				streams->setAllocatedStreams(allocatedStreams);
+				completionQueueEntry.DWord0 = allocatedStreams; // NSA
+				return;
+			}
+			else
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			// Only as much as the host asked for (and no more than there is) crosses the PRPs
+			Payload transferPayload(dataPayload.getBuffer(), (UINT_32)std::min<UINT_64>(numberOfBytes, dataPayload.getSize()));
+			PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, transferPayload.getSize(), memoryPageSize);
+			prp.placePayloadInExistingPRPs(transferPayload);
+		}
+
+		UINT_32 Controller::getStreamsAllocatedToOtherNamespaces(Namespace* theNamespace)
+		{
+			UINT_32 allocatedStreams = 0;
+			for (auto &otherNamespace : Namespaces)
+			{
+				if (otherNamespace.second.get() != theNamespace)
+				{
+					allocatedStreams += otherNamespace.second->getStreams()->getAllocatedStreams();
+				}
+			}
+			return allocatedStreams;
+		}
+
+		void Controller::createIoCompletionQueue(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_16 queueId = command->DWord10 & 0xFFFF;
+			UINT_32 queueSize = (command->DWord10 >> 16) + 1; // 0-based
+			bool physicallyContiguous = command->DWord11 & 1;
+
+			if (queueId == ADMIN_QUEUE_ID || queueId > MAX_QUEUE_IDENTIFIER || getQueueWithId(ValidCompletionQueues, queueId, false))
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_QUEUE_IDENTIFIER;
+			}
+			else if (queueSize < 2 || queueSize > (UINT_32)ControllerRegisters->getControllerRegisters()->CAP.MQES + 1)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_QUEUE_SIZE;
+			}
+			else if (!physicallyContiguous || command->DPTR.DPTR1 == 0)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // CAP.CQR is 1
+			}
+			else
+			{
+				controller::registers::QUEUE_DOORBELLS* doorbells = ControllerRegisters->getQueueDoorbells();
+				doorbells[queueId].CQHDBL.CQH = 0; // Don't mistake a head left behind by an old queue with this ID for consumed entries
+				ValidCompletionQueues.push_back(Queue(queueSize, queueId, &doorbells[queueId].CQHDBL.CQH, command->DPTR.DPTR1));
+				LOG_INFO("Created I/O completion queue " + std::to_string(queueId) + " with " + std::to_string(queueSize) + " entries.");
+				return;
+			}
+
+			completionQueueEntry.DNR = 1;
+		}
+
+		void Controller::createIoSubmissionQueue(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_16 queueId = command->DWord10 & 0xFFFF;
+			UINT_32 queueSize = (command->DWord10 >> 16) + 1; // 0-based
+			bool physicallyContiguous = command->DWord11 & 1;
+			UINT_16 completionQueueId = command->DWord11 >> 16;
+			Queue* completionQueue = getQueueWithId(ValidCompletionQueues, completionQueueId, false);
+
+			if (queueId == ADMIN_QUEUE_ID || queueId > MAX_QUEUE_IDENTIFIER || getQueueWithId(ValidSubmissionQueues, queueId, false))
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_QUEUE_IDENTIFIER;
+			}
+			else if (completionQueueId == ADMIN_QUEUE_ID || !completionQueue)
+			{
+				// Any number of I/O SQs can share an I/O CQ, but the admin CQ is only for the admin SQ
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::COMPLETION_QUEUE_INVALID;
+			}
+			else if (queueSize < 2 || queueSize > (UINT_32)ControllerRegisters->getControllerRegisters()->CAP.MQES + 1)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_QUEUE_SIZE;
+			}
+			else if (!physicallyContiguous || command->DPTR.DPTR1 == 0)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // CAP.CQR is 1
+			}
+			else
+			{
+				controller::registers::QUEUE_DOORBELLS* doorbells = ControllerRegisters->getQueueDoorbells();
+				ValidSubmissionQueues.push_back(Queue(queueSize, queueId, &doorbells[queueId].SQTDBL.SQT, command->DPTR.DPTR1));
+				Queue* submissionQueue = &ValidSubmissionQueues.back();
+				submissionQueue->setMappedQueue(completionQueue); // Map SQ -> CQ
+				InFlight.resetQueue(queueId);
+				LOG_INFO("Created I/O submission queue " + std::to_string(queueId) + " with " + std::to_string(queueSize) + " entries, mapped to CQ " + std::to_string(completionQueueId) + ".");
+				return;
+			}
+
+			completionQueueEntry.DNR = 1;
+		}
+
+		void Controller::deleteIoCompletionQueue(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_16 queueId = command->DWord10 & 0xFFFF;
+			Queue* completionQueue = getQueueWithId(ValidCompletionQueues, queueId, false);
+
+			if (queueId == ADMIN_QUEUE_ID || !completionQueue)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_QUEUE_IDENTIFIER;
+			}
+			else if (std::any_of(ValidSubmissionQueues.begin(), ValidSubmissionQueues.end(), [&](Queue &q) {return q.getMappedQueue() == completionQueue; }))
+			{
+				// Every SQ using it has to be deleted first
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_QUEUE_DELETION;
+			}
+			else
+			{
+				ValidCompletionQueues.remove_if([&](const Queue &q) {return q.getQueueId() == queueId; });
+				return;
+			}
+
+			completionQueueEntry.DNR = 1;
+		}
+
+		void Controller::deleteIoSubmissionQueue(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_16 queueId = command->DWord10 & 0xFFFF;
+			Queue* submissionQueue = getQueueWithId(ValidSubmissionQueues, queueId, false);
+
+			if (queueId == ADMIN_QUEUE_ID || !submissionQueue)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::INVALID_QUEUE_IDENTIFIER;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			ValidSubmissionQueues.remove_if([&](const Queue &q) {return q.getQueueId() == queueId; });
+			QosLimiter.unpark(queueId); // Its commands are gone
+			std::lock_guard<std::mutex> lock(CommandIdentifiersMutex);
+			SubmissionQueueIdToCommandIdentifiers.erase(queueId);
+		}
+
+		void Controller::readOrWrite(NVME_COMMAND* command, Namespace &theNamespace, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize, UINT_16 submissionQueueId)
+		{
+			UINT_64 startingLba = getStartingLba(command);
+			UINT_32 numberOfBlocks = getNumberOfLogicalBlocks(command);
+
+			if (!theNamespace.isValidRange(startingLba, numberOfBlocks))
+			{
+				completionQueueEntry.SC = codes::generic::LBA_OUT_OF_RANGE;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, numberOfBlocks * theNamespace.getBlockSize(), memoryPageSize);
+			if (command->DWord0Breakdown.OPC == constants::opcodes::nvm::READ)
+			{
+				Payload transferPayload(prp.getNumBytes());
+				theNamespace.getPredictableLatency()->countRead(prp.getNumBytes());
+				if (!theNamespace.getReadCache()->read(submissionQueueId, startingLba, numberOfBlocks, transferPayload.getBuffer()))
+				{
+					completionQueueEntry.SCT = types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = codes::integrity::UNRECOVERED_READ_ERROR; // Nothing (stale or zeroed) goes to the host
+					return;
+				}
+				prp.placePayloadInExistingPRPs(transferPayload);
+				return;
+			}
+
+			// Streams directive: the media is told which stream the blocks belong to before they're written.
+			// Checked before the zone's write pointer is claimed, so a write failed for its directive can be retried as is.
+			UINT_16 streamId = 0;
+			if (getDirectiveType(command) == constants::directives::TYPE_STREAMS && theNamespace.getStreams()->isEnabled())
+			{
+				streamId = getDirectiveSpecific(command);
+			}
+			else if (getDirectiveType(command) != constants::directives::TYPE_IDENTIFY)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // Not a directive that applies to writes
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+			if (streamId)
+			{
+				theNamespace.getStreams()->open(streamId);
+			}
+
+			if (theNamespace.isZoned())
+			{
+				// Writes to a zoned namespace must land on the write pointer. Claiming it is the last check.
+				UINT_8 status = theNamespace.getZoneForLba(startingLba)->write(startingLba, numberOfBlocks);
+				if (status != codes::generic::SUCCESSFUL_COMPLETION)
+				{
+					completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+					completionQueueEntry.SC = status;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+			}
+
+			theNamespace.getBackingMedia()->setStream(startingLba, numberOfBlocks, streamId);
+
+			Payload transferPayload = prp.getPayloadCopy();
+			theNamespace.getPredictableLatency()->countWrite(prp.getNumBytes());
+			bool written = theNamespace.getMedia()->write(startingLba, numberOfBlocks, transferPayload.getBuffer());
+
+			// FUA: the data has to be durable before completing. A flush does that, and media that journals
+			//   group commits concurrent ones, so FUA writes don't each cost a sync.
+			if (written && isForceUnitAccess(command))
+			{
+				written = theNamespace.getMedia()->flush();
+			}
+
+			if (!written)
+			{
+				completionQueueEntry.SCT = types::MEDIA_AND_DATA_INTEGRITY;
+				completionQueueEntry.SC = codes::integrity::WRITE_FAULT;
+			}
+		}
+
+		void Controller::flush(NVME_COMMAND* command, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			bool flushed = true;
+			if (command->NSID == NAMESPACE_ID_ALL)
+			{
+				for (auto &theNamespace : Namespaces)
+				{
+					flushed &= theNamespace.second->getMedia()->flush();
+				}
+			}
+			else
+			{
+				Namespace* theNamespace = getNamespace(command->NSID);
+				if (!theNamespace)
+				{
+					completionQueueEntry.SC = codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				flushed = theNamespace->getMedia()->flush();
+			}
+
+			if (!flushed)
+			{
+				completionQueueEntry.SCT = types::MEDIA_AND_DATA_INTEGRITY;
+				completionQueueEntry.SC = codes::integrity::WRITE_FAULT;
+			}
+		}
+
+		void Controller::copy(NVME_COMMAND* command, Namespace &theNamespace, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize)
+		{
+			UINT_64 destinationLba = getStartingLba(command);
+			UINT_32 numberOfRanges = (command->DWord12 & 0xFF) + 1; // 0-based
+			UINT_8 descriptorFormat = (command->DWord12 >> 8) & 0xF;
+
+			if (descriptorFormat != 0)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (numberOfRanges > COPY_MAX_SOURCE_RANGES)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::COMMAND_SIZE_LIMIT_EXCEEDED;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			// The descriptors are the only thing that crosses the PRPs
+			PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, numberOfRanges * sizeof(COPY_SOURCE_RANGE_DESCRIPTOR), memoryPageSize);
+			Payload descriptorPayload = prp.getPayloadCopy();
+			PCOPY_SOURCE_RANGE_DESCRIPTOR descriptors = (PCOPY_SOURCE_RANGE_DESCRIPTOR)descriptorPayload.getBuffer();
+
+			UINT_64 totalBlocks = 0;
+			for (UINT_32 i = 0; i < numberOfRanges; i++)
+			{
+				UINT_64 numberOfBlocks = (UINT_64)descriptors[i].NLB + 1; // 0-based
+				if (!theNamespace.isValidRange(descriptors[i].SLBA, numberOfBlocks))
+				{
+					completionQueueEntry.SC = codes::generic::LBA_OUT_OF_RANGE;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				if (numberOfBlocks > COPY_MAX_SINGLE_SOURCE_RANGE_LENGTH)
+				{
+					completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+					completionQueueEntry.SC = codes::specific::COMMAND_SIZE_LIMIT_EXCEEDED;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+				totalBlocks += numberOfBlocks;
+			}
+
+			if (totalBlocks > COPY_MAX_LENGTH)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = codes::specific::COMMAND_SIZE_LIMIT_EXCEEDED;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (!theNamespace.isValidRange(destinationLba, totalBlocks))
+			{
+				completionQueueEntry.SC = codes::generic::LBA_OUT_OF_RANGE;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (theNamespace.isZoned())
+			{
+				// Same rule as a write: the destination must be the write pointer of one zone
+				UINT_8 status = theNamespace.getZoneForLba(destinationLba)->write(destinationLba, (UINT_32)totalBlocks);
+				if (status != codes::generic::SUCCESSFUL_COMPLETION)
+				{
+					completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+					completionQueueEntry.SC = status;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+			}
+
+			for (UINT_32 i = 0; i < numberOfRanges; i++)
+			{
+				UINT_64 numberOfBlocks = (UINT_64)descriptors[i].NLB + 1;
+				if (!theNamespace.getMedia()->copy(descriptors[i].SLBA, destinationLba, numberOfBlocks))
+				{
+					completionQueueEntry.SCT = types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = codes::integrity::WRITE_FAULT;
+					return;
+				}
+				destinationLba += numberOfBlocks;
+			}
+		}
+
+		void Controller::datasetManagement(NVME_COMMAND* command, Namespace &theNamespace, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize)
+		{
+			UINT_32 numberOfRanges = (command->DWord10 & 0xFF) + 1; // 0-based
+			bool deallocate = (command->DWord11 & (1 << 2)) != 0; // AD
+
+			PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, numberOfRanges * sizeof(DATASET_MANAGEMENT_RANGE), memoryPageSize);
+			Payload rangePayload = prp.getPayloadCopy();
+			PDATASET_MANAGEMENT_RANGE ranges = (PDATASET_MANAGEMENT_RANGE)rangePayload.getBuffer();
+
+			// Check every range before acting on any
+			for (UINT_32 i = 0; i < numberOfRanges; i++)
+			{
+				if (!theNamespace.isValidRange(ranges[i].SLBA, ranges[i].NLB))
+				{
+					completionQueueEntry.SC = codes::generic::LBA_OUT_OF_RANGE;
+					completionQueueEntry.DNR = 1;
+					return;
+				}
+			}
+
+			for (UINT_32 i = 0; i < numberOfRanges; i++)
+			{
+				if (ranges[i].NLB == 0)
+				{
+					continue;
+				}
+
+				if (deallocate && !theNamespace.getMedia()->deallocate(ranges[i].SLBA, ranges[i].NLB))
+				{
+					completionQueueEntry.SCT = types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = codes::integrity::WRITE_FAULT;
+					return;
+				}
+
+				// Hints are advisory, so a media that can't act on one doesn't fail the command
+				theNamespace.getBackingMedia()->hint(ranges[i].SLBA, ranges[i].NLB, ranges[i].CATTR);
+			}
+		}
+
+		void Controller::zoneAppend(NVME_COMMAND* command, Namespace &theNamespace, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize)
+		{
+			UINT_64 zoneStartLba = getStartingLba(command);
+			UINT_32 numberOfBlocks = getNumberOfLogicalBlocks(command);
+
+			zns::Zone* zone = theNamespace.getZoneForLba(zoneStartLba);
+			if (!zone)
+			{
+				completionQueueEntry.SC = codes::generic::LBA_OUT_OF_RANGE;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (zone->getStartLba() != zoneStartLba)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // ZSLBA must be the start of a zone
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, numberOfBlocks * theNamespace.getBlockSize(), memoryPageSize);
+			Payload transferPayload = prp.getPayloadCopy();
+			theNamespace.getPredictableLatency()->countWrite(prp.getNumBytes());
+
+			UINT_64 assignedLba = 0;
+			UINT_8 status = theNamespace.zoneAppend(zone, numberOfBlocks, transferPayload.getBuffer(), assignedLba);
+			if (status != codes::generic::SUCCESSFUL_COMPLETION)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = status;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			completionQueueEntry.DWord0 = (UINT_32)assignedLba;
+			completionQueueEntry.DWord1 = (UINT_32)(assignedLba >> 32);
+		}
+
+		void Controller::zoneManagementSend(NVME_COMMAND* command, Namespace &theNamespace, COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_64 startingLba = getStartingLba(command);
+			UINT_8 action = command->DWord13 & 0xFF;
+			bool selectAll = (command->DWord13 >> 8) & 1;
+
+			if (action < zns::ZONE_SEND_ACTION_CLOSE || action > zns::ZONE_SEND_ACTION_OFFLINE)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (selectAll)
+			{
+				// Applies to every zone in a state the action makes sense for. Others are silently skipped.
+				for (UINT_64 i = 0; i < theNamespace.getNumberOfZones(); i++)
+				{
+					zns::Zone* zone = theNamespace.getZone(i);
+					UINT_8 state = zone->getState();
+					bool opened = state == zns::ZONE_STATE_IMPLICITLY_OPENED || state == zns::ZONE_STATE_EXPLICITLY_OPENED;
+					bool applies = false;
+					switch (action)
+					{
+					case zns::ZONE_SEND_ACTION_CLOSE:
+						applies = opened;
+						break;
+					case zns::ZONE_SEND_ACTION_FINISH:
+						applies = opened || state == zns::ZONE_STATE_CLOSED;
+						break;
+					case zns::ZONE_SEND_ACTION_OPEN:
+						applies = state == zns::ZONE_STATE_CLOSED;
+						break;
+					case zns::ZONE_SEND_ACTION_RESET:
+						applies = opened || state == zns::ZONE_STATE_CLOSED || state == zns::ZONE_STATE_FULL;
+						break;
+					case zns::ZONE_SEND_ACTION_OFFLINE:
+						applies = state == zns::ZONE_STATE_READ_ONLY;
+						break;
+					}
+
+					if (applies)
+					{
+						theNamespace.zoneAction(zone, action);
+					}
+				}
+				return;
+			}
+
+			zns::Zone* zone = theNamespace.getZoneForLba(startingLba);
+			if (!zone)
+			{
+				completionQueueEntry.SC = codes::generic::LBA_OUT_OF_RANGE;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (zone->getStartLba() != startingLba)
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND; // SLBA must be the start of a zone
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			UINT_8 status = theNamespace.zoneAction(zone, action);
+			if (status != codes::generic::SUCCESSFUL_COMPLETION)
+			{
+				completionQueueEntry.SCT = types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = status;
+				completionQueueEntry.DNR = 1;
+			}
+		}
+
+		void Controller::zoneManagementReceive(NVME_COMMAND* command, Namespace &theNamespace, COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize)
+		{
+			UINT_64 startingLba = getStartingLba(command);
+			UINT_32 numberOfBytes = (command->DWord12 + 1) * sizeof(UINT_32); // NUMD is 0-based dwords
+			UINT_8 action = command->DWord13 & 0xFF;
+			UINT_8 stateFilter = (command->DWord13 >> 8) & 0xFF; // 0 is all zones, otherwise 1 + the ZS-ordered state list
+			bool partialReport = (command->DWord13 >> 16) & 1;
+
+			if (action != zns::ZONE_RECEIVE_ACTION_REPORT_ZONES || stateFilter > 7 || numberOfBytes < sizeof(zns::REPORT_ZONES_HEADER))
+			{
+				completionQueueEntry.SC = codes::generic::INVALID_FIELD_IN_COMMAND;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			if (!theNamespace.getZoneForLba(startingLba))
+			{
+				completionQueueEntry.SC = codes::generic::LBA_OUT_OF_RANGE;
+				completionQueueEntry.DNR = 1;
+				return;
+			}
+
+			// ZRAS values map to these states, in order, starting at 1
+			const UINT_8 filterToState[] = { 0, zns::ZONE_STATE_EMPTY, zns::ZONE_STATE_IMPLICITLY_OPENED, zns::ZONE_STATE_EXPLICITLY_OPENED,
+				zns::ZONE_STATE_CLOSED, zns::ZONE_STATE_FULL, zns::ZONE_STATE_READ_ONLY, zns::ZONE_STATE_OFFLINE };
+
+			Payload transferPayload(numberOfBytes);
+			zns::REPORT_ZONES_HEADER* header = (zns::REPORT_ZONES_HEADER*)transferPayload.getBuffer();
+			zns::ZONE_DESCRIPTOR* descriptors = (zns::ZONE_DESCRIPTOR*)(transferPayload.getBuffer() + sizeof(zns::REPORT_ZONES_HEADER));
+			UINT_64 maxDescriptors = (numberOfBytes - sizeof(zns::REPORT_ZONES_HEADER)) / sizeof(zns::ZONE_DESCRIPTOR);
+			UINT_64 matchingZones = 0;
+
+			for (UINT_64 i = startingLba / theNamespace.getZoneSize(); i < theNamespace.getNumberOfZones(); i++)
+			{
+				zns::ZONE_DESCRIPTOR descriptor = theNamespace.getZone(i)->getDescriptor();
+				if (stateFilter != 0 && descriptor.ZS != filterToState[stateFilter])
+				{
+					continue;
+				}
+
+				if (matchingZones < maxDescriptors)
+				{
+					descriptors[matchingZones] = descriptor;
+				}
+				else if (partialReport)
+				{
+					break; // Only count what we returned
+				}
+				matchingZones++;
+			}
+
+			header->NZ = matchingZones;
+
+			PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, numberOfBytes, memoryPageSize);
+			prp.placePayloadInExistingPRPs(transferPayload);
+		}
+
+		Queue* Controller::getQueueWithId(std::list<Queue> &queues, UINT_16 id, bool logIfMissing)
+		{
+			for (Queue &queue : queues)
+			{
+				if (queue.getQueueId() == id)
+				{
+					return &queue;
+				}
+			}
+
+			if (logIfMissing)
+			{
+				LOG_ERROR("Invalid queue id specified: " + std::to_string(id));
+			}
+			return nullptr;
+		}
+
+		void Controller::postCompletion(Queue &submissionQueue, UINT_16 submissionQueueHead, COMPLETION_QUEUE_ENTRY completionEntry, NVME_COMMAND* command)
+		{
+			Queue &completionQueue = *submissionQueue.getMappedQueue();
+			std::lock_guard<std::mutex> lock(completionQueue.getMutex()); // Other SQs may be posting to the same CQ
+
+			COMPLETION_QUEUE_ENTRY* completionQueueList = (COMPLETION_QUEUE_ENTRY*)MEMORY_ADDRESS_TO_8POINTER(completionQueue.getMemoryAddress());
+			ASSERT_IF(completionQueueList == nullptr, "completionQueueList cannot be NULL");
+			ASSERT_IF(completionQueue.isFull(), "Completion queue " + std::to_string(completionQueue.getQueueId()) + " is full. Commands should have been held back.");
+			LOG_INFO("About to post completion to queue " + std::to_string(completionQueue.getQueueId()) + ". Head: " +
+				std::to_string(completionQueue.getHeadPointer()) + ". Tail (just before moving): " + std::to_string(completionQueue.getTailPointer()));
+
+			completionQueueList += completionQueue.getTailPointer(); // Move pointer to correct index
+
+			completionEntry.SQID = submissionQueue.getQueueId();
+			completionEntry.SQHD = submissionQueueHead;
+			completionEntry.CID = command->DWord0Breakdown.CID;
+			completionEntry.P = (UINT_16)completionQueue.getPhaseTag(); // Kept by the CQ, which flips it as the tail wraps
+
+			UINT_32 completionQueueMemorySize = completionQueue.getQueueMemorySize();
+			completionQueueMemorySize -= (completionQueue.getTailPointer() * sizeof(COMPLETION_QUEUE_ENTRY)); // calculate new remaining memory size
+			ASSERT_IF(completionQueueMemorySize < sizeof(COMPLETION_QUEUE_ENTRY), "completionQueueMemorySize must be greater than a single completion queue entry");
+			memcpy_s(completionQueueList, completionQueueMemorySize, &completionEntry, sizeof(completionEntry)); // Post
+			LOG_INFO(completionEntry.toString());
+
+			completionQueue.incrementTailPointer(); // Move up CQ tail. The host moves the head with the doorbell as it consumes.
+		}
+
+		bool Controller::isValidCommandIdentifier(UINT_16 commandId, UINT_16 submissionQueueId)
+		{
+			std::lock_guard<std::mutex> lock(CommandIdentifiersMutex);
+			if (SubmissionQueueIdToCommandIdentifiers.find(submissionQueueId) == SubmissionQueueIdToCommandIdentifiers.end())
+			{
+				// SQID hasn't been used yet?
+				std::set<UINT_16> tmp = { commandId };
+				SubmissionQueueIdToCommandIdentifiers[submissionQueueId] = tmp;
+				return true;
+			}
+			else
+			{
+				// Have SQID in SubmissionQueueIdToCommandIdentifiers
+				std::set<UINT_16> &thisSubqsCids = SubmissionQueueIdToCommandIdentifiers[submissionQueueId];
+
+				if (thisSubqsCids.size() == MAX_COMMAND_IDENTIFIER)
+				{
+					LOG_INFO("Made it to the end of possible CIDs for SubQ " + std::to_string(submissionQueueId) + ". Resetting possibile CIDs.");
+					thisSubqsCids.clear();
+				}
+
+				if (thisSubqsCids.find(commandId) == thisSubqsCids.end())
+				{
+					thisSubqsCids.insert(commandId);
+					return true;
+				}
+			}
+
+			LOG_ERROR("Invalid command identifier was sent (" + std::to_string(commandId) + "). Was it re-used?");
+			return false;
+		}
+
+		void Controller::controllerResetCallback()
+		{
+			LOG_INFO("Recv'd a controllerResetCallback request.");
+			std::lock_guard<std::mutex> lock(DataPathMutex);
+			drainPipeline(); // Commands in it point at the queues about to go
+
+			ValidSubmissionQueues.remove_if([](const Queue &q) {return q.getQueueId() != ADMIN_QUEUE_ID; });
+			ValidCompletionQueues.remove_if([](const Queue &q) {return q.getQueueId() != ADMIN_QUEUE_ID; });
+			QosLimiter.unparkAll();
+			AsyncEvents.reset(); // Outstanding requests end without completions (parked ones hold no reserved entries to give back)
+
+			// Clear the SubQ to CID listing.
+			std::lock_guard<std::mutex> commandIdentifiersLock(CommandIdentifiersMutex);
+			this->SubmissionQueueIdToCommandIdentifiers.clear();
+		}
+
+		bool Controller::addNamespace(Namespace* theNamespace)
+		{
+			// A synchronization point like an admin command that changes what I/O sees, and no admin command is running either:
+			//   workers, the fetch stage and the admin thread all look namespaces up
+			std::lock_guard<std::mutex> adminCommandLock(AdminCommandMutex);
+			DataPathSynchronizationRequested = true;
+			std::lock_guard<std::mutex> dataPathLock(DataPathMutex);
+			DataPathSynchronizationRequested = false;
+			drainPipeline();
+
+			UINT_32 namespaceId = theNamespace->getNamespaceId();
+			if (namespaceId == 0 || namespaceId == 0xFFFFFFFF || Namespaces.find(namespaceId) != Namespaces.end())
+			{
+				LOG_ERROR("Unable to add namespace with NSID " + std::to_string(namespaceId));
+				delete theNamespace;
+				return false;
+			}
+
+			Namespaces[namespaceId].reset(theNamespace);
+			theNamespace->getWriteCache()->setEnabled(VolatileWriteCacheEnabled);
+			theNamespace->getReadCache()->setEnabled(ReadCacheEnabled);
+			buildActiveNamespaceIds();
+
+			// While the controller isn't ready the host has no view of the namespaces yet (it looks once it enables it), so nothing changed for it
+			if (ControllerRegisters->getControllerRegisters()->CSTS.RDY)
+			{
+				AsyncEvents.noteNamespaceChanged(namespaceId);
+				if (AsyncEventConfiguration & constants::async_events::CONFIGURATION_NAMESPACE_ATTRIBUTE_NOTICES)
+				{
+					raiseAsyncEvent(constants::async_events::TYPE_NOTICE, constants::async_events::NOTICE_NAMESPACE_ATTRIBUTE_CHANGED, constants::log_pages::CHANGED_NAMESPACE_LIST);
+				}
+			}
+			return true;
+		}
+
+		Namespace* Controller::getNamespace(UINT_32 namespaceId)
+		{
+			auto node = Namespaces.find(namespaceId);
+			if (node == Namespaces.end())
+			{
+				return nullptr;
+			}
+			return node->second.get();
 		}
 
 		void Controller::waitForChangeLoop()
 		{
 #ifndef SINGLE_THREADED
+			AdminDoorbellRung = true; // It may be asleep
+			AdminWaker.wake();
+			AdminWatcher.waitForFlip();
 			DoorbellWatcher.waitForFlip();
 #else
+			checkAdminQueue();
 			checkForChanges();
 #endif
 		}
@@ -6,14 +6,55 @@ Controller.h - A header file for the NVMe Controller
 
 #pragma once
 
+#include "AsyncEvent.h"
 #include "Command.h"
+#include "Constants.h"
 #include "ControllerRegisters.h"
+#include "Dedup.h"
+#include "Ftl.h"
+#include "Identify.h"
+#include "Namespace.h"
 #include "PCIe.h"
+#include "Pipeline.h"
+#include "Plugin.h"
+#include "Qos.h"
+#include "Tier.h"
 #include "Types.h"
 #include "Queue.h"
 
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+
 #define MAX_COMMAND_IDENTIFIER 0xFFFF
 #define MAX_SUBMISSION_QUEUES  0xFFFF
+#define MAX_QUEUE_IDENTIFIER   1024 // Doorbells for this many queues fit well within the BAR space after the controller registers
+
+#define DEFAULT_NAMESPACE_ID 1
+#define DEFAULT_NAMESPACE_BLOCK_SIZE 512
+#define DEFAULT_NAMESPACE_SIZE_IN_BLOCKS (1024 * 1024 * 2) // 1 GiB (sparse)
+#define NAMESPACE_ID_ALL 0xFFFFFFFF // Broadcast NSID
+
+#define MAX_LOG_PAGE_TRANSFER_SIZE (1024 * 1024)
+
+#define COPY_MAX_SOURCE_RANGES 128 // MSRC + 1
+#define COPY_MAX_SINGLE_SOURCE_RANGE_LENGTH 0x10000 // MSSRL
+
+#define COPY_MAX_LENGTH (COPY_MAX_SOURCE_RANGES * COPY_MAX_SINGLE_SOURCE_RANGE_LENGTH) // MCL
+
+#define FETCH_BUFFER_ENTRIES 64 // Most submission queue entries fetched in one burst (also the burst when Arbitration Burst is 'no limit')
+#define DEFAULT_ARBITRATION_BURST 6 // Arbitration feature AB (log2) until the host sets it: 64 commands per queue per turn
+
+#define COMMAND_TABLE_ENTRIES 256 // One dispatch table entry per opcode
+
+#define EXECUTOR_MAX_WORKERS 16 // Most execute stage workers the Executor Workers feature can ask for
+#define DEFAULT_EXECUTOR_WORKERS 2 // Execute stage workers until the host sets the Executor Workers feature
+
+#define SMART_COMPOSITE_TEMPERATURE 313 // Kelvin (40 C). Simulated media doesn't heat up.
+#define SMART_AVAILABLE_SPARE_THRESHOLD 10 // Percent. Spare is always all there (100 percent).
+
+#define ABORT_COMMAND_LIMIT 4 // ACL + 1. Each Abort completes before the next is looked at, so it's never exceeded.
 
 using namespace cnvme;
 
@@ -21,6 +62,90 @@ namespace cnvme
 {
 	namespace controller
 	{
+		/// <summary>
+		/// An I/O command on its way through the pipeline (fetch -> execute -> complete)
+		/// </summary>
+		struct PipelineCommand
+		{
+			command::NVME_COMMAND Command; // Copied out of the submission queue
+			Queue* SubmissionQueue; // Queue it came from. Queues aren't deleted while commands are in the pipeline.
+			UINT_16 SubmissionQueueHead; // SQHD to report: the head just after the burst it was fetched in
+			UINT_32 MemoryPageSize; // Memory page size for PRPs, as of the fetch
+			bool Execute; // False if decoding already failed it, so only the completion is left
+			std::atomic<bool> Started; // Claimed by the worker executing it, or by an Abort getting there first (the worker then only sets the status)
+			command::COMPLETION_QUEUE_ENTRY Completion; // Filled in by decode / execute
+		};
+
+		/// <summary>
+		/// One thread of the work stealing execute stage.
+		/// The fetch stage hands it commands (by sequence number) through its inbox, and it moves a batch at a time into its deque,
+		///   where idle workers can steal them.
+		/// </summary>
+		struct ExecutorWorker
+		{
+			ExecutorWorker() : Counters(MAX_QUEUE_IDENTIFIER)
+			{
+				Steals = 0;
+				Stolen = 0;
+				Running = false;
+			}
+
+			LoopingThread Thread; // Only running for the first (Executor Workers feature) workers
+			pipeline::SpscRing<UINT_64, PIPELINE_RING_ENTRIES> Inbox; // From the fetch stage
+			pipeline::ChaseLevDeque<UINT_64, PIPELINE_STAGE_BATCH> Deque; // Being worked on. Others steal from here.
+			pipeline::StageWaker Waker; // Woken by the fetch stage, or a worker with work to spare
+			pipeline::StageStatistics Statistics; // This worker's part of the execute stage
+			pipeline::SubmissionQueueCounters Counters; // Commands this worker executed, by SQID. Added up for the SMART / Health Information log page.
+			std::atomic<UINT_64> Steals; // Commands taken from other workers
+			std::atomic<UINT_64> Stolen; // Commands other workers took from this one
+			std::atomic<bool> Running; // Cleared to stop this worker going back to sleep, so it ends promptly. The others sleep on.
+		};
+
+		/// <summary>
+		/// What a command handler is given. The dispatcher has already done the validation the handler's descriptor asks for.
+		/// </summary>
+		struct CommandContext
+		{
+			command::NVME_COMMAND* Command; // Copied out of the submission queue
+			command::COMPLETION_QUEUE_ENTRY* Completion; // Posted once the handler returns. Successful unless the handler sets a status.
+			UINT_32 MemoryPageSize; // Memory page size for PRPs
+			UINT_16 SubmissionQueueId; // Queue the command came from
+			Namespace* TheNamespace; // What NSID names, or nullptr. Never nullptr if the descriptor needs a namespace.
+			bool CompletionDeferred; // Set by an admin handler that posts the completion itself later (Asynchronous Event Request)
+		};
+
+		/// <summary>
+		/// Handles one opcode
+		/// </summary>
+		typedef std::function<void(CommandContext &context)> CommandHandler;
+
+		/// <summary>
+		/// One entry of a command set's dispatch table: how to handle an opcode, and what to check before handing it over
+		/// </summary>
+		struct CommandDescriptor
+		{
+			CommandDescriptor()
+			{
+				DataTransfer = constants::data_transfer::NONE;
+				NeedsPrps = false;
+				NeedsNamespace = false;
+				SynchronizationPoint = true;
+			}
+
+			CommandDescriptor(CommandHandler handler, bool needsPrps, bool needsNamespace, bool synchronizationPoint = true) : CommandDescriptor()
+			{
+				Handler = handler;
+				NeedsPrps = needsPrps;
+				NeedsNamespace = needsNamespace;
+				SynchronizationPoint = synchronizationPoint;
+			}
+
+			CommandHandler Handler; // Empty if the opcode isn't supported
+			UINT_8 DataTransfer; // constants::data_transfer, from the opcode when registered
+			bool NeedsPrps; // PRP1 must be a dword aligned address. Only for opcodes that transfer data.
+			bool NeedsNamespace; // NSID must name a namespace
+			bool SynchronizationPoint; // Admin only: changes what I/O sees, so runs with the fetch stage stopped and the pipeline drained
+		};
 
 		class Controller
 		{
@@ -59,6 +184,48 @@ namespace cnvme
 			/// </summary>
 			void waitForChangeLoop();
 
+			/// <summary>
+			/// Adds a namespace to the controller. The controller takes ownership.
+			/// Can be done while it's running: waits for the admin command running and the I/O already fetched to finish first.
+			/// </summary>
+			/// <param name="theNamespace">The namespace to add</param>
+			/// <returns>True on success. False if the NSID is invalid or already in use (the namespace is then deleted).</returns>
+			bool addNamespace(Namespace* theNamespace);
+
+			/// <summary>
+			/// Registers a handler for an admin opcode (vendor specific ones are 0xC0 to 0xFF).
+			/// Should be done before the host sends commands with the opcode.
+			/// </summary>
+			/// <param name="opcode">The opcode</param>
+			/// <param name="descriptor">The handler and what to check before calling it</param>
+			/// <returns>False if the opcode already has a handler, or PRPs are needed for an opcode that transfers no data</returns>
+			bool registerAdminCommand(UINT_8 opcode, CommandDescriptor descriptor);
+
+			/// <summary>
+			/// Registers a handler for an I/O opcode of a command set (vendor specific ones are 0x80 to 0xFF).
+			/// Should be done before the host sends commands with the opcode.
+			/// </summary>
+			/// <param name="commandSet">constants::command_sets. Zoned namespaces use the Zoned Namespace command set, the rest NVM.</param>
+			/// <param name="opcode">The opcode</param>
+			/// <param name="descriptor">The handler and what to check before calling it</param>
+			/// <returns>False if the command set isn't supported, the opcode already has a handler, or PRPs are needed for an opcode that transfers no data</returns>
+			bool registerIoCommand(UINT_8 commandSet, UINT_8 opcode, CommandDescriptor descriptor);
+
+			/// <summary>
+			/// Loads a plugin and has it register its commands (see plugins::PluginEntryPoint). It stays loaded until the controller is destroyed.
+			/// Like registering, should be done before the host sends commands with the plugin's opcodes.
+			/// </summary>
+			/// <param name="path">Path to the plugin's shared object</param>
+			/// <returns>False if it couldn't be loaded or its entry point failed (anything it registered is then unregistered)</returns>
+			bool loadPlugin(std::string path);
+
+			/// <summary>
+			/// Gets the namespace with the given NSID
+			/// </summary>
+			/// <param name="namespaceId">The NSID</param>
+			/// <returns>The namespace or nullptr if it doesn't exist</returns>
+			Namespace* getNamespace(UINT_32 namespaceId);
+
 		private:
 
 			/// <summary>
@@ -72,21 +239,228 @@ namespace cnvme
 			pci::PCIExpressRegisters* PCIExpressRegisters;
 
 			/// <summary>
-			/// Looping thread to watch for doorbell writes.
+			/// Looping thread to watch for I/O submission queue doorbell writes. This is the pipeline's fetch stage.
 			/// </summary>
 			LoopingThread DoorbellWatcher;
 
+			/// <summary>
+			/// Looping thread servicing the admin queue, so a slow admin command never holds up fetching I/O
+			/// </summary>
+			LoopingThread AdminWatcher;
+
+			/// <summary>
+			/// Lets AdminWatcher sleep until the fetch stage (which polls the doorbells anyway) sees an admin doorbell rung
+			/// </summary>
+			pipeline::StageWaker AdminWaker;
+
+			/// <summary>
+			/// Set by the fetch stage when an admin doorbell changed, cleared by AdminWatcher as it looks at the admin queue
+			/// </summary>
+			std::atomic<bool> AdminDoorbellRung;
+
+			/// <summary>
+			/// Cleared to stop AdminWatcher going back to sleep, so it ends promptly
+			/// </summary>
+			std::atomic<bool> AdminRunning;
+
+			/// <summary>
+			/// The admin doorbells as the fetch stage last saw them
+			/// </summary>
+			controller::registers::QUEUE_DOORBELLS AdminDoorbellsSeen;
+
+			/// <summary>
+			/// The admin submission queue, in ValidSubmissionQueues once the host has given its address. Never deleted.
+			/// </summary>
+			Queue* AdminSubmissionQueue;
+
+			/// <summary>
+			/// The admin completion queue, in ValidCompletionQueues once the host has given its address. Never deleted.
+			/// </summary>
+			Queue* AdminCompletionQueue;
+
+			/// <summary>
+			/// Set while an admin command waits for DataPathMutex, so the fetch stage ends its pass early
+			/// </summary>
+			std::atomic<bool> DataPathSynchronizationRequested;
+
+			/// <summary>
+			/// Held by the fetch stage for each pass over the I/O queues. An admin command that changes what I/O sees
+			///   (queues, namespaces, features) holds it, with the pipeline drained, for as long as it runs.
+			/// Also guards the lists of valid queues.
+			/// </summary>
+			std::mutex DataPathMutex;
+
+			/// <summary>
+			/// Held by the admin thread for each command it runs, and by addNamespace(). Taken before DataPathMutex.
+			/// </summary>
+			std::mutex AdminCommandMutex;
+
+			/// <summary>
+			/// Looping thread running the pipeline's complete stage
+			/// </summary>
+			LoopingThread CompleteStage;
+
+			/// <summary>
+			/// The execute stage. Only the first NumberOfExecutorWorkers run, but the rest keep their counters.
+			/// </summary>
+			ExecutorWorker ExecutorWorkers[EXECUTOR_MAX_WORKERS];
+
+			/// <summary>
+			/// Workers running the execute stage (the Executor Workers feature). Only changed while they're stopped.
+			/// </summary>
+			UINT_32 NumberOfExecutorWorkers;
+
+			/// <summary>
+			/// Commands in the pipeline, by sequence number (modulo the size). Executed out of order, but posted in order for each completion queue.
+			/// </summary>
+			PipelineCommand PipelineSlots[PIPELINE_RING_ENTRIES];
+
+			/// <summary>
+			/// Set (by a worker) once the command in the matching PipelineSlots entry has executed, cleared once it's posted
+			/// </summary>
+			std::atomic<bool> PipelineSlotExecuted[PIPELINE_RING_ENTRIES];
+
+			/// <summary>
+			/// Set (by the complete stage) once the command in the matching PipelineSlots entry has been posted ahead of an older one,
+			///   cleared once CompletedSequence moves past it
+			/// </summary>
+			bool PipelineSlotPosted[PIPELINE_RING_ENTRIES];
+
+			/// <summary>
+			/// Bumped by a worker each time it marks a batch executed
+			/// </summary>
+			std::atomic<UINT_64> ExecutedBatches;
+
+			/// <summary>
+			/// ExecutedBatches as of the last complete stage pass that posted everything it could. The complete stage sleeps while they match.
+			/// </summary>
+			UINT_64 ExecutedBatchesSeen;
+
+			/// <summary>
+			/// Sequence number the next fetched I/O command gets (moved by the fetch stage)
+			/// </summary>
+			std::atomic<UINT_64> NextSequence;
+
+			/// <summary>
+			/// Sequence number of the oldest command yet to have its completion posted (moved by the complete stage)
+			/// </summary>
+			std::atomic<UINT_64> CompletedSequence;
+
+			/// <summary>
+			/// Wakes the complete stage when a worker finishes commands
+			/// </summary>
+			pipeline::StageWaker CompleteWaker;
+
+			/// <summary>
+			/// Counters for the fetch and complete stages (index with PIPELINE_STAGE_*), for the Pipeline Statistics log page.
+			/// The execute stage's are kept by each worker.
+			/// </summary>
+			pipeline::StageStatistics StageStatistics[PIPELINE_STAGES];
+
+			/// <summary>
+			/// Commands the admin thread processed (the admin queue's entry of the Submission Queue Statistics log page).
+			/// I/O commands are counted by the worker that executed them.
+			/// </summary>
+			pipeline::SubmissionQueueCounters AdminCounters;
+
+			/// <summary>
+			/// When the controller was created, for Power On Hours
+			/// </summary>
+			std::chrono::steady_clock::time_point PowerOnTime;
+
+			/// <summary>
+			/// Where each I/O command is, by (SQID, CID), so Abort can find it in its submission queue or the pipeline
+			/// </summary>
+			pipeline::InFlightCommands InFlight;
+
+			/// <summary>
+			/// Cleared to stop an idle complete stage from going back to sleep, so it ends promptly
+			/// </summary>
+			std::atomic<bool> StagesRunning;
+
 			/// <summary>
 			/// Used to keep track of the non-deleted but created submission queues
-			/// Vector of queue objects
+			/// List of queue objects (a list since queues point at each other and must not move)
 			/// </summary>
-			std::vector<Queue> ValidSubmissionQueues;
+			std::list<Queue> ValidSubmissionQueues;
 
 			/// <summary>
 			/// Used to keep track of the non-deleted but created completion queues
-			/// Vector of queue objects
+			/// List of queue objects (a list since queues point at each other and must not move)
+			/// </summary>
+			std::list<Queue> ValidCompletionQueues;
+
+			/// <summary>
+			/// NSID to namespace
 			/// </summary>
-			std::vector<Queue> ValidCompletionQueues;
+			std::map<UINT_32, std::unique_ptr<Namespace>> Namespaces;
+
+			/// <summary>
+			/// Volatile Write Cache feature (WCE). Applies to every namespace.
+			/// </summary>
+			bool VolatileWriteCacheEnabled;
+
+			/// <summary>
+			/// Vendor specific Read Cache feature (bit 0 of FID 0xC0). Applies to every namespace.
+			/// </summary>
+			bool ReadCacheEnabled;
+
+			/// <summary>
+			/// Vendor specific QoS Limits feature (FID 0xC1): IOPS / bandwidth limits the dispatcher holds commands to
+			/// </summary>
+			qos::RateLimiter QosLimiter;
+
+			/// <summary>
+			/// Arbitration feature (CDW11 as the host set it). Only round robin is supported, so just the Arbitration Burst is used.
+			/// </summary>
+			UINT_32 Arbitration;
+
+			/// <summary>
+			/// Commands fetched from an I/O submission queue in one burst, processed from here
+			/// </summary>
+			command::NVME_COMMAND FetchBuffer[FETCH_BUFFER_ENTRIES];
+
+			/// <summary>
+			/// Commands fetched from the admin submission queue in one burst, processed from here
+			/// </summary>
+			command::NVME_COMMAND AdminFetchBuffer[FETCH_BUFFER_ENTRIES];
+
+			/// <summary>
+			/// Identify Controller data. Built once the registers exist, as nothing it reports changes afterwards.
+			/// </summary>
+			identify::IDENTIFY_CONTROLLER_DATA IdentifyControllerData;
+
+			/// <summary>
+			/// The active NSIDs in order followed by a whole Active Namespace ID list of zeros, so the list after any NSID
+			///   is one contiguous copy from here. Rebuilt when a namespace is added.
+			/// </summary>
+			std::vector<UINT_32> ActiveNamespaceIds;
+
+			/// <summary>
+			/// Returned for the Sanitize Status log page. Updated by each Sanitize.
+			/// </summary>
+			logpages::SANITIZE_STATUS_LOG SanitizeStatus;
+
+			/// <summary>
+			/// Parked Asynchronous Event Requests, the events waiting for them and the logs they point at
+			/// </summary>
+			events::AsyncEvents AsyncEvents;
+
+			/// <summary>
+			/// Asynchronous Event Configuration feature: the SMART critical warnings and notices that raise events.
+			/// Read by whichever thread notices a change.
+			/// </summary>
+			std::atomic<UINT_32> AsyncEventConfiguration;
+
+			/// <summary>
+			/// Temperature Threshold feature: the composite temperature's over temperature threshold (Kelvin)
+			/// </summary>
+			UINT_16 OverTemperatureThreshold;
+
+			/// <summary>
+			/// Temperature Threshold feature: the composite temperature's under temperature threshold (Kelvin, 0 for none)
+			/// </summary>
+			UINT_16 UnderTemperatureThreshold;
 
 			/// <summary>
 			/// Used to keep track of CIDs that have been used
@@ -94,34 +468,425 @@ namespace cnvme
 			std::map<UINT_16, std::set<UINT_16>> SubmissionQueueIdToCommandIdentifiers;
 
 			/// <summary>
-			/// Function to be called in loop looking for changes
+			/// Admin command dispatch table, indexed by opcode
+			/// </summary>
+			CommandDescriptor AdminCommands[COMMAND_TABLE_ENTRIES];
+
+			/// <summary>
+			/// NVM command set dispatch table, indexed by opcode
+			/// </summary>
+			CommandDescriptor NvmCommands[COMMAND_TABLE_ENTRIES];
+
+			/// <summary>
+			/// Zoned Namespace command set dispatch table, indexed by opcode. The NVM commands plus the zone ones.
+			/// </summary>
+			CommandDescriptor ZonedNamespaceCommands[COMMAND_TABLE_ENTRIES];
+
+			/// <summary>
+			/// Loaded plugins. Unloaded in the destructor, once nothing can call their handlers.
+			/// </summary>
+			std::list<plugins::Plugin*> Plugins;
+
+			/// <summary>
+			/// Registers the built in admin and I/O commands
+			/// </summary>
+			void registerCommands();
+
+			/// <summary>
+			/// Puts a descriptor in a dispatch table, setting its data transfer direction from the opcode
+			/// </summary>
+			/// <param name="table">The dispatch table</param>
+			/// <param name="opcode">The opcode</param>
+			/// <param name="descriptor">The descriptor</param>
+			/// <returns>False if the opcode already has a handler, or PRPs are needed for an opcode that transfers no data</returns>
+			static bool registerCommand(CommandDescriptor* table, UINT_8 opcode, CommandDescriptor descriptor);
+
+			/// <summary>
+			/// The validation common to every command, as its descriptor asks for. Sets the completion's status if it fails.
+			/// </summary>
+			/// <param name="descriptor">The command's dispatch table entry</param>
+			/// <param name="context">The command</param>
+			/// <returns>True if the handler can be called</returns>
+			static bool validateCommand(const CommandDescriptor &descriptor, CommandContext &context);
+
+			/// <summary>
+			/// Identify: Identify Controller, Identify Namespace or the Active Namespace ID list. Each is kept built,
+			///   so this is one copy into the PRPs.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion queue entry to fill in on failure</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs</param>
+			void identify(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Asynchronous Event Request: parks the command (deferring its completion) until there's an event for it
+			/// </summary>
+			/// <param name="context">The command</param>
+			void asynchronousEventRequest(CommandContext &context);
+
+			/// <summary>
+			/// Abort: stops a command that hasn't executed yet, completing it with Command Abort Requested.
+			/// An I/O command can be stopped while in its submission queue (waiting for arbitration or held back by QoS)
+			///   or in the pipeline waiting for a worker. On the admin queue, only a parked Asynchronous Event Request can be.
+			/// DW0 bit 0 of its completion is cleared if the command was aborted.
+			/// </summary>
+			/// <param name="context">The command</param>
+			void abort(CommandContext &context);
+
+			/// <summary>
+			/// Abort's part for an I/O command. Needs DataPathMutex, so the fetch stage isn't moving the queue or filling pipeline slots.
+			/// </summary>
+			/// <param name="submissionQueue">Queue the command was submitted to</param>
+			/// <param name="commandId">Its CID</param>
+			/// <returns>True if it was aborted</returns>
+			bool abortIoCommand(Queue &submissionQueue, UINT_16 commandId);
+
+			/// <summary>
+			/// Completes parked Asynchronous Event Requests for the events waiting, as far as the admin completion queue has room.
+			/// Only called by the admin thread.
+			/// </summary>
+			void postAsyncEventCompletions();
+
+			/// <summary>
+			/// Reserves an admin completion queue entry for the completion of a parked Asynchronous Event Request, which gave
+			///   back its own when it was parked. There must be room. Only called by the admin thread.
+			/// </summary>
+			void reserveAdminCompletion();
+
+			/// <summary>
+			/// Queues an event and wakes the admin thread to complete a request with it
+			/// </summary>
+			/// <param name="type">constants::async_events TYPE_*</param>
+			/// <param name="information">Asynchronous Event Information</param>
+			/// <param name="logPageIdentifier">Log page the host reads to clear it</param>
+			void raiseAsyncEvent(UINT_8 type, UINT_8 information, UINT_8 logPageIdentifier);
+
+			/// <summary>
+			/// Logs (and raises an error event for) the host writing a doorbell a value past the end of its queue.
+			/// The write is otherwise ignored.
+			/// </summary>
+			/// <param name="queueId">Queue whose doorbell it is</param>
+			/// <param name="completionQueue">True for the completion queue head doorbell, false for the submission queue tail one</param>
+			/// <param name="value">What the host wrote</param>
+			void reportInvalidDoorbell(UINT_16 queueId, bool completionQueue, UINT_16 value);
+
+			/// <summary>
+			/// Returns true if the composite temperature is above the over threshold or below the under threshold
+			/// </summary>
+			bool isTemperatureOutsideThresholds() const;
+
+			/// <summary>
+			/// Builds IdentifyControllerData from the PCI header and the controller registers
+			/// </summary>
+			void buildIdentifyControllerData();
+
+			/// <summary>
+			/// Rebuilds ActiveNamespaceIds from Namespaces
+			/// </summary>
+			void buildActiveNamespaceIds();
+
+			/// <summary>
+			/// Mutex for SubmissionQueueIdToCommandIdentifiers, which the fetch stage and the admin queue both use
+			/// </summary>
+			std::mutex CommandIdentifiersMutex;
+
+			/// <summary>
+			/// Function to be called in loop looking for changes to the I/O queues (the fetch stage)
 			/// </summary>
 			void checkForChanges();
 
 			/// <summary>
-			/// This call will take the command of the given submission queue, process the command and
+			/// Function to be called in loop looking for changes to the admin queue. Sets the admin queues up once the host
+			///   has given their addresses, then fetches and runs admin commands.
+			/// </summary>
+			void checkAdminQueue();
+
+			/// <summary>
+			/// Returns true if the admin command changes (or reports on) state the I/O data path uses, so the fetch stage
+			///   has to be stopped and the pipeline drained while it runs. Anything else runs alongside I/O.
+			/// </summary>
+			/// <param name="command">The admin command</param>
+			bool isDataPathSynchronizationPoint(command::NVME_COMMAND* command);
+
+			/// <summary>
+			/// This call will take the given (fetched) admin command, process the command and
 			/// pass back completion via the completion queue doorbell.
+			/// Admin commands run on AdminWatcher. A synchronization point waits for the fetch stage to stop between passes
+			///   and for the pipeline to drain, so it never overlaps I/O.
+			/// </summary>
+			/// <param name="submissionQueue">The internal submission queue object for this command</param>
+			/// <param name="command">The command, copied out of the submission queue</param>
+			void processAdminCommandAndPostCompletion(Queue &submissionQueue, command::NVME_COMMAND* command);
+
+			/// <summary>
+			/// Decodes a fetched I/O command and hands it to the worker for its submission queue. There must be a free pipeline slot.
 			/// </summary>
 			/// <param name="submissionQueue">The internal submission queue object for this command</param>
-			void processCommandAndPostCompletion(Queue &submissionQueue);
+			/// <param name="command">The command, copied out of the submission queue</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs</param>
+			void submitToPipeline(Queue &submissionQueue, command::NVME_COMMAND* command, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Returns how many more I/O commands fit in the pipeline
+			/// </summary>
+			/// <returns>Free PipelineSlots</returns>
+			UINT_32 getPipelineFreeEntries();
+
+			/// <summary>
+			/// Starts or stops execute stage workers, so the given number are running. Only the ones that differ are touched.
+			/// The pipeline should be drained first.
+			/// </summary>
+			/// <param name="numberOfWorkers">Workers to have running (0 to EXECUTOR_MAX_WORKERS)</param>
+			void setExecutorWorkers(UINT_32 numberOfWorkers);
+
+			/// <summary>
+			/// Execute stage, for one worker: runs up to a batch of commands, from its own deque (refilled from its inbox)
+			///   or else stolen from another worker, then marks them executed for the complete stage
+			/// </summary>
+			/// <param name="workerIndex">The worker</param>
+			/// <returns>Commands executed</returns>
+			UINT_32 runExecutorWorker(UINT_32 workerIndex);
+
+			/// <summary>
+			/// Returns true if the worker has commands of its own or could steal some
+			/// </summary>
+			/// <param name="workerIndex">The worker</param>
+			bool executorWorkerHasWork(UINT_32 workerIndex);
+
+			/// <summary>
+			/// Complete stage: posts the completions of up to a batch of executed commands. Each completion queue gets them in
+			///   the order they were fetched (so SQHD never goes backwards), stopping at its first one still executing.
+			/// </summary>
+			/// <returns>Completions posted</returns>
+			UINT_32 runCompleteStage();
+
+			/// <summary>
+			/// Waits for every I/O command in the pipeline to have its completion posted
+			/// </summary>
+			void drainPipeline();
+
+			/// <summary>
+			/// Fetches a burst of commands from a submission queue into a fetch buffer, moving its head (and so the SQHD
+			///   completions report) past all of them at once.
+			/// A burst is the contiguous run from the head up to the tail or the end of the queue, at most the Arbitration Burst,
+			///   no more than the completion queue has room for and stopping at a command over its QoS limits.
+			/// </summary>
+			/// <param name="submissionQueue">The internal submission queue object</param>
+			/// <param name="buffer">Where to put the commands (FETCH_BUFFER_ENTRIES of them)</param>
+			/// <returns>Number of commands fetched</returns>
+			UINT_32 fetchBurst(Queue &submissionQueue, command::NVME_COMMAND* buffer);
+
+			/// <summary>
+			/// Returns how many more completions the completion queue a submission queue posts to has room for,
+			///   before the host has to consume some (and ring the head doorbell)
+			/// </summary>
+			/// <param name="submissionQueue">The internal submission queue object</param>
+			/// <returns>Free completion queue entries</returns>
+			UINT_32 getCompletionQueueSpace(Queue &submissionQueue);
+
+			/// <summary>
+			/// Asks the QoS limits if a command from an I/O submission queue can be dispatched now.
+			/// Admin commands are never held back.
+			/// </summary>
+			/// <param name="submissionQueueId">The submission queue the command is in</param>
+			/// <param name="command">The command</param>
+			/// <returns>True to dispatch it. False to leave it parked at the head for a later pass.</returns>
+			bool admitCommand(UINT_16 submissionQueueId, command::NVME_COMMAND* command);
+
+			/// <summary>
+			/// Processes an I/O command: looks it up in the dispatch table of its namespace's command set, validates it and calls its handler
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status / command specific values</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs</param>
+			/// <param name="submissionQueueId">Queue the command came from</param>
+			/// <param name="counters">The executing worker's counters, to count the command in</param>
+			void processNvmCommand(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize, UINT_16 submissionQueueId,
+				pipeline::SubmissionQueueCounters &counters);
+
+			/// <summary>
+			/// Adds up every worker's (and the admin thread's) per submission queue counters
+			/// </summary>
+			/// <returns>Submission Queue Statistics log page entries, in SQID order, for the queues that have had a command</returns>
+			std::vector<logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY> getSubmissionQueueStatistics() const;
+
+			/// <summary>
+			/// Builds the SMART / Health Information log page out of the per submission queue counters
+			/// </summary>
+			/// <returns>SMART_HEALTH_INFORMATION_LOG</returns>
+			logpages::SMART_HEALTH_INFORMATION_LOG getSmartHealthInformation();
+
+			/// <summary>
+			/// Handles GET_LOG_PAGE
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs</param>
+			void getLogPage(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Handles SET_FEATURES. For QoS Limits, CDW12 is the IOPS limit and CDW13 the bandwidth limit in KiB/s (0 for unlimited),
+			///   for the namespace in NSID (every namespace if broadcast) or, if NSID is 0, the submission queue in CDW11 bits 15:0.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void setFeatures(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles GET_FEATURES. The feature's value is returned in DWord 0 of the completion.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status / value</param>
+			void getFeatures(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles FORMAT_NVM. Only the current LBA format (0, no metadata or protection information) is supported.
+			/// Completes straight away no matter the namespace size: see Namespace::format().
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void formatNvm(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles SANITIZE. Block erase and crypto erase format every namespace, and are done by the time the command completes.
+			/// Overwrite isn't supported.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void sanitize(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles DIRECTIVE_SEND: enabling / disabling the Streams directive and releasing stream identifiers or resources
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void directiveSend(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles DIRECTIVE_RECEIVE: Identify and Streams return parameters, the open streams, and allocating stream resources.
+			/// The number of streams allocated is returned in DWord 0 of the completion.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs</param>
+			void directiveReceive(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Returns the number of streams allocated to every namespace but the given one
+			/// </summary>
+			/// <param name="theNamespace">Namespace to leave out (or nullptr)</param>
+			/// <returns>Allocated streams</returns>
+			UINT_32 getStreamsAllocatedToOtherNamespaces(Namespace* theNamespace);
+
+			/// <summary>
+			/// Handles CREATE_IO_COMPLETION_QUEUE
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void createIoCompletionQueue(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles CREATE_IO_SUBMISSION_QUEUE
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void createIoSubmissionQueue(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles DELETE_IO_COMPLETION_QUEUE
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void deleteIoCompletionQueue(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles DELETE_IO_SUBMISSION_QUEUE
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void deleteIoSubmissionQueue(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles READ and WRITE. Reads are tagged with the submission queue, which the read cache tracks as a stream.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="theNamespace">Namespace the command targets</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs</param>
+			/// <param name="submissionQueueId">Queue the command came from</param>
+			void readOrWrite(command::NVME_COMMAND* command, Namespace &theNamespace, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize, UINT_16 submissionQueueId);
+
+			/// <summary>
+			/// Handles FLUSH: returns once everything the namespace (or every namespace) has cached is durable
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void flush(command::NVME_COMMAND* command, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles COPY. The data is moved by the media itself, never through host memory.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="theNamespace">Namespace the command targets</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs (used for the source range descriptors)</param>
+			void copy(command::NVME_COMMAND* command, Namespace &theNamespace, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Handles DATASET_MANAGEMENT. Deallocate (AD) ranges are deallocated, and every range's context attributes
+			///   are passed to the backing media as a hint (used by tiered media to place data).
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="theNamespace">Namespace the command targets</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs (used for the ranges)</param>
+			void datasetManagement(command::NVME_COMMAND* command, Namespace &theNamespace, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Handles ZONE_APPEND. The assigned LBA is returned in DWord 0/1 of the completion.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="theNamespace">Namespace the command targets</param>
+			/// <param name="completionQueueEntry">Completion to fill in status / assigned LBA</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs</param>
+			void zoneAppend(command::NVME_COMMAND* command, Namespace &theNamespace, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Handles ZONE_MANAGEMENT_SEND
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="theNamespace">Namespace the command targets</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			void zoneManagementSend(command::NVME_COMMAND* command, Namespace &theNamespace, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Handles ZONE_MANAGEMENT_RECEIVE (Report Zones)
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="theNamespace">Namespace the command targets</param>
+			/// <param name="completionQueueEntry">Completion to fill in status</param>
+			/// <param name="memoryPageSize">Memory page size for PRPs</param>
+			void zoneManagementReceive(command::NVME_COMMAND* command, Namespace &theNamespace, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry, UINT_32 memoryPageSize);
 
 			/// <summary>
 			/// Returns a Queue matching the given id
 			/// </summary>
-			/// <param name="queues">vector of Queues</param>
+			/// <param name="queues">list of Queues</param>
 			/// <param name="id">The queue id</param>
+			/// <param name="logIfMissing">If true, logs an error if the queue doesn't exist</param>
 			/// <returns>Queue</returns>
-			Queue *getQueueWithId(std::vector<Queue> &queues, UINT_16 id);
+			Queue *getQueueWithId(std::list<Queue> &queues, UINT_16 id, bool logIfMissing = true);
 
 			/// <summary>
-			/// Posts the given completion to the given queue.
-			/// Fills in sqid, sqhd, cid.
-			/// Also can flip the Phase Tag if needed.
+			/// Posts the given completion to the completion queue the given submission queue is mapped to.
+			/// Fills in sqid, sqhd, cid and the phase tag.
+			/// Holds the completion queue's lock while posting, since other submission queues may share it.
 			/// </summary>
-			/// <param name="completionQueue">Queue to post to</param>
+			/// <param name="submissionQueue">Queue the command came from</param>
+			/// <param name="submissionQueueHead">SQHD to report</param>
 			/// <param name="completionEntry">Entry to post to the queue</param>
 			/// <param name="command">The NVMe Command that is having its completion posted</param>
-			void postCompletion(Queue &completionQueue, command::COMPLETION_QUEUE_ENTRY completionEntry, command::NVME_COMMAND* command);
+			void postCompletion(Queue &submissionQueue, UINT_16 submissionQueueHead, command::COMPLETION_QUEUE_ENTRY completionEntry, command::NVME_COMMAND* command);
 
 			/// <summary>
 			/// Returns true if the command id 
@@ -131,10 +896,6 @@ namespace cnvme
 			/// <returns>true if valid, False otherwise.</returns>
 			bool isValidCommandIdentifier(UINT_16 commandId, UINT_16 submissionQueueId);
 
-			/// <summary>
-			/// Corresponds with the phase tag in the completion queue entry for a queue
-			/// </summary>
-			std::map<UINT_16, bool> QueueToPhaseTag;
 		};
 	}
 }
@@ -0,0 +1,275 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Dedup.cpp - An implementation file for the Deduplicating media
+*/
+
+#include "Checksum.h"
+#include "Dedup.h"
+
+namespace cnvme
+{
+	namespace media
+	{
+		DedupMedia::DedupMedia(UINT_32 blockSize, UINT_64 numberOfBlocks) : MediaBackend(blockSize, numberOfBlocks)
+		{
+			ASSERT_IF(blockSize == 0, "DedupMedia needs a non-zero block size");
+			Blocks.resize(1); // DEDUP_ZERO_BLOCK
+			Statistics = { 0 };
+		}
+
+		bool DedupMedia::read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to read out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(DedupMutex);
+			for (UINT_32 i = 0; i < numberOfBlocks; i++, buffer += BlockSize)
+			{
+				UINT_32 blockId = getBlockIdLocked(lba + i);
+				if (blockId == DEDUP_ZERO_BLOCK)
+				{
+					memset(buffer, 0, BlockSize);
+				}
+				else
+				{
+					memcpy(buffer, Blocks[blockId].Data.get(), BlockSize);
+				}
+			}
+			return true;
+		}
+
+		bool DedupMedia::write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to write out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			// Hashing is the expensive part, so it's done before taking the lock. A hash of 0 here just means all zeros.
+			std::vector<std::pair<bool, UINT_32>> hashes(numberOfBlocks);
+			for (UINT_32 i = 0; i < numberOfBlocks; i++)
+			{
+				const BYTE* block = buffer + (UINT_64)i * BlockSize;
+				bool zero = block[0] == 0 && memcmp(block, block + 1, BlockSize - 1) == 0;
+				hashes[i] = std::make_pair(zero, zero ? 0 : checksum::crc32c(block, BlockSize));
+			}
+
+			std::lock_guard<std::mutex> lock(DedupMutex);
+			for (UINT_32 i = 0; i < numberOfBlocks; i++)
+			{
+				Statistics.HBW++;
+				UINT_32 blockId = DEDUP_ZERO_BLOCK;
+				if (hashes[i].first)
+				{
+					Statistics.ZBW++;
+				}
+				else
+				{
+					blockId = storeLocked(buffer + (UINT_64)i * BlockSize, hashes[i].second);
+				}
+				mapLocked(lba + i, blockId);
+			}
+			return true;
+		}
+
+		bool DedupMedia::deallocate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to deallocate out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(DedupMutex);
+			UINT_64 end = lba + numberOfBlocks;
+			UINT_64 firstPage = lba / DEDUP_MAP_PAGE_ENTRIES;
+			UINT_64 lastPage = (end - 1) / DEDUP_MAP_PAGE_ENTRIES;
+
+			// Visit whichever is fewer: the pages in the range, or the pages that exist
+			std::vector<UINT_64> pages;
+			if (lastPage - firstPage + 1 > MapPages.size())
+			{
+				for (auto &page : MapPages)
+				{
+					if (page.first >= firstPage && page.first <= lastPage)
+					{
+						pages.push_back(page.first);
+					}
+				}
+			}
+			else
+			{
+				for (UINT_64 page = firstPage; page <= lastPage; page++)
+				{
+					if (MapPages.count(page))
+					{
+						pages.push_back(page);
+					}
+				}
+			}
+
+			for (UINT_64 pageIndex : pages)
+			{
+				UINT_64 pageStart = pageIndex * DEDUP_MAP_PAGE_ENTRIES;
+				UINT_64 start = std::max(lba, pageStart);
+				UINT_64 stop = std::min(end, pageStart + DEDUP_MAP_PAGE_ENTRIES);
+				for (UINT_64 i = start; i < stop; i++)
+				{
+					mapLocked(i, DEDUP_ZERO_BLOCK);
+				}
+
+				if (stop - start == DEDUP_MAP_PAGE_ENTRIES)
+				{
+					MapPages.erase(pageIndex); // Now all zeros
+				}
+			}
+			return true;
+		}
+
+		bool DedupMedia::copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(sourceLba, numberOfBlocks) || !isValidRange(destinationLba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to copy out of range. Source LBA: " + std::to_string(sourceLba) + ". Destination LBA: " +
+					std::to_string(destinationLba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			// Walk backwards when the destination overlaps the end of the source, like memmove
+			std::lock_guard<std::mutex> lock(DedupMutex);
+			bool backwards = destinationLba > sourceLba;
+			for (UINT_64 done = 0; done < numberOfBlocks; done++)
+			{
+				UINT_64 i = backwards ? numberOfBlocks - 1 - done : done;
+				UINT_32 blockId = getBlockIdLocked(sourceLba + i);
+				if (blockId != DEDUP_ZERO_BLOCK)
+				{
+					Blocks[blockId].References++;
+				}
+				mapLocked(destinationLba + i, blockId);
+			}
+			return true;
+		}
+
+		bool DedupMedia::format()
+		{
+			std::lock_guard<std::mutex> lock(DedupMutex);
+			MapPages.clear();
+			Blocks.clear();
+			Blocks.resize(1);
+			FreeBlockIds.clear();
+			HashIndex.clear();
+			Statistics.MB = 0;
+			Statistics.UB = 0;
+			return true;
+		}
+
+		logpages::DEDUP_STATISTICS_LOG DedupMedia::getStatistics()
+		{
+			std::lock_guard<std::mutex> lock(DedupMutex);
+			logpages::DEDUP_STATISTICS_LOG statistics = Statistics;
+			statistics.SB = statistics.UB * BlockSize;
+			statistics.DR = statistics.UB ? (UINT_32)(statistics.MB * 1000 / statistics.UB) : 0;
+			statistics.BS = BlockSize;
+			return statistics;
+		}
+
+		UINT_32 DedupMedia::getBlockIdLocked(UINT_64 lba)
+		{
+			auto page = MapPages.find(lba / DEDUP_MAP_PAGE_ENTRIES);
+			return page == MapPages.end() ? DEDUP_ZERO_BLOCK : page->second[lba % DEDUP_MAP_PAGE_ENTRIES];
+		}
+
+		void DedupMedia::mapLocked(UINT_64 lba, UINT_32 blockId)
+		{
+			UINT_64 pageIndex = lba / DEDUP_MAP_PAGE_ENTRIES;
+			auto page = MapPages.find(pageIndex);
+			if (page == MapPages.end())
+			{
+				if (blockId == DEDUP_ZERO_BLOCK)
+				{
+					return; // Already zero
+				}
+				page = MapPages.emplace(pageIndex, std::unique_ptr<UINT_32[]>(new UINT_32[DEDUP_MAP_PAGE_ENTRIES]())).first;
+			}
+
+			UINT_32 &entry = page->second[lba % DEDUP_MAP_PAGE_ENTRIES];
+			UINT_32 oldBlockId = entry;
+			entry = blockId;
+			if (blockId != DEDUP_ZERO_BLOCK)
+			{
+				Statistics.MB++;
+			}
+			if (oldBlockId != DEDUP_ZERO_BLOCK)
+			{
+				Statistics.MB--;
+				releaseLocked(oldBlockId);
+			}
+		}
+
+		UINT_32 DedupMedia::storeLocked(const BYTE* data, UINT_32 hash)
+		{
+			auto candidates = HashIndex.equal_range(hash);
+			for (auto candidate = candidates.first; candidate != candidates.second; candidate++)
+			{
+				StoredBlock &storedBlock = Blocks[candidate->second];
+				if (memcmp(storedBlock.Data.get(), data, BlockSize) == 0)
+				{
+					storedBlock.References++;
+					Statistics.DBW++;
+					return candidate->second;
+				}
+				Statistics.HC++;
+			}
+
+			UINT_32 blockId;
+			if (FreeBlockIds.empty())
+			{
+				ASSERT_IF(Blocks.size() >= UINT32_MAX, "DedupMedia ran out of stored block IDs");
+				blockId = (UINT_32)Blocks.size();
+				Blocks.emplace_back();
+			}
+			else
+			{
+				blockId = FreeBlockIds.back();
+				FreeBlockIds.pop_back();
+			}
+
+			StoredBlock &storedBlock = Blocks[blockId];
+			storedBlock.References = 1;
+			storedBlock.Hash = hash;
+			storedBlock.Data.reset(new BYTE[BlockSize]);
+			memcpy(storedBlock.Data.get(), data, BlockSize);
+			HashIndex.emplace(hash, blockId);
+			Statistics.UB++;
+			return blockId;
+		}
+
+		void DedupMedia::releaseLocked(UINT_32 blockId)
+		{
+			StoredBlock &storedBlock = Blocks[blockId];
+			if (--storedBlock.References)
+			{
+				return;
+			}
+
+			auto candidates = HashIndex.equal_range(storedBlock.Hash);
+			for (auto candidate = candidates.first; candidate != candidates.second; candidate++)
+			{
+				if (candidate->second == blockId)
+				{
+					HashIndex.erase(candidate);
+					break;
+				}
+			}
+			storedBlock.Data.reset();
+			FreeBlockIds.push_back(blockId);
+			Statistics.UB--;
+		}
+	}
+}
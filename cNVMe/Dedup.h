@@ -0,0 +1,143 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Dedup.h - A header file for the Deduplicating media
+*/
+
+#pragma once
+
+#include "LogPage.h"
+#include "Media.h"
+#include "Types.h"
+
+#include <memory>
+#include <unordered_map>
+
+#define DEDUP_MAP_PAGE_ENTRIES 1024 // LBAs per page of the LBA -> stored block map (pages are allocated once written)
+#define DEDUP_ZERO_BLOCK 0 // Stored block ID of every all zero (or unwritten) LBA. Takes no storage.
+
+namespace cnvme
+{
+	namespace media
+	{
+		/// <summary>
+		/// Content addressed in-memory media. Each written logical block is hashed (CRC32C) and stored once no matter how
+		///   many LBAs hold the same data: LBAs map to reference counted stored blocks, and a hash index (checked byte for byte,
+		///   so collisions are harmless) finds an existing copy. All zero blocks map to DEDUP_ZERO_BLOCK and take no storage at all.
+		/// Copies just map the destination to the source's stored blocks.
+		/// Statistics, including the deduplication ratio, are returned as a vendor specific log page.
+		/// </summary>
+		class DedupMedia : public MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			/// <param name="blockSize">Size of a logical block in bytes</param>
+			/// <param name="numberOfBlocks">Number of logical blocks in the media</param>
+			DedupMedia(UINT_32 blockSize, UINT_64 numberOfBlocks);
+
+			bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override;
+			bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) override;
+			bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Copies by pointing the destination LBAs at the source's stored blocks. No data is moved.
+			/// </summary>
+			bool copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Drops every stored block and the whole map
+			/// </summary>
+			bool format() override;
+
+			/// <summary>
+			/// Returns the current statistics as the deduplication log page
+			/// </summary>
+			/// <returns>DEDUP_STATISTICS_LOG</returns>
+			logpages::DEDUP_STATISTICS_LOG getStatistics();
+
+		private:
+			/// <summary>
+			/// A unique block of data
+			/// </summary>
+			struct StoredBlock
+			{
+				/// <summary>
+				/// Number of LBAs mapped to this block. 0 if the ID is free.
+				/// </summary>
+				UINT_32 References;
+
+				/// <summary>
+				/// CRC32C of Data
+				/// </summary>
+				UINT_32 Hash;
+
+				/// <summary>
+				/// The block's data (BlockSize bytes)
+				/// </summary>
+				std::unique_ptr<BYTE[]> Data;
+			};
+
+			/// <summary>
+			/// Returns the stored block ID the LBA maps to. Must be called with DedupMutex held.
+			/// </summary>
+			/// <param name="lba">LBA</param>
+			/// <returns>Stored block ID</returns>
+			UINT_32 getBlockIdLocked(UINT_64 lba);
+
+			/// <summary>
+			/// Maps the LBA to a stored block ID (which must already count this reference), releasing whatever it mapped to before.
+			/// Must be called with DedupMutex held.
+			/// </summary>
+			/// <param name="lba">LBA</param>
+			/// <param name="blockId">Stored block ID</param>
+			void mapLocked(UINT_64 lba, UINT_32 blockId);
+
+			/// <summary>
+			/// Finds a stored block holding the given data, or stores a new one, and adds a reference to it.
+			/// Must be called with DedupMutex held.
+			/// </summary>
+			/// <param name="data">Block of data (not all zeros)</param>
+			/// <param name="hash">CRC32C of data</param>
+			/// <returns>Stored block ID</returns>
+			UINT_32 storeLocked(const BYTE* data, UINT_32 hash);
+
+			/// <summary>
+			/// Drops a reference to a stored block, freeing it if it was the last. Must be called with DedupMutex held.
+			/// </summary>
+			/// <param name="blockId">Stored block ID</param>
+			void releaseLocked(UINT_32 blockId);
+
+			/// <summary>
+			/// Page index -> DEDUP_MAP_PAGE_ENTRIES stored block IDs
+			/// </summary>
+			std::unordered_map<UINT_64, std::unique_ptr<UINT_32[]>> MapPages;
+
+			/// <summary>
+			/// Stored block ID -> stored block. ID 0 (DEDUP_ZERO_BLOCK) is never used.
+			/// </summary>
+			std::vector<StoredBlock> Blocks;
+
+			/// <summary>
+			/// Stored block IDs free for reuse
+			/// </summary>
+			std::vector<UINT_32> FreeBlockIds;
+
+			/// <summary>
+			/// CRC32C -> stored block IDs with that hash
+			/// </summary>
+			std::unordered_multimap<UINT_32, UINT_32> HashIndex;
+
+			/// <summary>
+			/// Counters for the log page. Ratios and sizes are filled in by getStatistics().
+			/// </summary>
+			logpages::DEDUP_STATISTICS_LOG Statistics;
+
+			/// <summary>
+			/// Guards everything above
+			/// </summary>
+			std::mutex DedupMutex;
+		};
+	}
+}
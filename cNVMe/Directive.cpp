@@ -0,0 +1,122 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Directive.cpp - An implementation file for NVMe Directives (Identify and Streams)
+*/
+
+#include "Directive.h"
+#include "Strings.h"
+
+#include <algorithm>
+
+namespace cnvme
+{
+	namespace directives
+	{
+		std::string IDENTIFY_RETURN_PARAMETERS::toString() const
+		{
+			std::string retStr;
+			retStr += "Identify Directive Return Parameters:\n";
+			retStr += strings::toString(ToStringParams(DS[0], "Directives Supported (types 7:0)"));
+			retStr += strings::toString(ToStringParams(DE[0], "Directives Enabled (types 7:0)"));
+			return retStr;
+		}
+
+		std::string STREAMS_RETURN_PARAMETERS::toString() const
+		{
+			std::string retStr;
+			retStr += "Streams Directive Return Parameters:\n";
+			retStr += strings::toString(ToStringParams(MSL, "Max Streams Limit"));
+			retStr += strings::toString(ToStringParams(NSSA, "NVM Subsystem Streams Available"));
+			retStr += strings::toString(ToStringParams(NSSO, "NVM Subsystem Streams Open"));
+			retStr += strings::toString(ToStringParams(NSSC, "NVM Subsystem Stream Capability"));
+			retStr += strings::toString(ToStringParams(SWS, "Stream Write Size"));
+			retStr += strings::toString(ToStringParams(SGS, "Stream Granularity Size"));
+			retStr += strings::toString(ToStringParams(NSA, "Namespace Streams Allocated"));
+			retStr += strings::toString(ToStringParams(NSO, "Namespace Streams Open"));
+			return retStr;
+		}
+
+		Streams::Streams()
+		{
+			Enabled = false;
+			AllocatedStreams = 0;
+		}
+
+		bool Streams::isEnabled()
+		{
+			std::lock_guard<std::mutex> lock(StreamsMutex);
+			return Enabled;
+		}
+
+		void Streams::setEnabled(bool enabled)
+		{
+			std::lock_guard<std::mutex> lock(StreamsMutex);
+			Enabled = enabled;
+			if (!enabled)
+			{
+				AllocatedStreams = 0;
+				OpenStreams.clear();
+			}
+		}
+
+		UINT_16 Streams::getAllocatedStreams()
+		{
+			std::lock_guard<std::mutex> lock(StreamsMutex);
+			return AllocatedStreams;
+		}
+
+		void Streams::setAllocatedStreams(UINT_16 allocatedStreams)
+		{
+			std::lock_guard<std::mutex> lock(StreamsMutex);
+			AllocatedStreams = allocatedStreams;
+			while (OpenStreams.size() > getOpenLimitLocked())
+			{
+				OpenStreams.pop_front();
+			}
+		}
+
+		void Streams::open(UINT_16 streamId)
+		{
+			std::lock_guard<std::mutex> lock(StreamsMutex);
+			auto openStream = std::find(OpenStreams.begin(), OpenStreams.end(), streamId);
+			if (openStream != OpenStreams.end())
+			{
+				OpenStreams.splice(OpenStreams.end(), OpenStreams, openStream); // Most recently written
+				return;
+			}
+
+			if (OpenStreams.size() >= getOpenLimitLocked())
+			{
+				OpenStreams.pop_front(); // Implicitly release the least recently written
+			}
+			OpenStreams.push_back(streamId);
+		}
+
+		void Streams::release(UINT_16 streamId)
+		{
+			std::lock_guard<std::mutex> lock(StreamsMutex);
+			OpenStreams.remove(streamId);
+		}
+
+		void Streams::releaseResources()
+		{
+			std::lock_guard<std::mutex> lock(StreamsMutex);
+			AllocatedStreams = 0;
+			OpenStreams.clear();
+		}
+
+		std::vector<UINT_16> Streams::getOpenStreams()
+		{
+			std::lock_guard<std::mutex> lock(StreamsMutex);
+			std::vector<UINT_16> openStreams(OpenStreams.begin(), OpenStreams.end());
+			std::sort(openStreams.begin(), openStreams.end());
+			return openStreams;
+		}
+
+		size_t Streams::getOpenLimitLocked()
+		{
+			return AllocatedStreams ? AllocatedStreams : STREAMS_MAX_STREAMS;
+		}
+	}
+}
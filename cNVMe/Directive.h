@@ -0,0 +1,145 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Directive.h - A header file for NVMe Directives (Identify and Streams)
+*/
+
+#pragma once
+
+#include "Types.h"
+
+#include <list>
+#include <mutex>
+#include <vector>
+
+#define STREAMS_MAX_STREAMS 16 // MSL: streams the whole subsystem can have allocated or open
+#define STREAMS_WRITE_SIZE 4096 // SWS: optimal write size in bytes for a stream
+#define STREAMS_GRANULARITY_SIZE 256 // SGS: stream granularity in units of SWS (one erase block's worth on the FTL model)
+
+namespace cnvme
+{
+	namespace directives
+	{
+		/// <summary>
+		/// Data returned by Directive Receive / Identify / Return Parameters
+		/// </summary>
+		typedef struct IDENTIFY_RETURN_PARAMETERS
+		{
+			UINT_8 DS[32]; // Directives Supported (one bit per directive type)
+			UINT_8 DE[32]; // Directives Enabled (one bit per directive type)
+			UINT_8 RSVD0[4032]; // Reserved
+
+			std::string toString() const;
+		}IDENTIFY_RETURN_PARAMETERS, *PIDENTIFY_RETURN_PARAMETERS;
+		static_assert(sizeof(IDENTIFY_RETURN_PARAMETERS) == 4096, "IDENTIFY_RETURN_PARAMETERS should be 4096 byte(s) in size.");
+
+		/// <summary>
+		/// Data returned by Directive Receive / Streams / Return Parameters
+		/// </summary>
+		typedef struct STREAMS_RETURN_PARAMETERS
+		{
+			UINT_16 MSL; // Max Streams Limit
+			UINT_16 NSSA; // NVM Subsystem Streams Available
+			UINT_16 NSSO; // NVM Subsystem Streams Open
+			UINT_8 NSSC; // NVM Subsystem Stream Capability
+			UINT_8 RSVD0[9]; // Reserved
+			UINT_32 SWS; // Stream Write Size (bytes)
+			UINT_16 SGS; // Stream Granularity Size (in SWS units)
+			UINT_16 NSA; // Namespace Streams Allocated
+			UINT_16 NSO; // Namespace Streams Open
+			UINT_8 RSVD1[6]; // Reserved
+
+			std::string toString() const;
+		}STREAMS_RETURN_PARAMETERS, *PSTREAMS_RETURN_PARAMETERS;
+		static_assert(sizeof(STREAMS_RETURN_PARAMETERS) == 32, "STREAMS_RETURN_PARAMETERS should be 32 byte(s) in size.");
+
+		/// <summary>
+		/// The Streams directive state of one namespace: whether it's enabled, the stream resources allocated to it, and its open streams.
+		/// Writes open streams implicitly. Once the namespace has as many open as it may, the least recently written one is released.
+		/// Safe to use from many threads at once.
+		/// </summary>
+		class Streams
+		{
+		public:
+			/// <summary>
+			/// Constructor. Streams start out disabled.
+			/// </summary>
+			Streams();
+
+			/// <summary>
+			/// Returns true if the Streams directive is enabled
+			/// </summary>
+			/// <returns>True if enabled</returns>
+			bool isEnabled();
+
+			/// <summary>
+			/// Enables or disables the Streams directive. Disabling releases every stream and the allocated resources.
+			/// </summary>
+			/// <param name="enabled">True to enable</param>
+			void setEnabled(bool enabled);
+
+			/// <summary>
+			/// Returns the number of streams allocated to the namespace (NSA)
+			/// </summary>
+			/// <returns>Allocated streams</returns>
+			UINT_16 getAllocatedStreams();
+
+			/// <summary>
+			/// Sets the number of streams allocated to the namespace, releasing open streams beyond it (least recently written first)
+			/// </summary>
+			/// <param name="allocatedStreams">Allocated streams</param>
+			void setAllocatedStreams(UINT_16 allocatedStreams);
+
+			/// <summary>
+			/// Marks a stream as just written, opening it if needed
+			/// </summary>
+			/// <param name="streamId">Stream identifier (not 0)</param>
+			void open(UINT_16 streamId);
+
+			/// <summary>
+			/// Releases a stream identifier. Does nothing if it isn't open.
+			/// </summary>
+			/// <param name="streamId">Stream identifier</param>
+			void release(UINT_16 streamId);
+
+			/// <summary>
+			/// Releases every open stream and the allocated resources
+			/// </summary>
+			void releaseResources();
+
+			/// <summary>
+			/// Returns the open stream identifiers in ascending order
+			/// </summary>
+			/// <returns>Open stream identifiers</returns>
+			std::vector<UINT_16> getOpenStreams();
+
+		private:
+			/// <summary>
+			/// Most streams that may be open at once: the allocated ones, or all of MSL if none are allocated.
+			/// Must be called with StreamsMutex held.
+			/// </summary>
+			/// <returns>Limit</returns>
+			size_t getOpenLimitLocked();
+
+			/// <summary>
+			/// True if the Streams directive is enabled
+			/// </summary>
+			bool Enabled;
+
+			/// <summary>
+			/// Streams allocated to the namespace
+			/// </summary>
+			UINT_16 AllocatedStreams;
+
+			/// <summary>
+			/// Open stream identifiers, least recently written first
+			/// </summary>
+			std::list<UINT_16> OpenStreams;
+
+			/// <summary>
+			/// Guards everything above
+			/// </summary>
+			std::mutex StreamsMutex;
+		};
+	}
+}
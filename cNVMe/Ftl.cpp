@@ -0,0 +1,341 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Ftl.cpp - An implementation file for the Flash Translation Layer (FTL) media model
+*/
+
+#include "Ftl.h"
+
+#include <algorithm>
+
+namespace cnvme
+{
+	namespace media
+	{
+		FtlMedia::FtlMedia(UINT_32 blockSize, UINT_64 numberOfBlocks, UINT_32 pagesPerEraseBlock, UINT_32 eraseBlocksPerSuperblock,
+			UINT_32 overprovisioningPercent, FTL_GC_POLICY gcPolicy, UINT_32 streamSlots) : MediaBackend(blockSize, numberOfBlocks)
+		{
+			ASSERT_IF(streamSlots > STREAM_STATISTICS_MAX_SLOTS, "FTL has too many stream slots");
+			PagesPerSuperblock = pagesPerEraseBlock * eraseBlocksPerSuperblock;
+			OverprovisioningPercent = overprovisioningPercent;
+			GcPolicy = gcPolicy;
+
+			// The host's data plus overprovisioning, plus the free superblocks GC keeps in reserve and the open ones
+			//   (GC's and one per stream slot), so the reserve doesn't eat into the overprovisioning
+			UINT_64 physicalSuperblocks = (numberOfBlocks * (100 + overprovisioningPercent) / 100 + PagesPerSuperblock - 1) / PagesPerSuperblock;
+			physicalSuperblocks += FTL_GC_BACKGROUND_FREE_SUPERBLOCKS + 2 + streamSlots;
+			ASSERT_IF(PagesPerSuperblock == 0 || physicalSuperblocks * PagesPerSuperblock >= FTL_INVALID_PAGE, "FTL geometry is invalid or too large to map");
+
+			LogicalToPhysical.assign((size_t)numberOfBlocks, FTL_INVALID_PAGE);
+			PhysicalToLogical.assign((size_t)(physicalSuperblocks * PagesPerSuperblock), FTL_INVALID_PAGE);
+			Superblocks.resize((size_t)physicalSuperblocks);
+			for (UINT_64 i = physicalSuperblocks; i > 0; i--)
+			{
+				Superblocks[(size_t)i - 1].ValidPages = 0;
+				Superblocks[(size_t)i - 1].ProgrammedPages = 0;
+				Superblocks[(size_t)i - 1].EraseCount = 0;
+				Superblocks[(size_t)i - 1].LastWriteSequence = 0;
+				FreeSuperblocks.push_back((UINT_32)i - 1);
+			}
+
+			HostOpenSuperblocks.assign(streamSlots + 1, FTL_INVALID_PAGE);
+			if (streamSlots)
+			{
+				StreamSlots.assign((size_t)numberOfBlocks, 0);
+			}
+			GcOpenSuperblock = FTL_INVALID_PAGE;
+			GcVictim = FTL_INVALID_PAGE;
+			GcCursor = 0;
+			WriteSequence = 0;
+			Statistics = { 0 };
+			StreamStatistics.assign(streamSlots + 1, logpages::STREAM_STATISTICS_ENTRY());
+			Deterministic = false;
+
+			GcThread = LoopingThread([&] {FtlMedia::backgroundGarbageCollection(); }, FTL_GC_SLEEP_MS);
+			GcThread.start();
+		}
+
+		FtlMedia::~FtlMedia()
+		{
+			GcThread.end();
+		}
+
+		bool FtlMedia::read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to read out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(FtlMutex);
+			for (UINT_32 i = 0; i < numberOfBlocks; i++, buffer += BlockSize)
+			{
+				UINT_32 physicalPage = LogicalToPhysical[(size_t)(lba + i)];
+				if (physicalPage == FTL_INVALID_PAGE)
+				{
+					memset(buffer, 0, BlockSize); // Unmapped
+					continue;
+				}
+
+				Superblock &superblock = Superblocks[physicalPage / PagesPerSuperblock];
+				memcpy(buffer, superblock.Data->getBuffer() + (size_t)(physicalPage % PagesPerSuperblock) * BlockSize, BlockSize);
+			}
+			return true;
+		}
+
+		bool FtlMedia::write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to write out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(FtlMutex);
+			for (UINT_32 i = 0; i < numberOfBlocks; i++, buffer += BlockSize)
+			{
+				UINT_32 streamSlot = getStreamSlotLocked(lba + i);
+				UINT_32 &hostOpenSuperblock = HostOpenSuperblocks[streamSlot];
+				bool needsNewSuperblock = hostOpenSuperblock == FTL_INVALID_PAGE || Superblocks[hostOpenSuperblock].ProgrammedPages == PagesPerSuperblock;
+				if (needsNewSuperblock && FreeSuperblocks.size() <= FTL_GC_FOREGROUND_FREE_SUPERBLOCKS)
+				{
+					// Out of room. This write has to wait for GC.
+					auto start = std::chrono::steady_clock::now();
+					while (FreeSuperblocks.size() <= FTL_GC_FOREGROUND_FREE_SUPERBLOCKS && collectGarbageLocked(PagesPerSuperblock))
+					{
+					}
+					UINT_64 stallMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+					Statistics.FGCS++;
+					Statistics.FGCST += stallMicroseconds;
+					Statistics.MFGCST = std::max<UINT_64>(Statistics.MFGCST, stallMicroseconds);
+				}
+
+				invalidateLocked(lba + i);
+				programPageLocked(hostOpenSuperblock, lba + i, buffer);
+				Statistics.HPW++;
+				StreamStatistics[streamSlot].HPW++;
+			}
+			return true;
+		}
+
+		bool FtlMedia::deallocate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to deallocate out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(FtlMutex);
+			for (UINT_64 i = 0; i < numberOfBlocks; i++)
+			{
+				invalidateLocked(lba + i);
+			}
+			return true;
+		}
+
+		bool FtlMedia::format()
+		{
+			std::lock_guard<std::mutex> lock(FtlMutex);
+			std::fill(LogicalToPhysical.begin(), LogicalToPhysical.end(), FTL_INVALID_PAGE);
+			std::fill(PhysicalToLogical.begin(), PhysicalToLogical.end(), FTL_INVALID_PAGE);
+			std::fill(StreamSlots.begin(), StreamSlots.end(), 0);
+			for (Superblock &superblock : Superblocks)
+			{
+				superblock.ValidPages = 0;
+			}
+			return true;
+		}
+
+		logpages::FTL_STATISTICS_LOG FtlMedia::getStatistics()
+		{
+			std::lock_guard<std::mutex> lock(FtlMutex);
+			logpages::FTL_STATISTICS_LOG statistics = Statistics;
+			statistics.WAF = statistics.HPW ? (UINT_32)(statistics.NPW * 1000 / statistics.HPW) : 0;
+			statistics.TSB = (UINT_32)Superblocks.size();
+			statistics.FSB = (UINT_32)FreeSuperblocks.size();
+			statistics.PPSB = PagesPerSuperblock;
+			statistics.OP = OverprovisioningPercent;
+			statistics.GCP = (UINT_8)GcPolicy;
+			for (const Superblock &superblock : Superblocks)
+			{
+				statistics.MEC = std::max<UINT_64>(statistics.MEC, superblock.EraseCount);
+			}
+			return statistics;
+		}
+
+		bool FtlMedia::setStream(UINT_64 lba, UINT_64 numberOfBlocks, UINT_16 streamId)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to set the stream out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			if (StreamSlots.empty())
+			{
+				return true; // Streams all share one open superblock
+			}
+
+			UINT_32 numberOfStreamSlots = (UINT_32)HostOpenSuperblocks.size() - 1;
+			UINT_8 streamSlot = streamId ? (UINT_8)((streamId - 1) % numberOfStreamSlots + 1) : 0;
+			std::lock_guard<std::mutex> lock(FtlMutex);
+			std::fill(StreamSlots.begin() + (size_t)lba, StreamSlots.begin() + (size_t)(lba + numberOfBlocks), streamSlot);
+			return true;
+		}
+
+		logpages::STREAM_STATISTICS_LOG FtlMedia::getStreamStatistics()
+		{
+			std::lock_guard<std::mutex> lock(FtlMutex);
+			logpages::STREAM_STATISTICS_LOG statistics = { 0 };
+			statistics.NSS = (UINT_32)HostOpenSuperblocks.size() - 1;
+			for (size_t i = 0; i < StreamStatistics.size(); i++)
+			{
+				statistics.SE[i] = StreamStatistics[i];
+				statistics.SE[i].WAF = statistics.SE[i].HPW ? (UINT_32)(statistics.SE[i].NPW * 1000 / statistics.SE[i].HPW) : 0;
+			}
+			return statistics;
+		}
+
+		void FtlMedia::setDeterministic(bool deterministic)
+		{
+			Deterministic = deterministic;
+		}
+
+		void FtlMedia::backgroundGarbageCollection()
+		{
+			// Work in small steps so host writes can get the lock in between
+			while (!Deterministic)
+			{
+				std::lock_guard<std::mutex> lock(FtlMutex);
+				if (FreeSuperblocks.size() >= FTL_GC_BACKGROUND_FREE_SUPERBLOCKS || !collectGarbageLocked(FTL_GC_BACKGROUND_BATCH_PAGES))
+				{
+					return;
+				}
+			}
+		}
+
+		bool FtlMedia::collectGarbageLocked(UINT_32 maxPages)
+		{
+			if (GcVictim == FTL_INVALID_PAGE)
+			{
+				GcVictim = pickVictimLocked();
+				GcCursor = 0;
+				if (GcVictim == FTL_INVALID_PAGE)
+				{
+					return false;
+				}
+			}
+
+			Superblock &victim = Superblocks[GcVictim];
+			UINT_32 firstPage = GcVictim * PagesPerSuperblock;
+			UINT_32 relocatedPages = 0;
+			for (; GcCursor < victim.ProgrammedPages && relocatedPages < maxPages; GcCursor++)
+			{
+				UINT_32 lba = PhysicalToLogical[firstPage + GcCursor];
+				if (lba == FTL_INVALID_PAGE)
+				{
+					continue; // Stale
+				}
+
+				// Programming can't pick the victim: it is neither free nor open
+				invalidateLocked(lba);
+				programPageLocked(GcOpenSuperblock, lba, victim.Data->getBuffer() + (size_t)GcCursor * BlockSize);
+				Statistics.GCPR++;
+				relocatedPages++;
+			}
+
+			if (GcCursor == victim.ProgrammedPages)
+			{
+				// Everything valid has moved. Erase.
+				victim.ValidPages = 0;
+				victim.ProgrammedPages = 0;
+				victim.EraseCount++;
+				victim.Data.reset();
+				FreeSuperblocks.push_back(GcVictim);
+				Statistics.SBE++;
+				GcVictim = FTL_INVALID_PAGE;
+			}
+			return true;
+		}
+
+		UINT_32 FtlMedia::pickVictimLocked()
+		{
+			UINT_32 bestSuperblock = FTL_INVALID_PAGE;
+			double bestScore = 0;
+			for (UINT_32 i = 0; i < Superblocks.size(); i++)
+			{
+				const Superblock &superblock = Superblocks[i];
+				bool open = i == GcOpenSuperblock || std::find(HostOpenSuperblocks.begin(), HostOpenSuperblocks.end(), i) != HostOpenSuperblocks.end();
+				if (open || superblock.ProgrammedPages != PagesPerSuperblock || superblock.ValidPages == PagesPerSuperblock)
+				{
+					continue; // Free, open, or nothing to gain
+				}
+
+				double utilization = (double)superblock.ValidPages / PagesPerSuperblock;
+				double score;
+				if (GcPolicy == FTL_GC_POLICY_COST_BENEFIT)
+				{
+					double age = (double)(WriteSequence - superblock.LastWriteSequence + 1);
+					score = utilization == 0 ? INFINITY : (1 - utilization) * age / (2 * utilization);
+				}
+				else
+				{
+					score = 1 - utilization;
+				}
+
+				if (bestSuperblock == FTL_INVALID_PAGE || score > bestScore)
+				{
+					bestSuperblock = i;
+					bestScore = score;
+				}
+			}
+			return bestSuperblock;
+		}
+
+		void FtlMedia::programPageLocked(UINT_32 &openSuperblock, UINT_64 lba, const BYTE* data)
+		{
+			if (openSuperblock == FTL_INVALID_PAGE || Superblocks[openSuperblock].ProgrammedPages == PagesPerSuperblock)
+			{
+				ASSERT_IF(FreeSuperblocks.empty(), "FTL ran out of free superblocks. GC thresholds are too low for this geometry.");
+				openSuperblock = FreeSuperblocks.back();
+				FreeSuperblocks.pop_back();
+			}
+
+			Superblock &superblock = Superblocks[openSuperblock];
+			if (!superblock.Data)
+			{
+				superblock.Data.reset(new Payload(PagesPerSuperblock * BlockSize));
+			}
+
+			UINT_32 physicalPage = openSuperblock * PagesPerSuperblock + superblock.ProgrammedPages;
+			memcpy(superblock.Data->getBuffer() + (size_t)superblock.ProgrammedPages * BlockSize, data, BlockSize);
+			superblock.ProgrammedPages++;
+			superblock.ValidPages++;
+			superblock.LastWriteSequence = ++WriteSequence;
+
+			LogicalToPhysical[(size_t)lba] = physicalPage;
+			PhysicalToLogical[physicalPage] = (UINT_32)lba;
+			Statistics.NPW++;
+			StreamStatistics[getStreamSlotLocked(lba)].NPW++;
+		}
+
+		void FtlMedia::invalidateLocked(UINT_64 lba)
+		{
+			UINT_32 physicalPage = LogicalToPhysical[(size_t)lba];
+			if (physicalPage != FTL_INVALID_PAGE)
+			{
+				Superblocks[physicalPage / PagesPerSuperblock].ValidPages--;
+				PhysicalToLogical[physicalPage] = FTL_INVALID_PAGE;
+				LogicalToPhysical[(size_t)lba] = FTL_INVALID_PAGE;
+			}
+		}
+
+		UINT_32 FtlMedia::getStreamSlotLocked(UINT_64 lba)
+		{
+			return StreamSlots.empty() ? 0 : StreamSlots[(size_t)lba];
+		}
+	}
+}
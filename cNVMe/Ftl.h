@@ -0,0 +1,269 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Ftl.h - A header file for the Flash Translation Layer (FTL) media model
+*/
+
+#pragma once
+
+#include "LogPage.h"
+#include "LoopingThread.h"
+#include "Media.h"
+#include "Types.h"
+
+#include <memory>
+
+#define FTL_DEFAULT_PAGES_PER_ERASE_BLOCK 256
+#define FTL_DEFAULT_ERASE_BLOCKS_PER_SUPERBLOCK 4
+#define FTL_DEFAULT_OVERPROVISIONING_PERCENT 7
+
+#define FTL_GC_BACKGROUND_FREE_SUPERBLOCKS 4 // Background GC runs while there are fewer free superblocks than this
+#define FTL_GC_FOREGROUND_FREE_SUPERBLOCKS 2 // Host writes stall for GC while there are this many free superblocks or fewer
+#define FTL_GC_BACKGROUND_BATCH_PAGES 64 // Pages relocated per background GC step (the lock is dropped between steps)
+#define FTL_GC_SLEEP_MS 1
+
+#define FTL_INVALID_PAGE 0xFFFFFFFF
+
+namespace cnvme
+{
+	namespace media
+	{
+		/// <summary>
+		/// How garbage collection picks the superblock to reclaim
+		/// </summary>
+		enum FTL_GC_POLICY
+		{
+			FTL_GC_POLICY_GREEDY = 0, // Fewest valid pages
+			FTL_GC_POLICY_COST_BENEFIT = 1, // Best (1 - u) * age / 2u, which prefers cold superblocks
+		};
+
+		/// <summary>
+		/// A NAND flash model behind a page mapped FTL.
+		/// A page holds one logical block. Pages are programmed in order within a superblock
+		///   (a group of erase blocks that are erased together), and an overwrite just remaps the LBA
+		///   and leaves the old page stale. Garbage collection relocates the valid pages out of a victim
+		///   superblock and erases it, mostly in a background thread, but inline (stalling the host write)
+		///   when free superblocks run out. Write amplification and stalls are tracked for the FTL log page.
+		/// With stream slots, each stream's host writes go to their own open superblock, so data the host says
+		///   has a similar lifetime is erased together. Write amplification is also tracked per slot.
+		/// </summary>
+		class FtlMedia : public MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			/// <param name="blockSize">Size of a logical block (and NAND page) in bytes</param>
+			/// <param name="numberOfBlocks">Number of logical blocks exposed to the host</param>
+			/// <param name="pagesPerEraseBlock">Pages per erase block</param>
+			/// <param name="eraseBlocksPerSuperblock">Erase blocks per superblock</param>
+			/// <param name="overprovisioningPercent">Extra physical space (beyond numberOfBlocks) in percent</param>
+			/// <param name="gcPolicy">FTL_GC_POLICY used to pick victims</param>
+			/// <param name="streamSlots">Streams that get their own open superblock (at most STREAM_STATISTICS_MAX_SLOTS). 0 to ignore streams.</param>
+			FtlMedia(UINT_32 blockSize, UINT_64 numberOfBlocks, UINT_32 pagesPerEraseBlock = FTL_DEFAULT_PAGES_PER_ERASE_BLOCK,
+				UINT_32 eraseBlocksPerSuperblock = FTL_DEFAULT_ERASE_BLOCKS_PER_SUPERBLOCK, UINT_32 overprovisioningPercent = FTL_DEFAULT_OVERPROVISIONING_PERCENT,
+				FTL_GC_POLICY gcPolicy = FTL_GC_POLICY_GREEDY, UINT_32 streamSlots = 0);
+
+			/// <summary>
+			/// Destructor. Stops background garbage collection.
+			/// </summary>
+			~FtlMedia();
+
+			bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override;
+			bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) override;
+			bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Unmaps every LBA and marks every superblock as holding no valid pages. Nothing is erased here:
+			///   garbage collection erases the superblocks (with nothing to relocate) as it needs them.
+			/// </summary>
+			bool format() override;
+
+			/// <summary>
+			/// Returns the current statistics as the FTL log page
+			/// </summary>
+			/// <returns>FTL_STATISTICS_LOG</returns>
+			logpages::FTL_STATISTICS_LOG getStatistics();
+
+			/// <summary>
+			/// Tags the LBAs with the slot of the stream. Stream S (not 0) uses slot ((S - 1) % streamSlots) + 1.
+			/// </summary>
+			bool setStream(UINT_64 lba, UINT_64 numberOfBlocks, UINT_16 streamId) override;
+
+			/// <summary>
+			/// Returns the per stream slot write amplification as the Stream Statistics log page
+			/// </summary>
+			/// <returns>STREAM_STATISTICS_LOG</returns>
+			logpages::STREAM_STATISTICS_LOG getStreamStatistics();
+
+			/// <summary>
+			/// Pauses background garbage collection while deterministic. Host writes still stall for foreground GC
+			///   if free superblocks run that low.
+			/// </summary>
+			void setDeterministic(bool deterministic) override;
+
+		private:
+			/// <summary>
+			/// Physical state of a superblock
+			/// </summary>
+			struct Superblock
+			{
+				/// <summary>
+				/// Pages still mapped by an LBA
+				/// </summary>
+				UINT_32 ValidPages;
+
+				/// <summary>
+				/// Pages programmed since the last erase (the next page to program)
+				/// </summary>
+				UINT_32 ProgrammedPages;
+
+				/// <summary>
+				/// Number of times this superblock has been erased
+				/// </summary>
+				UINT_64 EraseCount;
+
+				/// <summary>
+				/// WriteSequence of the last page programmed here (for cost-benefit age)
+				/// </summary>
+				UINT_64 LastWriteSequence;
+
+				/// <summary>
+				/// Page data. Allocated on first program after an erase, freed on erase.
+				/// </summary>
+				std::unique_ptr<Payload> Data;
+			};
+
+			/// <summary>
+			/// Background garbage collection step. Called by GcThread.
+			/// </summary>
+			void backgroundGarbageCollection();
+
+			/// <summary>
+			/// Relocates up to maxPages valid pages out of the current victim (picking one if needed),
+			///   erasing the victim once it is empty. Must be called with FtlMutex held.
+			/// </summary>
+			/// <param name="maxPages">Most valid pages to relocate in this call</param>
+			/// <returns>False if there is nothing worth collecting</returns>
+			bool collectGarbageLocked(UINT_32 maxPages);
+
+			/// <summary>
+			/// Picks the next victim superblock with GcPolicy. Must be called with FtlMutex held.
+			/// </summary>
+			/// <returns>Superblock index or FTL_INVALID_PAGE if there is none</returns>
+			UINT_32 pickVictimLocked();
+
+			/// <summary>
+			/// Programs one page into the given open superblock, opening a new one from the free list if needed.
+			/// Must be called with FtlMutex held.
+			/// </summary>
+			/// <param name="openSuperblock">One of HostOpenSuperblocks or GcOpenSuperblock</param>
+			/// <param name="lba">LBA the page belongs to</param>
+			/// <param name="data">getBlockSize() bytes to program</param>
+			void programPageLocked(UINT_32 &openSuperblock, UINT_64 lba, const BYTE* data);
+
+			/// <summary>
+			/// Marks the page currently mapped to lba (if any) as stale. Must be called with FtlMutex held.
+			/// </summary>
+			/// <param name="lba">The LBA</param>
+			void invalidateLocked(UINT_64 lba);
+
+			/// <summary>
+			/// Returns the stream slot the LBA is tagged with (0 if none). Must be called with FtlMutex held.
+			/// </summary>
+			/// <param name="lba">The LBA</param>
+			/// <returns>Stream slot</returns>
+			UINT_32 getStreamSlotLocked(UINT_64 lba);
+
+			/// <summary>
+			/// Pages per superblock
+			/// </summary>
+			UINT_32 PagesPerSuperblock;
+
+			/// <summary>
+			/// Overprovisioning in percent
+			/// </summary>
+			UINT_32 OverprovisioningPercent;
+
+			/// <summary>
+			/// Victim selection policy
+			/// </summary>
+			FTL_GC_POLICY GcPolicy;
+
+			/// <summary>
+			/// Logical to physical map. LBA -> physical page number or FTL_INVALID_PAGE if unmapped.
+			/// </summary>
+			std::vector<UINT_32> LogicalToPhysical;
+
+			/// <summary>
+			/// Physical to logical map. Physical page number -> LBA or FTL_INVALID_PAGE if stale / unprogrammed.
+			/// </summary>
+			std::vector<UINT_32> PhysicalToLogical;
+
+			/// <summary>
+			/// All superblocks
+			/// </summary>
+			std::vector<Superblock> Superblocks;
+
+			/// <summary>
+			/// Erased superblocks ready to be opened
+			/// </summary>
+			std::vector<UINT_32> FreeSuperblocks;
+
+			/// <summary>
+			/// Stream slot -> superblock its host writes go to (FTL_INVALID_PAGE if none is open). Slot 0 is writes without a stream.
+			/// </summary>
+			std::vector<UINT_32> HostOpenSuperblocks;
+
+			/// <summary>
+			/// LBA -> stream slot it was last tagged with. Empty without stream slots.
+			/// </summary>
+			std::vector<UINT_8> StreamSlots;
+
+			/// <summary>
+			/// Superblock GC relocations go to. Kept apart from host writes so relocated (cold) data stays together.
+			/// </summary>
+			UINT_32 GcOpenSuperblock;
+
+			/// <summary>
+			/// Superblock being collected (FTL_INVALID_PAGE if none)
+			/// </summary>
+			UINT_32 GcVictim;
+
+			/// <summary>
+			/// Next page in GcVictim to look at
+			/// </summary>
+			UINT_32 GcCursor;
+
+			/// <summary>
+			/// Incremented for every page programmed
+			/// </summary>
+			UINT_64 WriteSequence;
+
+			/// <summary>
+			/// Counters for the log page. TSB/FSB/WAF/etc are filled in by getStatistics().
+			/// </summary>
+			logpages::FTL_STATISTICS_LOG Statistics;
+
+			/// <summary>
+			/// Per stream slot counters for the Stream Statistics log page. WAF is filled in by getStreamStatistics().
+			/// </summary>
+			std::vector<logpages::STREAM_STATISTICS_ENTRY> StreamStatistics;
+
+			/// <summary>
+			/// Guards everything above
+			/// </summary>
+			std::mutex FtlMutex;
+
+			/// <summary>
+			/// True while background garbage collection is paused for a deterministic window
+			/// </summary>
+			std::atomic<bool> Deterministic;
+
+			/// <summary>
+			/// Runs backgroundGarbageCollection()
+			/// </summary>
+			LoopingThread GcThread;
+		};
+	}
+}
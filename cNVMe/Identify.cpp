@@ -0,0 +1,59 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Identify.cpp - An implementation file for the NVMe Identify data structures
+*/
+
+#include "Identify.h"
+#include "Strings.h"
+
+namespace cnvme
+{
+	namespace identify
+	{
+		std::string IDENTIFY_CONTROLLER_DATA::toString() const
+		{
+			std::string retStr;
+			retStr += "Identify Controller Data:\n";
+			retStr += strings::toString(ToStringParams(VID, "PCI Vendor ID"));
+			retStr += strings::toString(ToStringParams(SSVID, "PCI Subsystem Vendor ID"));
+			retStr += "Serial Number: " + std::string(SN, sizeof(SN)) + "\n";
+			retStr += "Model Number: " + std::string(MN, sizeof(MN)) + "\n";
+			retStr += "Firmware Revision: " + std::string(FR, sizeof(FR)) + "\n";
+			retStr += strings::toString(ToStringParams(MDTS, "Maximum Data Transfer Size"));
+			retStr += strings::toString(ToStringParams(CNTLID, "Controller ID"));
+			retStr += strings::toString(ToStringParams(VER, "Version"));
+			retStr += strings::toString(ToStringParams(CTRATT, "Controller Attributes"));
+			retStr += strings::toString(ToStringParams(OACS, "Optional Admin Command Support"));
+			retStr += strings::toString(ToStringParams(SANICAP, "Sanitize Capabilities"));
+			retStr += strings::toString(ToStringParams(NSETIDMAX, "NVM Set Identifier Maximum"));
+			retStr += strings::toString(ToStringParams(SQES, "Submission Queue Entry Size"));
+			retStr += strings::toString(ToStringParams(CQES, "Completion Queue Entry Size"));
+			retStr += strings::toString(ToStringParams(NN, "Number of Namespaces"));
+			retStr += strings::toString(ToStringParams(ONCS, "Optional NVM Command Support"));
+			retStr += strings::toString(ToStringParams(VWC, "Volatile Write Cache"));
+			return retStr;
+		}
+
+		std::string IDENTIFY_NAMESPACE_DATA::toString() const
+		{
+			std::string retStr;
+			retStr += "Identify Namespace Data:\n";
+			retStr += strings::toString(ToStringParams(NSZE, "Namespace Size"));
+			retStr += strings::toString(ToStringParams(NCAP, "Namespace Capacity"));
+			retStr += strings::toString(ToStringParams(NUSE, "Namespace Utilization"));
+			retStr += strings::toString(ToStringParams(NLBAF, "Number of LBA Formats"));
+			retStr += strings::toString(ToStringParams(FLBAS, "Formatted LBA Size"));
+			retStr += strings::toString(ToStringParams(DLFEAT, "Deallocate Logical Block Features"));
+			retStr += strings::toString(ToStringParams(NVMSETID, "NVM Set Identifier"));
+			retStr += strings::toString(ToStringParams(LBAF[0].LBADS, "LBA Format 0 LBA Data Size"));
+			return retStr;
+		}
+
+		void setAsciiField(char* field, size_t fieldSize, const std::string &value)
+		{
+			memset(field, ' ', fieldSize);
+			memcpy(field, value.c_str(), std::min(fieldSize, value.size()));
+		}
+	}
+}
@@ -0,0 +1,202 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Identify.h - A header file for the NVMe Identify data structures
+*/
+
+#pragma once
+
+#include "Types.h"
+
+#define IDENTIFY_DATA_SIZE 4096 // Every Identify data structure is this big
+#define ACTIVE_NAMESPACE_ID_LIST_ENTRIES (IDENTIFY_DATA_SIZE / sizeof(UINT_32)) // NSIDs an Active Namespace ID list has room for
+
+namespace cnvme
+{
+	namespace identify
+	{
+		/// <summary>
+		/// Power State Descriptor, one per power state in Identify Controller
+		/// </summary>
+		typedef struct POWER_STATE_DESCRIPTOR
+		{
+			UINT_16 MP; // Maximum Power (centiwatts, or 0.0001 W with MXPS set)
+			UINT_8 RSVD0; // Reserved
+			UINT_8 MXPS : 1; // Max Power Scale
+			UINT_8 NOPS : 1; // Non-Operational State
+			UINT_8 RSVD1 : 6; // Reserved
+			UINT_32 ENLAT; // Entry Latency (microseconds)
+			UINT_32 EXLAT; // Exit Latency (microseconds)
+			UINT_8 RRT; // Relative Read Throughput
+			UINT_8 RRL; // Relative Read Latency
+			UINT_8 RWT; // Relative Write Throughput
+			UINT_8 RWL; // Relative Write Latency
+			UINT_16 IDLP; // Idle Power
+			UINT_8 RSVD2 : 6; // Reserved
+			UINT_8 IPS : 2; // Idle Power Scale
+			UINT_8 RSVD3; // Reserved
+			UINT_16 ACTP; // Active Power
+			UINT_8 APW : 3; // Active Power Workload
+			UINT_8 RSVD4 : 3; // Reserved
+			UINT_8 APS : 2; // Active Power Scale
+			UINT_8 RSVD5[9]; // Reserved
+		}POWER_STATE_DESCRIPTOR, *PPOWER_STATE_DESCRIPTOR;
+		static_assert(sizeof(POWER_STATE_DESCRIPTOR) == 32, "POWER_STATE_DESCRIPTOR should be 32 byte(s) in size.");
+
+		/// <summary>
+		/// Identify Controller data structure (CNS 0x01)
+		/// </summary>
+		typedef struct IDENTIFY_CONTROLLER_DATA
+		{
+			UINT_16 VID; // PCI Vendor ID
+			UINT_16 SSVID; // PCI Subsystem Vendor ID
+			char SN[20]; // Serial Number (ASCII, space padded)
+			char MN[40]; // Model Number (ASCII, space padded)
+			char FR[8]; // Firmware Revision (ASCII, space padded)
+			UINT_8 RAB; // Recommended Arbitration Burst
+			UINT_8 IEEE[3]; // IEEE OUI Identifier
+			UINT_8 CMIC; // Controller Multi-Path I/O and Namespace Sharing Capabilities
+			UINT_8 MDTS; // Maximum Data Transfer Size (power of two of the minimum memory page size, 0 is no limit)
+			UINT_16 CNTLID; // Controller ID
+			UINT_32 VER; // Version (as the VS register)
+			UINT_32 RTD3R; // RTD3 Resume Latency (microseconds)
+			UINT_32 RTD3E; // RTD3 Entry Latency (microseconds)
+			UINT_32 OAES; // Optional Asynchronous Events Supported
+			UINT_32 CTRATT; // Controller Attributes
+			UINT_16 RRLS; // Read Recovery Levels Supported
+			UINT_8 RSVD0[9]; // Reserved
+			UINT_8 CNTRLTYPE; // Controller Type
+			UINT_8 FGUID[16]; // FRU Globally Unique Identifier
+			UINT_16 CRDT1; // Command Retry Delay Time 1
+			UINT_16 CRDT2; // Command Retry Delay Time 2
+			UINT_16 CRDT3; // Command Retry Delay Time 3
+			UINT_8 RSVD1[122]; // Reserved (and NVMe Management Interface)
+			UINT_16 OACS; // Optional Admin Command Support
+			UINT_8 ACL; // Abort Command Limit (0-based)
+			UINT_8 AERL; // Asynchronous Event Request Limit (0-based)
+			UINT_8 FRMW; // Firmware Updates
+			UINT_8 LPA; // Log Page Attributes
+			UINT_8 ELPE; // Error Log Page Entries (0-based)
+			UINT_8 NPSS; // Number of Power States Support (0-based)
+			UINT_8 AVSCC; // Admin Vendor Specific Command Configuration
+			UINT_8 APSTA; // Autonomous Power State Transition Attributes
+			UINT_16 WCTEMP; // Warning Composite Temperature Threshold (Kelvin)
+			UINT_16 CCTEMP; // Critical Composite Temperature Threshold (Kelvin)
+			UINT_16 MTFA; // Maximum Time for Firmware Activation
+			UINT_32 HMPRE; // Host Memory Buffer Preferred Size
+			UINT_32 HMMIN; // Host Memory Buffer Minimum Size
+			UINT_8 TNVMCAP[16]; // Total NVM Capacity (bytes)
+			UINT_8 UNVMCAP[16]; // Unallocated NVM Capacity (bytes)
+			UINT_32 RPMBS; // Replay Protected Memory Block Support
+			UINT_16 EDSTT; // Extended Device Self-test Time
+			UINT_8 DSTO; // Device Self-test Options
+			UINT_8 FWUG; // Firmware Update Granularity
+			UINT_16 KAS; // Keep Alive Support
+			UINT_16 HCTMA; // Host Controlled Thermal Management Attributes
+			UINT_16 MNTMT; // Minimum Thermal Management Temperature
+			UINT_16 MXTMT; // Maximum Thermal Management Temperature
+			UINT_32 SANICAP; // Sanitize Capabilities
+			UINT_32 HMMINDS; // Host Memory Buffer Minimum Descriptor Entry Size
+			UINT_16 HMMAXD; // Host Memory Maximum Descriptors Entries
+			UINT_16 NSETIDMAX; // NVM Set Identifier Maximum
+			UINT_16 ENDGIDMAX; // Endurance Group Identifier Maximum
+			UINT_8 ANATT; // ANA Transition Time
+			UINT_8 ANACAP; // Asymmetric Namespace Access Capabilities
+			UINT_32 ANAGRPMAX; // ANA Group Identifier Maximum
+			UINT_32 NANAGRPID; // Number of ANA Group Identifiers
+			UINT_32 PELS; // Persistent Event Log Size
+			UINT_8 RSVD2[156]; // Reserved
+			UINT_8 SQES; // Submission Queue Entry Size (required and maximum, as powers of two)
+			UINT_8 CQES; // Completion Queue Entry Size (required and maximum, as powers of two)
+			UINT_16 MAXCMD; // Maximum Outstanding Commands
+			UINT_32 NN; // Number of Namespaces (largest NSID)
+			UINT_16 ONCS; // Optional NVM Command Support
+			UINT_16 FUSES; // Fused Operation Support
+			UINT_8 FNA; // Format NVM Attributes
+			UINT_8 VWC; // Volatile Write Cache
+			UINT_16 AWUN; // Atomic Write Unit Normal
+			UINT_16 AWUPF; // Atomic Write Unit Power Fail
+			UINT_8 NVSCC; // NVM Vendor Specific Command Configuration
+			UINT_8 NWPC; // Namespace Write Protection Capabilities
+			UINT_16 ACWU; // Atomic Compare & Write Unit
+			UINT_8 RSVD3[2]; // Reserved
+			UINT_32 SGLS; // SGL Support
+			UINT_32 MNAN; // Maximum Number of Allowed Namespaces
+			UINT_8 RSVD4[224]; // Reserved
+			char SUBNQN[256]; // NVM Subsystem NVMe Qualified Name
+			UINT_8 RSVD5[1024]; // Reserved (and NVMe over Fabrics)
+			POWER_STATE_DESCRIPTOR PSD[32]; // Power State Descriptors
+			UINT_8 VS[1024]; // Vendor Specific
+
+			std::string toString() const;
+		}IDENTIFY_CONTROLLER_DATA, *PIDENTIFY_CONTROLLER_DATA;
+		static_assert(sizeof(IDENTIFY_CONTROLLER_DATA) == IDENTIFY_DATA_SIZE, "IDENTIFY_CONTROLLER_DATA should be 4096 byte(s) in size.");
+
+		/// <summary>
+		/// LBA Format, one per format in Identify Namespace
+		/// </summary>
+		typedef struct LBA_FORMAT
+		{
+			UINT_16 MS; // Metadata Size (bytes per LBA)
+			UINT_8 LBADS; // LBA Data Size (power of two)
+			UINT_8 RP : 2; // Relative Performance
+			UINT_8 RSVD0 : 6; // Reserved
+		}LBA_FORMAT, *PLBA_FORMAT;
+		static_assert(sizeof(LBA_FORMAT) == 4, "LBA_FORMAT should be 4 byte(s) in size.");
+
+		/// <summary>
+		/// Identify Namespace data structure (CNS 0x00)
+		/// </summary>
+		typedef struct IDENTIFY_NAMESPACE_DATA
+		{
+			UINT_64 NSZE; // Namespace Size (blocks)
+			UINT_64 NCAP; // Namespace Capacity (blocks)
+			UINT_64 NUSE; // Namespace Utilization (blocks)
+			UINT_8 NSFEAT; // Namespace Features
+			UINT_8 NLBAF; // Number of LBA Formats (0-based)
+			UINT_8 FLBAS; // Formatted LBA Size
+			UINT_8 MC; // Metadata Capabilities
+			UINT_8 DPC; // End-to-end Data Protection Capabilities
+			UINT_8 DPS; // End-to-end Data Protection Type Settings
+			UINT_8 NMIC; // Namespace Multi-path I/O and Namespace Sharing Capabilities
+			UINT_8 RESCAP; // Reservation Capabilities
+			UINT_8 FPI; // Format Progress Indicator
+			UINT_8 DLFEAT; // Deallocate Logical Block Features
+			UINT_16 NAWUN; // Namespace Atomic Write Unit Normal
+			UINT_16 NAWUPF; // Namespace Atomic Write Unit Power Fail
+			UINT_16 NACWU; // Namespace Atomic Compare & Write Unit
+			UINT_16 NABSN; // Namespace Atomic Boundary Size Normal
+			UINT_16 NABO; // Namespace Atomic Boundary Offset
+			UINT_16 NABSPF; // Namespace Atomic Boundary Size Power Fail
+			UINT_16 NOIOB; // Namespace Optimal I/O Boundary (blocks)
+			UINT_8 NVMCAP[16]; // NVM Capacity (bytes)
+			UINT_16 NPWG; // Namespace Preferred Write Granularity (0-based blocks)
+			UINT_16 NPWA; // Namespace Preferred Write Alignment (0-based blocks)
+			UINT_16 NPDG; // Namespace Preferred Deallocate Granularity (0-based blocks)
+			UINT_16 NPDA; // Namespace Preferred Deallocate Alignment (0-based blocks)
+			UINT_16 NOWS; // Namespace Optimal Write Size (0-based blocks)
+			UINT_8 RSVD0[18]; // Reserved
+			UINT_32 ANAGRPID; // ANA Group Identifier
+			UINT_8 RSVD1[3]; // Reserved
+			UINT_8 NSATTR; // Namespace Attributes
+			UINT_16 NVMSETID; // NVM Set Identifier
+			UINT_16 ENDGID; // Endurance Group Identifier
+			UINT_8 NGUID[16]; // Namespace Globally Unique Identifier
+			UINT_8 EUI64[8]; // IEEE Extended Unique Identifier
+			LBA_FORMAT LBAF[16]; // LBA Formats
+			UINT_8 RSVD2[192]; // Reserved
+			UINT_8 VS[3712]; // Vendor Specific
+
+			std::string toString() const;
+		}IDENTIFY_NAMESPACE_DATA, *PIDENTIFY_NAMESPACE_DATA;
+		static_assert(sizeof(IDENTIFY_NAMESPACE_DATA) == IDENTIFY_DATA_SIZE, "IDENTIFY_NAMESPACE_DATA should be 4096 byte(s) in size.");
+
+		/// <summary>
+		/// Copies a string into an ASCII Identify field, space padded (and cut short if too long)
+		/// </summary>
+		/// <param name="field">The field</param>
+		/// <param name="fieldSize">Size of the field in bytes</param>
+		/// <param name="value">The string</param>
+		void setAsciiField(char* field, size_t fieldSize, const std::string &value);
+	}
+}
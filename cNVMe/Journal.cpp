@@ -0,0 +1,382 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Journal.cpp - An implementation file for the Journaled (crash consistent) media
+*/
+
+#include "Checksum.h"
+#include "Journal.h"
+
+namespace cnvme
+{
+	namespace media
+	{
+		JournaledMedia::JournaledMedia(MediaBackend* homeMedia, std::string journalPath, UINT_64 journalSize) :
+			MediaBackend(homeMedia->getBlockSize(), homeMedia->getNumberOfBlocks()), Journal(journalPath, 1, journalSize)
+		{
+			ASSERT_IF(journalSize < sizeof(JOURNAL_RECORD) + JOURNAL_MAX_RECORD_DATA_SIZE, "The journal must be able to hold at least one full sized record");
+			HomeMedia.reset(homeMedia);
+			AppendOffset = 0;
+			Sequence = 0;
+			Checkpoints = 0;
+			RecoveredRecords = 0;
+			DurableSequence = 0;
+			CommitInProgress = false;
+			CommitRequests = 0;
+			Commits = 0;
+
+			if (isOpen())
+			{
+				recover();
+
+				// Start from an empty journal, so a torn record left at the end can't be mistaken for part of a later run's journal
+				std::lock_guard<std::mutex> lock(JournalMutex);
+				checkpointLocked();
+			}
+		}
+
+		JournaledMedia::~JournaledMedia()
+		{
+			if (isOpen())
+			{
+				std::lock_guard<std::mutex> lock(JournalMutex);
+				checkpointLocked();
+			}
+		}
+
+		bool JournaledMedia::read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to read out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			// Held across the home read so a checkpoint can't move data out from under it
+			std::lock_guard<std::mutex> lock(JournalMutex);
+			if (!HomeMedia->read(lba, numberOfBlocks, buffer))
+			{
+				return false;
+			}
+
+			// Anything newer is in the journal
+			UINT_64 end = lba + numberOfBlocks;
+			auto extent = Extents.upper_bound(lba);
+			if (extent != Extents.begin())
+			{
+				extent--;
+			}
+			for (; extent != Extents.end() && extent->first < end; extent++)
+			{
+				UINT_64 start = std::max(lba, extent->first);
+				UINT_64 stop = std::min(end, extent->first + extent->second.NumberOfBlocks);
+				if (start >= stop)
+				{
+					continue;
+				}
+
+				BYTE* destination = buffer + (start - lba) * BlockSize;
+				UINT_32 bytes = (UINT_32)((stop - start) * BlockSize);
+				if (extent->second.DataOffset == JOURNAL_DEALLOCATED)
+				{
+					memset(destination, 0, bytes);
+				}
+				else if (!Journal.read(extent->second.DataOffset + (start - extent->first) * BlockSize, bytes, destination))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool JournaledMedia::write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to write out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			UINT_32 blocksPerRecord = std::max<UINT_32>(1, JOURNAL_MAX_RECORD_DATA_SIZE / BlockSize);
+			std::lock_guard<std::mutex> lock(JournalMutex);
+			for (UINT_32 done = 0; done < numberOfBlocks; done += blocksPerRecord)
+			{
+				UINT_32 blocks = std::min(blocksPerRecord, numberOfBlocks - done);
+				if (!appendLocked(JOURNAL_RECORD_TYPE_WRITE, lba + done, blocks, buffer + (UINT_64)done * BlockSize))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool JournaledMedia::deallocate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to deallocate out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(JournalMutex);
+			for (UINT_64 done = 0; done < numberOfBlocks; done += UINT32_MAX)
+			{
+				UINT_32 blocks = (UINT_32)std::min<UINT_64>(UINT32_MAX, numberOfBlocks - done);
+				if (!appendLocked(JOURNAL_RECORD_TYPE_DEALLOCATE, lba + done, blocks, nullptr))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool JournaledMedia::flush()
+		{
+			UINT_64 target;
+			{
+				std::lock_guard<std::mutex> lock(JournalMutex);
+				target = Sequence;
+			}
+
+			std::unique_lock<std::mutex> lock(CommitMutex);
+			CommitRequests++;
+			while (DurableSequence < target)
+			{
+				if (CommitInProgress)
+				{
+					// Someone else is syncing. Their sync may not cover us, so check again once it's done.
+					CommitDone.wait(lock);
+					continue;
+				}
+
+				// Sync for everyone who has written so far
+				CommitInProgress = true;
+				lock.unlock();
+				UINT_64 committing;
+				{
+					std::lock_guard<std::mutex> journalLock(JournalMutex);
+					committing = Sequence;
+				}
+				bool synced = Journal.flush();
+				lock.lock();
+
+				CommitInProgress = false;
+				Commits++;
+				if (synced)
+				{
+					DurableSequence = std::max(DurableSequence, committing);
+				}
+				CommitDone.notify_all();
+				if (!synced)
+				{
+					LOG_ERROR("Unable to sync the journal");
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool JournaledMedia::format()
+		{
+			std::lock_guard<std::mutex> lock(JournalMutex);
+			return checkpointLocked() && HomeMedia->format() && HomeMedia->flush();
+		}
+
+		bool JournaledMedia::isOpen() const
+		{
+			return Journal.isOpen();
+		}
+
+		UINT_64 JournaledMedia::getNumberOfCommitRequests()
+		{
+			std::lock_guard<std::mutex> lock(CommitMutex);
+			return CommitRequests;
+		}
+
+		UINT_64 JournaledMedia::getNumberOfCommits()
+		{
+			std::lock_guard<std::mutex> lock(CommitMutex);
+			return Commits;
+		}
+
+		UINT_64 JournaledMedia::getNumberOfCheckpoints()
+		{
+			std::lock_guard<std::mutex> lock(JournalMutex);
+			return Checkpoints;
+		}
+
+		UINT_64 JournaledMedia::getNumberOfRecoveredRecords()
+		{
+			std::lock_guard<std::mutex> lock(JournalMutex);
+			return RecoveredRecords;
+		}
+
+		bool JournaledMedia::appendLocked(JOURNAL_RECORD_TYPE type, UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			UINT_64 dataSize = type == JOURNAL_RECORD_TYPE_WRITE ? (UINT_64)numberOfBlocks * BlockSize : 0;
+			if (AppendOffset + sizeof(JOURNAL_RECORD) + dataSize > Journal.getNumberOfBlocks() && !checkpointLocked())
+			{
+				return false;
+			}
+
+			JOURNAL_RECORD record = { 0 };
+			record.Magic = JOURNAL_RECORD_MAGIC;
+			record.Sequence = Sequence + 1;
+			record.Lba = lba;
+			record.NumberOfBlocks = numberOfBlocks;
+			record.Type = type;
+			record.Checksum = checksum::crc32c(buffer, (size_t)dataSize, checksum::crc32c((BYTE*)&record, sizeof(record)));
+
+			UINT_64 dataOffset = AppendOffset + sizeof(JOURNAL_RECORD);
+			if (!Journal.write(AppendOffset, sizeof(record), (BYTE*)&record) || (dataSize && !Journal.write(dataOffset, (UINT_32)dataSize, buffer)))
+			{
+				LOG_ERROR("Unable to append to the journal");
+				return false;
+			}
+
+			indexLocked(lba, numberOfBlocks, type == JOURNAL_RECORD_TYPE_WRITE ? dataOffset : JOURNAL_DEALLOCATED);
+			AppendOffset = dataOffset + dataSize;
+			Sequence++;
+			return true;
+		}
+
+		void JournaledMedia::indexLocked(UINT_64 lba, UINT_64 numberOfBlocks, UINT_64 dataOffset)
+		{
+			UINT_64 end = lba + numberOfBlocks;
+			auto offsetBy = [&](UINT_64 offset, UINT_64 blocks) {
+				return offset == JOURNAL_DEALLOCATED ? JOURNAL_DEALLOCATED : offset + blocks * BlockSize;
+			};
+
+			// An extent starting before the new one: keep its head, and its tail if it runs past the new one
+			auto extent = Extents.upper_bound(lba);
+			if (extent != Extents.begin())
+			{
+				auto previous = std::prev(extent);
+				UINT_64 previousEnd = previous->first + previous->second.NumberOfBlocks;
+				if (previousEnd > lba)
+				{
+					if (previousEnd > end)
+					{
+						Extents[end] = { previousEnd - end, offsetBy(previous->second.DataOffset, end - previous->first) };
+					}
+					previous->second.NumberOfBlocks = lba - previous->first;
+					if (previous->second.NumberOfBlocks == 0)
+					{
+						Extents.erase(previous);
+					}
+				}
+			}
+
+			// Extents starting inside the new one: drop them, keeping the tail of the last if it runs past
+			extent = Extents.lower_bound(lba);
+			while (extent != Extents.end() && extent->first < end)
+			{
+				UINT_64 extentEnd = extent->first + extent->second.NumberOfBlocks;
+				if (extentEnd > end)
+				{
+					Extents[end] = { extentEnd - end, offsetBy(extent->second.DataOffset, end - extent->first) };
+				}
+				extent = Extents.erase(extent);
+			}
+
+			Extents[lba] = { numberOfBlocks, dataOffset };
+		}
+
+		bool JournaledMedia::checkpointLocked()
+		{
+			Payload bounce(JOURNAL_MAX_RECORD_DATA_SIZE);
+			UINT_32 blocksPerPiece = std::max<UINT_32>(1, JOURNAL_MAX_RECORD_DATA_SIZE / BlockSize);
+			if (bounce.getSize() < (UINT_64)blocksPerPiece * BlockSize)
+			{
+				bounce = Payload(blocksPerPiece * BlockSize); // Block size bigger than a record
+			}
+
+			for (auto &extent : Extents)
+			{
+				if (extent.second.DataOffset == JOURNAL_DEALLOCATED)
+				{
+					if (!HomeMedia->deallocate(extent.first, extent.second.NumberOfBlocks))
+					{
+						return false;
+					}
+					continue;
+				}
+
+				for (UINT_64 done = 0; done < extent.second.NumberOfBlocks; done += blocksPerPiece)
+				{
+					UINT_32 blocks = (UINT_32)std::min<UINT_64>(blocksPerPiece, extent.second.NumberOfBlocks - done);
+					if (!Journal.read(extent.second.DataOffset + done * BlockSize, blocks * BlockSize, bounce.getBuffer()) ||
+						!HomeMedia->write(extent.first + done, blocks, bounce.getBuffer()))
+					{
+						LOG_ERROR("Unable to checkpoint the journal");
+						return false;
+					}
+				}
+			}
+
+			// The home media has to be durable before the journal can be let go of. Emptying the journal is then synced too,
+			//   so new records can't end up in front of old ones that were never really removed.
+			if (!HomeMedia->flush() || !Journal.format() || !Journal.flush())
+			{
+				LOG_ERROR("Unable to checkpoint the journal");
+				return false;
+			}
+
+			Extents.clear();
+			AppendOffset = 0;
+			Checkpoints++;
+
+			std::lock_guard<std::mutex> lock(CommitMutex);
+			DurableSequence = Sequence; // Everything is in the (synced) home media now
+			CommitDone.notify_all();
+			return true;
+		}
+
+		void JournaledMedia::recover()
+		{
+			std::lock_guard<std::mutex> lock(JournalMutex);
+			std::vector<BYTE> data;
+			UINT_64 journalSize = Journal.getNumberOfBlocks();
+			while (AppendOffset + sizeof(JOURNAL_RECORD) <= journalSize)
+			{
+				JOURNAL_RECORD record;
+				if (!Journal.read(AppendOffset, sizeof(record), (BYTE*)&record) || record.Magic != JOURNAL_RECORD_MAGIC)
+				{
+					break; // End of the journal
+				}
+
+				UINT_64 dataSize = record.Type == JOURNAL_RECORD_TYPE_WRITE ? (UINT_64)record.NumberOfBlocks * BlockSize : 0;
+				if ((RecoveredRecords && record.Sequence != Sequence + 1) ||
+					(record.Type != JOURNAL_RECORD_TYPE_WRITE && record.Type != JOURNAL_RECORD_TYPE_DEALLOCATE) ||
+					!isValidRange(record.Lba, record.NumberOfBlocks) || AppendOffset + sizeof(record) + dataSize > journalSize)
+				{
+					break; // Left over from before the last checkpoint, or garbage
+				}
+
+				data.resize((size_t)dataSize);
+				UINT_64 dataOffset = AppendOffset + sizeof(record);
+				if (dataSize && !Journal.read(dataOffset, (UINT_32)dataSize, data.data()))
+				{
+					break;
+				}
+
+				UINT_32 expectedChecksum = record.Checksum;
+				record.Checksum = 0;
+				if (checksum::crc32c(data.data(), data.size(), checksum::crc32c((BYTE*)&record, sizeof(record))) != expectedChecksum)
+				{
+					break; // Torn
+				}
+
+				indexLocked(record.Lba, record.NumberOfBlocks, record.Type == JOURNAL_RECORD_TYPE_WRITE ? dataOffset : JOURNAL_DEALLOCATED);
+				AppendOffset = dataOffset + dataSize;
+				Sequence = record.Sequence;
+				RecoveredRecords++;
+			}
+
+			if (RecoveredRecords)
+			{
+				LOG_INFO("Recovered " + std::to_string(RecoveredRecords) + " journal records");
+			}
+		}
+	}
+}
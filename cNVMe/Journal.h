@@ -0,0 +1,234 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Journal.h - A header file for the Journaled (crash consistent) media
+*/
+
+#pragma once
+
+#include "Media.h"
+#include "Types.h"
+
+#include <memory>
+
+#define JOURNAL_DEFAULT_SIZE (64 * 1024 * 1024) // Bytes of journal. Bounds both recovery time and how often a checkpoint is needed.
+#define JOURNAL_MAX_RECORD_DATA_SIZE (1024 * 1024) // Larger writes are split across records
+#define JOURNAL_RECORD_MAGIC 0x4C4E524A // "JRNL"
+#define JOURNAL_DEALLOCATED 0xFFFFFFFFFFFFFFFF // JournalExtent::DataOffset of a deallocated extent
+
+namespace cnvme
+{
+	namespace media
+	{
+		/// <summary>
+		/// What a journal record does
+		/// </summary>
+		enum JOURNAL_RECORD_TYPE
+		{
+			JOURNAL_RECORD_TYPE_WRITE = 1, // Data follows the record
+			JOURNAL_RECORD_TYPE_DEALLOCATE = 2, // No data
+		};
+
+		/// <summary>
+		/// On disk header of each journal record
+		/// </summary>
+		typedef struct JOURNAL_RECORD
+		{
+			UINT_32 Magic; // JOURNAL_RECORD_MAGIC
+			UINT_32 Checksum; // CRC32C of this header (with Checksum as 0) and the data after it
+			UINT_64 Sequence; // One more than the record before it
+			UINT_64 Lba; // Starting LBA
+			UINT_32 NumberOfBlocks; // Number of blocks
+			UINT_32 Type; // JOURNAL_RECORD_TYPE
+		} JOURNAL_RECORD, *PJOURNAL_RECORD;
+		static_assert(sizeof(JOURNAL_RECORD) == 32, "JOURNAL_RECORD should be 32 bytes in size");
+
+		/// <summary>
+		/// Crash consistent media: a write ahead journal file in front of a home media (normally a FileMedia).
+		/// Writes and deallocates are appended to the journal and indexed by LBA extent, so they complete without touching
+		///   the home media. flush() makes everything written so far durable with a single sync of the journal, and
+		///   concurrent flushes are group committed: while one sync is running the rest queue up, and the next sync covers them all.
+		/// When the journal fills, a checkpoint copies the indexed extents to the home media, syncs it, and empties the journal.
+		/// On construction the journal is replayed up to the first torn or out of sequence record (so recovery reads at most
+		///   one journal's worth) and then checkpointed.
+		/// </summary>
+		class JournaledMedia : public MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor. Recovers anything left in the journal by an earlier run.
+			/// </summary>
+			/// <param name="homeMedia">Media holding the data once checkpointed. The journaled media takes ownership.</param>
+			/// <param name="journalPath">Path to the journal file (created if needed)</param>
+			/// <param name="journalSize">Size of the journal in bytes</param>
+			JournaledMedia(MediaBackend* homeMedia, std::string journalPath, UINT_64 journalSize = JOURNAL_DEFAULT_SIZE);
+
+			/// <summary>
+			/// Destructor. Checkpoints, so the next run has nothing to recover.
+			/// </summary>
+			~JournaledMedia();
+
+			bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override;
+			bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) override;
+			bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Group commits the journal. Returns once everything written before the call is durable.
+			/// </summary>
+			bool flush() override;
+
+			/// <summary>
+			/// Checkpoints then formats the home media, so a crash part way through leaves either the old data or none
+			/// </summary>
+			bool format() override;
+
+			/// <summary>
+			/// Returns true if the journal file was opened
+			/// </summary>
+			/// <returns>True if open</returns>
+			bool isOpen() const;
+
+			/// <summary>
+			/// Returns the number of flush() calls
+			/// </summary>
+			/// <returns>Commit requests</returns>
+			UINT_64 getNumberOfCommitRequests();
+
+			/// <summary>
+			/// Returns the number of journal syncs done for flush() calls (at most getNumberOfCommitRequests())
+			/// </summary>
+			/// <returns>Commits</returns>
+			UINT_64 getNumberOfCommits();
+
+			/// <summary>
+			/// Returns the number of checkpoints (including the one after recovery)
+			/// </summary>
+			/// <returns>Checkpoints</returns>
+			UINT_64 getNumberOfCheckpoints();
+
+			/// <summary>
+			/// Returns the number of journal records replayed on construction
+			/// </summary>
+			/// <returns>Recovered records</returns>
+			UINT_64 getNumberOfRecoveredRecords();
+
+		private:
+			/// <summary>
+			/// Where the latest data for a run of LBAs is in the journal
+			/// </summary>
+			struct JournalExtent
+			{
+				/// <summary>
+				/// Number of blocks
+				/// </summary>
+				UINT_64 NumberOfBlocks;
+
+				/// <summary>
+				/// Journal offset of the first block's data, or JOURNAL_DEALLOCATED
+				/// </summary>
+				UINT_64 DataOffset;
+			};
+
+			/// <summary>
+			/// Appends a record (and its data, for a write) to the journal and indexes it, checkpointing first if it won't fit.
+			/// Must be called with JournalMutex held.
+			/// </summary>
+			/// <param name="type">JOURNAL_RECORD_TYPE</param>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <param name="buffer">Data for a write, else nullptr</param>
+			/// <returns>True on success</returns>
+			bool appendLocked(JOURNAL_RECORD_TYPE type, UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer);
+
+			/// <summary>
+			/// Points the given LBAs at dataOffset in the index, trimming or splitting whatever they overlap.
+			/// Must be called with JournalMutex held.
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <param name="dataOffset">Journal offset of the data or JOURNAL_DEALLOCATED</param>
+			void indexLocked(UINT_64 lba, UINT_64 numberOfBlocks, UINT_64 dataOffset);
+
+			/// <summary>
+			/// Copies every indexed extent to the home media, syncs it, then empties the journal. Must be called with JournalMutex held.
+			/// </summary>
+			/// <returns>True on success</returns>
+			bool checkpointLocked();
+
+			/// <summary>
+			/// Rebuilds the index from the journal, stopping at the first record that is torn, corrupt or out of sequence
+			/// </summary>
+			void recover();
+
+			/// <summary>
+			/// Where checkpointed data lives
+			/// </summary>
+			std::unique_ptr<MediaBackend> HomeMedia;
+
+			/// <summary>
+			/// The journal file, addressed in bytes (a block size of 1)
+			/// </summary>
+			FileMedia Journal;
+
+			/// <summary>
+			/// LBA -> where its latest data is in the journal. Extents never overlap.
+			/// </summary>
+			std::map<UINT_64, JournalExtent> Extents;
+
+			/// <summary>
+			/// Journal offset the next record goes at
+			/// </summary>
+			UINT_64 AppendOffset;
+
+			/// <summary>
+			/// Sequence number of the last record appended
+			/// </summary>
+			UINT_64 Sequence;
+
+			/// <summary>
+			/// Checkpoints done
+			/// </summary>
+			UINT_64 Checkpoints;
+
+			/// <summary>
+			/// Records replayed by recover()
+			/// </summary>
+			UINT_64 RecoveredRecords;
+
+			/// <summary>
+			/// Guards everything above. Lock before CommitMutex if both are needed.
+			/// </summary>
+			std::mutex JournalMutex;
+
+			/// <summary>
+			/// Sequence number of the last record known to be durable
+			/// </summary>
+			UINT_64 DurableSequence;
+
+			/// <summary>
+			/// True while a flush() is syncing the journal on behalf of everyone waiting
+			/// </summary>
+			bool CommitInProgress;
+
+			/// <summary>
+			/// flush() calls
+			/// </summary>
+			UINT_64 CommitRequests;
+
+			/// <summary>
+			/// Journal syncs done by flush()
+			/// </summary>
+			UINT_64 Commits;
+
+			/// <summary>
+			/// Guards DurableSequence, CommitInProgress, CommitRequests and Commits
+			/// </summary>
+			std::mutex CommitMutex;
+
+			/// <summary>
+			/// Signalled whenever a commit finishes
+			/// </summary>
+			std::condition_variable CommitDone;
+		};
+	}
+}
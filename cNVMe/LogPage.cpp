@@ -0,0 +1,297 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+LogPage.cpp - An implementation file for the NVMe Log Pages
+*/
+
+#include "LogPage.h"
+#include "Strings.h"
+
+namespace cnvme
+{
+	namespace logpages
+	{
+		std::string ERROR_INFORMATION_ENTRY::toString() const
+		{
+			std::string retStr;
+			retStr += "Error Information Entry:\n";
+			retStr += strings::toString(ToStringParams(ERRCNT, "Error Count"));
+			retStr += strings::toString(ToStringParams(SQID, "Submission Queue ID"));
+			retStr += strings::toString(ToStringParams(CMDID, "Command ID"));
+			retStr += strings::toString(ToStringParams(STS, "Status Field"));
+			retStr += strings::toString(ToStringParams(PEL, "Parameter Error Location"));
+			retStr += strings::toString(ToStringParams(LBA, "LBA"));
+			retStr += strings::toString(ToStringParams(NS, "Namespace"));
+			retStr += strings::toString(ToStringParams(CSI, "Command Specific Information"));
+			return retStr;
+		}
+
+		std::string CHANGED_NAMESPACE_LIST_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Changed Namespace List Log:\n";
+			for (UINT_32 i = 0; i < CHANGED_NAMESPACE_LIST_ENTRIES && NSID[i] != 0; i++)
+			{
+				retStr += strings::toString(NSID[i], "NSID", "Namespace ID");
+			}
+			return retStr;
+		}
+
+		std::string SANITIZE_STATUS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Sanitize Status Log:\n";
+			retStr += strings::toString(ToStringParams(SPROG, "Sanitize Progress"));
+			retStr += strings::toString(ToStringParams(SOS, "Sanitize Operation Status"));
+			retStr += strings::toString(ToStringParams(OPC, "Overwrite Passes Completed"));
+			retStr += strings::toString(ToStringParams(GDE, "Global Data Erased"));
+			retStr += strings::toString(ToStringParams(SCDW10, "Sanitize Command Dword 10"));
+			retStr += strings::toString(ToStringParams(ETO, "Estimated Time For Overwrite"));
+			retStr += strings::toString(ToStringParams(ETBE, "Estimated Time For Block Erase"));
+			retStr += strings::toString(ToStringParams(ETCE, "Estimated Time For Crypto Erase"));
+			retStr += strings::toString(ToStringParams(ETOND, "Estimated Time For Overwrite With No-Deallocate"));
+			retStr += strings::toString(ToStringParams(ETBEND, "Estimated Time For Block Erase With No-Deallocate"));
+			retStr += strings::toString(ToStringParams(ETCEND, "Estimated Time For Crypto Erase With No-Deallocate"));
+			return retStr;
+		}
+
+		std::string PREDICTABLE_LATENCY_PER_NVM_SET_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Predictable Latency Per NVM Set Log:\n";
+			retStr += strings::toString(ToStringParams(STATUS, "Status"));
+			retStr += strings::toString(ToStringParams(ET, "Event Type"));
+			retStr += strings::toString(ToStringParams(DTWINRT, "DTWIN Reads Typical"));
+			retStr += strings::toString(ToStringParams(DTWINWT, "DTWIN Writes Typical"));
+			retStr += strings::toString(ToStringParams(DTWINTM, "DTWIN Time Maximum"));
+			retStr += strings::toString(ToStringParams(NDWINTMH, "NDWIN Time Minimum High"));
+			retStr += strings::toString(ToStringParams(NDWINTML, "NDWIN Time Minimum Low"));
+			retStr += strings::toString(ToStringParams(DTWINRE, "DTWIN Reads Estimate"));
+			retStr += strings::toString(ToStringParams(DTWINWE, "DTWIN Writes Estimate"));
+			retStr += strings::toString(ToStringParams(DTWINTE, "DTWIN Time Estimate"));
+			return retStr;
+		}
+
+		std::string PREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Predictable Latency Event Aggregate Log:\n";
+			retStr += strings::toString(ToStringParams(NE, "Number of Entries"));
+			return retStr;
+		}
+
+		std::string FTL_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "FTL Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(HPW, "Host Pages Written"));
+			retStr += strings::toString(ToStringParams(NPW, "NAND Pages Written"));
+			retStr += strings::toString(ToStringParams(GCPR, "Garbage Collection Pages Relocated"));
+			retStr += strings::toString(ToStringParams(SBE, "Superblocks Erased"));
+			retStr += strings::toString(ToStringParams(FGCS, "Foreground Garbage Collection Stalls"));
+			retStr += strings::toString(ToStringParams(FGCST, "Foreground Garbage Collection Stall Time (us)"));
+			retStr += strings::toString(ToStringParams(MFGCST, "Maximum Foreground Garbage Collection Stall Time (us)"));
+			retStr += strings::toString(ToStringParams(WAF, "Write Amplification Factor (x1000)"));
+			retStr += strings::toString(ToStringParams(TSB, "Total Superblocks"));
+			retStr += strings::toString(ToStringParams(FSB, "Free Superblocks"));
+			retStr += strings::toString(ToStringParams(PPSB, "Pages Per Superblock"));
+			retStr += strings::toString(ToStringParams(OP, "Overprovisioning (percent)"));
+			retStr += strings::toString(ToStringParams(GCP, "Garbage Collection Policy"));
+			retStr += strings::toString(ToStringParams(MEC, "Maximum Erase Count"));
+			return retStr;
+		}
+
+		std::string READ_CACHE_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Read Cache Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(HRB, "Host Read Blocks"));
+			retStr += strings::toString(ToStringParams(CHB, "Cache Hit Blocks"));
+			retStr += strings::toString(ToStringParams(CMB, "Cache Miss Blocks"));
+			retStr += strings::toString(ToStringParams(PL, "Prefetched Lines"));
+			retStr += strings::toString(ToStringParams(UPL, "Useful Prefetched Lines"));
+			retStr += strings::toString(ToStringParams(WPL, "Wasted Prefetched Lines"));
+			retStr += strings::toString(ToStringParams(EL, "Evicted Lines"));
+			retStr += strings::toString(ToStringParams(IL, "Invalidated Lines"));
+			retStr += strings::toString(ToStringParams(SSD, "Sequential Streams Detected"));
+			retStr += strings::toString(ToStringParams(HR, "Hit Ratio (x1000)"));
+			retStr += strings::toString(ToStringParams(PA, "Prefetch Accuracy (x1000)"));
+			retStr += strings::toString(ToStringParams(LS, "Line Size (bytes)"));
+			retStr += strings::toString(ToStringParams(CL, "Cached Lines"));
+			retStr += strings::toString(ToStringParams(TL, "Total Lines"));
+			retStr += strings::toString(ToStringParams(EN, "Enabled"));
+			return retStr;
+		}
+
+		std::string DEDUP_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Deduplication Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(HBW, "Host Blocks Written"));
+			retStr += strings::toString(ToStringParams(ZBW, "Zero Blocks Written"));
+			retStr += strings::toString(ToStringParams(DBW, "Duplicate Blocks Written"));
+			retStr += strings::toString(ToStringParams(HC, "Hash Collisions"));
+			retStr += strings::toString(ToStringParams(MB, "Mapped Blocks"));
+			retStr += strings::toString(ToStringParams(UB, "Unique Blocks"));
+			retStr += strings::toString(ToStringParams(SB, "Stored Bytes"));
+			retStr += strings::toString(ToStringParams(DR, "Deduplication Ratio (x1000)"));
+			retStr += strings::toString(ToStringParams(BS, "Block Size (bytes)"));
+			return retStr;
+		}
+
+		std::string TIERING_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Tiering Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(FRB, "Fast tier Read Blocks"));
+			retStr += strings::toString(ToStringParams(FWB, "Fast tier Written Blocks"));
+			retStr += strings::toString(ToStringParams(SRB, "Slow tier Read Blocks"));
+			retStr += strings::toString(ToStringParams(SWB, "Slow tier Written Blocks"));
+			retStr += strings::toString(ToStringParams(PS, "Promoted Segments"));
+			retStr += strings::toString(ToStringParams(DS, "Demoted Segments"));
+			retStr += strings::toString(ToStringParams(HPS, "Hint Promoted Segments"));
+			retStr += strings::toString(ToStringParams(HDS, "Hint Demoted Segments"));
+			retStr += strings::toString(ToStringParams(FSR, "Fast Segments Resident"));
+			retStr += strings::toString(ToStringParams(FSC, "Fast Segment Capacity"));
+			retStr += strings::toString(ToStringParams(SS, "Segment Size (bytes)"));
+			return retStr;
+		}
+
+		std::string STREAM_STATISTICS_ENTRY::toString() const
+		{
+			std::string retStr;
+			retStr += strings::toString(ToStringParams(HPW, "Host Pages Written"));
+			retStr += strings::toString(ToStringParams(NPW, "NAND Pages Written"));
+			retStr += strings::toString(ToStringParams(WAF, "Write Amplification Factor (x1000)"));
+			return retStr;
+		}
+
+		std::string STREAM_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Stream Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(NSS, "Number of Stream Slots"));
+			for (UINT_32 i = 0; i <= NSS && i <= STREAM_STATISTICS_MAX_SLOTS; i++)
+			{
+				retStr += "Stream Slot " + std::to_string(i) + (i ? ":\n" : " (no stream):\n");
+				retStr += SE[i].toString();
+			}
+			return retStr;
+		}
+
+		std::string QOS_STATISTICS_ENTRY::toString() const
+		{
+			std::string retStr;
+			retStr += strings::toString(ToStringParams(TYPE, "Type (0 = Submission Queue, 1 = Namespace)"));
+			retStr += strings::toString(ToStringParams(ID, "Identifier"));
+			retStr += strings::toString(ToStringParams(IOPSL, "IOPS Limit"));
+			retStr += strings::toString(ToStringParams(BWL, "Bandwidth Limit (bytes per second)"));
+			retStr += strings::toString(ToStringParams(DC, "Dispatched Commands"));
+			retStr += strings::toString(ToStringParams(ITC, "IOPS Throttled Commands"));
+			retStr += strings::toString(ToStringParams(BTC, "Bandwidth Throttled Commands"));
+			retStr += strings::toString(ToStringParams(TTD, "Total Throttle Delay (us)"));
+			retStr += strings::toString(ToStringParams(MTD, "Max Throttle Delay (us)"));
+			return retStr;
+		}
+
+		std::string QOS_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "QoS Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(NE, "Number of Entries"));
+			retStr += strings::toString(ToStringParams(BMS, "Burst Milliseconds"));
+			return retStr;
+		}
+
+		std::string PIPELINE_STAGE_STATISTICS::toString() const
+		{
+			std::string retStr;
+			retStr += strings::toString(ToStringParams(CMDS, "Commands"));
+			retStr += strings::toString(ToStringParams(SVCS, "Services"));
+			retStr += strings::toString(ToStringParams(STNS, "Service Time (ns)"));
+			retStr += strings::toString(ToStringParams(OCCS, "Occupancy Sum"));
+			retStr += strings::toString(ToStringParams(MOCC, "Max Occupancy"));
+			retStr += strings::toString(ToStringParams(ICAP, "Input Capacity"));
+			return retStr;
+		}
+
+		std::string PIPELINE_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Pipeline Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(NS, "Number of Stages"));
+			for (UINT_32 i = 0; i < NS && i < 3; i++)
+			{
+				retStr += "Stage " + std::to_string(i) + ":\n";
+				retStr += STG[i].toString();
+			}
+			return retStr;
+		}
+
+		std::string EXECUTOR_WORKER_STATISTICS::toString() const
+		{
+			std::string retStr;
+			retStr += strings::toString(ToStringParams(CMDS, "Commands"));
+			retStr += strings::toString(ToStringParams(STLS, "Steals"));
+			retStr += strings::toString(ToStringParams(STLN, "Stolen"));
+			return retStr;
+		}
+
+		std::string EXECUTOR_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Executor Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(NW, "Number of Workers"));
+			for (UINT_32 i = 0; i < NW && i < 16; i++)
+			{
+				retStr += "Worker " + std::to_string(i) + ":\n";
+				retStr += WRK[i].toString();
+			}
+			return retStr;
+		}
+
+		std::string SMART_HEALTH_INFORMATION_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "SMART / Health Information Log:\n";
+			retStr += strings::toString(ToStringParams(CW, "Critical Warning"));
+			retStr += strings::toString(CTEMP[0] | (CTEMP[1] << 8), "CTEMP", "Composite Temperature (K)");
+			retStr += strings::toString(ToStringParams(AVSP, "Available Spare"));
+			retStr += strings::toString(ToStringParams(AVSPT, "Available Spare Threshold"));
+			retStr += strings::toString(ToStringParams(PUSED, "Percentage Used"));
+			retStr += strings::toString(DUR[0], "DUR", "Data Units Read");
+			retStr += strings::toString(DUW[0], "DUW", "Data Units Written");
+			retStr += strings::toString(HRC[0], "HRC", "Host Read Commands");
+			retStr += strings::toString(HWC[0], "HWC", "Host Write Commands");
+			retStr += strings::toString(CBT[0], "CBT", "Controller Busy Time (minutes)");
+			retStr += strings::toString(PWRC[0], "PWRC", "Power Cycles");
+			retStr += strings::toString(POH[0], "POH", "Power On Hours");
+			retStr += strings::toString(UNSAFE[0], "UNSAFE", "Unsafe Shutdowns");
+			retStr += strings::toString(MEDERR[0], "MEDERR", "Media and Data Integrity Errors");
+			retStr += strings::toString(NUMERR[0], "NUMERR", "Number of Error Information Log Entries");
+			return retStr;
+		}
+
+		std::string SUBMISSION_QUEUE_STATISTICS_ENTRY::toString() const
+		{
+			std::string retStr;
+			retStr += strings::toString(ToStringParams(SQID, "Submission Queue Identifier"));
+			retStr += strings::toString(ToStringParams(RC, "Read Commands"));
+			retStr += strings::toString(ToStringParams(WC, "Write Commands"));
+			retStr += strings::toString(ToStringParams(OC, "Other Commands"));
+			retStr += strings::toString(ToStringParams(EC, "Error Commands"));
+			retStr += strings::toString(ToStringParams(MEC, "Media Error Commands"));
+			retStr += strings::toString(ToStringParams(BR, "Bytes Read"));
+			retStr += strings::toString(ToStringParams(BW, "Bytes Written"));
+			return retStr;
+		}
+
+		std::string SUBMISSION_QUEUE_STATISTICS_LOG::toString() const
+		{
+			std::string retStr;
+			retStr += "Submission Queue Statistics Log:\n";
+			retStr += strings::toString(ToStringParams(NE, "Number of Entries"));
+			return retStr;
+		}
+	}
+}
@@ -0,0 +1,406 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+LogPage.h - A header file for the NVMe Log Pages
+*/
+
+#pragma once
+
+#include "Types.h"
+
+#define STREAM_STATISTICS_MAX_SLOTS 16 // Stream slots the Stream Statistics log page has room for
+#define CHANGED_NAMESPACE_LIST_ENTRIES 1024 // NSIDs the Changed Namespace List log page has room for
+
+namespace cnvme
+{
+	namespace logpages
+	{
+		/// <summary>
+		/// One entry of the Error Information log page (LID 0x01). The page is a list of these, newest first.
+		/// </summary>
+		typedef struct ERROR_INFORMATION_ENTRY
+		{
+			UINT_64 ERRCNT; // Error Count (unique, and never 0 for an entry in use)
+			UINT_16 SQID; // Submission Queue ID
+			UINT_16 CMDID; // Command ID (0xFFFF if not for a command)
+			UINT_16 STS; // Status Field (as in the completion, including the phase tag bit)
+			UINT_16 PEL; // Parameter Error Location (0xFFFF if not for a parameter)
+			UINT_64 LBA; // LBA
+			UINT_32 NS; // Namespace
+			UINT_8 VSIA; // Vendor Specific Information Available
+			UINT_8 TRTYPE; // Transport Type
+			UINT_8 RSVD0[2]; // Reserved
+			UINT_64 CSI; // Command Specific Information
+			UINT_16 TTSI; // Transport Type Specific Information
+			UINT_8 RSVD1[22]; // Reserved
+
+			std::string toString() const;
+		}ERROR_INFORMATION_ENTRY, *PERROR_INFORMATION_ENTRY;
+		static_assert(sizeof(ERROR_INFORMATION_ENTRY) == 64, "ERROR_INFORMATION_ENTRY should be 64 byte(s) in size.");
+
+		/// <summary>
+		/// Changed Namespace List log page (LID 0x04). NSIDs (ascending, zero filled) whose Identify Namespace data changed
+		///   since the page was last read. If more than fit changed, the first entry is 0xFFFFFFFF and the rest are zero.
+		/// </summary>
+		typedef struct CHANGED_NAMESPACE_LIST_LOG
+		{
+			UINT_32 NSID[CHANGED_NAMESPACE_LIST_ENTRIES]; // Namespace IDs
+
+			std::string toString() const;
+		}CHANGED_NAMESPACE_LIST_LOG, *PCHANGED_NAMESPACE_LIST_LOG;
+		static_assert(sizeof(CHANGED_NAMESPACE_LIST_LOG) == 4096, "CHANGED_NAMESPACE_LIST_LOG should be 4096 byte(s) in size.");
+
+		/// <summary>
+		/// Sanitize Status log page (LID 0x81)
+		/// </summary>
+		typedef struct SANITIZE_STATUS_LOG
+		{
+			UINT_16 SPROG; // Sanitize Progress (numerator of a fraction of 65536 done)
+			UINT_16 SOS : 3; // Sanitize Operation Status
+			UINT_16 OPC : 5; // Overwrite Passes Completed
+			UINT_16 GDE : 1; // Global Data Erased
+			UINT_16 RSVD0 : 7; // Reserved
+			UINT_32 SCDW10; // Sanitize Command Dword 10 of the most recent sanitize
+			UINT_32 ETO; // Estimated Time For Overwrite (seconds)
+			UINT_32 ETBE; // Estimated Time For Block Erase (seconds)
+			UINT_32 ETCE; // Estimated Time For Crypto Erase (seconds)
+			UINT_32 ETOND; // Estimated Time For Overwrite With No-Deallocate Media Modification (seconds)
+			UINT_32 ETBEND; // Estimated Time For Block Erase With No-Deallocate Media Modification (seconds)
+			UINT_32 ETCEND; // Estimated Time For Crypto Erase With No-Deallocate Media Modification (seconds)
+			UINT_8 RSVD1[480]; // Reserved
+
+			std::string toString() const;
+		}SANITIZE_STATUS_LOG, *PSANITIZE_STATUS_LOG;
+		static_assert(sizeof(SANITIZE_STATUS_LOG) == 512, "SANITIZE_STATUS_LOG should be 512 byte(s) in size.");
+
+		/// <summary>
+		/// Predictable Latency Per NVM Set log page (LID 0x0A). The NVM Set is picked by the Log Specific Identifier.
+		/// </summary>
+		typedef struct PREDICTABLE_LATENCY_PER_NVM_SET_LOG
+		{
+			UINT_8 STATUS : 3; // Status (current window, or 0 if Predictable Latency Mode is not enabled)
+			UINT_8 RSVD0 : 5; // Reserved
+			UINT_8 RSVD1; // Reserved
+			UINT_16 ET; // Event Type (events pending for the Predictable Latency Event Aggregate log page)
+			UINT_8 RSVD2[28]; // Reserved
+			UINT_64 DTWINRT; // DTWIN Reads Typical (4 KiB reads)
+			UINT_64 DTWINWT; // DTWIN Writes Typical (4 KiB writes)
+			UINT_64 DTWINTM; // DTWIN Time Maximum (milliseconds)
+			UINT_64 NDWINTMH; // NDWIN Time Minimum High (milliseconds in NDWIN after a DTWIN that exceeded a typical value)
+			UINT_64 NDWINTML; // NDWIN Time Minimum Low (milliseconds in NDWIN after any other DTWIN)
+			UINT_8 RSVD3[56]; // Reserved
+			UINT_64 DTWINRE; // DTWIN Reads Estimate (4 KiB reads left before an autonomous transition to NDWIN)
+			UINT_64 DTWINWE; // DTWIN Writes Estimate (4 KiB writes left before an autonomous transition to NDWIN)
+			UINT_64 DTWINTE; // DTWIN Time Estimate (milliseconds left before an autonomous transition to NDWIN)
+			UINT_8 RSVD4[360]; // Reserved
+
+			std::string toString() const;
+		}PREDICTABLE_LATENCY_PER_NVM_SET_LOG, *PPREDICTABLE_LATENCY_PER_NVM_SET_LOG;
+		static_assert(sizeof(PREDICTABLE_LATENCY_PER_NVM_SET_LOG) == 512, "PREDICTABLE_LATENCY_PER_NVM_SET_LOG should be 512 byte(s) in size.");
+
+		/// <summary>
+		/// Header of the Predictable Latency Event Aggregate log page (LID 0x0B).
+		/// It's followed by NE 16 bit NVM Set IDs: the sets with events pending, in ID order.
+		/// </summary>
+		typedef struct PREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG
+		{
+			UINT_64 NE; // Number of Entries
+
+			std::string toString() const;
+		}PREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG, *PPREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG;
+		static_assert(sizeof(PREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG) == 8, "PREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG should be 8 byte(s) in size.");
+
+		/// <summary>
+		/// Vendor specific FTL Statistics log page (LID 0xC0).
+		/// Only returned for namespaces backed by an FtlMedia.
+		/// </summary>
+		typedef struct FTL_STATISTICS_LOG
+		{
+			UINT_64 HPW; // Host Pages Written
+			UINT_64 NPW; // NAND Pages Written (host + garbage collection)
+			UINT_64 GCPR; // Garbage Collection Pages Relocated
+			UINT_64 SBE; // Superblocks Erased
+			UINT_64 FGCS; // Foreground Garbage Collection Stalls (writes that had to wait for GC)
+			UINT_64 FGCST; // Foreground Garbage Collection Stall Time (microseconds, total)
+			UINT_64 MFGCST; // Maximum Foreground Garbage Collection Stall Time (microseconds)
+			UINT_32 WAF; // Write Amplification Factor (in thousandths: NPW * 1000 / HPW)
+			UINT_32 TSB; // Total Superblocks
+			UINT_32 FSB; // Free Superblocks
+			UINT_32 PPSB; // Pages Per Superblock
+			UINT_32 OP; // Overprovisioning (percent)
+			UINT_8 GCP; // Garbage Collection Policy (FTL_GC_POLICY)
+			UINT_8 RSVD0[3]; // Reserved
+			UINT_64 MEC; // Maximum Erase Count of any superblock
+			UINT_8 RSVD1[424]; // Reserved
+
+			std::string toString() const;
+		}FTL_STATISTICS_LOG, *PFTL_STATISTICS_LOG;
+		static_assert(sizeof(FTL_STATISTICS_LOG) == 512, "FTL_STATISTICS_LOG should be 512 byte(s) in size.");
+
+		/// <summary>
+		/// Vendor specific Read Cache Statistics log page (LID 0xC1). Per namespace.
+		/// </summary>
+		typedef struct READ_CACHE_STATISTICS_LOG
+		{
+			UINT_64 HRB; // Host Read Blocks
+			UINT_64 CHB; // Cache Hit Blocks (host read blocks served from the cache)
+			UINT_64 CMB; // Cache Miss Blocks
+			UINT_64 PL; // Prefetched Lines (cache lines read ahead for a sequential stream)
+			UINT_64 UPL; // Useful Prefetched Lines (later read by the host)
+			UINT_64 WPL; // Wasted Prefetched Lines (evicted or invalidated before the host read them)
+			UINT_64 EL; // Evicted Lines
+			UINT_64 IL; // Invalidated Lines (by writes, deallocates and copies)
+			UINT_64 SSD; // Sequential Streams Detected
+			UINT_32 HR; // Hit Ratio (in thousandths: CHB * 1000 / HRB)
+			UINT_32 PA; // Prefetch Accuracy (in thousandths: UPL * 1000 / (UPL + WPL))
+			UINT_32 LS; // Line Size (bytes)
+			UINT_32 CL; // Cached Lines
+			UINT_32 TL; // Total Lines the cache can hold
+			UINT_8 EN; // Enabled
+			UINT_8 RSVD0[3]; // Reserved
+			UINT_8 RSVD1[416]; // Reserved
+
+			std::string toString() const;
+		}READ_CACHE_STATISTICS_LOG, *PREAD_CACHE_STATISTICS_LOG;
+		static_assert(sizeof(READ_CACHE_STATISTICS_LOG) == 512, "READ_CACHE_STATISTICS_LOG should be 512 byte(s) in size.");
+
+		/// <summary>
+		/// Vendor specific Deduplication Statistics log page (LID 0xC2).
+		/// Only returned for namespaces backed by a DedupMedia.
+		/// </summary>
+		typedef struct DEDUP_STATISTICS_LOG
+		{
+			UINT_64 HBW; // Host Blocks Written
+			UINT_64 ZBW; // Zero Blocks Written (stored as nothing)
+			UINT_64 DBW; // Duplicate Blocks Written (matched a block already stored)
+			UINT_64 HC; // Hash Collisions (hash matched a stored block but the data didn't)
+			UINT_64 MB; // Mapped Blocks (LBAs currently holding non-zero data)
+			UINT_64 UB; // Unique Blocks stored
+			UINT_64 SB; // Stored Bytes (UB * block size)
+			UINT_32 DR; // Deduplication Ratio (in thousandths: MB * 1000 / UB)
+			UINT_32 BS; // Block Size (bytes)
+			UINT_8 RSVD0[448]; // Reserved
+
+			std::string toString() const;
+		}DEDUP_STATISTICS_LOG, *PDEDUP_STATISTICS_LOG;
+		static_assert(sizeof(DEDUP_STATISTICS_LOG) == 512, "DEDUP_STATISTICS_LOG should be 512 byte(s) in size.");
+
+		/// <summary>
+		/// Vendor specific Tiering Statistics log page (LID 0xC3).
+		/// Only returned for namespaces backed by a TieredMedia.
+		/// </summary>
+		typedef struct TIERING_STATISTICS_LOG
+		{
+			UINT_64 FRB; // Fast tier Read Blocks
+			UINT_64 FWB; // Fast tier Written Blocks
+			UINT_64 SRB; // Slow tier Read Blocks
+			UINT_64 SWB; // Slow tier Written Blocks
+			UINT_64 PS; // Promoted Segments (slow to fast)
+			UINT_64 DS; // Demoted Segments (fast to slow)
+			UINT_64 HPS; // Hint Promoted Segments (of PS, promoted because of a Dataset Management hint)
+			UINT_64 HDS; // Hint Demoted Segments (of DS, demoted because of a Dataset Management hint)
+			UINT_64 FSR; // Fast Segments Resident
+			UINT_64 FSC; // Fast Segment Capacity
+			UINT_32 SS; // Segment Size (bytes)
+			UINT_8 RSVD0[428]; // Reserved
+
+			std::string toString() const;
+		}TIERING_STATISTICS_LOG, *PTIERING_STATISTICS_LOG;
+		static_assert(sizeof(TIERING_STATISTICS_LOG) == 512, "TIERING_STATISTICS_LOG should be 512 byte(s) in size.");
+
+		/// <summary>
+		/// Write amplification of one stream slot in the Stream Statistics log page
+		/// </summary>
+		typedef struct STREAM_STATISTICS_ENTRY
+		{
+			UINT_64 HPW; // Host Pages Written with this slot's streams
+			UINT_64 NPW; // NAND Pages Written for them (host + garbage collection relocations)
+			UINT_32 WAF; // Write Amplification Factor (in thousandths: NPW * 1000 / HPW)
+			UINT_8 RSVD0[12]; // Reserved
+
+			std::string toString() const;
+		}STREAM_STATISTICS_ENTRY, *PSTREAM_STATISTICS_ENTRY;
+		static_assert(sizeof(STREAM_STATISTICS_ENTRY) == 32, "STREAM_STATISTICS_ENTRY should be 32 byte(s) in size.");
+
+		/// <summary>
+		/// Vendor specific Stream Statistics log page (LID 0xC4).
+		/// Only returned for namespaces backed by an FtlMedia. Entry 0 is writes without a stream.
+		///   Stream identifier S (not 0) uses entry ((S - 1) % NSS) + 1.
+		/// </summary>
+		typedef struct STREAM_STATISTICS_LOG
+		{
+			UINT_32 NSS; // Number of Stream Slots (entries after entry 0 that are in use)
+			UINT_8 RSVD0[28]; // Reserved
+			STREAM_STATISTICS_ENTRY SE[STREAM_STATISTICS_MAX_SLOTS + 1]; // Stream Entries
+			UINT_8 RSVD1[448]; // Reserved
+
+			std::string toString() const;
+		}STREAM_STATISTICS_LOG, *PSTREAM_STATISTICS_LOG;
+		static_assert(sizeof(STREAM_STATISTICS_LOG) == 1024, "STREAM_STATISTICS_LOG should be 1024 byte(s) in size.");
+
+		/// <summary>
+		/// Limits and throttling of one submission queue or namespace in the QoS Statistics log page
+		/// </summary>
+		typedef struct QOS_STATISTICS_ENTRY
+		{
+			UINT_8 TYPE; // 0 for a submission queue, 1 for a namespace
+			UINT_8 RSVD0[3]; // Reserved
+			UINT_32 ID; // SQID or NSID
+			UINT_64 IOPSL; // IOPS Limit (0 if unlimited)
+			UINT_64 BWL; // Bandwidth Limit (bytes per second, 0 if unlimited)
+			UINT_64 DC; // Dispatched Commands
+			UINT_64 ITC; // IOPS Throttled Commands (commands the IOPS limit held back)
+			UINT_64 BTC; // Bandwidth Throttled Commands (commands the bandwidth limit held back)
+			UINT_64 TTD; // Total Throttle Delay (microseconds commands were held back by these limits)
+			UINT_64 MTD; // Max Throttle Delay (microseconds)
+
+			std::string toString() const;
+		}QOS_STATISTICS_ENTRY, *PQOS_STATISTICS_ENTRY;
+		static_assert(sizeof(QOS_STATISTICS_ENTRY) == 64, "QOS_STATISTICS_ENTRY should be 64 byte(s) in size.");
+
+		/// <summary>
+		/// Header of the vendor specific QoS Statistics log page (LID 0xC5).
+		/// It's followed by NE QOS_STATISTICS_ENTRYs: the limited submission queues then the limited namespaces, each in ID order.
+		/// </summary>
+		typedef struct QOS_STATISTICS_LOG
+		{
+			UINT_32 NE; // Number of Entries
+			UINT_32 BMS; // Burst Milliseconds (how much of its rate each limit lets through at once)
+			UINT_8 RSVD0[56]; // Reserved
+
+			std::string toString() const;
+		}QOS_STATISTICS_LOG, *PQOS_STATISTICS_LOG;
+		static_assert(sizeof(QOS_STATISTICS_LOG) == 64, "QOS_STATISTICS_LOG should be 64 byte(s) in size.");
+
+		/// <summary>
+		/// Counters of one command pipeline stage in the Pipeline Statistics log page.
+		/// Average service time per command is STNS / CMDS and average input occupancy is OCCS / SVCS.
+		/// </summary>
+		typedef struct PIPELINE_STAGE_STATISTICS
+		{
+			UINT_64 CMDS; // Commands handled
+			UINT_64 SVCS; // Services (batches of commands taken from the input)
+			UINT_64 STNS; // Service Time (nanoseconds, total)
+			UINT_64 OCCS; // Occupancy Sum (commands waiting in the input at the start of each service)
+			UINT_32 MOCC; // Max Occupancy
+			UINT_32 ICAP; // Input Capacity (0 for the fetch stage, whose input is the submission queues)
+			UINT_8 RSVD0[24]; // Reserved
+
+			std::string toString() const;
+		}PIPELINE_STAGE_STATISTICS, *PPIPELINE_STAGE_STATISTICS;
+		static_assert(sizeof(PIPELINE_STAGE_STATISTICS) == 64, "PIPELINE_STAGE_STATISTICS should be 64 byte(s) in size.");
+
+		/// <summary>
+		/// Vendor specific Pipeline Statistics log page (LID 0xC6).
+		/// One entry per I/O command pipeline stage: fetch (and decode), execute, complete.
+		/// </summary>
+		typedef struct PIPELINE_STATISTICS_LOG
+		{
+			UINT_32 NS; // Number of Stages
+			UINT_8 RSVD0[60]; // Reserved
+			PIPELINE_STAGE_STATISTICS STG[3]; // Stages
+
+			std::string toString() const;
+		}PIPELINE_STATISTICS_LOG, *PPIPELINE_STATISTICS_LOG;
+		static_assert(sizeof(PIPELINE_STATISTICS_LOG) == 256, "PIPELINE_STATISTICS_LOG should be 256 byte(s) in size.");
+
+		/// <summary>
+		/// Counters of one execute stage worker in the Executor Statistics log page.
+		/// Across all workers, the commands stolen add up to the commands stolen from.
+		/// </summary>
+		typedef struct EXECUTOR_WORKER_STATISTICS
+		{
+			UINT_64 CMDS; // Commands executed
+			UINT_64 STLS; // Steals (commands this worker took from another worker)
+			UINT_64 STLN; // Stolen (commands another worker took from this one)
+			UINT_8 RSVD0[8]; // Reserved
+
+			std::string toString() const;
+		}EXECUTOR_WORKER_STATISTICS, *PEXECUTOR_WORKER_STATISTICS;
+		static_assert(sizeof(EXECUTOR_WORKER_STATISTICS) == 32, "EXECUTOR_WORKER_STATISTICS should be 32 byte(s) in size.");
+
+		/// <summary>
+		/// Vendor specific Executor Statistics log page (LID 0xC7).
+		/// One entry per worker of the work stealing execute stage. Entries past NW are zero.
+		/// </summary>
+		typedef struct EXECUTOR_STATISTICS_LOG
+		{
+			UINT_32 NW; // Number of Workers
+			UINT_8 RSVD0[28]; // Reserved
+			EXECUTOR_WORKER_STATISTICS WRK[16]; // Workers
+
+			std::string toString() const;
+		}EXECUTOR_STATISTICS_LOG, *PEXECUTOR_STATISTICS_LOG;
+		static_assert(sizeof(EXECUTOR_STATISTICS_LOG) == 544, "EXECUTOR_STATISTICS_LOG should be 544 byte(s) in size.");
+
+		/// <summary>
+		/// SMART / Health Information log page (LID 0x02), for the whole controller.
+		/// The 128 bit counters are two UINT_64s, low then high.
+		/// </summary>
+		typedef struct SMART_HEALTH_INFORMATION_LOG
+		{
+			UINT_8 CW; // Critical Warning
+			UINT_8 CTEMP[2]; // Composite Temperature (Kelvin, little endian)
+			UINT_8 AVSP; // Available Spare (percent)
+			UINT_8 AVSPT; // Available Spare Threshold (percent)
+			UINT_8 PUSED; // Percentage Used
+			UINT_8 EGCWS; // Endurance Group Critical Warning Summary
+			UINT_8 RSVD0[25]; // Reserved
+			UINT_64 DUR[2]; // Data Units Read (thousands of 512 byte units, rounded up)
+			UINT_64 DUW[2]; // Data Units Written (thousands of 512 byte units, rounded up)
+			UINT_64 HRC[2]; // Host Read Commands
+			UINT_64 HWC[2]; // Host Write Commands
+			UINT_64 CBT[2]; // Controller Busy Time (minutes)
+			UINT_64 PWRC[2]; // Power Cycles
+			UINT_64 POH[2]; // Power On Hours
+			UINT_64 UNSAFE[2]; // Unsafe Shutdowns
+			UINT_64 MEDERR[2]; // Media and Data Integrity Errors
+			UINT_64 NUMERR[2]; // Number of Error Information Log Entries
+			UINT_32 WCTT; // Warning Composite Temperature Time (minutes)
+			UINT_32 CCTT; // Critical Composite Temperature Time (minutes)
+			UINT_16 TSEN[8]; // Temperature Sensors 1 to 8 (Kelvin, 0 if not implemented)
+			UINT_32 TMT1TC; // Thermal Management Temperature 1 Transition Count
+			UINT_32 TMT2TC; // Thermal Management Temperature 2 Transition Count
+			UINT_32 TTMT1; // Total Time For Thermal Management Temperature 1 (seconds)
+			UINT_32 TTMT2; // Total Time For Thermal Management Temperature 2 (seconds)
+			UINT_8 RSVD1[280]; // Reserved
+
+			std::string toString() const;
+		}SMART_HEALTH_INFORMATION_LOG, *PSMART_HEALTH_INFORMATION_LOG;
+		static_assert(sizeof(SMART_HEALTH_INFORMATION_LOG) == 512, "SMART_HEALTH_INFORMATION_LOG should be 512 byte(s) in size.");
+
+		/// <summary>
+		/// Counters of one submission queue in the Submission Queue Statistics log page.
+		/// Every command is one of read, write or other. Bytes only count for commands that succeeded.
+		/// </summary>
+		typedef struct SUBMISSION_QUEUE_STATISTICS_ENTRY
+		{
+			UINT_16 SQID; // Submission Queue Identifier
+			UINT_8 RSVD0[6]; // Reserved
+			UINT_64 RC; // Read Commands (Read, Compare)
+			UINT_64 WC; // Write Commands (Write, Zone Append)
+			UINT_64 OC; // Other Commands
+			UINT_64 EC; // Error Commands (completed with a status other than success)
+			UINT_64 MEC; // Media Error Commands (completed with a Media and Data Integrity Error)
+			UINT_64 BR; // Bytes Read
+			UINT_64 BW; // Bytes Written
+
+			std::string toString() const;
+		}SUBMISSION_QUEUE_STATISTICS_ENTRY, *PSUBMISSION_QUEUE_STATISTICS_ENTRY;
+		static_assert(sizeof(SUBMISSION_QUEUE_STATISTICS_ENTRY) == 64, "SUBMISSION_QUEUE_STATISTICS_ENTRY should be 64 byte(s) in size.");
+
+		/// <summary>
+		/// Header of the vendor specific Submission Queue Statistics log page (LID 0xC8).
+		/// It's followed by NE SUBMISSION_QUEUE_STATISTICS_ENTRYs, in SQID order, for each queue (admin included) that has had a command.
+		/// Counters carry on across a queue being deleted and created again.
+		/// </summary>
+		typedef struct SUBMISSION_QUEUE_STATISTICS_LOG
+		{
+			UINT_32 NE; // Number of Entries
+			UINT_8 RSVD0[60]; // Reserved
+
+			std::string toString() const;
+		}SUBMISSION_QUEUE_STATISTICS_LOG, *PSUBMISSION_QUEUE_STATISTICS_LOG;
+		static_assert(sizeof(SUBMISSION_QUEUE_STATISTICS_LOG) == 64, "SUBMISSION_QUEUE_STATISTICS_LOG should be 64 byte(s) in size.");
+	}
+}
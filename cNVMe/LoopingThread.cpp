@@ -14,6 +14,12 @@ namespace cnvme
 		SleepDuration = sleepDuration;
 	}
 
+	LoopingThread::LoopingThread(std::function<void()> functionToLoop, std::function<void()> waitFunction) : LoopingThread::LoopingThread()
+	{
+		FunctionToLoop = functionToLoop;
+		WaitFunction = waitFunction;
+	}
+
 	LoopingThread::LoopingThread()
 	{
 		ContinueLoop = false;
@@ -39,6 +45,7 @@ namespace cnvme
 		Flipper = other.Flipper.load();
 		SleepDuration = other.SleepDuration;
 		FunctionToLoop = other.FunctionToLoop;
+		WaitFunction = other.WaitFunction;
 
 		return *this;
 	}
@@ -52,10 +59,18 @@ namespace cnvme
 	{
 		if (!isRunning())
 		{
+			// Hold the flip lock from before the thread exists, so its first iteration can't flip before we start waiting
+			//   (we'd then wait for its second, which may be a whole sleep later)
+			std::unique_lock<std::mutex> flipLock(FlipMutex);
+			bool cachedFlipper = Flipper.load();
 			ContinueLoop = true;
 			TheThread = std::thread(&LoopingThread::loopingFunction, this);
 			IsRunning = true;
-			waitForFlip(); // wait for one iteration, to make sure it is running
+
+			while (Flipper == cachedFlipper) // wait for one iteration, to make sure it is running
+			{
+				FlipCondition.wait(flipLock);
+			}
 		}
 	}
 
@@ -111,7 +126,14 @@ namespace cnvme
 				FlipCondition.notify_all();
 			}
 
-			std::this_thread::sleep_for(std::chrono::milliseconds(SleepDuration));
+			if (WaitFunction)
+			{
+				WaitFunction();
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(SleepDuration));
+			}
 		}
 
 		RunningMutex.unlock();
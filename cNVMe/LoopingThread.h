@@ -23,6 +23,14 @@ namespace cnvme
 		/// <param name="sleepDuration">Time in ms to sleep between loop iterations</param>
 		LoopingThread(std::function<void()> functionToLoop, UINT_64 sleepDuration);
 
+		/// <summary>
+		/// Constructor for a thread that waits for its own reason between loop iterations (instead of sleeping a set time).
+		/// The wait happens without the flip lock held, so it may block for a while. It must return once end() is on its way.
+		/// </summary>
+		/// <param name="functionToLoop">The function to loop</param>
+		/// <param name="waitFunction">Called between loop iterations</param>
+		LoopingThread(std::function<void()> functionToLoop, std::function<void()> waitFunction);
+
 		/// <summary>
 		/// Base constructor
 		/// </summary>
@@ -79,6 +87,11 @@ namespace cnvme
 		/// </summary>
 		UINT_64 SleepDuration;
 
+		/// <summary>
+		/// If set, called between loop iterations instead of sleeping SleepDuration
+		/// </summary>
+		std::function<void()> WaitFunction;
+
 		/// <summary>
 		/// The thread that will be running
 		/// </summary>
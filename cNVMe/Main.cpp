@@ -4,6 +4,7 @@ This file is part of cNVMe and is released under the MIT License
 Main.cpp - An implementation file for the Main entry
 */
 
+#include "Benchmarks.h"
 #include "Strings.h"
 #include "Tests.h"
 
@@ -12,8 +13,14 @@ Main.cpp - An implementation file for the Main entry
 using namespace cnvme;
 using namespace cnvme::command;
 
-int main()
+int main(int argc, char** argv)
 {
+	if (argc > 1 && std::string(argv[1]) == "--benchmark")
+	{
+		cnvme::benchmarks::helpers::runBenchmarks();
+		return 0;
+	}
+
 	// This is testing code.
 	LOG_SET_LEVEL(2);
 
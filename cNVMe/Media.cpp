@@ -0,0 +1,637 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Media.cpp - An implementation file for the NVMe Media
+*/
+
+#include "Media.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace cnvme
+{
+	namespace media
+	{
+		MediaBackend::MediaBackend(UINT_32 blockSize, UINT_64 numberOfBlocks)
+		{
+			BlockSize = blockSize;
+			NumberOfBlocks = numberOfBlocks;
+		}
+
+		UINT_32 MediaBackend::getBlockSize() const
+		{
+			return BlockSize;
+		}
+
+		UINT_64 MediaBackend::getNumberOfBlocks() const
+		{
+			return NumberOfBlocks;
+		}
+
+		bool MediaBackend::isValidRange(UINT_64 lba, UINT_64 numberOfBlocks) const
+		{
+			return lba < NumberOfBlocks && numberOfBlocks <= NumberOfBlocks - lba;
+		}
+
+		bool MediaBackend::copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(sourceLba, numberOfBlocks) || !isValidRange(destinationLba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to copy out of range. Source LBA: " + std::to_string(sourceLba) + ". Destination LBA: " +
+					std::to_string(destinationLba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::vector<BYTE> bounceBuffer((size_t)(numberOfBlocks * BlockSize));
+			return read(sourceLba, (UINT_32)numberOfBlocks, bounceBuffer.data()) && write(destinationLba, (UINT_32)numberOfBlocks, bounceBuffer.data());
+		}
+
+		bool MediaBackend::flush()
+		{
+			return true;
+		}
+
+		bool MediaBackend::format()
+		{
+			return deallocate(0, NumberOfBlocks);
+		}
+
+		MediaBackend* MediaBackend::clone()
+		{
+			return nullptr;
+		}
+
+		bool MediaBackend::hint(UINT_64 lba, UINT_64 numberOfBlocks, UINT_32 contextAttributes)
+		{
+			return true;
+		}
+
+		bool MediaBackend::setStream(UINT_64 lba, UINT_64 numberOfBlocks, UINT_16 streamId)
+		{
+			return true;
+		}
+
+		void MediaBackend::setDeterministic(bool deterministic)
+		{
+		}
+
+		RamMedia::Chunk::Chunk() : Data(MEDIA_CHUNK_SIZE)
+		{
+			Owners = 1;
+			Generation = 0;
+		}
+
+		RamMedia::RamMedia(UINT_32 blockSize, UINT_64 numberOfBlocks) : MediaBackend(blockSize, numberOfBlocks)
+		{
+			ASSERT_IF(blockSize == 0 || MEDIA_CHUNK_SIZE % blockSize != 0, "RamMedia block size must evenly divide MEDIA_CHUNK_SIZE");
+			Generation = 0;
+			StaleChunks = 0;
+			ReclaimBucket = 0;
+			ReclaimThread = LoopingThread([&] {RamMedia::reclaim(); }, MEDIA_RECLAIM_SLEEP_MS);
+		}
+
+		RamMedia::~RamMedia()
+		{
+			ReclaimThread.end();
+
+			// Let any clone still sharing our chunks write them in place
+			std::lock_guard<std::mutex> lock(ChunksMutex);
+			for (auto &node : Chunks)
+			{
+				node.second->Owners--;
+			}
+		}
+
+		bool RamMedia::read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to read out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			UINT_64 byteOffset = lba * BlockSize;
+			UINT_64 bytesRemaining = (UINT_64)numberOfBlocks * BlockSize;
+			while (bytesRemaining)
+			{
+				UINT_64 chunkIndex = byteOffset / MEDIA_CHUNK_SIZE;
+				UINT_32 offsetInChunk = (UINT_32)(byteOffset % MEDIA_CHUNK_SIZE);
+				UINT_32 bytesThisChunk = (UINT_32)std::min<UINT_64>(MEDIA_CHUNK_SIZE - offsetInChunk, bytesRemaining);
+
+				std::shared_ptr<Chunk> chunk = getChunk(chunkIndex);
+				if (chunk)
+				{
+					memcpy(buffer, chunk->Data.getBuffer() + offsetInChunk, bytesThisChunk);
+				}
+				else
+				{
+					memset(buffer, 0, bytesThisChunk); // Never written
+				}
+
+				buffer += bytesThisChunk;
+				byteOffset += bytesThisChunk;
+				bytesRemaining -= bytesThisChunk;
+			}
+			return true;
+		}
+
+		bool RamMedia::write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to write out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			UINT_64 byteOffset = lba * BlockSize;
+			UINT_64 bytesRemaining = (UINT_64)numberOfBlocks * BlockSize;
+			while (bytesRemaining)
+			{
+				UINT_64 chunkIndex = byteOffset / MEDIA_CHUNK_SIZE;
+				UINT_32 offsetInChunk = (UINT_32)(byteOffset % MEDIA_CHUNK_SIZE);
+				UINT_32 bytesThisChunk = (UINT_32)std::min<UINT_64>(MEDIA_CHUNK_SIZE - offsetInChunk, bytesRemaining);
+
+				std::shared_ptr<Chunk> chunk = getChunkForWrite(chunkIndex);
+				memcpy(chunk->Data.getBuffer() + offsetInChunk, buffer, bytesThisChunk);
+
+				buffer += bytesThisChunk;
+				byteOffset += bytesThisChunk;
+				bytesRemaining -= bytesThisChunk;
+			}
+			return true;
+		}
+
+		bool RamMedia::deallocate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to deallocate out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			UINT_64 byteOffset = lba * BlockSize;
+			UINT_64 bytesRemaining = numberOfBlocks * BlockSize;
+			while (bytesRemaining)
+			{
+				UINT_64 chunkIndex = byteOffset / MEDIA_CHUNK_SIZE;
+				UINT_32 offsetInChunk = (UINT_32)(byteOffset % MEDIA_CHUNK_SIZE);
+				UINT_32 bytesThisChunk = (UINT_32)std::min<UINT_64>(MEDIA_CHUNK_SIZE - offsetInChunk, bytesRemaining);
+
+				if (bytesThisChunk == MEDIA_CHUNK_SIZE)
+				{
+					// Whole chunk. Just drop it.
+					std::lock_guard<std::mutex> lock(ChunksMutex);
+					releaseChunkLocked(chunkIndex);
+				}
+				else if (getChunk(chunkIndex))
+				{
+					std::shared_ptr<Chunk> chunk = getChunkForWrite(chunkIndex);
+					memset(chunk->Data.getBuffer() + offsetInChunk, 0, bytesThisChunk);
+				}
+
+				byteOffset += bytesThisChunk;
+				bytesRemaining -= bytesThisChunk;
+			}
+			return true;
+		}
+
+		bool RamMedia::copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(sourceLba, numberOfBlocks) || !isValidRange(destinationLba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to copy out of range. Source LBA: " + std::to_string(sourceLba) + ". Destination LBA: " +
+					std::to_string(destinationLba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			UINT_64 sourceByte = sourceLba * BlockSize;
+			UINT_64 destinationByte = destinationLba * BlockSize;
+			UINT_64 bytesRemaining = numberOfBlocks * BlockSize;
+
+			if (sourceByte < destinationByte + bytesRemaining && destinationByte < sourceByte + bytesRemaining)
+			{
+				// Overlapping. Bounce the whole thing.
+				return MediaBackend::copy(sourceLba, destinationLba, numberOfBlocks);
+			}
+
+			if (sourceByte % MEDIA_CHUNK_SIZE != destinationByte % MEDIA_CHUNK_SIZE)
+			{
+				// Chunks can't line up. Move the bytes in chunk sized pieces instead.
+				Payload bounce(MEDIA_CHUNK_SIZE);
+				UINT_32 blocksPerPiece = MEDIA_CHUNK_SIZE / BlockSize;
+				for (UINT_64 done = 0; done < numberOfBlocks; done += blocksPerPiece)
+				{
+					UINT_32 blocks = (UINT_32)std::min<UINT_64>(blocksPerPiece, numberOfBlocks - done);
+					if (!read(sourceLba + done, blocks, bounce.getBuffer()) || !write(destinationLba + done, blocks, bounce.getBuffer()))
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+
+			while (bytesRemaining)
+			{
+				UINT_64 sourceChunkIndex = sourceByte / MEDIA_CHUNK_SIZE;
+				UINT_64 destinationChunkIndex = destinationByte / MEDIA_CHUNK_SIZE;
+				UINT_32 offsetInChunk = (UINT_32)(sourceByte % MEDIA_CHUNK_SIZE);
+				UINT_32 bytesThisChunk = (UINT_32)std::min<UINT_64>(MEDIA_CHUNK_SIZE - offsetInChunk, bytesRemaining);
+
+				if (bytesThisChunk == MEDIA_CHUNK_SIZE)
+				{
+					// Whole chunk on both sides: share it
+					std::lock_guard<std::mutex> lock(ChunksMutex);
+					releaseChunkLocked(destinationChunkIndex);
+					auto node = Chunks.find(sourceChunkIndex);
+					if (node != Chunks.end() && !isStaleLocked(node->second))
+					{
+						node->second->Owners++;
+						Chunks[destinationChunkIndex] = node->second;
+					}
+				}
+				else
+				{
+					// Partial chunk at the start or end of the range
+					std::shared_ptr<Chunk> sourceChunk = getChunk(sourceChunkIndex);
+					if (sourceChunk)
+					{
+						std::shared_ptr<Chunk> destinationChunk = getChunkForWrite(destinationChunkIndex);
+						memmove(destinationChunk->Data.getBuffer() + offsetInChunk, sourceChunk->Data.getBuffer() + offsetInChunk, bytesThisChunk);
+					}
+					else if (getChunk(destinationChunkIndex))
+					{
+						std::shared_ptr<Chunk> destinationChunk = getChunkForWrite(destinationChunkIndex);
+						memset(destinationChunk->Data.getBuffer() + offsetInChunk, 0, bytesThisChunk);
+					}
+				}
+
+				sourceByte += bytesThisChunk;
+				destinationByte += bytesThisChunk;
+				bytesRemaining -= bytesThisChunk;
+			}
+			return true;
+		}
+
+		bool RamMedia::format()
+		{
+			{
+				std::lock_guard<std::mutex> lock(ChunksMutex);
+				Generation++;
+				StaleChunks = Chunks.size(); // Everything, including anything left over from an earlier format
+				ReclaimBucket = 0;
+			}
+
+			// Not under ChunksMutex: start() waits for a first reclaim(), which takes it
+			std::call_once(ReclaimThreadStarted, [&] {ReclaimThread.start(); });
+			return true;
+		}
+
+		MediaBackend* RamMedia::clone()
+		{
+			RamMedia* clone = new RamMedia(BlockSize, NumberOfBlocks);
+
+			std::lock_guard<std::mutex> lock(ChunksMutex);
+			clone->Generation = Generation; // So the shared chunks are current in the clone too
+			clone->Chunks.reserve(Chunks.size() - StaleChunks);
+			for (auto &node : Chunks)
+			{
+				if (!isStaleLocked(node.second))
+				{
+					node.second->Owners++;
+					clone->Chunks.emplace(node.first, node.second);
+				}
+			}
+			return clone;
+		}
+
+		size_t RamMedia::getNumberOfAllocatedChunks()
+		{
+			std::lock_guard<std::mutex> lock(ChunksMutex);
+			return Chunks.size();
+		}
+
+		UINT_64 RamMedia::getGeneration()
+		{
+			std::lock_guard<std::mutex> lock(ChunksMutex);
+			return Generation;
+		}
+
+		size_t RamMedia::getNumberOfSharedChunks()
+		{
+			std::lock_guard<std::mutex> lock(ChunksMutex);
+			size_t sharedChunks = 0;
+			for (auto &node : Chunks)
+			{
+				if (node.second->Owners > 1)
+				{
+					sharedChunks++;
+				}
+			}
+			return sharedChunks;
+		}
+
+		std::shared_ptr<RamMedia::Chunk> RamMedia::getChunk(UINT_64 chunkIndex)
+		{
+			std::lock_guard<std::mutex> lock(ChunksMutex);
+			auto node = Chunks.find(chunkIndex);
+			if (node != Chunks.end() && !isStaleLocked(node->second))
+			{
+				return node->second;
+			}
+			return nullptr;
+		}
+
+		std::shared_ptr<RamMedia::Chunk> RamMedia::getChunkForWrite(UINT_64 chunkIndex)
+		{
+			std::lock_guard<std::mutex> lock(ChunksMutex);
+			std::shared_ptr<Chunk> &chunk = Chunks[chunkIndex];
+			if (chunk && isStaleLocked(chunk))
+			{
+				// Written before the last format. Replace it rather than wait for the reclaimer.
+				chunk->Owners--;
+				chunk.reset();
+				StaleChunks--;
+			}
+
+			if (!chunk)
+			{
+				chunk = std::make_shared<Chunk>();
+				chunk->Generation = Generation;
+			}
+			else if (chunk->Owners > 1)
+			{
+				// Shared with another LBA range or a clone. Take a private copy before writing.
+				std::shared_ptr<Chunk> privateChunk = std::make_shared<Chunk>();
+				memcpy(privateChunk->Data.getBuffer(), chunk->Data.getBuffer(), MEDIA_CHUNK_SIZE);
+				privateChunk->Generation = Generation;
+				chunk->Owners--;
+				chunk = privateChunk;
+			}
+			return chunk;
+		}
+
+		void RamMedia::releaseChunkLocked(UINT_64 chunkIndex)
+		{
+			auto node = Chunks.find(chunkIndex);
+			if (node != Chunks.end())
+			{
+				if (isStaleLocked(node->second))
+				{
+					StaleChunks--;
+				}
+				node->second->Owners--;
+				Chunks.erase(node);
+			}
+		}
+
+		bool RamMedia::isStaleLocked(const std::shared_ptr<Chunk> &chunk) const
+		{
+			return chunk->Generation != Generation;
+		}
+
+		void RamMedia::reclaim()
+		{
+			// Chunks are freed after the lock is dropped, so I/O isn't held up behind the frees
+			std::vector<std::shared_ptr<Chunk>> reclaimed;
+			{
+				std::lock_guard<std::mutex> lock(ChunksMutex);
+				if (StaleChunks == 0)
+				{
+					return;
+				}
+
+				std::vector<UINT_64> staleIndexes;
+				size_t buckets = std::min<size_t>(MEDIA_RECLAIM_BATCH_BUCKETS, Chunks.bucket_count());
+				for (size_t i = 0; i < buckets; i++, ReclaimBucket++)
+				{
+					if (ReclaimBucket >= Chunks.bucket_count())
+					{
+						ReclaimBucket = 0; // Wrap. A rehash may have moved stale chunks behind us.
+					}
+					for (auto node = Chunks.begin(ReclaimBucket); node != Chunks.end(ReclaimBucket); node++)
+					{
+						if (isStaleLocked(node->second))
+						{
+							staleIndexes.push_back(node->first);
+						}
+					}
+				}
+
+				for (UINT_64 chunkIndex : staleIndexes)
+				{
+					reclaimed.push_back(Chunks.find(chunkIndex)->second);
+					releaseChunkLocked(chunkIndex);
+				}
+			}
+		}
+
+		FileMedia::FileMedia(std::string filePath, UINT_32 blockSize, UINT_64 numberOfBlocks) : MediaBackend(blockSize, numberOfBlocks)
+		{
+#ifdef _WIN32
+			FileDescriptor = _open(filePath.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+			if (FileDescriptor >= 0)
+			{
+				_chsize_s(FileDescriptor, (INT_64)(numberOfBlocks * blockSize));
+			}
+#else
+			FileDescriptor = open(filePath.c_str(), O_RDWR | O_CREAT, 0644);
+			if (FileDescriptor >= 0 && ftruncate(FileDescriptor, (off_t)(numberOfBlocks * blockSize)) != 0)
+			{
+				LOG_ERROR("Unable to size media file " + filePath);
+			}
+#endif
+			if (FileDescriptor < 0)
+			{
+				LOG_ERROR("Unable to open media file " + filePath);
+			}
+		}
+
+		FileMedia::~FileMedia()
+		{
+			if (isOpen())
+			{
+#ifdef _WIN32
+				_close(FileDescriptor);
+#else
+				close(FileDescriptor);
+#endif
+				FileDescriptor = -1;
+			}
+		}
+
+		bool FileMedia::read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to read out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+			return readAt(lba * BlockSize, buffer, (UINT_64)numberOfBlocks * BlockSize);
+		}
+
+		bool FileMedia::write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to write out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+			return writeAt(lba * BlockSize, buffer, (UINT_64)numberOfBlocks * BlockSize);
+		}
+
+		bool FileMedia::deallocate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to deallocate out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+#ifdef __linux__
+			if (fallocate(FileDescriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)(lba * BlockSize), (off_t)(numberOfBlocks * BlockSize)) == 0)
+			{
+				return true;
+			}
+#endif
+			// No hole punching. Write zeros instead.
+			Payload zeros(MEDIA_CHUNK_SIZE);
+			UINT_64 byteOffset = lba * BlockSize;
+			UINT_64 bytesRemaining = numberOfBlocks * BlockSize;
+			while (bytesRemaining)
+			{
+				UINT_64 bytes = std::min<UINT_64>(bytesRemaining, MEDIA_CHUNK_SIZE);
+				if (!writeAt(byteOffset, zeros.getBuffer(), bytes))
+				{
+					return false;
+				}
+				byteOffset += bytes;
+				bytesRemaining -= bytes;
+			}
+			return true;
+		}
+
+		bool FileMedia::format()
+		{
+			UINT_64 size = NumberOfBlocks * BlockSize;
+#ifdef _WIN32
+			return _chsize_s(FileDescriptor, 0) == 0 && _chsize_s(FileDescriptor, (INT_64)size) == 0;
+#else
+			return ftruncate(FileDescriptor, 0) == 0 && ftruncate(FileDescriptor, (off_t)size) == 0;
+#endif
+		}
+
+		bool FileMedia::copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks)
+		{
+#ifdef __linux__
+			UINT_64 bytesRemaining = numberOfBlocks * BlockSize;
+			bool overlapping = sourceLba < destinationLba + numberOfBlocks && destinationLba < sourceLba + numberOfBlocks;
+			if (isValidRange(sourceLba, numberOfBlocks) && isValidRange(destinationLba, numberOfBlocks) && !overlapping)
+			{
+				// Let the filesystem do it (and reflink if it can). Fall back to bouncing if it won't.
+				loff_t sourceOffset = (loff_t)(sourceLba * BlockSize);
+				loff_t destinationOffset = (loff_t)(destinationLba * BlockSize);
+				while (bytesRemaining)
+				{
+					ssize_t copied = copy_file_range(FileDescriptor, &sourceOffset, FileDescriptor, &destinationOffset, (size_t)bytesRemaining, 0);
+					if (copied <= 0)
+					{
+						break;
+					}
+					bytesRemaining -= copied;
+				}
+
+				if (bytesRemaining == 0)
+				{
+					return true;
+				}
+
+				UINT_64 blocksDone = numberOfBlocks - bytesRemaining / BlockSize;
+				return MediaBackend::copy(sourceLba + blocksDone, destinationLba + blocksDone, numberOfBlocks - blocksDone);
+			}
+#endif
+			return MediaBackend::copy(sourceLba, destinationLba, numberOfBlocks);
+		}
+
+		bool FileMedia::flush()
+		{
+#ifdef _WIN32
+			return _commit(FileDescriptor) == 0;
+#elif defined(__linux__)
+			return fdatasync(FileDescriptor) == 0; // The file is sized up front, so only its data needs syncing
+#else
+			return fsync(FileDescriptor) == 0;
+#endif
+		}
+
+		bool FileMedia::isOpen() const
+		{
+			return FileDescriptor >= 0;
+		}
+
+		bool FileMedia::readAt(UINT_64 offset, BYTE* buffer, UINT_64 size)
+		{
+#ifdef _WIN32
+			std::lock_guard<std::mutex> lock(FileMutex);
+			if (_lseeki64(FileDescriptor, (INT_64)offset, SEEK_SET) < 0)
+			{
+				return false;
+			}
+#endif
+			while (size)
+			{
+#ifdef _WIN32
+				int bytesRead = _read(FileDescriptor, buffer, (unsigned int)std::min<UINT_64>(size, INT32_MAX));
+#else
+				ssize_t bytesRead = pread(FileDescriptor, buffer, (size_t)size, (off_t)offset);
+#endif
+				if (bytesRead < 0)
+				{
+					LOG_ERROR("Failed to read media file at offset " + std::to_string(offset));
+					return false;
+				}
+				if (bytesRead == 0)
+				{
+					memset(buffer, 0, (size_t)size); // Past the end of the file, which is still unwritten media
+					return true;
+				}
+				buffer += bytesRead;
+				offset += bytesRead;
+				size -= bytesRead;
+			}
+			return true;
+		}
+
+		bool FileMedia::writeAt(UINT_64 offset, const BYTE* buffer, UINT_64 size)
+		{
+#ifdef _WIN32
+			std::lock_guard<std::mutex> lock(FileMutex);
+			if (_lseeki64(FileDescriptor, (INT_64)offset, SEEK_SET) < 0)
+			{
+				return false;
+			}
+#endif
+			while (size)
+			{
+#ifdef _WIN32
+				int bytesWritten = _write(FileDescriptor, buffer, (unsigned int)std::min<UINT_64>(size, INT32_MAX));
+#else
+				ssize_t bytesWritten = pwrite(FileDescriptor, buffer, (size_t)size, (off_t)offset);
+#endif
+				if (bytesWritten <= 0)
+				{
+					LOG_ERROR("Failed to write media file at offset " + std::to_string(offset));
+					return false;
+				}
+				buffer += bytesWritten;
+				offset += bytesWritten;
+				size -= bytesWritten;
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,391 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Media.h - A header file for the NVMe Media (the backing store for a namespace)
+*/
+
+#pragma once
+
+#include "LoopingThread.h"
+#include "Types.h"
+
+#include <memory>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <io.h>
+#endif
+
+#define MEDIA_CHUNK_SIZE (64 * 1024) // Bytes per sparse allocation unit in RamMedia
+#define MEDIA_RECLAIM_BATCH_BUCKETS 1024 // Chunk map buckets RamMedia's reclaimer looks through per step
+#define MEDIA_RECLAIM_SLEEP_MS 1
+
+namespace cnvme
+{
+	namespace media
+	{
+		/// <summary>
+		/// Base class for anything that can act as the storage behind a namespace.
+		/// All addressing is done in logical blocks of getBlockSize() bytes.
+		/// </summary>
+		class MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			/// <param name="blockSize">Size of a logical block in bytes</param>
+			/// <param name="numberOfBlocks">Number of logical blocks in the media</param>
+			MediaBackend(UINT_32 blockSize, UINT_64 numberOfBlocks);
+
+			/// <summary>
+			/// Destructor
+			/// </summary>
+			virtual ~MediaBackend() = default;
+
+			/// <summary>
+			/// Returns the logical block size in bytes
+			/// </summary>
+			/// <returns>Block size</returns>
+			UINT_32 getBlockSize() const;
+
+			/// <summary>
+			/// Returns the number of logical blocks
+			/// </summary>
+			/// <returns>Number of blocks</returns>
+			UINT_64 getNumberOfBlocks() const;
+
+			/// <summary>
+			/// Returns true if the given range fits in the media
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <returns>True if in range</returns>
+			bool isValidRange(UINT_64 lba, UINT_64 numberOfBlocks) const;
+
+			/// <summary>
+			/// Reads numberOfBlocks blocks starting at lba into buffer.
+			/// Unwritten blocks read back as zeros.
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <param name="buffer">Buffer of at least numberOfBlocks * getBlockSize() bytes</param>
+			/// <returns>True on success</returns>
+			virtual bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) = 0;
+
+			/// <summary>
+			/// Writes numberOfBlocks blocks starting at lba from buffer
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <param name="buffer">Buffer of at least numberOfBlocks * getBlockSize() bytes</param>
+			/// <returns>True on success</returns>
+			virtual bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) = 0;
+
+			/// <summary>
+			/// Returns the given range to the unwritten (zero) state
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <returns>True on success</returns>
+			virtual bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) = 0;
+
+			/// <summary>
+			/// Copies numberOfBlocks blocks from sourceLba to destinationLba without the data ever leaving the media.
+			/// The base implementation bounces through a temporary buffer, so overlapping ranges behave as if
+			///   the source was fully read before the destination was written.
+			/// </summary>
+			/// <param name="sourceLba">First LBA to copy from</param>
+			/// <param name="destinationLba">First LBA to copy to</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <returns>True on success</returns>
+			virtual bool copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks);
+
+			/// <summary>
+			/// Makes everything written so far durable. The base implementation has nothing to do.
+			/// </summary>
+			/// <returns>True on success</returns>
+			virtual bool flush();
+
+			/// <summary>
+			/// Logically erases everything: afterwards every block reads back as zeros.
+			/// The base implementation deallocates the whole media.
+			/// </summary>
+			/// <returns>True on success</returns>
+			virtual bool format();
+
+			/// <summary>
+			/// Creates a copy-on-write clone: a new media that starts out with the same contents but is written independently.
+			/// The base implementation can't clone and returns nullptr.
+			/// </summary>
+			/// <returns>The clone (owned by the caller) or nullptr if this media can't be cloned</returns>
+			virtual MediaBackend* clone();
+
+			/// <summary>
+			/// Tells the media how the host expects a range to be accessed (Dataset Management context attributes).
+			/// The base implementation ignores it.
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <param name="contextAttributes">Context attributes of the range</param>
+			/// <returns>True on success</returns>
+			virtual bool hint(UINT_64 lba, UINT_64 numberOfBlocks, UINT_32 contextAttributes);
+
+			/// <summary>
+			/// Tags a range with the stream (Streams directive) the host is about to write it with. Media that places data
+			///   by stream uses the tag whenever those blocks are next written, so it survives the caches in front.
+			/// The base implementation ignores it.
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <param name="streamId">Stream identifier, or 0 for no stream</param>
+			/// <returns>True on success</returns>
+			virtual bool setStream(UINT_64 lba, UINT_64 numberOfBlocks, UINT_16 streamId);
+
+			/// <summary>
+			/// Tells the media whether the namespace is in a Predictable Latency Mode deterministic window.
+			///   While it is, media with background work (garbage collection, destaging, readahead) defers what it can.
+			/// The base implementation has nothing to defer.
+			/// </summary>
+			/// <param name="deterministic">True as a deterministic window starts, false as it ends</param>
+			virtual void setDeterministic(bool deterministic);
+
+		protected:
+			/// <summary>
+			/// Size of a logical block in bytes
+			/// </summary>
+			UINT_32 BlockSize;
+
+			/// <summary>
+			/// Number of logical blocks
+			/// </summary>
+			UINT_64 NumberOfBlocks;
+		};
+
+		/// <summary>
+		/// Sparse in-memory media. Memory is only allocated (in MEDIA_CHUNK_SIZE pieces) once written,
+		///   so very large namespaces can be simulated as long as they are mostly empty.
+		/// Every chunk is tagged with the generation it was written in. format() just bumps the generation,
+		///   which makes every existing chunk read as zeros at once. The stale chunks are freed afterwards,
+		///   a batch at a time, by a background reclaimer (or replaced on the spot if written first).
+		/// Clones share every chunk with their parent and only duplicate a chunk once either side writes it,
+		///   so one golden image can back any number of clones for the cost of their chunk maps.
+		/// </summary>
+		class RamMedia : public MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			/// <param name="blockSize">Size of a logical block in bytes. Must divide MEDIA_CHUNK_SIZE.</param>
+			/// <param name="numberOfBlocks">Number of logical blocks in the media</param>
+			RamMedia(UINT_32 blockSize, UINT_64 numberOfBlocks);
+
+			/// <summary>
+			/// Destructor. Stops the reclaimer and gives up this media's share of any chunks shared with clones.
+			/// </summary>
+			~RamMedia();
+
+			bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override;
+			bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) override;
+			bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Copies by sharing whole chunks between the source and destination where both line up on chunk boundaries
+			///   (a shared chunk is only duplicated once one side is written), and by memmove for everything else.
+			/// </summary>
+			bool copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Bumps the generation so everything reads as zeros. O(1) no matter how much was written.
+			/// </summary>
+			bool format() override;
+
+			/// <summary>
+			/// Clones by sharing every current chunk with the new media. Only the chunk map is copied.
+			/// Writes racing the clone may or may not be seen by it, so the caller should quiesce I/O first.
+			/// </summary>
+			MediaBackend* clone() override;
+
+			/// <summary>
+			/// Returns the number of chunks currently allocated (including stale ones not yet reclaimed)
+			/// </summary>
+			/// <returns>Number of chunks</returns>
+			size_t getNumberOfAllocatedChunks();
+
+			/// <summary>
+			/// Returns the current generation (the number of formats so far)
+			/// </summary>
+			/// <returns>Generation</returns>
+			UINT_64 getGeneration();
+
+			/// <summary>
+			/// Returns the number of chunks this media shares with a clone, its parent, or another of its own LBA ranges
+			/// </summary>
+			/// <returns>Number of shared chunks</returns>
+			size_t getNumberOfSharedChunks();
+
+		private:
+			/// <summary>
+			/// A piece of media. May be referenced by more than one chunk index (after a copy or clone),
+			///   in which case it is read-only and must be duplicated before being written.
+			/// </summary>
+			struct Chunk
+			{
+				/// <summary>
+				/// Constructor. Data starts zeroed.
+				/// </summary>
+				Chunk();
+
+				/// <summary>
+				/// The chunk's bytes (MEDIA_CHUNK_SIZE of them)
+				/// </summary>
+				Payload Data;
+
+				/// <summary>
+				/// Number of chunk indexes referencing this chunk, across this media and its clones.
+				/// Atomic since clones update it under their own ChunksMutex.
+				/// </summary>
+				std::atomic<UINT_32> Owners;
+
+				/// <summary>
+				/// Generation the chunk was allocated in. Stale (reads as zeros) once it differs from RamMedia::Generation.
+				/// </summary>
+				UINT_64 Generation;
+			};
+
+			/// <summary>
+			/// Gets the chunk with the given index for reading
+			/// </summary>
+			/// <param name="chunkIndex">Index of the chunk</param>
+			/// <returns>The chunk or nullptr if it was never written (in this generation)</returns>
+			std::shared_ptr<Chunk> getChunk(UINT_64 chunkIndex);
+
+			/// <summary>
+			/// Gets the chunk with the given index for writing.
+			/// A missing or stale chunk is allocated (zeroed). A shared chunk is first duplicated so the write is private.
+			/// </summary>
+			/// <param name="chunkIndex">Index of the chunk</param>
+			/// <returns>The chunk</returns>
+			std::shared_ptr<Chunk> getChunkForWrite(UINT_64 chunkIndex);
+
+			/// <summary>
+			/// Drops the chunk at the given index. Must be called with ChunksMutex held.
+			/// </summary>
+			/// <param name="chunkIndex">Index of the chunk</param>
+			void releaseChunkLocked(UINT_64 chunkIndex);
+
+			/// <summary>
+			/// Returns true if the chunk is from an older generation. Must be called with ChunksMutex held.
+			/// </summary>
+			/// <param name="chunk">The chunk</param>
+			/// <returns>True if stale</returns>
+			bool isStaleLocked(const std::shared_ptr<Chunk> &chunk) const;
+
+			/// <summary>
+			/// Frees a batch of stale chunks. Called by ReclaimThread.
+			/// </summary>
+			void reclaim();
+
+			/// <summary>
+			/// Chunk index to chunk data
+			/// </summary>
+			std::unordered_map<UINT_64, std::shared_ptr<Chunk>> Chunks;
+
+			/// <summary>
+			/// Current generation. Bumped by format().
+			/// </summary>
+			UINT_64 Generation;
+
+			/// <summary>
+			/// Number of stale chunks still in Chunks
+			/// </summary>
+			size_t StaleChunks;
+
+			/// <summary>
+			/// Bucket of Chunks the reclaimer continues from
+			/// </summary>
+			size_t ReclaimBucket;
+
+			/// <summary>
+			/// Guards everything above. Only held for lookup/insert, not while copying data.
+			/// </summary>
+			std::mutex ChunksMutex;
+
+			/// <summary>
+			/// Runs reclaim(). Started by the first format().
+			/// </summary>
+			LoopingThread ReclaimThread;
+
+			/// <summary>
+			/// Makes sure ReclaimThread is only started once
+			/// </summary>
+			std::once_flag ReclaimThreadStarted;
+		};
+
+		/// <summary>
+		/// Media backed by a (sparse) file on the host.
+		/// Copies are offloaded to the host filesystem with copy_file_range where available (which can reflink).
+		/// </summary>
+		class FileMedia : public MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor. Creates the file if needed and sizes it to hold the whole media.
+			/// </summary>
+			/// <param name="filePath">Path to the backing file</param>
+			/// <param name="blockSize">Size of a logical block in bytes</param>
+			/// <param name="numberOfBlocks">Number of logical blocks in the media</param>
+			FileMedia(std::string filePath, UINT_32 blockSize, UINT_64 numberOfBlocks);
+
+			/// <summary>
+			/// Destructor. Closes the file (the file is left behind).
+			/// </summary>
+			~FileMedia();
+
+			bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override;
+			bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) override;
+			bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) override;
+			bool copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Syncs the backing file to stable storage
+			/// </summary>
+			bool flush() override;
+
+			/// <summary>
+			/// Truncates the file to nothing and back, which frees all of it at once on a sparse-capable filesystem
+			/// </summary>
+			bool format() override;
+
+			/// <summary>
+			/// Returns true if the backing file was opened
+			/// </summary>
+			/// <returns>True if open</returns>
+			bool isOpen() const;
+
+		private:
+			/// <summary>
+			/// Reads size bytes at offset in the file
+			/// </summary>
+			bool readAt(UINT_64 offset, BYTE* buffer, UINT_64 size);
+
+			/// <summary>
+			/// Writes size bytes at offset in the file
+			/// </summary>
+			bool writeAt(UINT_64 offset, const BYTE* buffer, UINT_64 size);
+
+			/// <summary>
+			/// The open file
+			/// </summary>
+			int FileDescriptor;
+
+#ifdef _WIN32
+			/// <summary>
+			/// No pread/pwrite on Windows, so seek + read/write must be done as one step
+			/// </summary>
+			std::mutex FileMutex;
+#endif
+		};
+	}
+}
@@ -0,0 +1,216 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Namespace.cpp - An implementation file for the NVMe Namespace
+*/
+
+#include "Constants.h"
+#include "Namespace.h"
+
+using namespace cnvme::constants::status::codes;
+
+namespace cnvme
+{
+	namespace controller
+	{
+		Namespace::Namespace(UINT_32 namespaceId, media::MediaBackend* mediaBackend) :
+			PredictableLatencyMode([this](bool deterministic) {
+				ReadCache->setDeterministic(deterministic);
+				WriteCache->setDeterministic(deterministic);
+				Media->setDeterministic(deterministic);
+			})
+		{
+			NamespaceId = namespaceId;
+			Media.reset(mediaBackend);
+			WriteCache.reset(new media::WriteCacheMedia(mediaBackend));
+			ReadCache.reset(new media::ReadCacheMedia(WriteCache.get()));
+			ZoneSize = 0;
+			buildIdentifyData();
+		}
+
+		Namespace::Namespace(UINT_32 namespaceId, media::MediaBackend* mediaBackend, UINT_64 zoneSize) : Namespace(namespaceId, mediaBackend)
+		{
+			ASSERT_IF(zoneSize == 0, "A zoned namespace needs a non-zero zone size");
+			ZoneSize = zoneSize;
+
+			UINT_64 numberOfZones = Media->getNumberOfBlocks() / zoneSize;
+			for (UINT_64 i = 0; i < numberOfZones; i++)
+			{
+				Zones.emplace_back(new zns::Zone(i * zoneSize, zoneSize));
+			}
+			buildIdentifyData(); // Again, as only whole zones are usable
+		}
+
+		UINT_32 Namespace::getNamespaceId() const
+		{
+			return NamespaceId;
+		}
+
+		media::MediaBackend* Namespace::getMedia()
+		{
+			return ReadCache.get();
+		}
+
+		media::MediaBackend* Namespace::getBackingMedia()
+		{
+			return Media.get();
+		}
+
+		media::WriteCacheMedia* Namespace::getWriteCache()
+		{
+			return WriteCache.get();
+		}
+
+		media::ReadCacheMedia* Namespace::getReadCache()
+		{
+			return ReadCache.get();
+		}
+
+		directives::Streams* Namespace::getStreams()
+		{
+			return &StreamsDirective;
+		}
+
+		plm::PredictableLatency* Namespace::getPredictableLatency()
+		{
+			return &PredictableLatencyMode;
+		}
+
+		UINT_32 Namespace::getBlockSize() const
+		{
+			return Media->getBlockSize();
+		}
+
+		UINT_64 Namespace::getNumberOfBlocks() const
+		{
+			if (isZoned())
+			{
+				return getNumberOfZones() * ZoneSize;
+			}
+			return Media->getNumberOfBlocks();
+		}
+
+		bool Namespace::isValidRange(UINT_64 lba, UINT_64 numberOfBlocks) const
+		{
+			UINT_64 nsze = getNumberOfBlocks();
+			return lba < nsze && numberOfBlocks <= nsze - lba;
+		}
+
+		bool Namespace::isZoned() const
+		{
+			return ZoneSize != 0;
+		}
+
+		UINT_64 Namespace::getZoneSize() const
+		{
+			return ZoneSize;
+		}
+
+		UINT_64 Namespace::getNumberOfZones() const
+		{
+			return Zones.size();
+		}
+
+		zns::Zone* Namespace::getZoneForLba(UINT_64 lba)
+		{
+			if (!isZoned())
+			{
+				return nullptr;
+			}
+			return getZone(lba / ZoneSize);
+		}
+
+		zns::Zone* Namespace::getZone(UINT_64 zoneIndex)
+		{
+			if (zoneIndex < Zones.size())
+			{
+				return Zones[(size_t)zoneIndex].get();
+			}
+			return nullptr;
+		}
+
+		UINT_8 Namespace::zoneAppend(zns::Zone* zone, UINT_32 numberOfBlocks, const BYTE* buffer, UINT_64 &assignedLba)
+		{
+			UINT_8 status = zone->append(numberOfBlocks, assignedLba);
+			if (status == generic::SUCCESSFUL_COMPLETION)
+			{
+				// The zone only hands out LBAs inside itself, so this can't be out of range
+				bool written = getMedia()->write(assignedLba, numberOfBlocks, buffer);
+				ASSERT_IF(!written, "Media write failed for a range the zone handed out");
+			}
+			return status;
+		}
+
+		UINT_8 Namespace::zoneAction(zns::Zone* zone, UINT_8 action)
+		{
+			UINT_8 status = zone->performAction(action);
+			if (status == generic::SUCCESSFUL_COMPLETION && action == zns::ZONE_SEND_ACTION_RESET)
+			{
+				getMedia()->deallocate(zone->getStartLba(), zone->getCapacity());
+			}
+			return status;
+		}
+
+		bool Namespace::format()
+		{
+			bool formatted = getMedia()->format();
+			for (auto &zone : Zones)
+			{
+				zone->performAction(zns::ZONE_SEND_ACTION_RESET); // Read only and offline zones stay that way
+			}
+			return formatted;
+		}
+
+		Namespace* Namespace::clone(UINT_32 namespaceId)
+		{
+			if (isZoned())
+			{
+				LOG_ERROR("Zoned namespaces can't be cloned");
+				return nullptr;
+			}
+
+			if (!getMedia()->flush())
+			{
+				LOG_ERROR("Unable to write back the cache before cloning namespace " + std::to_string(NamespaceId));
+				return nullptr;
+			}
+
+			media::MediaBackend* clonedMedia = Media->clone();
+			if (!clonedMedia)
+			{
+				LOG_ERROR("The media behind namespace " + std::to_string(NamespaceId) + " can't be cloned");
+				return nullptr;
+			}
+			return new Namespace(namespaceId, clonedMedia);
+		}
+
+		const identify::IDENTIFY_NAMESPACE_DATA& Namespace::getIdentifyData() const
+		{
+			return IdentifyData;
+		}
+
+		void Namespace::buildIdentifyData()
+		{
+			memset(&IdentifyData, 0, sizeof(IdentifyData));
+			UINT_32 blockSize = getBlockSize();
+			IdentifyData.NSZE = getNumberOfBlocks();
+			IdentifyData.NCAP = IdentifyData.NSZE;
+			IdentifyData.NUSE = IdentifyData.NSZE; // No thin provisioning reported, so this doesn't have to track writes
+			IdentifyData.NSFEAT = 0x10; // OPTPERF: the preferred granularities and NOWS are valid
+			IdentifyData.DLFEAT = 0x1; // Deallocated blocks read back as zeros
+			IdentifyData.NPWG = (UINT_16)(STREAMS_WRITE_SIZE / blockSize - 1);
+			IdentifyData.NPWA = IdentifyData.NPWG;
+			IdentifyData.NPDG = (UINT_16)(MEDIA_CHUNK_SIZE / blockSize - 1); // Less than a chunk may not free anything
+			IdentifyData.NPDA = IdentifyData.NPDG;
+			IdentifyData.NOWS = IdentifyData.NPWG;
+			IdentifyData.NVMSETID = NamespaceId <= 0xFFFF ? (UINT_16)NamespaceId : 0; // Each namespace is its own NVM Set
+
+			UINT_64 capacity = IdentifyData.NSZE * blockSize;
+			memcpy(IdentifyData.NVMCAP, &capacity, sizeof(capacity));
+
+			IdentifyData.NLBAF = 0; // Just the one format: the media's block size, no metadata
+			IdentifyData.FLBAS = 0;
+			IdentifyData.LBAF[0].LBADS = (UINT_8)std::log2(blockSize);
+		}
+	}
+}
@@ -0,0 +1,239 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Namespace.h - A header file for the NVMe Namespace
+*/
+
+#pragma once
+
+#include "Directive.h"
+#include "Identify.h"
+#include "Media.h"
+#include "PredictableLatency.h"
+#include "ReadCache.h"
+#include "Types.h"
+#include "WriteCache.h"
+#include "Zone.h"
+
+#include <memory>
+
+namespace cnvme
+{
+	namespace controller
+	{
+		/// <summary>
+		/// A namespace: an NSID plus the media behind it.
+		/// Optionally zoned (ZNS), in which case the LBA range is split into equal sized sequential write required zones.
+		/// </summary>
+		class Namespace
+		{
+		public:
+			/// <summary>
+			/// Constructor for a conventional namespace
+			/// </summary>
+			/// <param name="namespaceId">The NSID</param>
+			/// <param name="mediaBackend">Media for this namespace. The namespace takes ownership.</param>
+			Namespace(UINT_32 namespaceId, media::MediaBackend* mediaBackend);
+
+			/// <summary>
+			/// Constructor for a zoned namespace
+			/// </summary>
+			/// <param name="namespaceId">The NSID</param>
+			/// <param name="mediaBackend">Media for this namespace. The namespace takes ownership.</param>
+			/// <param name="zoneSize">Number of blocks per zone. Any trailing blocks that don't make up a full zone are unused.</param>
+			Namespace(UINT_32 namespaceId, media::MediaBackend* mediaBackend, UINT_64 zoneSize);
+
+			/// <summary>
+			/// Destructor
+			/// </summary>
+			~Namespace() = default;
+
+			/// <summary>
+			/// Returns the NSID
+			/// </summary>
+			/// <returns>NSID</returns>
+			UINT_32 getNamespaceId() const;
+
+			/// <summary>
+			/// Returns the media all I/O to this namespace should go through (the read cache, then the write cache. Each passes through when disabled.)
+			/// </summary>
+			/// <returns>MediaBackend pointer</returns>
+			media::MediaBackend* getMedia();
+
+			/// <summary>
+			/// Returns the media backing this namespace, underneath any caching
+			/// </summary>
+			/// <returns>MediaBackend pointer</returns>
+			media::MediaBackend* getBackingMedia();
+
+			/// <summary>
+			/// Returns the volatile write cache in front of the backing media
+			/// </summary>
+			/// <returns>WriteCacheMedia pointer</returns>
+			media::WriteCacheMedia* getWriteCache();
+
+			/// <summary>
+			/// Returns the read cache in front of the write cache
+			/// </summary>
+			/// <returns>ReadCacheMedia pointer</returns>
+			media::ReadCacheMedia* getReadCache();
+
+			/// <summary>
+			/// Returns the Streams directive state of this namespace
+			/// </summary>
+			/// <returns>Streams pointer</returns>
+			directives::Streams* getStreams();
+
+			/// <summary>
+			/// Returns the Predictable Latency Mode state of this namespace (each namespace is its own NVM Set, NVMSETID == NSID)
+			/// </summary>
+			/// <returns>PredictableLatency pointer</returns>
+			plm::PredictableLatency* getPredictableLatency();
+
+			/// <summary>
+			/// Returns the logical block size in bytes
+			/// </summary>
+			/// <returns>Block size</returns>
+			UINT_32 getBlockSize() const;
+
+			/// <summary>
+			/// Returns the number of usable logical blocks (NSZE)
+			/// </summary>
+			/// <returns>Number of blocks</returns>
+			UINT_64 getNumberOfBlocks() const;
+
+			/// <summary>
+			/// Returns true if the given range is inside the namespace
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <returns>True if in range</returns>
+			bool isValidRange(UINT_64 lba, UINT_64 numberOfBlocks) const;
+
+			/// <summary>
+			/// Returns true if this is a zoned namespace
+			/// </summary>
+			/// <returns>True if zoned</returns>
+			bool isZoned() const;
+
+			/// <summary>
+			/// Returns the number of blocks per zone (0 if not zoned)
+			/// </summary>
+			/// <returns>Zone size in blocks</returns>
+			UINT_64 getZoneSize() const;
+
+			/// <summary>
+			/// Returns the number of zones (0 if not zoned)
+			/// </summary>
+			/// <returns>Number of zones</returns>
+			UINT_64 getNumberOfZones() const;
+
+			/// <summary>
+			/// Returns the zone containing the given LBA
+			/// </summary>
+			/// <param name="lba">LBA</param>
+			/// <returns>The zone or nullptr if not zoned or out of range</returns>
+			zns::Zone* getZoneForLba(UINT_64 lba);
+
+			/// <summary>
+			/// Returns the zone at the given index
+			/// </summary>
+			/// <param name="zoneIndex">Index of the zone</param>
+			/// <returns>The zone or nullptr if out of range</returns>
+			zns::Zone* getZone(UINT_64 zoneIndex);
+
+			/// <summary>
+			/// Zone Append: claims space at the zone's write pointer then writes the data there.
+			/// Safe to call from many threads at once against the same zone.
+			/// </summary>
+			/// <param name="zone">Zone to append to</param>
+			/// <param name="numberOfBlocks">Number of blocks to write</param>
+			/// <param name="buffer">Data to write</param>
+			/// <param name="assignedLba">Set to the LBA the data was written at</param>
+			/// <returns>Command specific status code (0 on success)</returns>
+			UINT_8 zoneAppend(zns::Zone* zone, UINT_32 numberOfBlocks, const BYTE* buffer, UINT_64 &assignedLba);
+
+			/// <summary>
+			/// Performs a Zone Send Action on the zone. A reset also deallocates the zone's media.
+			/// </summary>
+			/// <param name="zone">Zone to act on</param>
+			/// <param name="action">ZONE_SEND_ACTION</param>
+			/// <returns>Command specific status code (0 on success)</returns>
+			UINT_8 zoneAction(zns::Zone* zone, UINT_8 action);
+
+			/// <summary>
+			/// Format NVM / Sanitize: logically erases all user data (through the caches) and resets every zone to empty.
+			/// Returns straight away. Whatever the media has to free is done lazily.
+			/// </summary>
+			/// <returns>True on success</returns>
+			bool format();
+
+			/// <summary>
+			/// Creates a copy-on-write clone of this namespace under a new NSID. Anything in the write cache is written back first.
+			/// The clone shares the media with this namespace until either side writes, so a clone that is never written
+			///   doubles as a snapshot (and cloning it again restores it). The caller should quiesce I/O to this namespace first.
+			/// Only conventional namespaces whose media supports cloning (RamMedia) can be cloned.
+			/// </summary>
+			/// <param name="namespaceId">NSID for the clone</param>
+			/// <returns>The clone (owned by the caller, e.g. to pass to Controller::addNamespace()) or nullptr if this namespace can't be cloned</returns>
+			Namespace* clone(UINT_32 namespaceId);
+
+			/// <summary>
+			/// Returns the Identify Namespace data. It's built with the namespace, as nothing it reports changes afterwards.
+			/// </summary>
+			/// <returns>Identify Namespace data</returns>
+			const identify::IDENTIFY_NAMESPACE_DATA& getIdentifyData() const;
+
+		private:
+			/// <summary>
+			/// Builds IdentifyData from the media and zones
+			/// </summary>
+			void buildIdentifyData();
+
+			/// <summary>
+			/// The NSID
+			/// </summary>
+			UINT_32 NamespaceId;
+
+			/// <summary>
+			/// The media behind this namespace
+			/// </summary>
+			std::unique_ptr<media::MediaBackend> Media;
+
+			/// <summary>
+			/// Volatile write cache in front of Media. Declared after Media so it is destroyed (and written back) first.
+			/// </summary>
+			std::unique_ptr<media::WriteCacheMedia> WriteCache;
+
+			/// <summary>
+			/// Read cache in front of WriteCache
+			/// </summary>
+			std::unique_ptr<media::ReadCacheMedia> ReadCache;
+
+			/// <summary>
+			/// Number of blocks per zone. 0 if not zoned.
+			/// </summary>
+			UINT_64 ZoneSize;
+
+			/// <summary>
+			/// The zones (empty if not zoned). Held by pointer as zones contain atomics.
+			/// </summary>
+			std::vector<std::unique_ptr<zns::Zone>> Zones;
+
+			/// <summary>
+			/// Streams directive state
+			/// </summary>
+			directives::Streams StreamsDirective;
+
+			/// <summary>
+			/// Predictable Latency Mode state. Its windows are passed on to every media layer.
+			/// </summary>
+			plm::PredictableLatency PredictableLatencyMode;
+
+			/// <summary>
+			/// Identify Namespace data
+			/// </summary>
+			identify::IDENTIFY_NAMESPACE_DATA IdentifyData;
+		};
+	}
+}
@@ -195,45 +195,54 @@ namespace cnvme
 
 	bool PRP::placePayloadInExistingPRPs(Payload &payload)
 	{
-		if (payload.getSize() > getNumBytes())
+		return placeBufferInExistingPRPs(payload.getBuffer(), payload.getSize());
+	}
+
+	bool PRP::placeBufferInExistingPRPs(const BYTE* buffer, UINT_32 size)
+	{
+		if (size > getNumBytes())
 		{
 			LOG_ERROR("Given payload is larger than the allocated PRPs");
 			return false;
 		}
 
-		UINT_32 bytesRemaining = payload.getSize();
-
-		BYTE* prp1Pointer = MEMORY_ADDRESS_TO_8POINTER(PRP1);
-
-		// Copy in first page of data
-		UINT_32 bytesIntoPrp1 = std::min(MemoryPageSize, bytesRemaining);
-		BYTE* payloadBuf = payload.getBuffer();
-		memcpy_s(prp1Pointer, MemoryPageSize, payloadBuf, bytesIntoPrp1);
-		payloadBuf += bytesIntoPrp1;
-		bytesRemaining -= bytesIntoPrp1;
-
-		if (bytesRemaining)
+		for (std::pair<BYTE*, UINT_32> &segment : getSegments())
 		{
-			BYTE* prp2Pointer = MEMORY_ADDRESS_TO_8POINTER(PRP2);
-			if (usesPRPList())
-			{
-				std::vector<std::pair<BYTE*, UINT_32>> prpList = getPRPListPointers();
-				for (std::pair<BYTE*, UINT_32> &prp : prpList)
-				{
-					memcpy_s(prp.first, prp.second, payloadBuf, prp.second);
-					payloadBuf += prp.second;
-				}
-			}
-			else
+			if (size == 0)
 			{
-				// Copy the rest of the data into PRP2
-				UINT_32 bytesIntoPrp2 = std::min(MemoryPageSize, bytesRemaining);
-				memcpy_s(prp2Pointer, MemoryPageSize, payloadBuf, bytesIntoPrp2);
+				break;
 			}
+
+			UINT_32 bytesIntoSegment = std::min(segment.second, size);
+			memcpy_s(segment.first, segment.second, buffer, bytesIntoSegment);
+			buffer += bytesIntoSegment;
+			size -= bytesIntoSegment;
 		}
 		return true;
 	}
 
+	std::vector<std::pair<BYTE*, UINT_32>> PRP::getSegments()
+	{
+		std::vector<std::pair<BYTE*, UINT_32>> segments;
+		if (NumberOfBytes == 0)
+		{
+			return segments;
+		}
+
+		UINT_32 bytesIntoPrp1 = std::min(MemoryPageSize, NumberOfBytes);
+		segments.emplace_back(MEMORY_ADDRESS_TO_8POINTER(PRP1), bytesIntoPrp1);
+		if (usesPRPList())
+		{
+			std::vector<std::pair<BYTE*, UINT_32>> prpList = getPRPListPointers();
+			segments.insert(segments.end(), prpList.begin(), prpList.end());
+		}
+		else if (NumberOfBytes > bytesIntoPrp1)
+		{
+			segments.emplace_back(MEMORY_ADDRESS_TO_8POINTER(PRP2), NumberOfBytes - bytesIntoPrp1);
+		}
+		return segments;
+	}
+
 	bool PRP::usesPRPList()
 	{
 		return NumberOfBytes > (MemoryPageSize * 2);
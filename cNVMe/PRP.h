@@ -84,6 +84,20 @@ namespace cnvme
 		/// <returns>True if the FULL payload has been sent to the PRPs. False otherwise.</returns>
 		bool placePayloadInExistingPRPs(Payload &payload);
 
+		/// <summary>
+		/// Copies a buffer into the existing PRP addresses, straight from the buffer
+		/// </summary>
+		/// <param name="buffer">Data to copy to PRPs</param>
+		/// <param name="size">Number of bytes to copy</param>
+		/// <returns>True if the FULL buffer has been sent to the PRPs. False otherwise.</returns>
+		bool placeBufferInExistingPRPs(const BYTE* buffer, UINT_32 size);
+
+		/// <summary>
+		/// Gets the memory behind the PRP, in order, to be read or written in place rather than copied
+		/// </summary>
+		/// <returns>vector of byte pointers and the number of bytes of data at each</returns>
+		std::vector<std::pair<BYTE*, UINT_32>> getSegments();
+
 	private:
 
 		/// <summary>
@@ -0,0 +1,249 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Pipeline.cpp - An implementation file for the pieces of the staged (fetch, execute, complete) command pipeline
+*/
+
+#include "Constants.h"
+#include "Pipeline.h"
+
+#include <cstdint>
+#include <new>
+
+namespace cnvme
+{
+	namespace pipeline
+	{
+		StageWaker::StageWaker()
+		{
+			Waiting = false;
+		}
+
+		void StageWaker::wait(std::function<bool()> hasWork)
+		{
+			// Say we're going to sleep before the last look, so a push after that look is sure to see it and wake us
+			Waiting = true;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!hasWork())
+			{
+				std::unique_lock<std::mutex> lock(WakeMutex);
+				WakeCondition.wait_for(lock, std::chrono::milliseconds(PIPELINE_IDLE_WAIT_MS), hasWork);
+			}
+			Waiting = false;
+		}
+
+		void StageWaker::wake()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (Waiting)
+			{
+				std::lock_guard<std::mutex> lock(WakeMutex);
+				WakeCondition.notify_one();
+			}
+		}
+
+		StageStatistics::StageStatistics()
+		{
+			Commands = 0;
+			Services = 0;
+			ServiceNanoseconds = 0;
+			OccupancySum = 0;
+			MaxOccupancy = 0;
+		}
+
+		void StageStatistics::record(UINT_32 commands, UINT_32 occupancy, std::chrono::steady_clock::time_point start)
+		{
+			Commands += commands;
+			Services++;
+			ServiceNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			OccupancySum += occupancy;
+			if (occupancy > MaxOccupancy)
+			{
+				MaxOccupancy = occupancy; // Only the stage's own thread records, so no compare and swap needed
+			}
+		}
+
+		logpages::PIPELINE_STAGE_STATISTICS StageStatistics::getStatistics(UINT_32 inputCapacity) const
+		{
+			logpages::PIPELINE_STAGE_STATISTICS statistics = { 0 };
+			addTo(statistics);
+			statistics.ICAP = inputCapacity;
+			return statistics;
+		}
+
+		void StageStatistics::addTo(logpages::PIPELINE_STAGE_STATISTICS &statistics) const
+		{
+			statistics.CMDS += Commands;
+			statistics.SVCS += Services;
+			statistics.STNS += ServiceNanoseconds;
+			statistics.OCCS += OccupancySum;
+			statistics.MOCC = std::max(statistics.MOCC, MaxOccupancy.load());
+		}
+
+		SubmissionQueueCounters::SubmissionQueueCounters(UINT_32 submissionQueues)
+		{
+			// Padded a cache line past the end too, so nothing else allocated next to the table shares its last line
+			SubmissionQueues = submissionQueues;
+			Allocation = new BYTE[(SubmissionQueues + 2) * sizeof(QueueCounters)];
+			uintptr_t firstLine = ((uintptr_t)Allocation + PIPELINE_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(PIPELINE_CACHE_LINE_SIZE - 1);
+			Counters = (QueueCounters*)firstLine;
+			for (UINT_32 i = 0; i < SubmissionQueues; i++)
+			{
+				QueueCounters* counters = new (&Counters[i]) QueueCounters;
+				counters->ReadCommands = 0;
+				counters->WriteCommands = 0;
+				counters->OtherCommands = 0;
+				counters->ErrorCommands = 0;
+				counters->MediaErrorCommands = 0;
+				counters->BytesRead = 0;
+				counters->BytesWritten = 0;
+			}
+		}
+
+		SubmissionQueueCounters::~SubmissionQueueCounters()
+		{
+			for (UINT_32 i = 0; i < SubmissionQueues; i++)
+			{
+				Counters[i].~QueueCounters();
+			}
+			delete[] Allocation;
+		}
+
+		void SubmissionQueueCounters::record(UINT_16 submissionQueueId, COMMAND_KIND kind, UINT_64 bytes, UINT_8 statusCodeType, UINT_8 statusCode)
+		{
+			if (submissionQueueId >= SubmissionQueues)
+			{
+				return;
+			}
+
+			QueueCounters &counters = Counters[submissionQueueId];
+			bool failed = statusCodeType != constants::status::types::GENERIC_COMMAND || statusCode != constants::status::codes::generic::SUCCESSFUL_COMPLETION;
+			switch (kind)
+			{
+			case COMMAND_KIND_READ:
+				add(counters.ReadCommands, 1);
+				add(counters.BytesRead, failed ? 0 : bytes);
+				break;
+			case COMMAND_KIND_WRITE:
+				add(counters.WriteCommands, 1);
+				add(counters.BytesWritten, failed ? 0 : bytes);
+				break;
+			default:
+				add(counters.OtherCommands, 1);
+				break;
+			}
+
+			if (failed)
+			{
+				add(counters.ErrorCommands, 1);
+				if (statusCodeType == constants::status::types::MEDIA_AND_DATA_INTEGRITY)
+				{
+					add(counters.MediaErrorCommands, 1);
+				}
+			}
+		}
+
+		void SubmissionQueueCounters::addTo(logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY &entry) const
+		{
+			if (entry.SQID >= SubmissionQueues)
+			{
+				return;
+			}
+
+			const QueueCounters &counters = Counters[entry.SQID];
+			entry.RC += counters.ReadCommands.load(std::memory_order_relaxed);
+			entry.WC += counters.WriteCommands.load(std::memory_order_relaxed);
+			entry.OC += counters.OtherCommands.load(std::memory_order_relaxed);
+			entry.EC += counters.ErrorCommands.load(std::memory_order_relaxed);
+			entry.MEC += counters.MediaErrorCommands.load(std::memory_order_relaxed);
+			entry.BR += counters.BytesRead.load(std::memory_order_relaxed);
+			entry.BW += counters.BytesWritten.load(std::memory_order_relaxed);
+		}
+
+		void SubmissionQueueCounters::add(std::atomic<UINT_64> &counter, UINT_64 value)
+		{
+			// Atomic only so a reader never sees a torn value. With one writer, no locked instruction is needed.
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+
+		InFlightCommands::InFlightCommands(UINT_32 submissionQueues)
+		{
+			SubmissionQueues = submissionQueues;
+			Tables = new std::atomic<UINT_16>**[SubmissionQueues]();
+		}
+
+		InFlightCommands::~InFlightCommands()
+		{
+			for (UINT_32 i = 0; i < SubmissionQueues; i++)
+			{
+				if (Tables[i])
+				{
+					for (UINT_32 page = 0; page < IN_FLIGHT_PAGES; page++)
+					{
+						delete[] Tables[i][page];
+					}
+					delete[] Tables[i];
+				}
+			}
+			delete[] Tables;
+		}
+
+		void InFlightCommands::resetQueue(UINT_16 submissionQueueId)
+		{
+			if (submissionQueueId >= SubmissionQueues)
+			{
+				return;
+			}
+
+			if (!Tables[submissionQueueId])
+			{
+				Tables[submissionQueueId] = new std::atomic<UINT_16>*[IN_FLIGHT_PAGES]();
+				return;
+			}
+
+			// A deleted queue may have left marks for commands it never fetched
+			for (UINT_32 page = 0; page < IN_FLIGHT_PAGES; page++)
+			{
+				for (UINT_32 i = 0; Tables[submissionQueueId][page] && i < IN_FLIGHT_PAGE_ENTRIES; i++)
+				{
+					Tables[submissionQueueId][page][i].store(IN_FLIGHT_NONE, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		UINT_16 InFlightCommands::get(UINT_16 submissionQueueId, UINT_16 commandId) const
+		{
+			if (submissionQueueId >= SubmissionQueues || !Tables[submissionQueueId])
+			{
+				return IN_FLIGHT_NONE;
+			}
+
+			std::atomic<UINT_16>* page = Tables[submissionQueueId][commandId / IN_FLIGHT_PAGE_ENTRIES];
+			return page ? page[commandId % IN_FLIGHT_PAGE_ENTRIES].load(std::memory_order_relaxed) : IN_FLIGHT_NONE;
+		}
+
+		void InFlightCommands::set(UINT_16 submissionQueueId, UINT_16 commandId, UINT_16 value)
+		{
+			if (submissionQueueId >= SubmissionQueues || !Tables[submissionQueueId])
+			{
+				return;
+			}
+
+			std::atomic<UINT_16>* &page = Tables[submissionQueueId][commandId / IN_FLIGHT_PAGE_ENTRIES];
+			if (!page)
+			{
+				if (value == IN_FLIGHT_NONE)
+				{
+					return; // Already reads as that
+				}
+
+				page = new std::atomic<UINT_16>[IN_FLIGHT_PAGE_ENTRIES];
+				for (UINT_32 i = 0; i < IN_FLIGHT_PAGE_ENTRIES; i++)
+				{
+					page[i].store(IN_FLIGHT_NONE, std::memory_order_relaxed);
+				}
+			}
+			page[commandId % IN_FLIGHT_PAGE_ENTRIES].store(value, std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,499 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Pipeline.h - A header file for the pieces of the staged (fetch, execute, complete) command pipeline
+*/
+
+#pragma once
+
+#include "LogPage.h"
+#include "Types.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+#define PIPELINE_RING_ENTRIES 256 // Most commands in the pipeline (also what each worker's inbox holds)
+#define PIPELINE_STAGE_BATCH 32 // Most commands a stage (or worker) takes on before recording a service and looking again
+#define PIPELINE_IDLE_WAIT_MS 100 // Longest an idle stage sleeps. Only a backstop: it's woken as soon as work is pushed to it.
+
+#define PIPELINE_STAGE_FETCH 0 // Fetch and decode: submission queues to the execute stage workers' inboxes
+#define PIPELINE_STAGE_EXECUTE 1 // Execute: work stealing workers, marking commands executed in any order
+#define PIPELINE_STAGE_COMPLETE 2 // Complete: executed commands, in the order they were fetched, to the completion queues
+#define PIPELINE_STAGES 3
+
+#define PIPELINE_CACHE_LINE_SIZE 64 // Counters written by different threads are kept at least this far apart
+
+#define IN_FLIGHT_PAGE_ENTRIES 256 // CIDs per page of an InFlightCommands table. A page is only allocated once one of its CIDs is used.
+#define IN_FLIGHT_PAGES (0x10000 / IN_FLIGHT_PAGE_ENTRIES) // Pages to cover every CID
+#define IN_FLIGHT_NONE 0 // InFlightCommands value: not fetched yet, or already posted
+#define IN_FLIGHT_ABORT_REQUESTED 0xFFFF // InFlightCommands value: aborted while still in its submission queue, so it's completed as soon as it's fetched
+
+namespace cnvme
+{
+	namespace pipeline
+	{
+		/// <summary>
+		/// Lock free ring between exactly one producer thread and exactly one consumer thread.
+		/// The producer only writes Tail and the consumer only writes Head, each on its own cache line.
+		/// </summary>
+		template <typename T, UINT_32 Entries>
+		class SpscRing
+		{
+		public:
+			/// <summary>
+			/// Constructor. Starts out empty.
+			/// </summary>
+			SpscRing()
+			{
+				Head = 0;
+				Tail = 0;
+			}
+
+			/// <summary>
+			/// Adds an item. Producer only.
+			/// </summary>
+			/// <param name="item">The item</param>
+			/// <returns>False if the ring is full</returns>
+			bool push(const T &item)
+			{
+				UINT_64 tail = Tail.load(std::memory_order_relaxed);
+				if (tail - Head.load(std::memory_order_acquire) == Entries)
+				{
+					return false;
+				}
+
+				Items[tail % Entries] = item;
+				Tail.store(tail + 1, std::memory_order_release); // Publishes the item
+				return true;
+			}
+
+			/// <summary>
+			/// Takes the oldest item. Consumer only.
+			/// </summary>
+			/// <param name="item">Set to the item</param>
+			/// <returns>False if the ring is empty</returns>
+			bool pop(T &item)
+			{
+				UINT_64 head = Head.load(std::memory_order_relaxed);
+				if (head == Tail.load(std::memory_order_acquire))
+				{
+					return false;
+				}
+
+				item = Items[head % Entries];
+				Head.store(head + 1, std::memory_order_release); // Hands the slot back to the producer
+				return true;
+			}
+
+			/// <summary>
+			/// Returns how many items are in the ring. Exact from either side for its own end, a snapshot otherwise.
+			/// </summary>
+			/// <returns>Items</returns>
+			UINT_32 size() const
+			{
+				UINT_64 head = Head.load(std::memory_order_acquire);
+				return (UINT_32)(Tail.load(std::memory_order_acquire) - head);
+			}
+
+			/// <summary>
+			/// Returns how many more items fit. Never more than the producer can really push.
+			/// </summary>
+			/// <returns>Free entries</returns>
+			UINT_32 getFreeEntries() const
+			{
+				return Entries - size();
+			}
+
+			/// <summary>
+			/// Returns the number of items the ring holds when full
+			/// </summary>
+			/// <returns>Entries</returns>
+			UINT_32 getCapacity() const
+			{
+				return Entries;
+			}
+
+		private:
+			/// <summary>
+			/// Count of items ever popped (written by the consumer)
+			/// </summary>
+			alignas(64) std::atomic<UINT_64> Head;
+
+			/// <summary>
+			/// Count of items ever pushed (written by the producer)
+			/// </summary>
+			alignas(64) std::atomic<UINT_64> Tail;
+
+			/// <summary>
+			/// The slots
+			/// </summary>
+			alignas(64) T Items[Entries];
+		};
+
+		/// <summary>
+		/// Chase-Lev work stealing deque with a fixed capacity. Its owner thread pushes and pops at the bottom (newest first),
+		///   while any other thread may steal from the top (oldest first). Only a steal racing the owner for the last item
+		///   needs a compare and swap.
+		/// </summary>
+		template <typename T, UINT_32 Entries>
+		class ChaseLevDeque
+		{
+		public:
+			/// <summary>
+			/// Constructor. Starts out empty.
+			/// </summary>
+			ChaseLevDeque()
+			{
+				Top = 0;
+				Bottom = 0;
+			}
+
+			/// <summary>
+			/// Adds an item at the bottom. Owner only.
+			/// </summary>
+			/// <param name="item">The item</param>
+			/// <returns>False if the deque is full</returns>
+			bool push(T item)
+			{
+				INT_64 bottom = Bottom.load(std::memory_order_relaxed);
+				if (bottom - Top.load(std::memory_order_acquire) >= (INT_64)Entries)
+				{
+					return false;
+				}
+
+				Items[bottom % Entries].store(item, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release); // The item is there before a thief can see it
+				Bottom.store(bottom + 1, std::memory_order_relaxed);
+				return true;
+			}
+
+			/// <summary>
+			/// Takes the newest item. Owner only.
+			/// </summary>
+			/// <param name="item">Set to the item</param>
+			/// <returns>False if the deque is empty (or a thief got the last item)</returns>
+			bool pop(T &item)
+			{
+				// Claim the bottom item first, then see if a thief is after the same one
+				INT_64 bottom = Bottom.load(std::memory_order_relaxed) - 1;
+				Bottom.store(bottom, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				INT_64 top = Top.load(std::memory_order_relaxed);
+
+				if (top > bottom)
+				{
+					Bottom.store(bottom + 1, std::memory_order_relaxed); // Was empty
+					return false;
+				}
+
+				item = Items[bottom % Entries].load(std::memory_order_relaxed);
+				if (top == bottom)
+				{
+					// Last item: whoever moves Top past it gets it
+					bool won = Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+					Bottom.store(bottom + 1, std::memory_order_relaxed);
+					return won;
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// Takes the oldest item. Any thread.
+			/// </summary>
+			/// <param name="item">Set to the item</param>
+			/// <returns>False if the deque is empty or another thread took the item first</returns>
+			bool steal(T &item)
+			{
+				INT_64 top = Top.load(std::memory_order_acquire);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				INT_64 bottom = Bottom.load(std::memory_order_acquire);
+				if (top >= bottom)
+				{
+					return false;
+				}
+
+				item = Items[top % Entries].load(std::memory_order_relaxed);
+				return Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			}
+
+			/// <summary>
+			/// Returns how many items are in the deque. A snapshot unless called by the owner with no thieves around.
+			/// </summary>
+			/// <returns>Items</returns>
+			UINT_32 size() const
+			{
+				INT_64 bottom = Bottom.load(std::memory_order_acquire);
+				INT_64 top = Top.load(std::memory_order_acquire);
+				return bottom > top ? (UINT_32)(bottom - top) : 0;
+			}
+
+		private:
+			/// <summary>
+			/// Index of the oldest item (moved by thieves, and by the owner taking the last item)
+			/// </summary>
+			alignas(64) std::atomic<INT_64> Top;
+
+			/// <summary>
+			/// Index just past the newest item (moved by the owner)
+			/// </summary>
+			alignas(64) std::atomic<INT_64> Bottom;
+
+			/// <summary>
+			/// The slots. Atomic since a thief may read one the owner is about to reuse (its compare and swap then fails).
+			/// </summary>
+			alignas(64) std::atomic<T> Items[Entries];
+		};
+
+		/// <summary>
+		/// Lets an idle stage sleep until the stage before it pushes work, instead of spinning.
+		/// Pushing stays lock free: the producer only takes the mutex if the consumer said it's going to sleep.
+		/// </summary>
+		class StageWaker
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			StageWaker();
+
+			/// <summary>
+			/// Sleeps (for at most PIPELINE_IDLE_WAIT_MS) unless there's work. Consumer only.
+			/// </summary>
+			/// <param name="hasWork">Returns true if there is work in the consumer's ring</param>
+			void wait(std::function<bool()> hasWork);
+
+			/// <summary>
+			/// Wakes the consumer if it's sleeping. Called by the producer after pushing.
+			/// </summary>
+			void wake();
+
+		private:
+			/// <summary>
+			/// True while the consumer is (about to be) asleep
+			/// </summary>
+			std::atomic<bool> Waiting;
+
+			/// <summary>
+			/// Mutex for WakeCondition
+			/// </summary>
+			std::mutex WakeMutex;
+
+			/// <summary>
+			/// Signalled to wake the consumer
+			/// </summary>
+			std::condition_variable WakeCondition;
+		};
+
+		/// <summary>
+		/// Counters for one stage: how much it did, how long that took and how full its input was.
+		/// A stage with a long service time per command and a full input is the bottleneck.
+		/// Only the stage's own thread records, but any thread may read.
+		/// </summary>
+		class StageStatistics
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			StageStatistics();
+
+			/// <summary>
+			/// Records one service (a batch of commands taken from the stage's input)
+			/// </summary>
+			/// <param name="commands">Commands handled</param>
+			/// <param name="occupancy">Commands that were waiting in the stage's input when it started</param>
+			/// <param name="start">When the service started</param>
+			void record(UINT_32 commands, UINT_32 occupancy, std::chrono::steady_clock::time_point start);
+
+			/// <summary>
+			/// Returns the counters as a Pipeline Statistics log page entry
+			/// </summary>
+			/// <param name="inputCapacity">How many commands the stage's input holds (0 if it varies)</param>
+			/// <returns>PIPELINE_STAGE_STATISTICS</returns>
+			logpages::PIPELINE_STAGE_STATISTICS getStatistics(UINT_32 inputCapacity) const;
+
+			/// <summary>
+			/// Adds the counters to a Pipeline Statistics log page entry, for a stage run by several threads (each with its own StageStatistics)
+			/// </summary>
+			/// <param name="statistics">The entry to add to. Max Occupancy becomes the largest of the two.</param>
+			void addTo(logpages::PIPELINE_STAGE_STATISTICS &statistics) const;
+
+		private:
+			/// <summary>
+			/// Commands handled
+			/// </summary>
+			std::atomic<UINT_64> Commands;
+
+			/// <summary>
+			/// Services (batches)
+			/// </summary>
+			std::atomic<UINT_64> Services;
+
+			/// <summary>
+			/// Total time spent servicing, in nanoseconds
+			/// </summary>
+			std::atomic<UINT_64> ServiceNanoseconds;
+
+			/// <summary>
+			/// Sum of the input occupancy seen at the start of each service
+			/// </summary>
+			std::atomic<UINT_64> OccupancySum;
+
+			/// <summary>
+			/// Most commands ever seen waiting in the input
+			/// </summary>
+			std::atomic<UINT_32> MaxOccupancy;
+		};
+
+		/// <summary>
+		/// What a command counts as in SubmissionQueueCounters (and so in the SMART / Health Information log page)
+		/// </summary>
+		enum COMMAND_KIND
+		{
+			COMMAND_KIND_READ,
+			COMMAND_KIND_WRITE,
+			COMMAND_KIND_OTHER,
+		};
+
+		/// <summary>
+		/// Per submission queue command counters kept by one thread (an execute stage worker, or the admin thread).
+		/// Only that thread writes them, so a counter is bumped with a plain load and store rather than a locked read-modify-write,
+		///   and the table takes whole cache lines of its own, so writing it never takes a line from another thread.
+		/// Readers add up every thread's table, so they may miss the commands being counted right then.
+		/// </summary>
+		class SubmissionQueueCounters
+		{
+		public:
+			/// <summary>
+			/// Constructor. All counters start at 0.
+			/// </summary>
+			/// <param name="submissionQueues">Counters are kept for SQIDs below this</param>
+			SubmissionQueueCounters(UINT_32 submissionQueues);
+
+			/// <summary>
+			/// Destructor
+			/// </summary>
+			~SubmissionQueueCounters();
+
+			SubmissionQueueCounters(const SubmissionQueueCounters&) = delete;
+			SubmissionQueueCounters& operator=(const SubmissionQueueCounters&) = delete;
+
+			/// <summary>
+			/// Counts a command. Only to be called by the thread owning these counters.
+			/// </summary>
+			/// <param name="submissionQueueId">Queue the command came from. Ignored if there are no counters for it.</param>
+			/// <param name="kind">Read, write or other</param>
+			/// <param name="bytes">Data the command read or wrote. Not counted if it failed.</param>
+			/// <param name="statusCodeType">SCT of the command's completion</param>
+			/// <param name="statusCode">SC of the command's completion</param>
+			void record(UINT_16 submissionQueueId, COMMAND_KIND kind, UINT_64 bytes, UINT_8 statusCodeType, UINT_8 statusCode);
+
+			/// <summary>
+			/// Adds the counters of the entry's SQID to a Submission Queue Statistics log page entry
+			/// </summary>
+			/// <param name="entry">The entry to add to</param>
+			void addTo(logpages::SUBMISSION_QUEUE_STATISTICS_ENTRY &entry) const;
+
+		private:
+			/// <summary>
+			/// The counters of one submission queue. A cache line each.
+			/// </summary>
+			struct QueueCounters
+			{
+				std::atomic<UINT_64> ReadCommands;
+				std::atomic<UINT_64> WriteCommands;
+				std::atomic<UINT_64> OtherCommands;
+				std::atomic<UINT_64> ErrorCommands;
+				std::atomic<UINT_64> MediaErrorCommands;
+				std::atomic<UINT_64> BytesRead;
+				std::atomic<UINT_64> BytesWritten;
+				UINT_8 Reserved[8];
+			};
+			static_assert(sizeof(QueueCounters) == PIPELINE_CACHE_LINE_SIZE, "QueueCounters should be a cache line in size.");
+
+			/// <summary>
+			/// Adds to a counter only this thread writes
+			/// </summary>
+			/// <param name="counter">The counter</param>
+			/// <param name="value">What to add</param>
+			static void add(std::atomic<UINT_64> &counter, UINT_64 value);
+
+			/// <summary>
+			/// What was allocated for Counters, with room to start them on a cache line boundary
+			/// </summary>
+			BYTE* Allocation;
+
+			/// <summary>
+			/// Counters by SQID
+			/// </summary>
+			QueueCounters* Counters;
+
+			/// <summary>
+			/// Number of Counters
+			/// </summary>
+			UINT_32 SubmissionQueues;
+		};
+
+		/// <summary>
+		/// Where each I/O command is, by (SQID, CID): IN_FLIGHT_NONE, IN_FLIGHT_ABORT_REQUESTED, or its pipeline slot + 1.
+		/// A queue's table is indexed straight by CID, through a page directory, so finding a command to abort is two loads at any queue depth.
+		/// Hosts use a small range of CIDs, so only a few pages of each table are ever allocated.
+		/// No two threads write the same entry at once: the fetch stage sets it, the complete stage clears it just before posting
+		///   (once the host sees the completion it may reuse the CID), and Abort only marks a command the fetch stage hasn't reached.
+		/// </summary>
+		class InFlightCommands
+		{
+		public:
+			/// <summary>
+			/// Constructor. No queue has a table until it's reset.
+			/// </summary>
+			/// <param name="submissionQueues">Tables can be kept for SQIDs below this</param>
+			InFlightCommands(UINT_32 submissionQueues);
+
+			/// <summary>
+			/// Destructor
+			/// </summary>
+			~InFlightCommands();
+
+			InFlightCommands(const InFlightCommands&) = delete;
+			InFlightCommands& operator=(const InFlightCommands&) = delete;
+
+			/// <summary>
+			/// Sets every entry of a queue's table to IN_FLIGHT_NONE, allocating it the first time. Only while nothing from the queue is in flight.
+			/// </summary>
+			/// <param name="submissionQueueId">The SQID</param>
+			void resetQueue(UINT_16 submissionQueueId);
+
+			/// <summary>
+			/// Returns where a command is
+			/// </summary>
+			/// <param name="submissionQueueId">Queue it came from</param>
+			/// <param name="commandId">Its CID</param>
+			/// <returns>IN_FLIGHT_NONE (always, for a queue without a table), IN_FLIGHT_ABORT_REQUESTED, or its pipeline slot + 1</returns>
+			UINT_16 get(UINT_16 submissionQueueId, UINT_16 commandId) const;
+
+			/// <summary>
+			/// Sets where a command is, allocating its page if need be. Ignored for a queue without a table.
+			/// Only the thread holding DataPathMutex (the fetch stage, or Abort) allocates: others only set entries of commands in flight.
+			/// </summary>
+			/// <param name="submissionQueueId">Queue it came from</param>
+			/// <param name="commandId">Its CID</param>
+			/// <param name="value">IN_FLIGHT_NONE, IN_FLIGHT_ABORT_REQUESTED, or its pipeline slot + 1</param>
+			void set(UINT_16 submissionQueueId, UINT_16 commandId, UINT_16 value);
+
+		private:
+			/// <summary>
+			/// Page directories by SQID, or nullptr for a queue never reset. Each has IN_FLIGHT_PAGES pages, nullptr until used.
+			/// </summary>
+			std::atomic<UINT_16>*** Tables;
+
+			/// <summary>
+			/// Number of Tables
+			/// </summary>
+			UINT_32 SubmissionQueues;
+		};
+	}
+}
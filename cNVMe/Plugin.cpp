@@ -0,0 +1,79 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Plugin.cpp - An implementation file for loadable vendor specific command plugins
+*/
+
+#include "Plugin.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace cnvme
+{
+	namespace plugins
+	{
+		Plugin::Plugin(std::string path)
+		{
+			Path = path;
+#ifdef _WIN32
+			Handle = (void*)LoadLibraryA(path.c_str());
+			if (!Handle)
+			{
+				LOG_ERROR("Unable to load plugin " + path + ". Error: " + std::to_string(GetLastError()));
+			}
+#else
+			Handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL); // Resolve everything now, rather than fail on first use in the data path
+			if (!Handle)
+			{
+				LOG_ERROR("Unable to load plugin " + path + ". Error: " + dlerror());
+			}
+#endif
+		}
+
+		Plugin::~Plugin()
+		{
+			if (Handle)
+			{
+#ifdef _WIN32
+				FreeLibrary((HMODULE)Handle);
+#else
+				dlclose(Handle);
+#endif
+				Handle = nullptr;
+			}
+		}
+
+		bool Plugin::isLoaded() const
+		{
+			return Handle != nullptr;
+		}
+
+		std::string Plugin::getPath() const
+		{
+			return Path;
+		}
+
+		PluginEntryPoint Plugin::getEntryPoint()
+		{
+			if (!Handle)
+			{
+				return nullptr;
+			}
+
+#ifdef _WIN32
+			PluginEntryPoint entryPoint = (PluginEntryPoint)GetProcAddress((HMODULE)Handle, PLUGIN_ENTRY_POINT);
+#else
+			PluginEntryPoint entryPoint = (PluginEntryPoint)dlsym(Handle, PLUGIN_ENTRY_POINT);
+#endif
+			if (!entryPoint)
+			{
+				LOG_ERROR("Plugin " + Path + " doesn't export " + PLUGIN_ENTRY_POINT);
+			}
+			return entryPoint;
+		}
+	}
+}
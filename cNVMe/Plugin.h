@@ -0,0 +1,92 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Plugin.h - A header file for loadable vendor specific command plugins
+*/
+
+#pragma once
+
+#include "Types.h"
+
+#define PLUGIN_ENTRY_POINT "cnvmeRegisterPlugin" // extern "C" function every plugin exports
+#define PLUGIN_INTERFACE_VERSION 1 // Bumped whenever CommandContext, CommandDescriptor or the entry point change
+
+// Goes in front of a plugin's entry point
+#ifdef _WIN32
+#define PLUGIN_EXPORT extern "C" __declspec(dllexport)
+#define PLUGIN_EXTENSION ".dll"
+#define WORKING_DIRECTORY ".\\"
+#else
+#define PLUGIN_EXPORT extern "C"
+#define PLUGIN_EXTENSION ".so"
+#define WORKING_DIRECTORY "./" // Without a directory, dlopen only looks in the library search path
+#endif
+
+#define SAMPLE_FILTER_PLUGIN WORKING_DIRECTORY "cNVMeFilterPlugin" PLUGIN_EXTENSION // What build.sh builds Plugins/FilterPlugin.cpp to
+#define SAMPLE_FILTER_OPCODE 0xC2 // Its vendor specific I/O command
+
+namespace cnvme
+{
+	namespace controller
+	{
+		class Controller;
+	}
+
+	namespace plugins
+	{
+		/// <summary>
+		/// What a plugin exports as PLUGIN_ENTRY_POINT. It registers its handlers with the controller's
+		///   registerAdminCommand / registerIoCommand and returns true, or returns false (for example, if
+		///   interfaceVersion isn't the PLUGIN_INTERFACE_VERSION it was built against) to not be loaded.
+		/// Handlers get the command, its PRPs (PRP::getSegments, without copying) and the namespace's media.
+		/// </summary>
+		typedef bool(*PluginEntryPoint)(controller::Controller &controller, UINT_32 interfaceVersion);
+
+		/// <summary>
+		/// A shared object (dlopen) or DLL (LoadLibrary) with a plugin in it. It stays loaded as long as this does.
+		/// </summary>
+		class Plugin
+		{
+		public:
+			/// <summary>
+			/// Constructor. Loads the shared object.
+			/// </summary>
+			/// <param name="path">Path to the shared object</param>
+			Plugin(std::string path);
+
+			/// <summary>
+			/// Destructor. Unloads the shared object, so nothing registered by it can be left to be called.
+			/// </summary>
+			~Plugin();
+
+			/// <summary>
+			/// Returns true if the shared object was loaded
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isLoaded() const;
+
+			/// <summary>
+			/// Returns the path the shared object was loaded from
+			/// </summary>
+			/// <returns>Path</returns>
+			std::string getPath() const;
+
+			/// <summary>
+			/// Looks up the plugin's PLUGIN_ENTRY_POINT
+			/// </summary>
+			/// <returns>The entry point or nullptr if not loaded or it isn't exported</returns>
+			PluginEntryPoint getEntryPoint();
+
+		private:
+			/// <summary>
+			/// Handle from dlopen / LoadLibrary. nullptr if not loaded.
+			/// </summary>
+			void* Handle;
+
+			/// <summary>
+			/// Path to the shared object
+			/// </summary>
+			std::string Path;
+		};
+	}
+}
@@ -0,0 +1,80 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+FilterPlugin.cpp - A sample plugin: on-device filtering as a vendor specific I/O command
+*/
+
+#include "../Controller.h"
+#include "../PRP.h"
+
+#define FILTER_CHUNK_BLOCKS 256 // Most blocks read from the media at a time
+
+using namespace cnvme;
+using namespace cnvme::controller;
+
+namespace
+{
+	/// <summary>
+	/// SAMPLE_FILTER_OPCODE (vendor specific, controller to host). Scans the blocks a Read of the same fields would (SLBA in DW10/11, 0-based NLB in DW12) as 64 bit records and
+	///   places the ones at least DW14/15 (the key) at the start of the data, straight into the host's memory.
+	/// Completion DW0 is the number of records placed.
+	/// </summary>
+	/// <param name="context">The command</param>
+	void filter(CommandContext &context)
+	{
+		command::NVME_COMMAND* command = context.Command;
+		Namespace &theNamespace = *context.TheNamespace;
+		UINT_64 startingLba = command->DWord10 | ((UINT_64)command->DWord11 << 32);
+		UINT_32 numberOfBlocks = (command->DWord12 & 0xFFFF) + 1;
+		UINT_64 key = command->DWord14 | ((UINT_64)command->DWord15 << 32);
+
+		if (!theNamespace.isValidRange(startingLba, numberOfBlocks))
+		{
+			context.Completion->SC = constants::status::codes::generic::LBA_OUT_OF_RANGE;
+			context.Completion->DNR = 1;
+			return;
+		}
+
+		PRP prp(command->DPTR.DPTR1, command->DPTR.DPTR2, numberOfBlocks * theNamespace.getBlockSize(), context.MemoryPageSize);
+		std::vector<std::pair<BYTE*, UINT_32>> segments = prp.getSegments();
+		auto segment = segments.begin();
+		UINT_32 segmentOffset = 0;
+
+		std::vector<UINT_64> records(FILTER_CHUNK_BLOCKS * theNamespace.getBlockSize() / sizeof(UINT_64));
+		UINT_32 matches = 0;
+		for (UINT_64 lba = startingLba; lba < startingLba + numberOfBlocks; lba += FILTER_CHUNK_BLOCKS)
+		{
+			UINT_32 chunkBlocks = (UINT_32)std::min((UINT_64)FILTER_CHUNK_BLOCKS, startingLba + numberOfBlocks - lba);
+			theNamespace.getReadCache()->read(context.SubmissionQueueId, lba, chunkBlocks, (BYTE*)records.data());
+
+			UINT_32 numberOfRecords = chunkBlocks * theNamespace.getBlockSize() / sizeof(UINT_64);
+			for (UINT_32 i = 0; i < numberOfRecords; i++)
+			{
+				if (records[i] < key)
+				{
+					continue;
+				}
+
+				// Segments are whole pages (or the rest of the transfer), so records never straddle two
+				memcpy(segment->first + segmentOffset, &records[i], sizeof(UINT_64));
+				segmentOffset += sizeof(UINT_64);
+				if (segmentOffset == segment->second)
+				{
+					segment++;
+					segmentOffset = 0;
+				}
+				matches++;
+			}
+		}
+		context.Completion->DWord0 = matches;
+	}
+}
+
+PLUGIN_EXPORT bool cnvmeRegisterPlugin(Controller &controller, UINT_32 interfaceVersion)
+{
+	if (interfaceVersion != PLUGIN_INTERFACE_VERSION)
+	{
+		return false;
+	}
+	return controller.registerIoCommand(constants::command_sets::NVM, SAMPLE_FILTER_OPCODE, CommandDescriptor(filter, true, true));
+}
@@ -0,0 +1,220 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+PredictableLatency.cpp - An implementation file for Predictable Latency Mode (I/O Determinism)
+*/
+
+#include "Constants.h"
+#include "PredictableLatency.h"
+
+using namespace cnvme::constants::predictable_latency;
+
+namespace cnvme
+{
+	namespace plm
+	{
+		PredictableLatency::PredictableLatency(std::function<void(bool)> applyWindow)
+		{
+			ApplyWindow = applyWindow;
+			Enabled = false;
+			Window = WINDOW_NONE;
+			WindowStart = std::chrono::steady_clock::now();
+			Reads = 0;
+			Writes = 0;
+			ExceededTypical = false;
+			Events = 0;
+			ExpiryThread = LoopingThread([&] {PredictableLatency::checkExpiry(); }, PLM_EXPIRY_SLEEP_MS);
+		}
+
+		PredictableLatency::~PredictableLatency()
+		{
+			ExpiryThread.end();
+		}
+
+		bool PredictableLatency::isEnabled()
+		{
+			return Enabled;
+		}
+
+		void PredictableLatency::setEnabled(bool enabled)
+		{
+			std::lock_guard<std::mutex> enabledLock(EnabledMutex);
+			{
+				std::lock_guard<std::mutex> lock(PlmMutex);
+				if (enabled == Enabled)
+				{
+					return;
+				}
+
+				Enabled = enabled;
+				ExceededTypical = false;
+				if (enabled)
+				{
+					enterWindowLocked(WINDOW_NON_DETERMINISTIC, std::chrono::steady_clock::now());
+				}
+				else
+				{
+					if (Window == WINDOW_DETERMINISTIC)
+					{
+						ApplyWindow(false);
+					}
+					Window = WINDOW_NONE;
+					Events = 0;
+				}
+			}
+
+			// Outside PlmMutex, as ending waits for a checkExpiry() that may be waiting on it
+			if (enabled)
+			{
+				ExpiryThread.start();
+			}
+			else
+			{
+				ExpiryThread.end();
+			}
+		}
+
+		UINT_8 PredictableLatency::getWindow()
+		{
+			std::lock_guard<std::mutex> lock(PlmMutex);
+			checkLimitsLocked(std::chrono::steady_clock::now());
+			return Window;
+		}
+
+		bool PredictableLatency::requestWindow(UINT_8 window)
+		{
+			std::lock_guard<std::mutex> lock(PlmMutex);
+			if (!Enabled)
+			{
+				return false;
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			checkLimitsLocked(now);
+			if (window == Window)
+			{
+				return true;
+			}
+
+			if (window == WINDOW_DETERMINISTIC)
+			{
+				// The deferred work needs its minimum time to catch up before the next DTWIN
+				UINT_64 minimum = ExceededTypical ? PLM_NDWIN_TIME_MINIMUM_HIGH_MS : PLM_NDWIN_TIME_MINIMUM_LOW_MS;
+				if (getWindowMillisecondsLocked(now) < minimum)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				ExceededTypical = Reads > PLM_DTWIN_READS_TYPICAL || Writes > PLM_DTWIN_WRITES_TYPICAL;
+			}
+			enterWindowLocked(window, now);
+			return true;
+		}
+
+		void PredictableLatency::countRead(UINT_64 bytes)
+		{
+			if (!Enabled)
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(PlmMutex);
+			if (Window == WINDOW_DETERMINISTIC)
+			{
+				Reads += (bytes + PLM_UNIT_SIZE - 1) / PLM_UNIT_SIZE;
+				checkLimitsLocked(std::chrono::steady_clock::now());
+			}
+		}
+
+		void PredictableLatency::countWrite(UINT_64 bytes)
+		{
+			if (!Enabled)
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(PlmMutex);
+			if (Window == WINDOW_DETERMINISTIC)
+			{
+				Writes += (bytes + PLM_UNIT_SIZE - 1) / PLM_UNIT_SIZE;
+				checkLimitsLocked(std::chrono::steady_clock::now());
+			}
+		}
+
+		bool PredictableLatency::hasEvents()
+		{
+			std::lock_guard<std::mutex> lock(PlmMutex);
+			checkLimitsLocked(std::chrono::steady_clock::now());
+			return Events != 0;
+		}
+
+		logpages::PREDICTABLE_LATENCY_PER_NVM_SET_LOG PredictableLatency::getLog(bool retainEvents)
+		{
+			std::lock_guard<std::mutex> lock(PlmMutex);
+			auto now = std::chrono::steady_clock::now();
+			checkLimitsLocked(now);
+
+			logpages::PREDICTABLE_LATENCY_PER_NVM_SET_LOG log = { 0 };
+			log.STATUS = Window;
+			log.ET = Events;
+			log.DTWINRT = PLM_DTWIN_READS_TYPICAL;
+			log.DTWINWT = PLM_DTWIN_WRITES_TYPICAL;
+			log.DTWINTM = PLM_DTWIN_TIME_MAXIMUM_MS;
+			log.NDWINTMH = PLM_NDWIN_TIME_MINIMUM_HIGH_MS;
+			log.NDWINTML = PLM_NDWIN_TIME_MINIMUM_LOW_MS;
+
+			// Estimates are for a DTWIN starting now if in NDWIN
+			bool deterministic = Window == WINDOW_DETERMINISTIC;
+			UINT_64 elapsed = deterministic ? getWindowMillisecondsLocked(now) : 0;
+			log.DTWINRE = PLM_DTWIN_READS_TYPICAL - (deterministic ? Reads : 0);
+			log.DTWINWE = PLM_DTWIN_WRITES_TYPICAL - (deterministic ? Writes : 0);
+			log.DTWINTE = PLM_DTWIN_TIME_MAXIMUM_MS - elapsed;
+
+			if (!retainEvents)
+			{
+				Events = 0;
+			}
+			return log;
+		}
+
+		void PredictableLatency::checkExpiry()
+		{
+			std::lock_guard<std::mutex> lock(PlmMutex);
+			checkLimitsLocked(std::chrono::steady_clock::now());
+		}
+
+		void PredictableLatency::enterWindowLocked(UINT_8 window, std::chrono::steady_clock::time_point now)
+		{
+			if (window == WINDOW_DETERMINISTIC || Window == WINDOW_DETERMINISTIC)
+			{
+				ApplyWindow(window == WINDOW_DETERMINISTIC);
+			}
+			Window = window;
+			WindowStart = now;
+			Reads = 0;
+			Writes = 0;
+		}
+
+		void PredictableLatency::checkLimitsLocked(std::chrono::steady_clock::time_point now)
+		{
+			if (Window != WINDOW_DETERMINISTIC)
+			{
+				return;
+			}
+
+			if (Reads > PLM_DTWIN_READS_TYPICAL || Writes > PLM_DTWIN_WRITES_TYPICAL || getWindowMillisecondsLocked(now) >= PLM_DTWIN_TIME_MAXIMUM_MS)
+			{
+				ExceededTypical = true;
+				Events |= EVENT_DTWIN_EXCEEDED;
+				enterWindowLocked(WINDOW_NON_DETERMINISTIC, now);
+			}
+		}
+
+		UINT_64 PredictableLatency::getWindowMillisecondsLocked(std::chrono::steady_clock::time_point now)
+		{
+			return std::chrono::duration_cast<std::chrono::milliseconds>(now - WindowStart).count();
+		}
+	}
+}
@@ -0,0 +1,191 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+PredictableLatency.h - A header file for Predictable Latency Mode (I/O Determinism)
+*/
+
+#pragma once
+
+#include "LogPage.h"
+#include "LoopingThread.h"
+#include "Types.h"
+#include "WriteCache.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#define PLM_UNIT_SIZE 4096 // Reads and writes are counted in these (the log page's 4 KiB units)
+#define PLM_DTWIN_READS_TYPICAL (1024 * 1024) // Reads a DTWIN takes. Reads need no background work, so this is generous.
+#define PLM_DTWIN_WRITES_TYPICAL (WRITE_CACHE_SIZE / PLM_UNIT_SIZE) // Writes a DTWIN takes: what the write cache holds without destaging
+#define PLM_DTWIN_TIME_MAXIMUM_MS 1000 // Longest a DTWIN lasts before the deferred background work has to run
+#define PLM_NDWIN_TIME_MINIMUM_HIGH_MS 100 // Shortest NDWIN after a DTWIN that went past a typical value
+#define PLM_NDWIN_TIME_MINIMUM_LOW_MS 10 // Shortest NDWIN after any other DTWIN
+#define PLM_EXPIRY_SLEEP_MS 10 // Time between checks (while enabled) for a DTWIN that ran out of time
+
+namespace cnvme
+{
+	namespace plm
+	{
+		/// <summary>
+		/// Predictable Latency Mode state of one NVM Set.
+		/// While enabled the set is either in a deterministic window (DTWIN), where background work (garbage collection,
+		///   destaging, readahead) is deferred so I/O latency only depends on the I/O itself, or a non-deterministic
+		///   window (NDWIN) where the deferred work catches up. The host picks the window, but the set drops back to
+		///   NDWIN by itself once a DTWIN goes past a typical value or the maximum time (raising an event), and
+		///   a DTWIN can't start until the set has spent the minimum time in NDWIN.
+		/// The limits are checked as I/O is counted and the log is read. While enabled, ExpiryThread also checks the time
+		///   limit, so a DTWIN the host left idle still ends (letting the deferred work run) once its time is up.
+		/// Safe to use from many threads at once.
+		/// </summary>
+		class PredictableLatency
+		{
+		public:
+			/// <summary>
+			/// Constructor. Predictable Latency Mode starts out disabled.
+			/// </summary>
+			/// <param name="applyWindow">Called (with the state locked) with true as a DTWIN starts and false as it ends</param>
+			PredictableLatency(std::function<void(bool)> applyWindow);
+
+			/// <summary>
+			/// Destructor. Stops ExpiryThread.
+			/// </summary>
+			~PredictableLatency();
+
+			/// <summary>
+			/// Returns true if Predictable Latency Mode is enabled
+			/// </summary>
+			/// <returns>True if enabled</returns>
+			bool isEnabled();
+
+			/// <summary>
+			/// Enables or disables Predictable Latency Mode. Enabling starts an NDWIN (with the low minimum time),
+			///   disabling ends any DTWIN and clears pending events.
+			/// </summary>
+			/// <param name="enabled">True to enable</param>
+			void setEnabled(bool enabled);
+
+			/// <summary>
+			/// Returns the current window
+			/// </summary>
+			/// <returns>WINDOW_DETERMINISTIC, WINDOW_NON_DETERMINISTIC or WINDOW_NONE if not enabled</returns>
+			UINT_8 getWindow();
+
+			/// <summary>
+			/// Host request to move to a window. Asking for the current window does nothing.
+			/// </summary>
+			/// <param name="window">WINDOW_DETERMINISTIC or WINDOW_NON_DETERMINISTIC</param>
+			/// <returns>False if not enabled or a DTWIN was asked for before the NDWIN minimum time was up</returns>
+			bool requestWindow(UINT_8 window);
+
+			/// <summary>
+			/// Counts a read against the current DTWIN (if any)
+			/// </summary>
+			/// <param name="bytes">Bytes read</param>
+			void countRead(UINT_64 bytes);
+
+			/// <summary>
+			/// Counts a write against the current DTWIN (if any)
+			/// </summary>
+			/// <param name="bytes">Bytes written</param>
+			void countWrite(UINT_64 bytes);
+
+			/// <summary>
+			/// Returns true if events are pending (so the set belongs in the event aggregate log)
+			/// </summary>
+			/// <returns>True if events are pending</returns>
+			bool hasEvents();
+
+			/// <summary>
+			/// Returns the state as the Predictable Latency Per NVM Set log page
+			/// </summary>
+			/// <param name="retainEvents">False to clear the pending events once returned</param>
+			/// <returns>PREDICTABLE_LATENCY_PER_NVM_SET_LOG</returns>
+			logpages::PREDICTABLE_LATENCY_PER_NVM_SET_LOG getLog(bool retainEvents);
+
+		private:
+			/// <summary>
+			/// ExpiryThread step. Ends a DTWIN that ran out of time.
+			/// </summary>
+			void checkExpiry();
+
+			/// <summary>
+			/// Switches window, restarting the window's clock and counters. Must be called with PlmMutex held.
+			/// </summary>
+			/// <param name="window">WINDOW_DETERMINISTIC or WINDOW_NON_DETERMINISTIC</param>
+			/// <param name="now">The current time</param>
+			void enterWindowLocked(UINT_8 window, std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Drops a DTWIN that went past a typical value or the maximum time back to NDWIN, raising an event.
+			/// Must be called with PlmMutex held.
+			/// </summary>
+			/// <param name="now">The current time</param>
+			void checkLimitsLocked(std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Returns how long the current window has lasted. Must be called with PlmMutex held.
+			/// </summary>
+			/// <param name="now">The current time</param>
+			/// <returns>Milliseconds</returns>
+			UINT_64 getWindowMillisecondsLocked(std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Called with true as a DTWIN starts and false as it ends
+			/// </summary>
+			std::function<void(bool)> ApplyWindow;
+
+			/// <summary>
+			/// True if Predictable Latency Mode is enabled. Read without the lock so I/O skips counting while disabled.
+			/// </summary>
+			std::atomic<bool> Enabled;
+
+			/// <summary>
+			/// The current window (WINDOW_NONE while disabled)
+			/// </summary>
+			UINT_8 Window;
+
+			/// <summary>
+			/// When the current window started
+			/// </summary>
+			std::chrono::steady_clock::time_point WindowStart;
+
+			/// <summary>
+			/// Reads (in PLM_UNIT_SIZE units) so far in the current DTWIN
+			/// </summary>
+			UINT_64 Reads;
+
+			/// <summary>
+			/// Writes (in PLM_UNIT_SIZE units) so far in the current DTWIN
+			/// </summary>
+			UINT_64 Writes;
+
+			/// <summary>
+			/// True if the last DTWIN went past a typical value, so the current NDWIN has to last the high minimum time
+			/// </summary>
+			bool ExceededTypical;
+
+			/// <summary>
+			/// Pending events (Event Type bits)
+			/// </summary>
+			UINT_16 Events;
+
+			/// <summary>
+			/// Guards everything above except Enabled (which is only changed with it held)
+			/// </summary>
+			std::mutex PlmMutex;
+
+			/// <summary>
+			/// Held across setEnabled() so ExpiryThread is started and ended in the same order Enabled changes.
+			///   Taken before PlmMutex, and never held by ExpiryThread.
+			/// </summary>
+			std::mutex EnabledMutex;
+
+			/// <summary>
+			/// Runs checkExpiry() while enabled. Declared last so it is stopped before anything it uses is destroyed.
+			/// </summary>
+			LoopingThread ExpiryThread;
+		};
+	}
+}
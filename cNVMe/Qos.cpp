@@ -0,0 +1,185 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Qos.cpp - An implementation file for per submission queue / per namespace QoS (token bucket rate limiting)
+*/
+
+#include "Qos.h"
+
+#include <algorithm>
+
+namespace cnvme
+{
+	namespace qos
+	{
+		TokenBucket::TokenBucket()
+		{
+			setRate(0);
+		}
+
+		void TokenBucket::setRate(UINT_64 ratePerSecond)
+		{
+			Rate = ratePerSecond;
+			Capacity = std::max(1.0, (double)ratePerSecond * QOS_BURST_MS / 1000);
+			Tokens = Capacity;
+			LastRefill = std::chrono::steady_clock::now();
+		}
+
+		UINT_64 TokenBucket::getRate() const
+		{
+			return Rate;
+		}
+
+		bool TokenBucket::hasTokens(std::chrono::steady_clock::time_point now)
+		{
+			if (!Rate)
+			{
+				return true;
+			}
+
+			if (now > LastRefill)
+			{
+				double seconds = std::chrono::duration<double>(now - LastRefill).count();
+				Tokens = std::min(Capacity, Tokens + seconds * Rate);
+				LastRefill = now;
+			}
+			return Tokens >= 1;
+		}
+
+		void TokenBucket::consume(UINT_64 tokens)
+		{
+			if (Rate)
+			{
+				Tokens -= tokens;
+			}
+		}
+
+		void RateLimiter::setSubmissionQueueLimits(UINT_16 submissionQueueId, UINT_64 iops, UINT_64 bytesPerSecond)
+		{
+			setLimits(SubmissionQueueLimits, submissionQueueId, QOS_ENTRY_SUBMISSION_QUEUE, iops, bytesPerSecond);
+		}
+
+		void RateLimiter::setNamespaceLimits(UINT_32 namespaceId, UINT_64 iops, UINT_64 bytesPerSecond)
+		{
+			setLimits(NamespaceLimits, namespaceId, QOS_ENTRY_NAMESPACE, iops, bytesPerSecond);
+		}
+
+		bool RateLimiter::isEnabled() const
+		{
+			return !SubmissionQueueLimits.empty() || !NamespaceLimits.empty();
+		}
+
+		bool RateLimiter::admit(UINT_16 submissionQueueId, UINT_32 namespaceId, UINT_64 bytes)
+		{
+			auto now = std::chrono::steady_clock::now();
+			auto queueLimits = SubmissionQueueLimits.find(submissionQueueId);
+			auto namespaceLimits = NamespaceLimits.find(namespaceId);
+			Limits* limits[2] = {
+				queueLimits == SubmissionQueueLimits.end() ? nullptr : &queueLimits->second,
+				namespaceLimits == NamespaceLimits.end() ? nullptr : &namespaceLimits->second,
+			};
+
+			// Every bucket is checked before any is taken from, so a held command never uses up tokens
+			UINT_8 throttledBy = 0;
+			for (int i = 0; i < 2; i++)
+			{
+				if (limits[i])
+				{
+					UINT_8 empty = (limits[i]->Iops.hasTokens(now) ? 0 : QOS_THROTTLED_IOPS) | (limits[i]->Bandwidth.hasTokens(now) ? 0 : QOS_THROTTLED_BANDWIDTH);
+					throttledBy |= empty << (i * 2);
+				}
+			}
+
+			auto parked = ParkedCommands.find(submissionQueueId);
+			if (throttledBy)
+			{
+				if (parked == ParkedCommands.end())
+				{
+					parked = ParkedCommands.emplace(submissionQueueId, ParkedCommand{ now, 0 }).first;
+				}
+
+				// Each limit counts a command once, no matter how many passes it holds it back for
+				UINT_8 newlyThrottledBy = throttledBy & ~parked->second.ThrottledBy;
+				for (int i = 0; i < 2; i++)
+				{
+					UINT_8 newly = (newlyThrottledBy >> (i * 2)) & 0x3;
+					if (newly & QOS_THROTTLED_IOPS)
+					{
+						limits[i]->Statistics.ITC++;
+					}
+					if (newly & QOS_THROTTLED_BANDWIDTH)
+					{
+						limits[i]->Statistics.BTC++;
+					}
+				}
+				parked->second.ThrottledBy |= throttledBy;
+				return false;
+			}
+
+			UINT_64 delay = 0;
+			UINT_8 heldBy = 0;
+			if (parked != ParkedCommands.end())
+			{
+				delay = std::chrono::duration_cast<std::chrono::microseconds>(now - parked->second.Since).count();
+				heldBy = parked->second.ThrottledBy;
+				ParkedCommands.erase(parked);
+			}
+
+			for (int i = 0; i < 2; i++)
+			{
+				if (limits[i])
+				{
+					limits[i]->Iops.consume(1);
+					limits[i]->Bandwidth.consume(bytes);
+					limits[i]->Statistics.DC++;
+					if ((heldBy >> (i * 2)) & 0x3)
+					{
+						limits[i]->Statistics.TTD += delay;
+						limits[i]->Statistics.MTD = std::max(limits[i]->Statistics.MTD, delay);
+					}
+				}
+			}
+			return true;
+		}
+
+		void RateLimiter::unpark(UINT_16 submissionQueueId)
+		{
+			ParkedCommands.erase(submissionQueueId);
+		}
+
+		void RateLimiter::unparkAll()
+		{
+			ParkedCommands.clear();
+		}
+
+		std::vector<logpages::QOS_STATISTICS_ENTRY> RateLimiter::getStatistics() const
+		{
+			std::vector<logpages::QOS_STATISTICS_ENTRY> entries;
+			for (auto limitsMap : { &SubmissionQueueLimits, &NamespaceLimits })
+			{
+				for (auto &limits : *limitsMap)
+				{
+					logpages::QOS_STATISTICS_ENTRY entry = limits.second.Statistics;
+					entry.IOPSL = limits.second.Iops.getRate();
+					entry.BWL = limits.second.Bandwidth.getRate();
+					entries.push_back(entry);
+				}
+			}
+			return entries;
+		}
+
+		void RateLimiter::setLimits(std::map<UINT_32, Limits> &limits, UINT_32 id, UINT_8 type, UINT_64 iops, UINT_64 bytesPerSecond)
+		{
+			auto found = limits.find(id);
+			if (found == limits.end())
+			{
+				found = limits.emplace(id, Limits()).first;
+				found->second.Statistics = { 0 };
+				found->second.Statistics.TYPE = type;
+				found->second.Statistics.ID = id;
+			}
+			found->second.Iops.setRate(iops);
+			found->second.Bandwidth.setRate(bytesPerSecond);
+		}
+	}
+}
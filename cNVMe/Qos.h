@@ -0,0 +1,212 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Qos.h - A header file for per submission queue / per namespace QoS (token bucket rate limiting)
+*/
+
+#pragma once
+
+#include "LogPage.h"
+#include "Types.h"
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+#define QOS_BURST_MS 10 // A bucket holds this many milliseconds of its rate, so short bursts go through without waiting
+
+#define QOS_THROTTLED_IOPS 0x1 // Held back by an IOPS limit
+#define QOS_THROTTLED_BANDWIDTH 0x2 // Held back by a bandwidth limit
+
+#define QOS_ENTRY_SUBMISSION_QUEUE 0 // QOS_STATISTICS_ENTRY TYPE of a submission queue's limits
+#define QOS_ENTRY_NAMESPACE 1 // QOS_STATISTICS_ENTRY TYPE of a namespace's limits
+
+namespace cnvme
+{
+	namespace qos
+	{
+		/// <summary>
+		/// A token bucket refilled at a fixed rate. Taking tokens may put it into debt, so a command larger than the whole
+		///   bucket still goes through and the next one waits for the debt to be paid off.
+		/// </summary>
+		class TokenBucket
+		{
+		public:
+			/// <summary>
+			/// Constructor. Starts out unlimited.
+			/// </summary>
+			TokenBucket();
+
+			/// <summary>
+			/// Sets the refill rate and fills the bucket
+			/// </summary>
+			/// <param name="ratePerSecond">Tokens per second. 0 for unlimited.</param>
+			void setRate(UINT_64 ratePerSecond);
+
+			/// <summary>
+			/// Returns the refill rate
+			/// </summary>
+			/// <returns>Tokens per second (0 for unlimited)</returns>
+			UINT_64 getRate() const;
+
+			/// <summary>
+			/// Refills the bucket up to now and returns true if there is at least a whole token to take
+			/// </summary>
+			/// <param name="now">The current time</param>
+			/// <returns>True if a token is left (always true if unlimited)</returns>
+			bool hasTokens(std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Takes tokens from the bucket
+			/// </summary>
+			/// <param name="tokens">Tokens to take</param>
+			void consume(UINT_64 tokens);
+
+		private:
+			/// <summary>
+			/// Refill rate in tokens per second (0 for unlimited)
+			/// </summary>
+			UINT_64 Rate;
+
+			/// <summary>
+			/// Most tokens the bucket holds
+			/// </summary>
+			double Capacity;
+
+			/// <summary>
+			/// Tokens in the bucket. Negative when in debt.
+			/// </summary>
+			double Tokens;
+
+			/// <summary>
+			/// When Tokens was last brought up to date
+			/// </summary>
+			std::chrono::steady_clock::time_point LastRefill;
+		};
+
+		/// <summary>
+		/// Rate limits submission queues and namespaces for the dispatcher.
+		/// Each submission queue and each namespace can have an IOPS limit and a bandwidth limit. A command is only dispatched
+		///   once every limit it falls under has tokens. Until then it's parked at the head of its submission queue: the dispatcher
+		///   moves on to the other queues and tries again on a later pass, so the rest of that queue waits behind it (like a device would).
+		/// Every limited queue / namespace counts its dispatched commands, the commands each of its limits held back and how long they waited.
+		/// Only meant to be used from the dispatcher thread.
+		/// </summary>
+		class RateLimiter
+		{
+		public:
+			/// <summary>
+			/// Sets the limits of a submission queue. They outlive the queue, so they apply again if it's recreated.
+			/// </summary>
+			/// <param name="submissionQueueId">SQID</param>
+			/// <param name="iops">Commands per second (0 for unlimited)</param>
+			/// <param name="bytesPerSecond">Bytes transferred per second (0 for unlimited)</param>
+			void setSubmissionQueueLimits(UINT_16 submissionQueueId, UINT_64 iops, UINT_64 bytesPerSecond);
+
+			/// <summary>
+			/// Sets the limits of a namespace. They're shared by every submission queue sending commands to it.
+			/// </summary>
+			/// <param name="namespaceId">NSID</param>
+			/// <param name="iops">Commands per second (0 for unlimited)</param>
+			/// <param name="bytesPerSecond">Bytes transferred per second (0 for unlimited)</param>
+			void setNamespaceLimits(UINT_32 namespaceId, UINT_64 iops, UINT_64 bytesPerSecond);
+
+			/// <summary>
+			/// Returns true if limits have ever been set (otherwise every command can be dispatched without asking)
+			/// </summary>
+			/// <returns>True if enabled</returns>
+			bool isEnabled() const;
+
+			/// <summary>
+			/// Decides if the command at the head of a submission queue can be dispatched now. If so its tokens are taken.
+			///   If not it's parked and the limits holding it back count it (once per command).
+			/// </summary>
+			/// <param name="submissionQueueId">SQID the command is in</param>
+			/// <param name="namespaceId">NSID the command targets</param>
+			/// <param name="bytes">Bytes the command transfers</param>
+			/// <returns>True if it may be dispatched</returns>
+			bool admit(UINT_16 submissionQueueId, UINT_32 namespaceId, UINT_64 bytes);
+
+			/// <summary>
+			/// Forgets the parked command of a submission queue (for when the queue is deleted)
+			/// </summary>
+			/// <param name="submissionQueueId">SQID</param>
+			void unpark(UINT_16 submissionQueueId);
+
+			/// <summary>
+			/// Forgets every parked command (for controller reset)
+			/// </summary>
+			void unparkAll();
+
+			/// <summary>
+			/// Returns an entry per limited submission queue then per limited namespace, each in ID order
+			/// </summary>
+			/// <returns>Entries for the QoS Statistics log page</returns>
+			std::vector<logpages::QOS_STATISTICS_ENTRY> getStatistics() const;
+
+		private:
+			/// <summary>
+			/// The limits of one submission queue or namespace
+			/// </summary>
+			struct Limits
+			{
+				/// <summary>
+				/// Commands per second
+				/// </summary>
+				TokenBucket Iops;
+
+				/// <summary>
+				/// Bytes per second
+				/// </summary>
+				TokenBucket Bandwidth;
+
+				/// <summary>
+				/// Counters for the log page. Limits are filled in by getStatistics().
+				/// </summary>
+				logpages::QOS_STATISTICS_ENTRY Statistics;
+			};
+
+			/// <summary>
+			/// A command held at the head of its submission queue
+			/// </summary>
+			struct ParkedCommand
+			{
+				/// <summary>
+				/// When it was first held back
+				/// </summary>
+				std::chrono::steady_clock::time_point Since;
+
+				/// <summary>
+				/// QOS_THROTTLED_* of the submission queue limits in bits 1:0 and of the namespace limits in bits 3:2,
+				///   for every limit that has held it back so far
+				/// </summary>
+				UINT_8 ThrottledBy;
+			};
+
+			/// <summary>
+			/// Sets the rates of a limits entry, adding it if needed
+			/// </summary>
+			/// <param name="limits">Map to put it in</param>
+			/// <param name="id">SQID / NSID</param>
+			/// <param name="type">QOS_ENTRY_*</param>
+			/// <param name="iops">Commands per second</param>
+			/// <param name="bytesPerSecond">Bytes per second</param>
+			static void setLimits(std::map<UINT_32, Limits> &limits, UINT_32 id, UINT_8 type, UINT_64 iops, UINT_64 bytesPerSecond);
+
+			/// <summary>
+			/// SQID -> limits
+			/// </summary>
+			std::map<UINT_32, Limits> SubmissionQueueLimits;
+
+			/// <summary>
+			/// NSID -> limits
+			/// </summary>
+			std::map<UINT_32, Limits> NamespaceLimits;
+
+			/// <summary>
+			/// SQID -> the command parked at its head
+			/// </summary>
+			std::map<UINT_16, ParkedCommand> ParkedCommands;
+		};
+	}
+}
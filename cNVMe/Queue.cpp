@@ -20,6 +20,8 @@ namespace cnvme
 			TailPointer = 0; // Queue start at 0
 			LinkedMemoryAddress = 0;
 			MappedQueue = nullptr;
+			PhaseTag = true; // The first pass through the queue uses a phase tag of 1
+			ReservedEntries = 0;
 		}
 
 		Queue::Queue(UINT_32 queueSize, UINT_32 queueId, UINT_16* doorbell, UINT_64 linkedMemoryAddress) : Queue()
@@ -30,6 +32,19 @@ namespace cnvme
 			LinkedMemoryAddress = linkedMemoryAddress;
 		}
 
+		Queue::Queue(const Queue &other)
+		{
+			QueueSize = other.QueueSize;
+			QueueId = other.QueueId;
+			Doorbell = other.Doorbell;
+			HeadPointer = other.HeadPointer;
+			TailPointer = other.TailPointer;
+			LinkedMemoryAddress = other.LinkedMemoryAddress;
+			MappedQueue = other.MappedQueue;
+			PhaseTag = other.PhaseTag;
+			ReservedEntries = other.ReservedEntries;
+		}
+
 		UINT_32 Queue::getQueueSize() const
 		{
 			return QueueSize;
@@ -67,6 +82,19 @@ namespace cnvme
 			return false;
 		}
 
+		bool Queue::setHeadPointer(UINT_32 newIndex)
+		{
+			// The head can only move up to the tail: past it would be consuming entries that haven't been placed yet
+			if (newIndex < getQueueSize() &&
+				(newIndex + getQueueSize() - HeadPointer) % getQueueSize() <= (TailPointer + getQueueSize() - HeadPointer) % getQueueSize())
+			{
+				HeadPointer = newIndex;
+				return true;
+			}
+
+			return false; // The caller reports it
+		}
+
 		UINT_16 Queue::incrementAndGetHeadCloserToTail()
 		{
 			ASSERT_IF(HeadPointer == TailPointer, "HeadPointer == TailPointer. Should not be incrementing.");
@@ -80,6 +108,56 @@ namespace cnvme
 			return TailPointer - HeadPointer;                      // Not wrapped around
 		}
 
+		void Queue::incrementTailPointer()
+		{
+			ASSERT_IF(isFull(), "Queue is full. Should not be incrementing the tail.");
+
+			TailPointer++;
+			TailPointer %= getQueueSize();
+			if (TailPointer == 0)
+			{
+				PhaseTag = !PhaseTag; // Next pass through the queue
+			}
+
+			if (ReservedEntries)
+			{
+				ReservedEntries--; // This was the entry set aside for it
+			}
+		}
+
+		void Queue::reserveEntries(UINT_32 entries)
+		{
+			ASSERT_IF(entries > getFreeEntries(), "Reserving more entries than the queue has free.");
+			ReservedEntries += entries;
+		}
+
+		void Queue::releaseEntries(UINT_32 entries)
+		{
+			ASSERT_IF(entries > ReservedEntries, "Releasing more entries than the queue has reserved.");
+			ReservedEntries -= entries;
+		}
+
+		bool Queue::getPhaseTag()
+		{
+			return PhaseTag;
+		}
+
+		std::mutex& Queue::getMutex()
+		{
+			return QueueMutex;
+		}
+
+		bool Queue::isFull()
+		{
+			return (TailPointer + 1) % getQueueSize() == HeadPointer;
+		}
+
+		UINT_32 Queue::getFreeEntries()
+		{
+			UINT_32 freeEntries = (HeadPointer + getQueueSize() - TailPointer - 1) % getQueueSize();
+			return freeEntries > ReservedEntries ? freeEntries - ReservedEntries : 0;
+		}
+
 		UINT_64 Queue::getMemoryAddress()
 		{
 			return LinkedMemoryAddress;
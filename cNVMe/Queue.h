@@ -8,6 +8,8 @@ Queue.h - A header file for the NVMe Queues
 
 #include "Types.h"
 
+#include <mutex>
+
 namespace cnvme
 {
 	namespace controller
@@ -32,6 +34,12 @@ namespace cnvme
 			/// <param name="linkedMemoryAddress">The memory this queue uses for operations</param>
 			Queue(UINT_32 queueSize, UINT_32 queueId, UINT_16* doorbell, UINT_64 linkedMemoryAddress);
 
+			/// <summary>
+			/// Copy constructor. The copy gets its own (unlocked) mutex.
+			/// </summary>
+			/// <param name="other">The queue to copy</param>
+			Queue(const Queue &other);
+
 			/// <summary>
 			/// Destructor
 			/// </summary>
@@ -74,6 +82,13 @@ namespace cnvme
 			/// <returns>True if successful. False if the new index is out of bounds</returns>
 			bool setTailPointer(UINT_32 newIndex);
 
+			/// <summary>
+			/// Sets the head pointer index. For completion queues this is where the host has consumed up to (its head doorbell).
+			/// </summary>
+			/// <param name="newIndex">the new index</param>
+			/// <returns>True if successful. False if the new index is out of bounds, or outside [head, tail] (modulo the queue size)</returns>
+			bool setHeadPointer(UINT_32 newIndex);
+
 			/// <summary>
 			/// Add 1 to the Head Pointer to get it closer to the tail
 			/// Will ASSERT if incremented past the tail.
@@ -81,6 +96,49 @@ namespace cnvme
 			/// <returns>Distance to tail from the new head</returns>
 			UINT_16 incrementAndGetHeadCloserToTail();
 
+			/// <summary>
+			/// Add 1 to the Tail Pointer, after an entry has been placed there (completion queues, where the controller owns the tail).
+			/// Flips the phase tag when the tail wraps and uses up a reserved entry (if any). Will ASSERT if the queue is full.
+			/// </summary>
+			void incrementTailPointer();
+
+			/// <summary>
+			/// Sets aside entries for completions of commands that have been fetched but not finished
+			/// </summary>
+			/// <param name="entries">Entries to reserve. Must be at most getFreeEntries().</param>
+			void reserveEntries(UINT_32 entries);
+
+			/// <summary>
+			/// Gives back entries set aside by reserveEntries() for commands that won't be completed for now
+			/// </summary>
+			/// <param name="entries">Entries to give back. Must be at most what's reserved.</param>
+			void releaseEntries(UINT_32 entries);
+
+			/// <summary>
+			/// Returns the phase tag for the entry at the tail (completion queues). Starts at 1 and flips each pass through the queue.
+			/// </summary>
+			/// <returns>The phase tag</returns>
+			bool getPhaseTag();
+
+			/// <summary>
+			/// Returns the mutex guarding the tail, head and phase tag of a completion queue,
+			///   since any number of submission queues may post to the same one
+			/// </summary>
+			/// <returns>The mutex</returns>
+			std::mutex& getMutex();
+
+			/// <summary>
+			/// Returns true if the queue is full: one more entry would make the tail catch up with the head
+			/// </summary>
+			/// <returns>True if full</returns>
+			bool isFull();
+
+			/// <summary>
+			/// Returns how many more entries fit before the queue is full, not counting reserved ones. Never wraps below 0.
+			/// </summary>
+			/// <returns>Free entries</returns>
+			UINT_32 getFreeEntries();
+
 			/// <summary>
 			/// Returns the address of the linked memory
 			/// </summary>
@@ -106,6 +164,7 @@ namespace cnvme
 
 			/// <summary>
 			/// Set the mapped queue. If Queue is a sub queue, this is the completion queue.
+			/// Completion queues don't map back, since several submission queues can share one.
 			/// </summary>
 			/// <param name="mappedQueue">Linked queue</param>
 			void setMappedQueue(Queue* mappedQueueId);
@@ -149,6 +208,21 @@ namespace cnvme
 			/// Example: If this is the admin submission queue, then this should be a pointer to the admin completion queue
 			/// </summary>
 			Queue* MappedQueue;
+
+			/// <summary>
+			/// Phase tag for the entry at the tail (completion queues)
+			/// </summary>
+			bool PhaseTag;
+
+			/// <summary>
+			/// Entries set aside for completions still on the way (completion queues)
+			/// </summary>
+			UINT_32 ReservedEntries;
+
+			/// <summary>
+			/// Guards the tail, head and phase tag of a completion queue
+			/// </summary>
+			std::mutex QueueMutex;
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,385 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+ReadCache.cpp - An implementation file for the Read Cache
+*/
+
+#include "ReadCache.h"
+
+namespace cnvme
+{
+	namespace media
+	{
+		ReadCacheMedia::ReadCacheMedia(MediaBackend* backingMedia) : MediaBackend(backingMedia->getBlockSize(), backingMedia->getNumberOfBlocks())
+		{
+			BackingMedia = backingMedia;
+			BlocksPerLine = std::max<UINT_64>(1, (READ_CACHE_LINE_SIZE + BlockSize - 1) / BlockSize);
+			TotalLines = (size_t)std::max<UINT_64>(1, READ_CACHE_SIZE / (BlocksPerLine * BlockSize));
+			ProtectedCapacity = TotalLines * READ_CACHE_PROTECTED_PERCENT / 100;
+			InvalidationSequence = 0;
+			Statistics = { 0 };
+			Enabled = false;
+			Deterministic = false;
+		}
+
+		bool ReadCacheMedia::read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			return read(READ_CACHE_DEFAULT_STREAM, lba, numberOfBlocks, buffer);
+		}
+
+		bool ReadCacheMedia::read(UINT_32 streamId, UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			if (!Enabled)
+			{
+				return BackingMedia->read(lba, numberOfBlocks, buffer);
+			}
+
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to read out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			UINT_64 end = lba + numberOfBlocks;
+			LineRuns misses;
+			UINT_64 sequence;
+			bool readahead;
+			UINT_64 readaheadFirstLine = 0;
+			UINT_64 readaheadLastLine = 0;
+			{
+				std::lock_guard<std::mutex> lock(CacheMutex);
+				Statistics.HRB += numberOfBlocks;
+				for (UINT_64 index = lba / BlocksPerLine; index * BlocksPerLine < end; index++)
+				{
+					UINT_64 lineStart = index * BlocksPerLine;
+					UINT_64 start = std::max(lba, lineStart);
+					UINT_64 stop = std::min(end, lineStart + getBlocksInLine(index));
+
+					auto found = Lines.find(index);
+					if (found == Lines.end())
+					{
+						Statistics.CMB += stop - start;
+						if (!misses.empty() && misses.back().first + misses.back().second == index)
+						{
+							misses.back().second++;
+						}
+						else
+						{
+							misses.emplace_back(index, 1);
+						}
+						continue;
+					}
+
+					auto line = found->second;
+					memcpy(buffer + (start - lba) * BlockSize, line->Data.data() + (start - lineStart) * BlockSize, (size_t)((stop - start) * BlockSize));
+					Statistics.CHB += stop - start;
+					if (line->Prefetched)
+					{
+						line->Prefetched = false;
+						Statistics.UPL++;
+					}
+					touchLocked(line);
+				}
+
+				readahead = updateStreamLocked(streamId, lba, numberOfBlocks, readaheadFirstLine, readaheadLastLine);
+				sequence = InvalidationSequence;
+			}
+
+			// Each run of missing lines is one backing read
+			for (auto &run : misses)
+			{
+				if (!fillLines(run, sequence, false, lba, numberOfBlocks, buffer))
+				{
+					return false;
+				}
+			}
+
+			if (readahead)
+			{
+				// There's no idle media time to hide readahead in here, so it is issued right after the read that
+				//   triggered it, as few large backing reads as possible. Lines already cached are skipped.
+				LineRuns prefetches;
+				{
+					std::lock_guard<std::mutex> lock(CacheMutex);
+					for (UINT_64 index = readaheadFirstLine; index <= readaheadLastLine; index++)
+					{
+						if (Lines.find(index) != Lines.end())
+						{
+							continue;
+						}
+						if (!prefetches.empty() && prefetches.back().first + prefetches.back().second == index)
+						{
+							prefetches.back().second++;
+						}
+						else
+						{
+							prefetches.emplace_back(index, 1);
+						}
+					}
+				}
+
+				for (auto &run : prefetches)
+				{
+					fillLines(run, sequence, true, 0, 0, nullptr); // A failed readahead doesn't fail the host read
+				}
+			}
+			return true;
+		}
+
+		bool ReadCacheMedia::write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			// Invalidate after the write lands, so a fill that read the old data can't cache it afterwards
+			bool written = BackingMedia->write(lba, numberOfBlocks, buffer);
+			invalidate(lba, numberOfBlocks);
+			return written;
+		}
+
+		bool ReadCacheMedia::deallocate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			bool deallocated = BackingMedia->deallocate(lba, numberOfBlocks);
+			invalidate(lba, numberOfBlocks);
+			return deallocated;
+		}
+
+		bool ReadCacheMedia::copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks)
+		{
+			bool copied = BackingMedia->copy(sourceLba, destinationLba, numberOfBlocks);
+			invalidate(destinationLba, numberOfBlocks);
+			return copied;
+		}
+
+		bool ReadCacheMedia::flush()
+		{
+			return BackingMedia->flush(); // Nothing here is dirty
+		}
+
+		bool ReadCacheMedia::format()
+		{
+			bool formatted = BackingMedia->format();
+			invalidate(0, NumberOfBlocks);
+			return formatted;
+		}
+
+		void ReadCacheMedia::setEnabled(bool enabled)
+		{
+			std::lock_guard<std::mutex> lock(CacheMutex);
+			if (!enabled)
+			{
+				Lines.clear();
+				ProbationLines.clear();
+				ProtectedLines.clear();
+				Streams.clear();
+				InvalidationSequence++;
+			}
+			Enabled = enabled;
+		}
+
+		bool ReadCacheMedia::isEnabled()
+		{
+			return Enabled;
+		}
+
+		logpages::READ_CACHE_STATISTICS_LOG ReadCacheMedia::getStatistics()
+		{
+			std::lock_guard<std::mutex> lock(CacheMutex);
+			logpages::READ_CACHE_STATISTICS_LOG statistics = Statistics;
+			statistics.HR = statistics.HRB ? (UINT_32)(statistics.CHB * 1000 / statistics.HRB) : 0;
+			statistics.PA = statistics.UPL + statistics.WPL ? (UINT_32)(statistics.UPL * 1000 / (statistics.UPL + statistics.WPL)) : 0;
+			statistics.LS = (UINT_32)(BlocksPerLine * BlockSize);
+			statistics.CL = (UINT_32)Lines.size();
+			statistics.TL = (UINT_32)TotalLines;
+			statistics.EN = Enabled;
+			return statistics;
+		}
+
+		void ReadCacheMedia::setDeterministic(bool deterministic)
+		{
+			Deterministic = deterministic;
+		}
+
+		bool ReadCacheMedia::updateStreamLocked(UINT_32 streamId, UINT_64 lba, UINT_64 numberOfBlocks, UINT_64 &firstLine, UINT_64 &lastLine)
+		{
+			UINT_64 initialReadahead = std::max<UINT_64>(BlocksPerLine, READ_CACHE_INITIAL_READAHEAD_SIZE / BlockSize);
+			auto found = Streams.find(streamId);
+			if (found == Streams.end())
+			{
+				found = Streams.emplace(streamId, Stream{ (UINT_64)-1, 0, initialReadahead, 0 }).first;
+			}
+
+			Stream &stream = found->second;
+			if (lba == stream.NextLba)
+			{
+				stream.SequentialReads++;
+				if (stream.SequentialReads == READ_CACHE_SEQUENTIAL_TRIGGER)
+				{
+					Statistics.SSD++;
+				}
+			}
+			else
+			{
+				stream.SequentialReads = 0;
+				stream.ReadaheadBlocks = initialReadahead;
+				stream.PrefetchedUntil = 0;
+			}
+			stream.NextLba = lba + numberOfBlocks;
+
+			// Keep a window ahead of the stream, topping it up (and growing it) once the stream is half way into it
+			if (Deterministic || stream.SequentialReads < READ_CACHE_SEQUENTIAL_TRIGGER || stream.PrefetchedUntil >= stream.NextLba + stream.ReadaheadBlocks / 2)
+			{
+				return false;
+			}
+
+			UINT_64 start = std::max(stream.NextLba, stream.PrefetchedUntil);
+			UINT_64 end = std::min(NumberOfBlocks, stream.NextLba + stream.ReadaheadBlocks);
+			stream.PrefetchedUntil = end;
+			stream.ReadaheadBlocks = std::min<UINT_64>(stream.ReadaheadBlocks * 2, std::max<UINT_64>(BlocksPerLine, READ_CACHE_MAX_READAHEAD_SIZE / BlockSize));
+			if (start >= end)
+			{
+				return false; // End of the media
+			}
+
+			firstLine = start / BlocksPerLine;
+			lastLine = (end - 1) / BlocksPerLine;
+			return true;
+		}
+
+		bool ReadCacheMedia::fillLines(const std::pair<UINT_64, UINT_64> &run, UINT_64 sequence, bool prefetch, UINT_64 lba, UINT_64 numberOfBlocks, BYTE* buffer)
+		{
+			UINT_64 runStart = run.first * BlocksPerLine;
+			UINT_64 runBlocks = std::min(run.second * BlocksPerLine, NumberOfBlocks - runStart);
+			std::unique_ptr<BYTE[]> data(new BYTE[(size_t)(runBlocks * BlockSize)]); // Not zeroed. The read fills all of it.
+			if (!BackingMedia->read(runStart, (UINT_32)runBlocks, data.get()))
+			{
+				return false;
+			}
+
+			if (buffer)
+			{
+				UINT_64 start = std::max(lba, runStart);
+				UINT_64 stop = std::min(lba + numberOfBlocks, runStart + runBlocks);
+				memcpy(buffer + (start - lba) * BlockSize, data.get() + (start - runStart) * BlockSize, (size_t)((stop - start) * BlockSize));
+			}
+
+			std::lock_guard<std::mutex> lock(CacheMutex);
+			if (!Enabled || sequence != InvalidationSequence)
+			{
+				return true; // Something changed while we read. What we have may be stale, so don't keep it.
+			}
+
+			for (UINT_64 i = 0; i < run.second; i++)
+			{
+				if (Lines.find(run.first + i) == Lines.end())
+				{
+					insertLocked(run.first + i, data.get() + i * BlocksPerLine * BlockSize, prefetch);
+				}
+			}
+			return true;
+		}
+
+		void ReadCacheMedia::touchLocked(std::list<CacheLine>::iterator line)
+		{
+			if (line->Protected)
+			{
+				ProtectedLines.splice(ProtectedLines.begin(), ProtectedLines, line);
+				return;
+			}
+
+			line->Protected = true;
+			ProtectedLines.splice(ProtectedLines.begin(), ProbationLines, line);
+			if (ProtectedLines.size() > ProtectedCapacity)
+			{
+				// Demote the coldest protected line. It gets another chance in probation before eviction.
+				auto demoted = std::prev(ProtectedLines.end());
+				demoted->Protected = false;
+				ProbationLines.splice(ProbationLines.begin(), ProtectedLines, demoted);
+			}
+		}
+
+		void ReadCacheMedia::insertLocked(UINT_64 index, const BYTE* data, bool prefetch)
+		{
+			UINT_64 bytes = getBlocksInLine(index) * BlockSize;
+			if (Lines.size() >= TotalLines)
+			{
+				// Reuse the victim's node and buffer rather than freeing one line and allocating another
+				auto victim = ProbationLines.empty() ? std::prev(ProtectedLines.end()) : std::prev(ProbationLines.end());
+				if (victim->Prefetched)
+				{
+					Statistics.WPL++;
+				}
+				Statistics.EL++;
+				Lines.erase(victim->Index);
+				ProbationLines.splice(ProbationLines.begin(), victim->Protected ? ProtectedLines : ProbationLines, victim);
+				victim->Data.assign(data, data + bytes);
+			}
+			else
+			{
+				ProbationLines.push_front(CacheLine{ index, std::vector<BYTE>(data, data + bytes), prefetch, false });
+			}
+
+			CacheLine &line = ProbationLines.front();
+			line.Index = index;
+			line.Prefetched = prefetch;
+			line.Protected = false;
+			Lines[index] = ProbationLines.begin();
+			if (prefetch)
+			{
+				Statistics.PL++;
+			}
+		}
+
+		void ReadCacheMedia::removeLocked(std::list<CacheLine>::iterator line)
+		{
+			if (line->Prefetched)
+			{
+				Statistics.WPL++;
+			}
+
+			Lines.erase(line->Index);
+			(line->Protected ? ProtectedLines : ProbationLines).erase(line);
+		}
+
+		void ReadCacheMedia::invalidate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			if (numberOfBlocks == 0)
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(CacheMutex);
+			InvalidationSequence++;
+
+			UINT_64 firstLine = lba / BlocksPerLine;
+			UINT_64 lastLine = (lba + numberOfBlocks - 1) / BlocksPerLine;
+			if (lastLine - firstLine >= Lines.size())
+			{
+				// Bigger than the cache (a format or whole namespace deallocate). Walk the lines instead of the range.
+				for (auto line = Lines.begin(); line != Lines.end();)
+				{
+					auto next = std::next(line);
+					if (line->first >= firstLine && line->first <= lastLine)
+					{
+						removeLocked(line->second);
+						Statistics.IL++;
+					}
+					line = next;
+				}
+				return;
+			}
+
+			for (UINT_64 index = firstLine; index <= lastLine; index++)
+			{
+				auto found = Lines.find(index);
+				if (found != Lines.end())
+				{
+					removeLocked(found->second);
+					Statistics.IL++;
+				}
+			}
+		}
+
+		UINT_64 ReadCacheMedia::getBlocksInLine(UINT_64 index) const
+		{
+			return std::min(BlocksPerLine, NumberOfBlocks - index * BlocksPerLine);
+		}
+	}
+}
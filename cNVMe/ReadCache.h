@@ -0,0 +1,277 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+ReadCache.h - A header file for the Read Cache
+*/
+
+#pragma once
+
+#include "LogPage.h"
+#include "Media.h"
+#include "Types.h"
+
+#include <list>
+#include <unordered_map>
+
+#define READ_CACHE_SIZE (32 * 1024 * 1024) // Bytes of clean data the cache can hold
+#define READ_CACHE_LINE_SIZE 4096 // Bytes per cache line (rounded up to a whole number of blocks)
+#define READ_CACHE_PROTECTED_PERCENT 80 // Share of the lines the protected (hit at least twice) segment may hold
+#define READ_CACHE_SEQUENTIAL_TRIGGER 2 // Back to back reads a stream needs before readahead starts
+#define READ_CACHE_INITIAL_READAHEAD_SIZE (128 * 1024) // First readahead window in bytes. Doubles on each top up.
+#define READ_CACHE_MAX_READAHEAD_SIZE (2 * 1024 * 1024) // Largest readahead window in bytes
+#define READ_CACHE_DEFAULT_STREAM 0 // Stream used by read() (queue 0 is the admin queue, which never reads)
+
+namespace cnvme
+{
+	namespace media
+	{
+		/// <summary>
+		/// Controller side DRAM read cache in front of another MediaBackend. Off unless the host turns it on (vendor specific feature 0xC0).
+		/// Clean data is kept in fixed size lines managed as a segmented LRU: new lines go into a probationary segment
+		///   and move to a protected segment on their second hit, so one big scan can't flush out the hot data.
+		/// Each stream (the controller uses one per submission queue) has a sequential detector. Once a stream reads
+		///   back to back, the lines ahead of it are read into the cache in one large backing read, and the window
+		///   doubles up to a limit as long as the stream stays sequential.
+		/// Writes, deallocates and copies go straight through and invalidate any lines they touch.
+		/// </summary>
+		class ReadCacheMedia : public MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor. Starts disabled.
+			/// </summary>
+			/// <param name="backingMedia">Media to cache. Not owned.</param>
+			ReadCacheMedia(MediaBackend* backingMedia);
+
+			/// <summary>
+			/// Reads as READ_CACHE_DEFAULT_STREAM
+			/// </summary>
+			bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override;
+
+			/// <summary>
+			/// Reads through the cache, feeding the given stream's sequential detector
+			/// </summary>
+			/// <param name="streamId">Identifies the reader (a submission queue ID)</param>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks to read</param>
+			/// <param name="buffer">Buffer to read into</param>
+			/// <returns>True on success</returns>
+			bool read(UINT_32 streamId, UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer);
+
+			bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) override;
+			bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) override;
+			bool copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks) override;
+			bool flush() override;
+
+			/// <summary>
+			/// Formats the backing media then drops every line
+			/// </summary>
+			bool format() override;
+
+			/// <summary>
+			/// Turns caching on or off. Turning it off drops every line.
+			/// </summary>
+			/// <param name="enabled">True to cache reads</param>
+			void setEnabled(bool enabled);
+
+			/// <summary>
+			/// Returns true if reads are being cached
+			/// </summary>
+			/// <returns>True if enabled</returns>
+			bool isEnabled();
+
+			/// <summary>
+			/// Returns the current statistics as the read cache log page
+			/// </summary>
+			/// <returns>READ_CACHE_STATISTICS_LOG</returns>
+			logpages::READ_CACHE_STATISTICS_LOG getStatistics();
+
+			/// <summary>
+			/// Stops issuing readahead while deterministic. Sequential detection carries on, so readahead resumes straight after.
+			/// </summary>
+			void setDeterministic(bool deterministic) override;
+
+		private:
+			/// <summary>
+			/// A cached line
+			/// </summary>
+			struct CacheLine
+			{
+				/// <summary>
+				/// Line number (first LBA / BlocksPerLine)
+				/// </summary>
+				UINT_64 Index;
+
+				/// <summary>
+				/// The line's data
+				/// </summary>
+				std::vector<BYTE> Data;
+
+				/// <summary>
+				/// True if read ahead and not yet read by the host
+				/// </summary>
+				bool Prefetched;
+
+				/// <summary>
+				/// True if in ProtectedLines, false if in ProbationLines
+				/// </summary>
+				bool Protected;
+			};
+
+			/// <summary>
+			/// Sequential detector state for one stream
+			/// </summary>
+			struct Stream
+			{
+				/// <summary>
+				/// LBA right after the stream's last read
+				/// </summary>
+				UINT_64 NextLba;
+
+				/// <summary>
+				/// Reads in a row that started at NextLba
+				/// </summary>
+				UINT_32 SequentialReads;
+
+				/// <summary>
+				/// Current readahead window in blocks
+				/// </summary>
+				UINT_64 ReadaheadBlocks;
+
+				/// <summary>
+				/// LBA readahead has been issued up to
+				/// </summary>
+				UINT_64 PrefetchedUntil;
+			};
+
+			/// <summary>
+			/// Runs of consecutive lines: first line -> number of lines
+			/// </summary>
+			typedef std::vector<std::pair<UINT_64, UINT_64>> LineRuns;
+
+			/// <summary>
+			/// Feeds a read to the stream's detector. Must be called with CacheMutex held.
+			/// </summary>
+			/// <param name="streamId">The stream</param>
+			/// <param name="lba">Starting LBA of the read</param>
+			/// <param name="numberOfBlocks">Number of blocks read</param>
+			/// <param name="firstLine">Set to the first line to read ahead</param>
+			/// <param name="lastLine">Set to the last line to read ahead</param>
+			/// <returns>True if readahead should be issued</returns>
+			bool updateStreamLocked(UINT_32 streamId, UINT_64 lba, UINT_64 numberOfBlocks, UINT_64 &firstLine, UINT_64 &lastLine);
+
+			/// <summary>
+			/// Reads a run of lines from the backing media and caches them, unless something was invalidated
+			///   since sequence was taken (the data read might then be stale).
+			/// Also copies the part of the run that overlaps [lba, lba + numberOfBlocks) into buffer, if given.
+			/// </summary>
+			/// <param name="run">Lines to read</param>
+			/// <param name="sequence">InvalidationSequence from before the lines were found missing</param>
+			/// <param name="prefetch">True if this is readahead</param>
+			/// <param name="lba">Starting LBA of the host read</param>
+			/// <param name="numberOfBlocks">Number of blocks in the host read</param>
+			/// <param name="buffer">Host read buffer or nullptr</param>
+			/// <returns>True if the backing read worked</returns>
+			bool fillLines(const std::pair<UINT_64, UINT_64> &run, UINT_64 sequence, bool prefetch, UINT_64 lba, UINT_64 numberOfBlocks, BYTE* buffer);
+
+			/// <summary>
+			/// Marks a line as just used, promoting it to the protected segment. Must be called with CacheMutex held.
+			/// </summary>
+			/// <param name="line">The line</param>
+			void touchLocked(std::list<CacheLine>::iterator line);
+
+			/// <summary>
+			/// Adds a line to the probationary segment, evicting if full. Must be called with CacheMutex held.
+			/// </summary>
+			/// <param name="index">Line number</param>
+			/// <param name="data">Start of the line's data</param>
+			/// <param name="prefetch">True if read ahead</param>
+			void insertLocked(UINT_64 index, const BYTE* data, bool prefetch);
+
+			/// <summary>
+			/// Drops a line. Must be called with CacheMutex held.
+			/// </summary>
+			/// <param name="line">The line</param>
+			void removeLocked(std::list<CacheLine>::iterator line);
+
+			/// <summary>
+			/// Drops every line overlapping the given range. Called after the backing media has changed.
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			void invalidate(UINT_64 lba, UINT_64 numberOfBlocks);
+
+			/// <summary>
+			/// Returns the number of blocks in the given line (the last line may be short)
+			/// </summary>
+			/// <param name="index">Line number</param>
+			/// <returns>Blocks in the line</returns>
+			UINT_64 getBlocksInLine(UINT_64 index) const;
+
+			/// <summary>
+			/// The media being cached
+			/// </summary>
+			MediaBackend* BackingMedia;
+
+			/// <summary>
+			/// Blocks per cache line
+			/// </summary>
+			UINT_64 BlocksPerLine;
+
+			/// <summary>
+			/// Most lines the cache holds
+			/// </summary>
+			size_t TotalLines;
+
+			/// <summary>
+			/// Most lines the protected segment holds
+			/// </summary>
+			size_t ProtectedCapacity;
+
+			/// <summary>
+			/// Line number -> line (in ProbationLines or ProtectedLines)
+			/// </summary>
+			std::unordered_map<UINT_64, std::list<CacheLine>::iterator> Lines;
+
+			/// <summary>
+			/// Lines hit once (or demoted from ProtectedLines). Most recently used first. Evictions come from the back.
+			/// </summary>
+			std::list<CacheLine> ProbationLines;
+
+			/// <summary>
+			/// Lines hit more than once. Most recently used first. Overflow is demoted to ProbationLines.
+			/// </summary>
+			std::list<CacheLine> ProtectedLines;
+
+			/// <summary>
+			/// Stream ID -> sequential detector
+			/// </summary>
+			std::unordered_map<UINT_32, Stream> Streams;
+
+			/// <summary>
+			/// Bumped on every invalidate, so a fill racing a write knows not to cache what it read
+			/// </summary>
+			UINT_64 InvalidationSequence;
+
+			/// <summary>
+			/// Counters for the log page. Ratios and sizes are filled in by getStatistics().
+			/// </summary>
+			logpages::READ_CACHE_STATISTICS_LOG Statistics;
+
+			/// <summary>
+			/// True if caching
+			/// </summary>
+			std::atomic<bool> Enabled;
+
+			/// <summary>
+			/// True while readahead is paused for a deterministic window
+			/// </summary>
+			std::atomic<bool> Deterministic;
+
+			/// <summary>
+			/// Guards everything above except Enabled and Deterministic. Never held across a backing media call.
+			/// </summary>
+			std::mutex CacheMutex;
+		};
+	}
+}
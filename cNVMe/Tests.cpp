@@ -4,10 +4,18 @@ This file is part of cNVMe and is released under the MIT License
 Tests.cpp - An implementation file for all unit testing
 */
 
+#include "Constants.h"
+#include "Journal.h"
 #include "Tests.h"
 
+#include <algorithm>
+#include <fstream>
 #include <random>
 #include <future>
+#include <memory>
+
+#define TEST_COMMAND_TIMEOUT_MS 5000
+#define TEST_THREADED_ITERATIONS 3 // Times each test that starts its own threads runs
 
 // Macros to fail a test
 #define FAIL(s) LOG_ERROR(s); return false;
@@ -38,7 +46,7 @@ namespace cnvme
 			{
 				std::vector<std::future<bool>> results;
 
-				// Run all tests 100 times, multi-threaded
+				// Run the unit tests 100 times, multi-threaded
 				for (int i = 0; i < 100; i++)
 				{
 					results.push_back(std::async(pci::testPciHeaderId));
@@ -56,6 +64,48 @@ namespace cnvme
 					retVal &= i.get();
 				}
 
+				// Each of these starts threads of its own (a controller's stages, a namespace's background work or racing workers).
+				//   A hundred at once starve them until commands time out, so they take turns.
+				std::vector<std::function<bool()>> threadedTests = {
+					general::testChaseLevDeque,
+					commands::testCommandDispatch,
+					commands::testPlugins,
+					commands::testIdentify,
+					commands::testAsynchronousEvents,
+					commands::testAsynchronousEventsInSmallAdminQueue,
+					nvm::testReadWrite,
+					nvm::testCompletionQueueFull,
+					nvm::testInvalidCompletionQueueHead,
+					nvm::testSharedCompletionQueue,
+					nvm::testArbitrationBurst,
+					nvm::testPipelineStatistics,
+					nvm::testWorkStealing,
+					nvm::testAdminBesideIo,
+					nvm::testSmartHealthInformation,
+					nvm::testCopy,
+					nvm::testVolatileWriteCache,
+					nvm::testReadCache,
+					nvm::testFormatAndSanitize,
+					nvm::testNamespaceClone,
+					nvm::testJournaledMedia,
+					nvm::testDedupMedia,
+					nvm::testTieredMedia,
+					nvm::testQos,
+					nvm::testAbort,
+					nvm::testPredictableLatency,
+					zns::testZoneAppendConcurrency,
+					zns::testZoneManagement,
+					ftl::testGarbageCollection,
+					ftl::testStreams
+				};
+				for (int i = 0; i < TEST_THREADED_ITERATIONS; i++)
+				{
+					for (auto &test : threadedTests)
+					{
+						retVal &= test();
+					}
+				}
+
 				return retVal;
 			}
 
@@ -68,6 +118,188 @@ namespace cnvme
 					payload.getBuffer()[i] = (BYTE)randInt(0, 0xFF);
 				}
 			}
+
+			HostQueuePair::HostQueuePair(Controller &controller, UINT_16 queueId, UINT_16 queueSize) : TheController(controller),
+				SubmissionQueueMemory(queueSize * sizeof(command::NVME_COMMAND)), CompletionQueueMemory(queueSize * sizeof(command::COMPLETION_QUEUE_ENTRY))
+			{
+				QueueId = queueId;
+				QueueSize = queueSize;
+				SubmissionQueueTail = 0;
+				CompletionQueueHead = 0;
+				NextCommandId = 0;
+				PhaseTag = true; // The controller's first pass through the queue uses a phase tag of 1
+			}
+
+			HostQueuePair::~HostQueuePair()
+			{
+				if (TheController.getControllerRegisters()->getControllerRegisters()->CC.EN)
+				{
+					disableController(TheController);
+				}
+			}
+
+			bool HostQueuePair::sendCommand(command::NVME_COMMAND command, command::COMPLETION_QUEUE_ENTRY &completion)
+			{
+				submitCommands({ command });
+				return waitForCompletion(completion);
+			}
+
+			void HostQueuePair::submitCommands(std::vector<command::NVME_COMMAND> commands)
+			{
+				command::NVME_COMMAND* submissionQueue = (command::NVME_COMMAND*)SubmissionQueueMemory.getBuffer();
+				for (auto &command : commands)
+				{
+					command.DWord0Breakdown.CID = NextCommandId++;
+					submissionQueue[SubmissionQueueTail] = command;
+					SubmissionQueueTail = (SubmissionQueueTail + 1) % QueueSize;
+				}
+
+				controller::registers::QUEUE_DOORBELLS* doorbells = TheController.getControllerRegisters()->getQueueDoorbells();
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				doorbells[QueueId].SQTDBL.SQT = SubmissionQueueTail;
+			}
+
+			bool HostQueuePair::hasCompletion(UINT_16 ahead)
+			{
+				volatile command::COMPLETION_QUEUE_ENTRY* completionQueue = (volatile command::COMPLETION_QUEUE_ENTRY*)CompletionQueueMemory.getBuffer();
+				UINT_16 index = (CompletionQueueHead + ahead) % QueueSize;
+				return completionQueue[index].P == (index < CompletionQueueHead ? !PhaseTag : PhaseTag); // Past the end is the next pass
+			}
+
+			bool HostQueuePair::waitForCompletion(command::COMPLETION_QUEUE_ENTRY &completion)
+			{
+				volatile command::COMPLETION_QUEUE_ENTRY* completionQueue = (volatile command::COMPLETION_QUEUE_ENTRY*)CompletionQueueMemory.getBuffer();
+				UINT_64 deathTime = getTimeInMilliseconds() + TEST_COMMAND_TIMEOUT_MS;
+				while (!hasCompletion())
+				{
+					if (getTimeInMilliseconds() > deathTime)
+					{
+						LOG_ERROR("Timed out waiting for a completion on queue " + std::to_string(QueueId));
+						disableController(TheController);
+						return false;
+					}
+					std::this_thread::yield();
+				}
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				memcpy(&completion, (void*)&completionQueue[CompletionQueueHead], sizeof(completion));
+				CompletionQueueHead = (CompletionQueueHead + 1) % QueueSize;
+				if (CompletionQueueHead == 0)
+				{
+					PhaseTag = !PhaseTag;
+				}
+				TheController.getControllerRegisters()->getQueueDoorbells()[QueueId].CQHDBL.CQH = CompletionQueueHead;
+				return true;
+			}
+
+			UINT_16 HostQueuePair::getQueueId()
+			{
+				return QueueId;
+			}
+
+			UINT_16 HostQueuePair::getQueueSize()
+			{
+				return QueueSize;
+			}
+
+			UINT_16 HostQueuePair::getNextCommandId()
+			{
+				return NextCommandId;
+			}
+
+			UINT_64 HostQueuePair::getSubmissionQueueAddress()
+			{
+				return SubmissionQueueMemory.getMemoryAddress();
+			}
+
+			UINT_64 HostQueuePair::getCompletionQueueAddress()
+			{
+				return CompletionQueueMemory.getMemoryAddress();
+			}
+
+			bool enableController(Controller &controller, HostQueuePair &adminQueuePair)
+			{
+				auto CR = controller.getControllerRegisters()->getControllerRegisters();
+				CR->AQA.ASQS = adminQueuePair.getQueueSize() - 1; // 0-based
+				CR->AQA.ACQS = adminQueuePair.getQueueSize() - 1; // 0-based
+				CR->ASQ.ASQB = adminQueuePair.getSubmissionQueueAddress();
+				CR->ACQ.ACQB = adminQueuePair.getCompletionQueueAddress();
+				CR->CC.EN = 1;
+
+				UINT_64 deathTime = getTimeInMilliseconds() + CR->CAP.TO * 500; // CAP.TO is in 500 millisecond intervals
+				while (CR->CSTS.RDY == 0)
+				{
+					if (getTimeInMilliseconds() > deathTime)
+					{
+						return false;
+					}
+					std::this_thread::yield();
+				}
+				return true;
+			}
+
+			bool disableController(Controller &controller)
+			{
+				auto CR = controller.getControllerRegisters()->getControllerRegisters();
+				UINT_64 deathTime = getTimeInMilliseconds() + CR->CAP.TO * 500; // Before the reset clears CAP (for a moment)
+				CR->CC.EN = 0;
+				while (CR->CSTS.RDY == 1)
+				{
+					if (getTimeInMilliseconds() > deathTime)
+					{
+						return false;
+					}
+					std::this_thread::yield();
+				}
+
+				// CSTS.RDY drops as the reset starts. Once each thread has gone around again, the reset (which drains the pipeline)
+				//   is done and nothing is part way through a command.
+				controller.getControllerRegisters()->waitForChangeLoop();
+				controller.waitForChangeLoop();
+				return true;
+			}
+
+			bool createIoQueuePair(HostQueuePair &adminQueuePair, HostQueuePair &ioQueuePair)
+			{
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+
+				command::NVME_COMMAND createCq = { 0 };
+				createCq.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_COMPLETION_QUEUE;
+				createCq.DPTR.DPTR1 = ioQueuePair.getCompletionQueueAddress();
+				createCq.DWord10 = ((UINT_32)(ioQueuePair.getQueueSize() - 1) << 16) | ioQueuePair.getQueueId();
+				createCq.DWord11 = 1; // Physically contiguous
+				if (!adminQueuePair.sendCommand(createCq, completion) || completion.SF != 0)
+				{
+					return false;
+				}
+
+				return createIoSubmissionQueue(adminQueuePair, ioQueuePair, ioQueuePair.getQueueId());
+			}
+
+			bool createIoSubmissionQueue(HostQueuePair &adminQueuePair, HostQueuePair &ioQueuePair, UINT_16 completionQueueId)
+			{
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+
+				command::NVME_COMMAND createSq = { 0 };
+				createSq.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_SUBMISSION_QUEUE;
+				createSq.DPTR.DPTR1 = ioQueuePair.getSubmissionQueueAddress();
+				createSq.DWord10 = ((UINT_32)(ioQueuePair.getQueueSize() - 1) << 16) | ioQueuePair.getQueueId();
+				createSq.DWord11 = ((UINT_32)completionQueueId << 16) | 1; // CQID, Physically contiguous
+				return adminQueuePair.sendCommand(createSq, completion) && completion.SF == 0;
+			}
+
+			command::NVME_COMMAND makeIoCommand(UINT_8 opcode, UINT_32 namespaceId, UINT_64 lba, UINT_32 numberOfBlocks, PRP &prp)
+			{
+				command::NVME_COMMAND command = { 0 };
+				command.DWord0Breakdown.OPC = opcode;
+				command.NSID = namespaceId;
+				command.DPTR.DPTR1 = prp.getPRP1();
+				command.DPTR.DPTR2 = prp.getPRP2();
+				command.DWord10 = (UINT_32)lba;
+				command.DWord11 = (UINT_32)(lba >> 32);
+				command.DWord12 = numberOfBlocks - 1; // 0-based
+				return command;
+			}
 		}
 
 		namespace general
@@ -88,6 +320,91 @@ namespace cnvme
 
 				return true;
 			}
+
+			bool testChaseLevDeque()
+			{
+				const UINT_32 capacity = 64;
+				const UINT_32 numberOfItems = 20000;
+				const UINT_32 numberOfThieves = 3;
+
+				// The owner works newest first and thieves oldest first
+				pipeline::ChaseLevDeque<UINT_32, capacity> deque;
+				UINT_32 item = 0;
+				FAIL_IF(deque.pop(item) || deque.steal(item), "Took an item from an empty deque");
+				for (UINT_32 i = 1; i <= 3; i++)
+				{
+					FAIL_IF(!deque.push(i), "Unable to push to the deque");
+				}
+				FAIL_IF(!deque.pop(item) || item != 3, "Pop didn't take the newest item");
+				FAIL_IF(!deque.steal(item) || item != 1, "Steal didn't take the oldest item");
+				FAIL_IF(!deque.pop(item) || item != 2, "Pop didn't take the last item");
+				FAIL_IF(deque.pop(item) || deque.steal(item) || deque.size() != 0, "The deque should be empty");
+				for (UINT_32 i = 0; i < capacity; i++)
+				{
+					FAIL_IF(!deque.push(i), "Unable to fill the deque");
+				}
+				FAIL_IF(deque.push(capacity), "Pushed to a full deque");
+				while (deque.pop(item));
+
+				// Thieves racing the owner (which pops a few between pushes) still take each item exactly once
+				std::atomic<bool> ownerDone(false);
+				std::vector<std::vector<UINT_32>> taken(numberOfThieves + 1);
+				std::vector<std::thread> thieves;
+				for (UINT_32 thief = 1; thief <= numberOfThieves; thief++)
+				{
+					thieves.emplace_back([&, thief] {
+						UINT_32 stolen = 0;
+						while (!ownerDone || deque.size() != 0)
+						{
+							if (deque.steal(stolen))
+							{
+								taken[thief].push_back(stolen);
+							}
+							else
+							{
+								std::this_thread::yield();
+							}
+						}
+					});
+				}
+
+				for (UINT_32 next = 0; next < numberOfItems;)
+				{
+					while (next < numberOfItems && deque.push(next))
+					{
+						next++;
+					}
+					for (UINT_32 i = 0; i < 2 && deque.pop(item); i++)
+					{
+						taken[0].push_back(item);
+					}
+				}
+				while (deque.pop(item))
+				{
+					taken[0].push_back(item);
+				}
+				ownerDone = true;
+				for (auto &thief : thieves)
+				{
+					thief.join();
+				}
+
+				std::vector<UINT_32> timesTaken(numberOfItems, 0);
+				for (auto &items : taken)
+				{
+					for (UINT_32 takenItem : items)
+					{
+						FAIL_IF(takenItem >= numberOfItems, "Took an item that was never pushed: " + std::to_string(takenItem));
+						timesTaken[takenItem]++;
+					}
+				}
+				for (UINT_32 i = 0; i < numberOfItems; i++)
+				{
+					FAIL_IF(timesTaken[i] != 1, "Item " + std::to_string(i) + " was taken " + std::to_string(timesTaken[i]) + " time(s)");
+				}
+
+				return true;
+			}
 		}
 
 		namespace pci
@@ -228,6 +545,350 @@ namespace cnvme
 
 				return true;
 			}
+
+			bool testCommandDispatch()
+			{
+				const UINT_8 vendorAdminOpcode = 0xC2; // Controller to host
+				const UINT_8 vendorIoOpcode = 0x80; // No data
+				const BYTE vendorPattern = 0xA5;
+
+				Controller controller;
+				FAIL_IF(controller.registerAdminCommand(constants::opcodes::admin::IDENTIFY, CommandDescriptor([](CommandContext &c) {}, false, false)), "Registered over a built in opcode");
+				FAIL_IF(controller.registerAdminCommand(0xC0, CommandDescriptor([](CommandContext &c) {}, true, false)), "Registered PRPs for an opcode that transfers no data");
+				FAIL_IF(controller.registerIoCommand(0x01, vendorIoOpcode, CommandDescriptor([](CommandContext &c) {}, false, true)), "Registered to an unsupported command set");
+				FAIL_IF(!controller.registerAdminCommand(vendorAdminOpcode, CommandDescriptor([](CommandContext &c) {
+					PRP prp(c.Command->DPTR.DPTR1, c.Command->DPTR.DPTR2, c.MemoryPageSize, c.MemoryPageSize);
+					Payload payload(c.MemoryPageSize);
+					memset(payload.getBuffer(), vendorPattern, payload.getSize());
+					prp.placePayloadInExistingPRPs(payload);
+				}, true, false)), "Unable to register a vendor specific admin command");
+				FAIL_IF(!controller.registerIoCommand(constants::command_sets::NVM, vendorIoOpcode, CommandDescriptor([](CommandContext &c) {
+					c.Completion->DWord0 = c.TheNamespace->getBlockSize();
+				}, false, true)), "Unable to register a vendor specific I/O command");
+
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 8);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				command::NVME_COMMAND unknown = { 0 };
+				unknown.DWord0Breakdown.OPC = 0xC4;
+				FAIL_IF(!adminQueuePair.sendCommand(unknown, completion), "Unregistered admin command timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_COMMAND_OPCODE || !completion.DNR, "Unregistered admin command did not fail with invalid opcode");
+
+				PRP vendorPrp(Payload(4096), 4096);
+				command::NVME_COMMAND vendor = { 0 };
+				vendor.DWord0Breakdown.OPC = vendorAdminOpcode;
+				FAIL_IF(!adminQueuePair.sendCommand(vendor, completion), "Vendor specific admin command timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Vendor specific admin command without PRPs did not fail with invalid field");
+				vendor.DPTR.DPTR1 = vendorPrp.getPRP1();
+				vendor.DPTR.DPTR2 = vendorPrp.getPRP2();
+				FAIL_IF(!adminQueuePair.sendCommand(vendor, completion), "Vendor specific admin command timed out");
+				FAIL_IF(completion.SF != 0, "Vendor specific admin command failed with status " + std::to_string(completion.SF));
+				Payload vendorData = vendorPrp.getPayloadCopy();
+				FAIL_IF(vendorData.getBuffer()[0] != vendorPattern || vendorData.getBuffer()[4095] != vendorPattern, "Vendor specific admin command did not fill its PRPs");
+
+				command::NVME_COMMAND vendorIo = { 0 };
+				vendorIo.DWord0Breakdown.OPC = vendorIoOpcode;
+				vendorIo.NSID = DEFAULT_NAMESPACE_ID;
+				FAIL_IF(!ioQueuePair.sendCommand(vendorIo, completion), "Vendor specific I/O command timed out");
+				FAIL_IF(completion.SF != 0 || completion.DWord0 != DEFAULT_NAMESPACE_BLOCK_SIZE, "Vendor specific I/O command did not run: " + completion.toString());
+				vendorIo.NSID = DEFAULT_NAMESPACE_ID + 100;
+				FAIL_IF(!ioQueuePair.sendCommand(vendorIo, completion), "Vendor specific I/O command timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT, "Vendor specific I/O command of a missing namespace did not fail with invalid namespace");
+
+				PRP readPrp(Payload(DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, 1, readPrp);
+				read.DPTR.DPTR1 = 0;
+				FAIL_IF(!ioQueuePair.sendCommand(read, completion), "Read timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Read without PRPs did not fail with invalid field");
+				read.DPTR.DPTR1 = readPrp.getPRP1() + 1;
+				FAIL_IF(!ioQueuePair.sendCommand(read, completion), "Read timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::PRP_OFFSET_INVALID, "Read with an unaligned PRP did not fail with PRP offset invalid");
+
+				command::NVME_COMMAND zoneAppend = helpers::makeIoCommand(constants::opcodes::zns::ZONE_APPEND, DEFAULT_NAMESPACE_ID, 0, 1, readPrp);
+				FAIL_IF(!ioQueuePair.sendCommand(zoneAppend, completion), "Zone Append timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_COMMAND_OPCODE, "Zone Append to a conventional namespace did not fail with invalid opcode");
+
+				return true;
+			}
+
+			bool testPlugins()
+			{
+				const UINT_32 numberOfBlocks = 16;
+				const UINT_32 numberOfRecords = numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE / sizeof(UINT_64);
+				const UINT_32 expectedMatches = 10;
+
+				Controller controller;
+				FAIL_IF(controller.loadPlugin("cNVMe_missing_plugin" PLUGIN_EXTENSION), "Loaded a plugin that doesn't exist");
+#ifndef _WIN32
+				FAIL_IF(controller.loadPlugin("libm.so.6"), "Loaded a shared object without an entry point");
+#endif
+				if (!std::ifstream(SAMPLE_FILTER_PLUGIN).good())
+				{
+					LOG_INFO(std::string(SAMPLE_FILTER_PLUGIN) + " wasn't built, so only failing to load plugins was tested");
+					return true;
+				}
+				FAIL_IF(!controller.loadPlugin(SAMPLE_FILTER_PLUGIN), "Unable to load the sample filter plugin");
+				FAIL_IF(controller.loadPlugin(SAMPLE_FILTER_PLUGIN), "Loaded the sample filter plugin over itself");
+
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 8);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				Payload records(numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE);
+				for (UINT_32 i = 0; i < numberOfRecords; i++)
+				{
+					((UINT_64*)records.getBuffer())[i] = i;
+				}
+				PRP recordsPrp(records, 4096);
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, 0, numberOfBlocks, recordsPrp), completion), "Write timed out");
+				FAIL_IF(completion.SF != 0, "Write failed with status " + std::to_string(completion.SF));
+
+				// Only the last few records are at least the key
+				PRP filterPrp(Payload(numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND filter = helpers::makeIoCommand(SAMPLE_FILTER_OPCODE, DEFAULT_NAMESPACE_ID, 0, numberOfBlocks, filterPrp);
+				filter.DWord14 = numberOfRecords - expectedMatches;
+				FAIL_IF(!ioQueuePair.sendCommand(filter, completion), "Filter timed out");
+				FAIL_IF(completion.SF != 0, "Filter failed with status " + std::to_string(completion.SF));
+				FAIL_IF(completion.DWord0 != expectedMatches, "Filter matched the wrong number of records: " + std::to_string(completion.DWord0));
+				Payload matches = filterPrp.getPayloadCopy();
+				for (UINT_32 i = 0; i < expectedMatches; i++)
+				{
+					FAIL_IF(((UINT_64*)matches.getBuffer())[i] != numberOfRecords - expectedMatches + i, "Filter returned the wrong record at " + std::to_string(i));
+				}
+
+				filter.NSID = DEFAULT_NAMESPACE_ID + 100;
+				FAIL_IF(!ioQueuePair.sendCommand(filter, completion), "Filter timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT, "Filter of a missing namespace did not fail with invalid namespace");
+
+				return true;
+			}
+
+			bool testIdentify()
+			{
+				const UINT_32 addedNamespaceId = 7;
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+
+				PRP identifyPrp(Payload(IDENTIFY_DATA_SIZE), 4096);
+				command::NVME_COMMAND identifyCommand = { 0 };
+				identifyCommand.DWord0Breakdown.OPC = constants::opcodes::admin::IDENTIFY;
+				identifyCommand.DPTR.DPTR1 = identifyPrp.getPRP1();
+				identifyCommand.DPTR.DPTR2 = identifyPrp.getPRP2();
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				auto sendIdentify = [&](UINT_8 cns, UINT_32 namespaceId) {
+					identifyCommand.DWord10 = cns;
+					identifyCommand.NSID = namespaceId;
+					return adminQueuePair.sendCommand(identifyCommand, completion);
+				};
+
+				FAIL_IF(!sendIdentify(constants::identify::CNS_CONTROLLER, 0), "Identify Controller timed out");
+				FAIL_IF(completion.SF != 0, "Identify Controller failed with status " + std::to_string(completion.SF));
+				Payload identifyPayload = identifyPrp.getPayloadCopy();
+				identify::PIDENTIFY_CONTROLLER_DATA controllerData = (identify::PIDENTIFY_CONTROLLER_DATA)identifyPayload.getBuffer();
+				FAIL_IF(controllerData->VID != controller.getPCIExpressRegisters()->getPciExpressRegisters().PciHeader->ID.VID, "Identify Controller has the wrong VID: " + controllerData->toString());
+				FAIL_IF(memcmp(&controllerData->VER, &controller.getControllerRegisters()->getControllerRegisters()->VS, sizeof(UINT_32)) != 0, "Identify Controller's VER isn't VS: " + controllerData->toString());
+				FAIL_IF(controllerData->SQES != 0x66 || controllerData->CQES != 0x44 || controllerData->NN == 0, "Identify Controller has bad queue entry sizes or no namespaces: " + controllerData->toString());
+				FAIL_IF(std::string(controllerData->MN, 5) != "cNVMe" || controllerData->MN[sizeof(controllerData->MN) - 1] != ' ', "Identify Controller's model number isn't space padded ASCII: " + controllerData->toString());
+
+				FAIL_IF(!sendIdentify(constants::identify::CNS_NAMESPACE, DEFAULT_NAMESPACE_ID), "Identify Namespace timed out");
+				FAIL_IF(completion.SF != 0, "Identify Namespace failed with status " + std::to_string(completion.SF));
+				identifyPayload = identifyPrp.getPayloadCopy();
+				identify::PIDENTIFY_NAMESPACE_DATA namespaceData = (identify::PIDENTIFY_NAMESPACE_DATA)identifyPayload.getBuffer();
+				FAIL_IF(namespaceData->NSZE != DEFAULT_NAMESPACE_SIZE_IN_BLOCKS || namespaceData->NCAP != DEFAULT_NAMESPACE_SIZE_IN_BLOCKS, "Identify Namespace has the wrong size: " + namespaceData->toString());
+				FAIL_IF((1u << namespaceData->LBAF[namespaceData->FLBAS & 0xF].LBADS) != DEFAULT_NAMESPACE_BLOCK_SIZE, "Identify Namespace has the wrong block size: " + namespaceData->toString());
+				FAIL_IF(!sendIdentify(constants::identify::CNS_NAMESPACE, addedNamespaceId), "Identify Namespace timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT, "Identify Namespace of a missing namespace did not fail with invalid namespace");
+
+				// A namespace added later shows up in the list, which starts after the NSID given
+				FAIL_IF(!controller.addNamespace(new Namespace(addedNamespaceId, new media::RamMedia(4096, 1024))), "Unable to add a namespace");
+				FAIL_IF(!sendIdentify(constants::identify::CNS_NAMESPACE, addedNamespaceId), "Identify Namespace timed out");
+				identifyPayload = identifyPrp.getPayloadCopy();
+				namespaceData = (identify::PIDENTIFY_NAMESPACE_DATA)identifyPayload.getBuffer();
+				FAIL_IF(completion.SF != 0 || namespaceData->NSZE != 1024 || namespaceData->LBAF[0].LBADS != 12, "Identify Namespace of the added namespace is wrong: " + namespaceData->toString());
+				for (UINT_32 startingNamespaceId : { (UINT_32)0, (UINT_32)DEFAULT_NAMESPACE_ID, addedNamespaceId })
+				{
+					FAIL_IF(!sendIdentify(constants::identify::CNS_ACTIVE_NAMESPACE_ID_LIST, startingNamespaceId), "Identify Active Namespace ID list timed out");
+					FAIL_IF(completion.SF != 0, "Identify Active Namespace ID list failed with status " + std::to_string(completion.SF));
+					identifyPayload = identifyPrp.getPayloadCopy();
+					UINT_32* namespaceIds = (UINT_32*)identifyPayload.getBuffer();
+					std::vector<UINT_32> expected;
+					for (UINT_32 namespaceId : { (UINT_32)DEFAULT_NAMESPACE_ID, addedNamespaceId })
+					{
+						if (namespaceId > startingNamespaceId)
+						{
+							expected.push_back(namespaceId);
+						}
+					}
+					expected.resize(ACTIVE_NAMESPACE_ID_LIST_ENTRIES, 0);
+					FAIL_IF(memcmp(namespaceIds, expected.data(), IDENTIFY_DATA_SIZE) != 0, "Active Namespace ID list after NSID " + std::to_string(startingNamespaceId) + " is wrong");
+				}
+
+				FAIL_IF(!sendIdentify(0x55, 0), "Identify timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Identify with an unsupported CNS did not fail with invalid field");
+
+				return true;
+			}
+
+			bool testAsynchronousEvents()
+			{
+				namespace async_events = constants::async_events;
+				const UINT_32 addedNamespaceId = 5;
+				const UINT_16 queueSize = 8;
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 16);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				auto setFeature = [&](UINT_8 featureIdentifier, UINT_32 value) {
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.DWord10 = featureIdentifier;
+					setFeatures.DWord11 = value;
+					return adminQueuePair.sendCommand(setFeatures, completion) && completion.SF == 0;
+				};
+				FAIL_IF(!setFeature(constants::features::ASYNCHRONOUS_EVENT_CONFIGURATION,
+					async_events::CONFIGURATION_TEMPERATURE_WARNING | async_events::CONFIGURATION_NAMESPACE_ATTRIBUTE_NOTICES), "Set Features (Asynchronous Event Configuration) failed");
+
+				// Parked requests have no completion, so the first one posted is for the request past the limit
+				command::NVME_COMMAND asyncEventRequest = { 0 };
+				asyncEventRequest.DWord0Breakdown.OPC = constants::opcodes::admin::ASYNCHRONOUS_EVENT_REQUEST;
+				adminQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(ASYNC_EVENT_REQUEST_LIMIT, asyncEventRequest));
+				FAIL_IF(!adminQueuePair.sendCommand(asyncEventRequest, completion), "Asynchronous Event Request timed out");
+				FAIL_IF(completion.SCT != constants::status::types::COMMAND_SPECIFIC || completion.SC != constants::status::codes::specific::ASYNCHRONOUS_EVENT_REQUEST_LIMIT_EXCEEDED,
+					"An Asynchronous Event Request past the limit did not fail: " + completion.toString());
+
+				auto waitForEvent = [&](UINT_8 type, UINT_8 information, UINT_8 logPageIdentifier) {
+					return adminQueuePair.waitForCompletion(completion) && completion.SF == 0 &&
+						completion.DWord0 == (type | ((UINT_32)information << 8) | ((UINT_32)logPageIdentifier << 16));
+				};
+
+				PRP logPrp(Payload(4096), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.NSID = NAMESPACE_ID_ALL;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				auto getLog = [&](UINT_8 logPageIdentifier, bool retainAsynchronousEvent) {
+					getLogPage.DWord10 = logPageIdentifier | (retainAsynchronousEvent << 15) | ((4096 / sizeof(UINT_32) - 1) << 16);
+					return adminQueuePair.sendCommand(getLogPage, completion) && completion.SF == 0;
+				};
+
+				// Namespace Attribute Changed. While it's masked, another namespace change waits.
+				FAIL_IF(!controller.addNamespace(new Namespace(addedNamespaceId, new media::RamMedia(4096, 1024))), "Unable to add a namespace");
+				FAIL_IF(!waitForEvent(async_events::TYPE_NOTICE, async_events::NOTICE_NAMESPACE_ATTRIBUTE_CHANGED, constants::log_pages::CHANGED_NAMESPACE_LIST),
+					"Adding a namespace did not complete an Asynchronous Event Request: " + completion.toString());
+				FAIL_IF(!getLog(constants::log_pages::CHANGED_NAMESPACE_LIST, true), "Get Log Page (Changed Namespace List) failed");
+				FAIL_IF(!controller.addNamespace(new Namespace(addedNamespaceId + 1, new media::RamMedia(4096, 1024))), "Unable to add a namespace");
+				controller.waitForChangeLoop();
+				FAIL_IF(adminQueuePair.hasCompletion(), "A namespace change completed a request while notices were masked (the log page was read with RAE)");
+
+				FAIL_IF(!getLog(constants::log_pages::CHANGED_NAMESPACE_LIST, false), "Get Log Page (Changed Namespace List) failed");
+				logpages::CHANGED_NAMESPACE_LIST_LOG changedNamespaces = { 0 };
+				memcpy(&changedNamespaces, logPrp.getPayloadCopy().getBuffer(), sizeof(changedNamespaces));
+				FAIL_IF(changedNamespaces.NSID[0] != addedNamespaceId || changedNamespaces.NSID[1] != addedNamespaceId + 1 || changedNamespaces.NSID[2] != 0,
+					"Unexpected Changed Namespace List: " + changedNamespaces.toString());
+				FAIL_IF(!waitForEvent(async_events::TYPE_NOTICE, async_events::NOTICE_NAMESPACE_ATTRIBUTE_CHANGED, constants::log_pages::CHANGED_NAMESPACE_LIST),
+					"The waiting notice did not complete a request once unmasked: " + completion.toString());
+				FAIL_IF(!getLog(constants::log_pages::CHANGED_NAMESPACE_LIST, false), "Get Log Page (Changed Namespace List) failed");
+				memcpy(&changedNamespaces, logPrp.getPayloadCopy().getBuffer(), sizeof(changedNamespaces));
+				FAIL_IF(changedNamespaces.NSID[0] != 0, "Reading the Changed Namespace List did not clear it: " + changedNamespaces.toString());
+
+				// SMART / Health: an over temperature threshold below the composite temperature
+				FAIL_IF(!setFeature(constants::features::TEMPERATURE_THRESHOLD, SMART_COMPOSITE_TEMPERATURE - 10), "Set Features (Temperature Threshold) failed");
+				FAIL_IF(!waitForEvent(async_events::TYPE_SMART_HEALTH_STATUS, async_events::SMART_TEMPERATURE_THRESHOLD, constants::log_pages::SMART_HEALTH_INFORMATION),
+					"Crossing the temperature threshold did not complete a request: " + completion.toString());
+				FAIL_IF(!getLog(constants::log_pages::SMART_HEALTH_INFORMATION, false), "Get Log Page (SMART / Health Information) failed");
+				logpages::SMART_HEALTH_INFORMATION_LOG smart = { 0 };
+				memcpy(&smart, logPrp.getPayloadCopy().getBuffer(), sizeof(smart));
+				FAIL_IF(!(smart.CW & async_events::CONFIGURATION_TEMPERATURE_WARNING), "SMART / Health Information has no temperature warning: " + smart.toString());
+
+				// Error: the host writing a tail doorbell past the end of its queue
+				controller::registers::QUEUE_DOORBELLS* doorbells = controller.getControllerRegisters()->getQueueDoorbells();
+				doorbells[ioQueuePair.getQueueId()].SQTDBL.SQT = queueSize + 1;
+				FAIL_IF(!waitForEvent(async_events::TYPE_ERROR_STATUS, async_events::ERROR_INVALID_DOORBELL_WRITE_VALUE, constants::log_pages::ERROR_INFORMATION),
+					"An invalid doorbell write did not complete a request: " + completion.toString());
+				doorbells[ioQueuePair.getQueueId()].SQTDBL.SQT = 0; // Back to where the controller has it
+				FAIL_IF(!getLog(constants::log_pages::ERROR_INFORMATION, false), "Get Log Page (Error Information) failed");
+				logpages::ERROR_INFORMATION_ENTRY error = { 0 };
+				memcpy(&error, logPrp.getPayloadCopy().getBuffer(), sizeof(error));
+				FAIL_IF(error.ERRCNT != 1 || error.SQID != ioQueuePair.getQueueId() || error.CMDID != 0xFFFF || error.CSI != queueSize + 1, "Unexpected Error Information entry: " + error.toString());
+
+				// Every parked request has completed, so nothing is left to complete
+				FAIL_IF(!controller.addNamespace(new Namespace(addedNamespaceId + 2, new media::RamMedia(4096, 1024))), "Unable to add a namespace");
+				controller.waitForChangeLoop();
+				FAIL_IF(adminQueuePair.hasCompletion(), "An event completed a request that was never sent");
+
+				return true;
+			}
+
+			bool testAsynchronousEventsInSmallAdminQueue()
+			{
+				namespace async_events = constants::async_events;
+				const UINT_16 queueSize = ASYNC_EVENT_REQUEST_LIMIT; // AERL + 1
+				const UINT_32 addedNamespaceId = 5;
+				const UINT_32 numberOfResets = 3;
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, queueSize);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				command::NVME_COMMAND setFeatures = { 0 };
+				setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+				setFeatures.DWord10 = constants::features::ASYNCHRONOUS_EVENT_CONFIGURATION;
+				setFeatures.DWord11 = async_events::CONFIGURATION_NAMESPACE_ATTRIBUTE_NOTICES;
+				FAIL_IF(!adminQueuePair.sendCommand(setFeatures, completion) || completion.SF != 0, "Set Features (Asynchronous Event Configuration) failed");
+
+				command::NVME_COMMAND getFeatures = { 0 };
+				getFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::GET_FEATURES;
+				getFeatures.DWord10 = constants::features::ARBITRATION;
+
+				PRP logPrp(Payload(4096), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.NSID = NAMESPACE_ID_ALL;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::CHANGED_NAMESPACE_LIST | ((4096 / sizeof(UINT_32) - 1) << 16);
+
+				command::NVME_COMMAND asyncEventRequest = { 0 };
+				asyncEventRequest.DWord0Breakdown.OPC = constants::opcodes::admin::ASYNCHRONOUS_EVENT_REQUEST;
+				for (UINT_32 reset = 0; reset <= numberOfResets; reset++)
+				{
+					// Park as many requests as the queue holds. Other commands still get through, each pass through the queue a few times.
+					adminQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueSize - 1, asyncEventRequest));
+					controller.waitForChangeLoop();
+					FAIL_IF(adminQueuePair.hasCompletion(), "A parked Asynchronous Event Request completed without an event: " + completion.toString());
+					for (UINT_32 i = 0; i < queueSize * 3; i++)
+					{
+						FAIL_IF(!adminQueuePair.sendCommand(getFeatures, completion), "Get Features timed out with requests parked (after " + std::to_string(reset) + " resets)");
+						FAIL_IF(completion.SF != 0, "Get Features failed: " + completion.toString());
+					}
+
+					// An event completes one of them
+					FAIL_IF(!controller.addNamespace(new Namespace(addedNamespaceId + reset, new media::RamMedia(4096, 1024))), "Unable to add a namespace");
+					FAIL_IF(!adminQueuePair.waitForCompletion(completion), "Adding a namespace did not complete a parked request");
+					FAIL_IF(completion.SF != 0 || completion.DWord0 != (async_events::TYPE_NOTICE | ((UINT_32)async_events::NOTICE_NAMESPACE_ATTRIBUTE_CHANGED << 8) |
+						((UINT_32)constants::log_pages::CHANGED_NAMESPACE_LIST << 16)), "Unexpected Asynchronous Event Request completion: " + completion.toString());
+					FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion) || completion.SF != 0, "Get Log Page (Changed Namespace List) failed");
+
+					// A reset drops the rest without completions. The queue has to be as deep as before afterwards.
+					FAIL_IF(!helpers::disableController(controller), "Controller did not reset");
+					FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready after a reset");
+				}
+
+				return true;
+			}
 		}
 
 		namespace prp
@@ -303,6 +964,1774 @@ namespace cnvme
 			}
 		}
 
+		namespace nvm
+		{
+			bool testReadWrite()
+			{
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				const UINT_32 numberOfBlocks = 8;
+				Payload writePayload(numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE);
+				helpers::randomizePayload(writePayload);
+				PRP writePrp(writePayload, 4096);
+				UINT_64 lba = helpers::randInt(0, DEFAULT_NAMESPACE_SIZE_IN_BLOCKS - numberOfBlocks);
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, lba, numberOfBlocks, writePrp), completion), "Write timed out");
+				FAIL_IF(completion.SF != 0, "Write failed with status " + std::to_string(completion.SF));
+
+				PRP readPrp(Payload(writePayload.getSize()), 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, lba, numberOfBlocks, readPrp), completion), "Read timed out");
+				FAIL_IF(completion.SF != 0, "Read failed with status " + std::to_string(completion.SF));
+				FAIL_IF(readPrp.getPayloadCopy() != writePayload, "Data read back did not match what was written");
+
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, DEFAULT_NAMESPACE_SIZE_IN_BLOCKS - 1, numberOfBlocks, readPrp), completion), "Read timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::LBA_OUT_OF_RANGE, "Read past the end of the namespace did not fail with LBA out of range");
+
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID + 1, 0, numberOfBlocks, readPrp), completion), "Read timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT, "Read of a missing namespace did not fail with invalid namespace");
+
+				return true;
+			}
+
+			bool testCompletionQueueFull()
+			{
+				const UINT_16 queueSize = 4; // Room for 3 completions
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				PRP readPrp(Payload(DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, 1, readPrp);
+				std::vector<command::NVME_COMMAND> reads(queueSize - 1, read);
+
+				// Fill the completion queue without consuming anything
+				ioQueuePair.submitCommands(reads);
+				UINT_64 deathTime = helpers::getTimeInMilliseconds() + TEST_COMMAND_TIMEOUT_MS;
+				while (!ioQueuePair.hasCompletion(queueSize - 2) && helpers::getTimeInMilliseconds() < deathTime)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				FAIL_IF(!ioQueuePair.hasCompletion(queueSize - 2), "The first commands did not complete");
+
+				// Every submission queue entry has been fetched, so there is room for more. Their completions have to wait.
+				ioQueuePair.submitCommands(reads);
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+				FAIL_IF(ioQueuePair.hasCompletion(queueSize - 1), "A completion was posted to a full completion queue");
+
+				// Consuming (and ringing the head doorbell) lets the rest through, in order and with nothing overwritten
+				for (UINT_16 commandId = 0; commandId < reads.size() * 2; commandId++)
+				{
+					command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+					FAIL_IF(!ioQueuePair.waitForCompletion(completion), "Timed out waiting for completion " + std::to_string(commandId));
+					FAIL_IF(completion.CID != commandId || completion.SF != 0, "Unexpected completion: " + completion.toString());
+				}
+
+				return true;
+			}
+
+			bool testInvalidCompletionQueueHead()
+			{
+				namespace async_events = constants::async_events;
+				const UINT_16 queueSize = 8;
+
+				// On its own, with completions reserved: a head past the tail is refused, and free entries never wrap below zero
+				UINT_16 doorbell = 0;
+				Queue completionQueue(queueSize, 1, &doorbell, 0);
+				completionQueue.incrementTailPointer();
+				completionQueue.incrementTailPointer();
+				completionQueue.reserveEntries(queueSize - 3); // Every free entry
+				FAIL_IF(completionQueue.setHeadPointer(3) || completionQueue.getHeadPointer() != 0, "A completion queue head past the tail was accepted");
+				FAIL_IF(completionQueue.getFreeEntries() != 0, "A completion queue with every free entry reserved has free entries");
+				FAIL_IF(!completionQueue.setHeadPointer(2) || completionQueue.getFreeEntries() != 2, "Consuming completions did not free their entries");
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, queueSize);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+
+				// Park some Asynchronous Event Requests, for the error event
+				command::NVME_COMMAND asyncEventRequest = { 0 };
+				asyncEventRequest.DWord0Breakdown.OPC = constants::opcodes::admin::ASYNCHRONOUS_EVENT_REQUEST;
+				adminQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(ASYNC_EVENT_REQUEST_LIMIT, asyncEventRequest));
+				controller.waitForChangeLoop();
+
+				// Everything posted so far is consumed, so one past the tail is a head the host can't have reached
+				controller::registers::QUEUE_DOORBELLS* doorbells = controller.getControllerRegisters()->getQueueDoorbells();
+				UINT_16 head = doorbells[adminQueuePair.getQueueId()].CQHDBL.CQH;
+				doorbells[adminQueuePair.getQueueId()].CQHDBL.CQH = (head + 1) % queueSize;
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				FAIL_IF(!adminQueuePair.waitForCompletion(completion) || completion.SF != 0 ||
+					completion.DWord0 != (async_events::TYPE_ERROR_STATUS | ((UINT_32)async_events::ERROR_INVALID_DOORBELL_WRITE_VALUE << 8) | ((UINT_32)constants::log_pages::ERROR_INFORMATION << 16)),
+					"The head past the tail was not reported: " + completion.toString());
+
+				// Taking the completion rang a valid head. The queue keeps working, in order.
+				command::NVME_COMMAND getFeatures = { 0 };
+				getFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::GET_FEATURES;
+				getFeatures.DWord10 = constants::features::ARBITRATION;
+				for (UINT_16 i = 0; i < queueSize * 2; i++)
+				{
+					FAIL_IF(!adminQueuePair.sendCommand(getFeatures, completion) || completion.SF != 0, "Get Features failed after the invalid head: " + completion.toString());
+				}
+
+				return true;
+			}
+
+			bool testSharedCompletionQueue()
+			{
+				const UINT_16 completionQueueId = 1;
+				const UINT_16 numberOfSubmissionQueues = 4;
+				const UINT_16 readsPerQueue = 3; // All of them fit in the completion queue at once
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+
+				// The first pair owns the completion queue, the rest only use their submission queues
+				std::vector<std::unique_ptr<helpers::HostQueuePair>> ioQueuePairs;
+				for (UINT_16 queueId = completionQueueId; queueId < completionQueueId + numberOfSubmissionQueues; queueId++)
+				{
+					ioQueuePairs.emplace_back(new helpers::HostQueuePair(controller, queueId, 16));
+				}
+				helpers::HostQueuePair &completionQueuePair = *ioQueuePairs.front();
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, completionQueuePair), "Unable to create the I/O queue pair");
+				for (size_t i = 1; i < ioQueuePairs.size(); i++)
+				{
+					FAIL_IF(!helpers::createIoSubmissionQueue(adminQueuePair, *ioQueuePairs[i], completionQueueId), "Unable to create a submission queue on the shared completion queue");
+				}
+				FAIL_IF(helpers::createIoSubmissionQueue(adminQueuePair, *ioQueuePairs.back(), 0), "Created an I/O submission queue on the admin completion queue");
+
+				PRP readPrp(Payload(DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, 1, readPrp);
+
+				// Enough rounds for the completion queue to wrap (and flip its phase tag) a few times
+				for (UINT_16 round = 0; round < 4; round++)
+				{
+					for (auto &ioQueuePair : ioQueuePairs)
+					{
+						ioQueuePair->submitCommands(std::vector<command::NVME_COMMAND>(readsPerQueue, read));
+					}
+
+					std::map<UINT_16, UINT_16> nextCommandIds;
+					for (UINT_16 i = 0; i < readsPerQueue * numberOfSubmissionQueues; i++)
+					{
+						command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+						FAIL_IF(!completionQueuePair.waitForCompletion(completion), "Timed out waiting for a completion on the shared completion queue");
+						FAIL_IF(completion.SF != 0, "Read failed: " + completion.toString());
+						FAIL_IF(completion.SQID < completionQueueId || completion.SQID >= completionQueueId + numberOfSubmissionQueues, "Unexpected SQID: " + completion.toString());
+
+						// Each submission queue's commands still complete in order
+						UINT_16 expectedCommandId = round * readsPerQueue + nextCommandIds[completion.SQID]++;
+						FAIL_IF(completion.CID != expectedCommandId, "Unexpected CID: " + completion.toString());
+					}
+					FAIL_IF(completionQueuePair.hasCompletion(), "More completions were posted than commands were sent");
+				}
+
+				auto deleteQueue = [&](UINT_8 opcode, UINT_16 queueId) {
+					command::NVME_COMMAND deleteCommand = { 0 };
+					deleteCommand.DWord0Breakdown.OPC = opcode;
+					deleteCommand.DWord10 = queueId;
+					command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+					return adminQueuePair.sendCommand(deleteCommand, completion) && completion.SF == 0;
+				};
+
+				for (auto &ioQueuePair : ioQueuePairs)
+				{
+					FAIL_IF(deleteQueue(constants::opcodes::admin::DELETE_IO_COMPLETION_QUEUE, completionQueueId), "Deleted a completion queue that submission queues still use");
+					FAIL_IF(!deleteQueue(constants::opcodes::admin::DELETE_IO_SUBMISSION_QUEUE, ioQueuePair->getQueueId()), "Unable to delete a submission queue");
+				}
+				FAIL_IF(!deleteQueue(constants::opcodes::admin::DELETE_IO_COMPLETION_QUEUE, completionQueueId), "Unable to delete the completion queue after its submission queues");
+
+				return true;
+			}
+
+			bool testArbitrationBurst()
+			{
+				const UINT_16 queueSize = 16;
+				const UINT_16 numberOfReads = 12;
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				command::NVME_COMMAND getFeatures = { 0 };
+				getFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::GET_FEATURES;
+				getFeatures.DWord10 = ((UINT_32)constants::features::SELECT_DEFAULT << 8) | constants::features::ARBITRATION;
+				FAIL_IF(!adminQueuePair.sendCommand(getFeatures, completion), "Get Features timed out");
+				FAIL_IF(completion.SF != 0 || completion.DWord0 != DEFAULT_ARBITRATION_BURST, "Get Features did not report the default Arbitration Burst");
+
+				PRP readPrp(Payload(DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, 1, readPrp);
+
+				// Bursts of 4 (SQ entries 0-11), then no limit, where the entries wrap (12-15 then 0-7) so it takes two bursts
+				UINT_16 head = 0;
+				for (UINT_8 arbitrationBurst : { 2, 7 })
+				{
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.DWord10 = constants::features::ARBITRATION;
+					setFeatures.DWord11 = arbitrationBurst;
+					FAIL_IF(!adminQueuePair.sendCommand(setFeatures, completion) || completion.SF != 0, "Set Features (Arbitration) failed");
+
+					getFeatures.DWord10 = constants::features::ARBITRATION;
+					FAIL_IF(!adminQueuePair.sendCommand(getFeatures, completion), "Get Features timed out");
+					FAIL_IF(completion.SF != 0 || completion.DWord0 != arbitrationBurst, "Get Features did not report the Arbitration Burst that was set");
+
+					ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(numberOfReads, read));
+					UINT_16 burstEnd = head;
+					for (UINT_16 i = 0; i < numberOfReads; i++, head = (head + 1) % queueSize)
+					{
+						if (head == burstEnd)
+						{
+							UINT_16 burst = arbitrationBurst == 7 ? queueSize - head : 1 << arbitrationBurst;
+							burstEnd = (head + std::min(burst, (UINT_16)(numberOfReads - i))) % queueSize;
+						}
+
+						FAIL_IF(!ioQueuePair.waitForCompletion(completion), "Read timed out");
+						FAIL_IF(completion.SF != 0, "Read failed with status " + std::to_string(completion.SF));
+						FAIL_IF(completion.SQHD != burstEnd, "SQHD did not move a burst at a time: " + completion.toString());
+					}
+				}
+
+				return true;
+			}
+
+			bool testPipelineStatistics()
+			{
+				const UINT_16 numberOfReads = 24;
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 32);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				// Each stage is FIFO, so completions come back in the order the commands were submitted
+				PRP readPrp(Payload(DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(numberOfReads, helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, 1, readPrp)));
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				UINT_16 firstCommandId = 0;
+				for (UINT_16 i = 0; i < numberOfReads; i++)
+				{
+					FAIL_IF(!ioQueuePair.waitForCompletion(completion), "Read timed out");
+					FAIL_IF(completion.SF != 0, "Read failed with status " + std::to_string(completion.SF));
+					firstCommandId = i == 0 ? completion.CID : firstCommandId;
+					FAIL_IF(completion.CID != (UINT_16)(firstCommandId + i), "Completions came back out of order: " + completion.toString());
+				}
+
+				PRP logPrp(Payload(4096), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::PIPELINE_STATISTICS | ((sizeof(logpages::PIPELINE_STATISTICS_LOG) / sizeof(UINT_32) - 1) << 16);
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SF != 0, "Get Log Page (Pipeline Statistics) failed with status " + std::to_string(completion.SF));
+
+				Payload logPayload = logPrp.getPayloadCopy();
+				logpages::PPIPELINE_STATISTICS_LOG statistics = (logpages::PPIPELINE_STATISTICS_LOG)logPayload.getBuffer();
+				FAIL_IF(statistics->NS != PIPELINE_STAGES, "Unexpected number of stages: " + statistics->toString());
+				FAIL_IF(statistics->STG[PIPELINE_STAGE_FETCH].CMDS != numberOfReads, "The fetch stage didn't fetch every read once: " + statistics->toString()); // Admin commands are fetched by AdminWatcher
+				for (UINT_32 stage : { PIPELINE_STAGE_EXECUTE, PIPELINE_STAGE_COMPLETE })
+				{
+					const logpages::PIPELINE_STAGE_STATISTICS &stageStatistics = statistics->STG[stage];
+					FAIL_IF(stageStatistics.CMDS != numberOfReads, "Stage " + std::to_string(stage) + " didn't handle every read once: " + statistics->toString());
+					FAIL_IF(stageStatistics.SVCS == 0 || stageStatistics.SVCS > stageStatistics.CMDS, "Stage " + std::to_string(stage) + " has an impossible service count: " + statistics->toString());
+					FAIL_IF(stageStatistics.ICAP != PIPELINE_RING_ENTRIES || stageStatistics.MOCC > stageStatistics.ICAP || stageStatistics.MOCC > numberOfReads,
+						"Stage " + std::to_string(stage) + " has an impossible occupancy: " + statistics->toString());
+				}
+				FAIL_IF(statistics->STG[PIPELINE_STAGE_EXECUTE].STNS == 0, "The execute stage took no time to run the reads: " + statistics->toString());
+
+				return true;
+			}
+
+			bool testWorkStealing()
+			{
+				const UINT_16 queueSize = 64;
+				const UINT_32 numberOfWorkers = 4;
+				const UINT_32 blocksPerRead = 64; // 32 KiB, so each read is worth stealing
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				auto setWorkers = [&](UINT_32 workers) {
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.DWord10 = constants::features::EXECUTOR_WORKERS;
+					setFeatures.DWord11 = workers;
+					return adminQueuePair.sendCommand(setFeatures, completion) && completion.SF == 0;
+				};
+				FAIL_IF(setWorkers(0) || completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Set Features allowed no workers");
+				FAIL_IF(setWorkers(EXECUTOR_MAX_WORKERS + 1) || completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Set Features allowed too many workers");
+				FAIL_IF(!setWorkers(numberOfWorkers), "Set Features (Executor Workers) failed");
+
+				command::NVME_COMMAND getFeatures = { 0 };
+				getFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::GET_FEATURES;
+				getFeatures.DWord10 = constants::features::EXECUTOR_WORKERS;
+				FAIL_IF(!adminQueuePair.sendCommand(getFeatures, completion), "Get Features timed out");
+				FAIL_IF(completion.SF != 0 || completion.DWord0 != numberOfWorkers, "Get Features did not report the workers that were set");
+
+				// All the reads come from one queue, so they all go to one worker and the others only get some by stealing.
+				// Whether any are stolen is up to the scheduler (testChaseLevDeque covers stealing itself), but the counts must add up.
+				PRP readPrp(Payload(blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, blocksPerRead, readPrp);
+				PRP logPrp(Payload(4096), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::EXECUTOR_STATISTICS | ((sizeof(logpages::EXECUTOR_STATISTICS_LOG) / sizeof(UINT_32) - 1) << 16);
+
+				UINT_64 reads = 0;
+				UINT_16 nextCommandId = 0;
+				for (UINT_32 round = 0; round < 4; round++)
+				{
+					// Executed out of order, but completions still come back in the order the commands were submitted
+					ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueSize - 1, read));
+					for (UINT_16 i = 0; i < queueSize - 1; i++, reads++)
+					{
+						FAIL_IF(!ioQueuePair.waitForCompletion(completion), "Read timed out");
+						FAIL_IF(completion.SF != 0, "Read failed with status " + std::to_string(completion.SF));
+						nextCommandId = reads == 0 ? completion.CID : nextCommandId;
+						FAIL_IF(completion.CID != nextCommandId++, "Completions came back out of order: " + completion.toString());
+					}
+				}
+
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SF != 0, "Get Log Page (Executor Statistics) failed with status " + std::to_string(completion.SF));
+				logpages::EXECUTOR_STATISTICS_LOG statistics = { 0 };
+				memcpy(&statistics, logPrp.getPayloadCopy().getBuffer(), sizeof(statistics));
+				FAIL_IF(statistics.NW != numberOfWorkers, "Unexpected number of workers: " + statistics.toString());
+				UINT_64 executed = 0;
+				UINT_64 steals = 0;
+				UINT_64 stolen = 0;
+				for (UINT_32 i = 0; i < EXECUTOR_MAX_WORKERS; i++)
+				{
+					executed += statistics.WRK[i].CMDS;
+					steals += statistics.WRK[i].STLS;
+					stolen += statistics.WRK[i].STLN;
+					FAIL_IF(i >= numberOfWorkers && statistics.WRK[i].CMDS != 0, "A worker that was never started executed commands: " + statistics.toString());
+				}
+				FAIL_IF(executed != reads, "The workers didn't execute each read once: " + statistics.toString());
+				FAIL_IF(stolen != steals, "Steals and commands stolen don't add up: " + statistics.toString());
+
+				return true;
+			}
+
+			bool testAdminBesideIo()
+			{
+				const UINT_16 queueSize = 32;
+				const UINT_32 blocksPerRead = 64;
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+				helpers::HostQueuePair deletedQueuePair(controller, 2, queueSize);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, deletedQueuePair), "Unable to create the I/O queue pair to delete");
+
+				PRP readPrp(Payload(blocksPerRead * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, 0, blocksPerRead, readPrp);
+
+				// An admin storm on its own host thread, while this one keeps reads going
+				std::atomic<bool> readsDone(false);
+				auto adminStorm = std::async(std::launch::async, [&] {
+					PRP identifyPrp(Payload(4096), 4096);
+					command::NVME_COMMAND identify = { 0 };
+					identify.DWord0Breakdown.OPC = constants::opcodes::admin::IDENTIFY;
+					identify.DWord10 = constants::identify::CNS_CONTROLLER;
+					identify.DPTR.DPTR1 = identifyPrp.getPRP1();
+					identify.DPTR.DPTR2 = identifyPrp.getPRP2();
+
+					PRP logPrp(Payload(sizeof(logpages::READ_CACHE_STATISTICS_LOG)), 4096);
+					command::NVME_COMMAND getLogPage = { 0 };
+					getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+					getLogPage.NSID = DEFAULT_NAMESPACE_ID;
+					getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+					getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+					getLogPage.DWord10 = constants::log_pages::READ_CACHE_STATISTICS | ((sizeof(logpages::READ_CACHE_STATISTICS_LOG) / sizeof(UINT_32) - 1) << 16);
+
+					command::COMPLETION_QUEUE_ENTRY adminCompletion = { 0 };
+					UINT_32 commands = 0;
+					while (!readsDone || commands == 0)
+					{
+						for (auto &command : { identify, getLogPage })
+						{
+							if (!adminQueuePair.sendCommand(command, adminCompletion) || adminCompletion.SF != 0)
+							{
+								LOG_ERROR("Admin command failed during I/O: " + adminCompletion.toString());
+								return false;
+							}
+							commands++;
+						}
+					}
+					return true;
+				});
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				bool readsPassed = true;
+				for (UINT_32 round = 0; round < 4 && readsPassed; round++)
+				{
+					ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueSize - 1, read));
+					for (UINT_16 i = 0; i < queueSize - 1 && readsPassed; i++)
+					{
+						readsPassed = ioQueuePair.waitForCompletion(completion) && completion.SF == 0;
+					}
+				}
+				readsDone = true;
+				FAIL_IF(!adminStorm.get(), "The admin storm failed");
+				FAIL_IF(!readsPassed, "A read failed (or timed out) during the admin storm: " + completion.toString());
+
+				// From an untouched queue (so nothing wraps) one burst fetches every read. Once the first completes,
+				//   the rest are in the pipeline when the delete comes.
+				deletedQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueSize - 1, read));
+				FAIL_IF(!deletedQueuePair.waitForCompletion(completion), "Read timed out");
+				command::NVME_COMMAND deleteQueue = { 0 };
+				deleteQueue.DWord0Breakdown.OPC = constants::opcodes::admin::DELETE_IO_SUBMISSION_QUEUE;
+				deleteQueue.DWord10 = deletedQueuePair.getQueueId();
+				FAIL_IF(!adminQueuePair.sendCommand(deleteQueue, completion), "Delete I/O Submission Queue timed out");
+				FAIL_IF(completion.SF != 0, "Delete I/O Submission Queue failed with status " + std::to_string(completion.SF));
+				FAIL_IF(!deletedQueuePair.hasCompletion(queueSize - 3), "The submission queue was deleted before the reads fetched from it completed");
+
+				return true;
+			}
+
+			bool testSmartHealthInformation()
+			{
+				const UINT_32 blocksPerCommand = 100;
+				const UINT_32 writes = 15; // 1500 blocks: 1.5 data units, reported as 2
+				const UINT_32 reads = 25; // 2500 blocks: 2.5 data units, reported as 3
+				const UINT_32 unreadableNamespaceId = DEFAULT_NAMESPACE_ID + 1;
+
+				// Media that takes writes but fails every read
+				class UnreadableMedia : public media::RamMedia
+				{
+				public:
+					UnreadableMedia() : media::RamMedia(DEFAULT_NAMESPACE_BLOCK_SIZE, blocksPerCommand) {}
+					bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override { return false; }
+				};
+
+				Controller controller;
+				FAIL_IF(!controller.addNamespace(new Namespace(unreadableNamespaceId, new UnreadableMedia())), "Unable to add the unreadable namespace");
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair writeQueuePair(controller, 1, 8);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, writeQueuePair), "Unable to create the write queue pair");
+				helpers::HostQueuePair readQueuePair(controller, 2, 8);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, readQueuePair), "Unable to create the read queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				PRP prp(Payload(blocksPerCommand * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				for (UINT_32 i = 0; i < writes; i++)
+				{
+					command::NVME_COMMAND write = helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, i * blocksPerCommand, blocksPerCommand, prp);
+					FAIL_IF(!writeQueuePair.sendCommand(write, completion), "Write timed out");
+					FAIL_IF(completion.SF != 0, "Write failed with status " + std::to_string(completion.SF));
+				}
+				for (UINT_32 i = 0; i < reads; i++)
+				{
+					command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, i * blocksPerCommand, blocksPerCommand, prp);
+					FAIL_IF(!readQueuePair.sendCommand(read, completion), "Read timed out");
+					FAIL_IF(completion.SF != 0, "Read failed with status " + std::to_string(completion.SF));
+				}
+
+				// A failed read is still a host read command, but reads no data
+				command::NVME_COMMAND badRead = helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, DEFAULT_NAMESPACE_SIZE_IN_BLOCKS, blocksPerCommand, prp);
+				FAIL_IF(!readQueuePair.sendCommand(badRead, completion), "Read timed out");
+				FAIL_IF(completion.SF == 0, "Read past the end of the namespace succeeded");
+
+				// So is one the media fails, and that's a media error
+				command::NVME_COMMAND unreadableRead = helpers::makeIoCommand(constants::opcodes::nvm::READ, unreadableNamespaceId, 0, blocksPerCommand, prp);
+				FAIL_IF(!readQueuePair.sendCommand(unreadableRead, completion), "Read timed out");
+				FAIL_IF(completion.SCT != constants::status::types::MEDIA_AND_DATA_INTEGRITY || completion.SC != constants::status::codes::integrity::UNRECOVERED_READ_ERROR,
+					"A read the media failed did not complete with Unrecovered Read Error: " + completion.toString());
+
+				PRP logPrp(Payload(4096), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.NSID = NAMESPACE_ID_ALL;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::SMART_HEALTH_INFORMATION | ((sizeof(logpages::SMART_HEALTH_INFORMATION_LOG) / sizeof(UINT_32) - 1) << 16);
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SF != 0, "Get Log Page (SMART / Health Information) failed with status " + std::to_string(completion.SF));
+				logpages::SMART_HEALTH_INFORMATION_LOG smart = { 0 };
+				memcpy(&smart, logPrp.getPayloadCopy().getBuffer(), sizeof(smart));
+				FAIL_IF(smart.HRC[0] != reads + 2 || smart.HWC[0] != writes, "Unexpected host command counts: " + smart.toString());
+				FAIL_IF(smart.DUR[0] != 3 || smart.DUW[0] != 2, "Unexpected data units: " + smart.toString());
+				FAIL_IF(smart.MEDERR[0] != 1 || smart.PWRC[0] != 1, "Unexpected media errors or power cycles: " + smart.toString());
+				FAIL_IF((smart.CTEMP[0] | (smart.CTEMP[1] << 8)) != SMART_COMPOSITE_TEMPERATURE || smart.AVSP != 100, "Unexpected temperature or spare: " + smart.toString());
+
+				getLogPage.NSID = DEFAULT_NAMESPACE_ID;
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "SMART / Health Information was given for a single namespace");
+
+				getLogPage.NSID = 0;
+				getLogPage.DWord10 = constants::log_pages::SUBMISSION_QUEUE_STATISTICS | ((4096 / sizeof(UINT_32) - 1) << 16);
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SF != 0, "Get Log Page (Submission Queue Statistics) failed with status " + std::to_string(completion.SF));
+				Payload logPayload = logPrp.getPayloadCopy();
+				logpages::PSUBMISSION_QUEUE_STATISTICS_LOG header = (logpages::PSUBMISSION_QUEUE_STATISTICS_LOG)logPayload.getBuffer();
+				logpages::PSUBMISSION_QUEUE_STATISTICS_ENTRY entries = (logpages::PSUBMISSION_QUEUE_STATISTICS_ENTRY)(logPayload.getBuffer() + sizeof(*header));
+				FAIL_IF(header->NE != 3, "Expected entries for the admin, write and read queues: " + header->toString());
+				FAIL_IF(entries[0].SQID != 0 || entries[0].OC == 0 || entries[0].RC != 0 || entries[0].WC != 0, "Unexpected admin queue entry: " + entries[0].toString());
+				FAIL_IF(entries[1].SQID != 1 || entries[1].WC != writes || entries[1].RC != 0 || entries[1].EC != 0 ||
+					entries[1].BW != writes * blocksPerCommand * DEFAULT_NAMESPACE_BLOCK_SIZE, "Unexpected write queue entry: " + entries[1].toString());
+				FAIL_IF(entries[2].SQID != 2 || entries[2].RC != reads + 2 || entries[2].WC != 0 || entries[2].EC != 2 || entries[2].MEC != 1 ||
+					entries[2].BR != reads * blocksPerCommand * DEFAULT_NAMESPACE_BLOCK_SIZE, "Unexpected read queue entry: " + entries[2].toString());
+
+				return true;
+			}
+
+			bool testCopy()
+			{
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				// One whole chunk (shared by the copy) and a small unaligned range (moved by bytes)
+				const UINT_32 blocksPerChunk = MEDIA_CHUNK_SIZE / DEFAULT_NAMESPACE_BLOCK_SIZE;
+				const UINT_64 chunkLba = blocksPerChunk * 4;
+				const UINT_64 smallLba = chunkLba + blocksPerChunk + 3;
+				const UINT_32 smallBlocks = 5;
+				const UINT_64 destinationLba = blocksPerChunk * 16;
+
+				Payload chunkPayload(MEDIA_CHUNK_SIZE);
+				helpers::randomizePayload(chunkPayload);
+				PRP chunkPrp(chunkPayload, 4096);
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, chunkLba, blocksPerChunk, chunkPrp), completion), "Write timed out");
+				FAIL_IF(completion.SF != 0, "Write failed with status " + std::to_string(completion.SF));
+
+				Payload smallPayload(smallBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE);
+				helpers::randomizePayload(smallPayload);
+				PRP smallPrp(smallPayload, 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, smallLba, smallBlocks, smallPrp), completion), "Write timed out");
+				FAIL_IF(completion.SF != 0, "Write failed with status " + std::to_string(completion.SF));
+
+				Payload descriptorPayload(2 * sizeof(command::COPY_SOURCE_RANGE_DESCRIPTOR));
+				command::PCOPY_SOURCE_RANGE_DESCRIPTOR descriptors = (command::PCOPY_SOURCE_RANGE_DESCRIPTOR)descriptorPayload.getBuffer();
+				descriptors[0].SLBA = chunkLba;
+				descriptors[0].NLB = blocksPerChunk - 1;
+				descriptors[1].SLBA = smallLba;
+				descriptors[1].NLB = smallBlocks - 1;
+				PRP descriptorPrp(descriptorPayload, 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::COPY, DEFAULT_NAMESPACE_ID, destinationLba, 2, descriptorPrp), completion), "Copy timed out");
+				FAIL_IF(completion.SF != 0, "Copy failed with status " + std::to_string(completion.SF));
+
+				// Overwrite the source chunk. The copy must keep the old data.
+				Payload overwritePayload(MEDIA_CHUNK_SIZE);
+				helpers::randomizePayload(overwritePayload);
+				PRP overwritePrp(overwritePayload, 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, chunkLba, blocksPerChunk, overwritePrp), completion), "Write timed out");
+				FAIL_IF(completion.SF != 0, "Write failed with status " + std::to_string(completion.SF));
+
+				PRP readPrp(Payload(MEDIA_CHUNK_SIZE + smallPayload.getSize()), 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, destinationLba, blocksPerChunk + smallBlocks, readPrp), completion), "Read timed out");
+				FAIL_IF(completion.SF != 0, "Read failed with status " + std::to_string(completion.SF));
+				Payload readPayload = readPrp.getPayloadCopy();
+				FAIL_IF(memcmp(readPayload.getBuffer(), chunkPayload.getBuffer(), MEDIA_CHUNK_SIZE) != 0, "Copied chunk does not match the original source data");
+				FAIL_IF(memcmp(readPayload.getBuffer() + MEDIA_CHUNK_SIZE, smallPayload.getBuffer(), smallPayload.getSize()) != 0, "Copied small range does not match the source");
+
+				descriptors[0].SLBA = DEFAULT_NAMESPACE_SIZE_IN_BLOCKS - 1;
+				PRP badDescriptorPrp(descriptorPayload, 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::COPY, DEFAULT_NAMESPACE_ID, destinationLba, 2, badDescriptorPrp), completion), "Copy timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::LBA_OUT_OF_RANGE, "Copy from past the end of the namespace did not fail with LBA out of range");
+
+				return true;
+			}
+
+			bool testVolatileWriteCache()
+			{
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::NVME_COMMAND setFeatures = { 0 };
+				setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+				setFeatures.DWord10 = constants::features::VOLATILE_WRITE_CACHE;
+				setFeatures.DWord11 = 1; // WCE
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				FAIL_IF(!adminQueuePair.sendCommand(setFeatures, completion), "Set Features timed out");
+				FAIL_IF(completion.SF != 0, "Set Features (Volatile Write Cache) failed with status " + std::to_string(completion.SF));
+
+				command::NVME_COMMAND getFeatures = { 0 };
+				getFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::GET_FEATURES;
+				getFeatures.DWord10 = constants::features::VOLATILE_WRITE_CACHE;
+				FAIL_IF(!adminQueuePair.sendCommand(getFeatures, completion), "Get Features timed out");
+				FAIL_IF(completion.SF != 0 || completion.DWord0 != 1, "Get Features did not report the write cache as enabled");
+
+				// Two adjacent writes, which should coalesce in the cache
+				const UINT_32 numberOfBlocks = 8;
+				UINT_64 lba = helpers::randInt(0, DEFAULT_NAMESPACE_SIZE_IN_BLOCKS - numberOfBlocks * 2);
+				Payload writePayload(numberOfBlocks * 2 * DEFAULT_NAMESPACE_BLOCK_SIZE);
+				helpers::randomizePayload(writePayload);
+				for (UINT_32 i = 0; i < 2; i++)
+				{
+					PRP writePrp(Payload(writePayload.getBuffer() + i * numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE, numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+					FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, lba + i * numberOfBlocks, numberOfBlocks, writePrp), completion), "Write timed out");
+					FAIL_IF(completion.SF != 0, "Write failed with status " + std::to_string(completion.SF));
+				}
+
+				PRP readPrp(Payload(writePayload.getSize()), 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, lba, numberOfBlocks * 2, readPrp), completion), "Read timed out");
+				FAIL_IF(completion.SF != 0, "Read failed with status " + std::to_string(completion.SF));
+				FAIL_IF(readPrp.getPayloadCopy() != writePayload, "Data read back through the write cache did not match what was written");
+
+				command::NVME_COMMAND flush = { 0 };
+				flush.DWord0Breakdown.OPC = constants::opcodes::nvm::FLUSH;
+				flush.NSID = NAMESPACE_ID_ALL;
+				FAIL_IF(!ioQueuePair.sendCommand(flush, completion), "Flush timed out");
+				FAIL_IF(completion.SF != 0, "Flush failed with status " + std::to_string(completion.SF));
+
+				Namespace* theNamespace = controller.getNamespace(DEFAULT_NAMESPACE_ID);
+				FAIL_IF(theNamespace->getWriteCache()->getDirtyBytes() != 0, "Flush left dirty data in the write cache");
+				Payload mediaPayload(writePayload.getSize());
+				theNamespace->getBackingMedia()->read(lba, numberOfBlocks * 2, mediaPayload.getBuffer());
+				FAIL_IF(mediaPayload != writePayload, "Data was not on the backing media after Flush");
+
+				setFeatures.DWord11 = 0;
+				FAIL_IF(!adminQueuePair.sendCommand(setFeatures, completion), "Set Features timed out");
+				FAIL_IF(theNamespace->getWriteCache()->isEnabled(), "Write cache still enabled after turning WCE off");
+
+				setFeatures.DWord10 |= 1u << 31; // Save
+				FAIL_IF(!adminQueuePair.sendCommand(setFeatures, completion), "Set Features timed out");
+				FAIL_IF(completion.SC != constants::status::codes::specific::FEATURE_IDENTIFIER_NOT_SAVEABLE, "Saving the write cache feature should fail");
+
+				return true;
+			}
+
+			bool testReadCache()
+			{
+				const UINT_32 namespaceId = 2;
+				const UINT_32 blockSize = 512;
+				const UINT_32 blocksPerRead = 8;
+				const UINT_32 numberOfReads = 128;
+
+				Controller controller;
+				FAIL_IF(!controller.addNamespace(new Namespace(namespaceId, new media::FtlMedia(blockSize, 4096, 16, 2))), "Unable to add the FTL namespace");
+				Namespace* theNamespace = controller.getNamespace(namespaceId);
+				FAIL_IF(theNamespace->getReadCache()->isEnabled(), "The read cache should start off");
+
+				Payload expected(blocksPerRead * numberOfReads * blockSize);
+				helpers::randomizePayload(expected);
+				FAIL_IF(!theNamespace->getMedia()->write(0, blocksPerRead * numberOfReads, expected.getBuffer()), "Unable to fill the namespace");
+
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::NVME_COMMAND setFeatures = { 0 };
+				setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+				setFeatures.DWord10 = constants::features::READ_CACHE;
+				setFeatures.DWord11 = 1;
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				FAIL_IF(!adminQueuePair.sendCommand(setFeatures, completion), "Set Features timed out");
+				FAIL_IF(completion.SF != 0 || !theNamespace->getReadCache()->isEnabled(), "Set Features (Read Cache) did not turn the read cache on");
+
+				for (UINT_32 i = 0; i < numberOfReads; i++)
+				{
+					PRP readPrp(Payload(blocksPerRead * blockSize), 4096);
+					FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, namespaceId, i * blocksPerRead, blocksPerRead, readPrp), completion), "Read timed out");
+					FAIL_IF(completion.SF != 0, "Read failed with status " + std::to_string(completion.SF));
+					FAIL_IF(memcmp(readPrp.getPayloadCopy().getBuffer(), expected.getBuffer() + i * blocksPerRead * blockSize, blocksPerRead * blockSize) != 0,
+						"Read " + std::to_string(i) + " of the sequential stream returned the wrong data");
+				}
+
+				// Overwrite a cached line. The next read has to see the new data.
+				Payload newData(blocksPerRead * blockSize);
+				helpers::randomizePayload(newData);
+				PRP writePrp(newData, 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, namespaceId, blocksPerRead, blocksPerRead, writePrp), completion), "Write timed out");
+				PRP readPrp(Payload(blocksPerRead * blockSize), 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, namespaceId, blocksPerRead, blocksPerRead, readPrp), completion), "Read timed out");
+				FAIL_IF(readPrp.getPayloadCopy() != newData, "Read after overwriting a cached line returned stale data");
+
+				PRP logPrp(Payload(sizeof(logpages::READ_CACHE_STATISTICS_LOG)), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.NSID = namespaceId;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::READ_CACHE_STATISTICS | ((sizeof(logpages::READ_CACHE_STATISTICS_LOG) / sizeof(UINT_32) - 1) << 16);
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SF != 0, "Get Log Page failed with status " + std::to_string(completion.SF));
+
+				Payload logPayload = logPrp.getPayloadCopy();
+				logpages::PREAD_CACHE_STATISTICS_LOG statistics = (logpages::PREAD_CACHE_STATISTICS_LOG)logPayload.getBuffer();
+				FAIL_IF(statistics->HRB != blocksPerRead * (numberOfReads + 1), "Host read blocks does not match what was read");
+				FAIL_IF(statistics->SSD != 1, "One sequential stream should have been detected");
+				FAIL_IF(statistics->PL == 0 || statistics->UPL == 0, "The sequential stream should have been read ahead, and the readahead used");
+				FAIL_IF(statistics->HR < 900, "A sequential stream should mostly hit in the read cache. Hit ratio (x1000): " + std::to_string(statistics->HR));
+				FAIL_IF(statistics->IL == 0, "The overwrite should have invalidated a cached line");
+
+				return true;
+			}
+
+			bool testFormatAndSanitize()
+			{
+				const UINT_32 hugeNamespaceId = 2;
+				const UINT_64 hugeNamespaceBlocks = 1ull << 34; // 8 TiB (sparse)
+				const UINT_32 numberOfBlocks = 8;
+
+				Controller controller;
+				FAIL_IF(!controller.addNamespace(new Namespace(hugeNamespaceId, new media::RamMedia(DEFAULT_NAMESPACE_BLOCK_SIZE, hugeNamespaceBlocks))), "Unable to add the huge namespace");
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				// Data at the start, middle and end of the huge namespace, plus some in the default namespace
+				Payload writePayload(numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE);
+				helpers::randomizePayload(writePayload);
+				PRP writePrp(writePayload, 4096);
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				const UINT_64 hugeLbas[] = { 0, hugeNamespaceBlocks / 2, hugeNamespaceBlocks - numberOfBlocks };
+				for (UINT_64 lba : hugeLbas)
+				{
+					FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, hugeNamespaceId, lba, numberOfBlocks, writePrp), completion), "Write timed out");
+					FAIL_IF(completion.SF != 0, "Write failed with status " + std::to_string(completion.SF));
+				}
+				UINT_64 defaultLba = helpers::randInt(0, DEFAULT_NAMESPACE_SIZE_IN_BLOCKS - numberOfBlocks);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, defaultLba, numberOfBlocks, writePrp), completion), "Write timed out");
+
+				command::NVME_COMMAND formatNvm = { 0 };
+				formatNvm.DWord0Breakdown.OPC = constants::opcodes::admin::FORMAT_NVM;
+				formatNvm.NSID = hugeNamespaceId;
+				formatNvm.DWord10 = constants::format_nvm::SES_USER_DATA_ERASE << 9;
+				FAIL_IF(!adminQueuePair.sendCommand(formatNvm, completion), "Format NVM timed out");
+				FAIL_IF(completion.SF != 0, "Format NVM failed with status " + std::to_string(completion.SF));
+
+				Payload zeros(writePayload.getSize());
+				for (UINT_64 lba : hugeLbas)
+				{
+					PRP readPrp(Payload(writePayload.getSize()), 4096);
+					FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, hugeNamespaceId, lba, numberOfBlocks, readPrp), completion), "Read timed out");
+					FAIL_IF(readPrp.getPayloadCopy() != zeros, "LBA " + std::to_string(lba) + " was not zero after Format NVM");
+				}
+				PRP readPrp(Payload(writePayload.getSize()), 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, defaultLba, numberOfBlocks, readPrp), completion), "Read timed out");
+				FAIL_IF(readPrp.getPayloadCopy() != writePayload, "Formatting one namespace changed another");
+
+				// The stale chunks are freed in the background
+				media::RamMedia* hugeMedia = dynamic_cast<media::RamMedia*>(controller.getNamespace(hugeNamespaceId)->getBackingMedia());
+				FAIL_IF(hugeMedia->getGeneration() != 1, "Format NVM should have bumped the media generation once");
+				UINT_64 start = helpers::getTimeInMilliseconds();
+				while (hugeMedia->getNumberOfAllocatedChunks() != 0 && helpers::getTimeInMilliseconds() - start < 10000)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				FAIL_IF(hugeMedia->getNumberOfAllocatedChunks() != 0, "Stale chunks were not reclaimed after Format NVM");
+
+				formatNvm.DWord10 = 1; // LBA format 1 doesn't exist
+				FAIL_IF(!adminQueuePair.sendCommand(formatNvm, completion), "Format NVM timed out");
+				FAIL_IF(completion.SCT != constants::status::types::COMMAND_SPECIFIC || completion.SC != constants::status::codes::specific::INVALID_FORMAT,
+					"Format NVM to an unsupported LBA format should fail with Invalid Format");
+
+				command::NVME_COMMAND sanitize = { 0 };
+				sanitize.DWord0Breakdown.OPC = constants::opcodes::admin::SANITIZE;
+				sanitize.DWord10 = constants::sanitize::BLOCK_ERASE;
+				FAIL_IF(!adminQueuePair.sendCommand(sanitize, completion), "Sanitize timed out");
+				FAIL_IF(completion.SF != 0, "Sanitize failed with status " + std::to_string(completion.SF));
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, DEFAULT_NAMESPACE_ID, defaultLba, numberOfBlocks, readPrp), completion), "Read timed out");
+				FAIL_IF(readPrp.getPayloadCopy() != zeros, "Data survived a Sanitize block erase");
+
+				PRP logPrp(Payload(sizeof(logpages::SANITIZE_STATUS_LOG)), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::SANITIZE_STATUS | ((sizeof(logpages::SANITIZE_STATUS_LOG) / sizeof(UINT_32) - 1) << 16);
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SF != 0, "Get Log Page (Sanitize Status) failed with status " + std::to_string(completion.SF));
+				Payload logPayload = logPrp.getPayloadCopy();
+				logpages::PSANITIZE_STATUS_LOG sanitizeStatus = (logpages::PSANITIZE_STATUS_LOG)logPayload.getBuffer();
+				FAIL_IF(sanitizeStatus->SOS != constants::sanitize::STATUS_COMPLETED || sanitizeStatus->SPROG != 0xFFFF || sanitizeStatus->SCDW10 != sanitize.DWord10,
+					"Sanitize Status log does not show the completed block erase");
+
+				sanitize.DWord10 = constants::sanitize::OVERWRITE;
+				FAIL_IF(!adminQueuePair.sendCommand(sanitize, completion), "Sanitize timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Sanitize overwrite is not supported and should fail");
+
+				return true;
+			}
+
+			bool testNamespaceClone()
+			{
+				const UINT_32 cloneNamespaceId = 2;
+				const UINT_32 goldenBlocks = 2048; // 16 chunks
+				const UINT_32 numberOfBlocks = 8;
+
+				// The golden image, with its last write still in the write cache
+				std::unique_ptr<Namespace> golden(new Namespace(DEFAULT_NAMESPACE_ID, new media::RamMedia(DEFAULT_NAMESPACE_BLOCK_SIZE, DEFAULT_NAMESPACE_SIZE_IN_BLOCKS)));
+				Payload goldenPayload(goldenBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE);
+				helpers::randomizePayload(goldenPayload);
+				FAIL_IF(!golden->getMedia()->write(0, goldenBlocks - numberOfBlocks, goldenPayload.getBuffer()), "Unable to write the golden image");
+				golden->getWriteCache()->setEnabled(true);
+				FAIL_IF(!golden->getMedia()->write(goldenBlocks - numberOfBlocks, numberOfBlocks, goldenPayload.getBuffer() + (goldenBlocks - numberOfBlocks) * DEFAULT_NAMESPACE_BLOCK_SIZE),
+					"Unable to write the golden image");
+
+				std::unique_ptr<Namespace> clone(golden->clone(cloneNamespaceId));
+				FAIL_IF(!clone, "Unable to clone the golden namespace");
+				FAIL_IF(clone->getNamespaceId() != cloneNamespaceId || clone->getNumberOfBlocks() != golden->getNumberOfBlocks(), "The clone has the wrong NSID or size");
+				media::RamMedia* goldenMedia = dynamic_cast<media::RamMedia*>(golden->getBackingMedia());
+				media::RamMedia* cloneMedia = dynamic_cast<media::RamMedia*>(clone->getBackingMedia());
+				FAIL_IF(goldenMedia->getNumberOfSharedChunks() != 16 || cloneMedia->getNumberOfSharedChunks() != 16, "The clone should share every chunk with the golden image");
+
+				Payload readPayload(goldenPayload.getSize());
+				FAIL_IF(!clone->getMedia()->read(0, goldenBlocks, readPayload.getBuffer()) || readPayload != goldenPayload, "The clone does not match the golden image");
+
+				// Writing the clone only diverges the chunk written
+				Payload writePayload(numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE);
+				helpers::randomizePayload(writePayload);
+				FAIL_IF(!clone->getMedia()->write(0, numberOfBlocks, writePayload.getBuffer()), "Unable to write the clone");
+				FAIL_IF(cloneMedia->getNumberOfSharedChunks() != 15, "Writing the clone should have given it a private copy of one chunk");
+				FAIL_IF(!golden->getMedia()->read(0, goldenBlocks, readPayload.getBuffer()) || readPayload != goldenPayload, "Writing the clone changed the golden image");
+
+				// As does writing the golden image. The clone keeps what it had.
+				FAIL_IF(!golden->getMedia()->write(goldenBlocks / 2, numberOfBlocks, writePayload.getBuffer()), "Unable to write the golden image");
+				FAIL_IF(!golden->getMedia()->flush(), "Unable to flush the golden image");
+				FAIL_IF(cloneMedia->getNumberOfSharedChunks() != 14, "Writing the golden image should have given it a private copy of one chunk");
+
+				// The clone outlives the image it came from
+				golden.reset();
+				Payload expected = goldenPayload;
+				memcpy(expected.getBuffer(), writePayload.getBuffer(), writePayload.getSize());
+				FAIL_IF(!clone->getMedia()->read(0, goldenBlocks, readPayload.getBuffer()) || readPayload != expected, "The clone changed after the golden image was written and destroyed");
+				FAIL_IF(cloneMedia->getNumberOfSharedChunks() != 0, "Nothing should be shared once the golden image is gone");
+
+				return true;
+			}
+
+			bool testJournaledMedia()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_64 numberOfBlocks = 64 * 1024;
+				const UINT_64 journalSize = 2 * 1024 * 1024;
+				const int numberOfThreads = 4;
+				const int writesPerThread = 32;
+				const std::string name = "cNVMe_journal_test_" + std::to_string(helpers::randInt(0, UINT32_MAX));
+				const std::string paths[] = { name + ".bin", name + ".journal", name + "_crash.bin", name + "_crash.journal" };
+				auto copyFile = [](const std::string &from, const std::string &to) {
+					std::ifstream source(from, std::ios::binary);
+					std::ofstream destination(to, std::ios::binary | std::ios::trunc);
+					destination << source.rdbuf();
+				};
+
+				bool passed = [&]() {
+					media::JournaledMedia journaled(new media::FileMedia(paths[0], blockSize, numberOfBlocks), paths[1], journalSize);
+					FAIL_IF(!journaled.isOpen(), "Unable to open the journal");
+
+					// Overlapping writes and a deallocate, all in the journal
+					Payload expected(16 * blockSize);
+					helpers::randomizePayload(expected);
+					Payload overwrite(8 * blockSize);
+					helpers::randomizePayload(overwrite);
+					FAIL_IF(!journaled.write(0, 16, expected.getBuffer()), "Journaled write failed");
+					FAIL_IF(!journaled.write(8, 8, overwrite.getBuffer()), "Journaled write failed");
+					FAIL_IF(!journaled.deallocate(2, 2), "Journaled deallocate failed");
+					memcpy(expected.getBuffer() + 8 * blockSize, overwrite.getBuffer(), overwrite.getSize());
+					memset(expected.getBuffer() + 2 * blockSize, 0, 2 * blockSize);
+					FAIL_IF(!journaled.flush(), "Journaled flush failed");
+
+					Payload readPayload(expected.getSize());
+					FAIL_IF(!journaled.read(0, 16, readPayload.getBuffer()) || readPayload != expected, "Journaled data did not read back");
+
+					// Crash now: take the files as they are, plus a torn record after the last good one
+					copyFile(paths[0], paths[2]);
+					copyFile(paths[1], paths[3]);
+					{
+						media::FileMedia crashedJournal(paths[3], 1, journalSize);
+						media::JOURNAL_RECORD torn = { JOURNAL_RECORD_MAGIC, 0, 4, 100, 8, media::JOURNAL_RECORD_TYPE_WRITE };
+						UINT_64 tornOffset = 3 * sizeof(media::JOURNAL_RECORD) + 24 * blockSize;
+						FAIL_IF(!crashedJournal.write(tornOffset, sizeof(torn), (BYTE*)&torn), "Unable to tear the journal");
+					}
+					{
+						media::JournaledMedia recovered(new media::FileMedia(paths[2], blockSize, numberOfBlocks), paths[3], journalSize);
+						FAIL_IF(recovered.getNumberOfRecoveredRecords() != 3, "Expected the 3 good journal records to be recovered, not " + std::to_string(recovered.getNumberOfRecoveredRecords()));
+						FAIL_IF(!recovered.read(0, 16, readPayload.getBuffer()) || readPayload != expected, "Recovered data does not match what was flushed");
+						Payload tornRead(8 * blockSize);
+						FAIL_IF(!recovered.read(100, 8, tornRead.getBuffer()) || tornRead != Payload(8 * blockSize), "The torn record was replayed");
+					}
+
+					// Concurrent writes with flushes share syncs
+					std::vector<std::thread> threads;
+					std::atomic<bool> failed(false);
+					for (int t = 0; t < numberOfThreads; t++)
+					{
+						threads.emplace_back([&, t]() {
+							for (int i = 0; i < writesPerThread; i++)
+							{
+								UINT_64 lba = 1024 + (t * writesPerThread + i) * 8;
+								failed = failed || !journaled.write(lba, 8, overwrite.getBuffer()) || !journaled.flush();
+							}
+						});
+					}
+					for (auto &thread : threads)
+					{
+						thread.join();
+					}
+					FAIL_IF(failed, "Concurrent journaled write or flush failed");
+					FAIL_IF(journaled.getNumberOfCommits() > journaled.getNumberOfCommitRequests(), "More journal syncs than flushes");
+
+					// Filling the journal checkpoints it to the home media
+					UINT_64 checkpoints = journaled.getNumberOfCheckpoints();
+					Payload big(JOURNAL_MAX_RECORD_DATA_SIZE);
+					helpers::randomizePayload(big);
+					UINT_32 bigBlocks = (UINT_32)(big.getSize() / blockSize);
+					for (UINT_64 i = 0; i < 3; i++)
+					{
+						FAIL_IF(!journaled.write(numberOfBlocks / 2 + i * bigBlocks, bigBlocks, big.getBuffer()), "Journaled write failed");
+					}
+					FAIL_IF(journaled.getNumberOfCheckpoints() == checkpoints, "Filling the journal should have checkpointed it");
+					Payload bigRead(big.getSize());
+					FAIL_IF(!journaled.read(numberOfBlocks / 2, bigBlocks, bigRead.getBuffer()) || bigRead != big, "Checkpointed data did not read back");
+					FAIL_IF(!journaled.read(0, 16, readPayload.getBuffer()) || readPayload != expected, "Checkpointed data did not read back");
+					return true;
+				}();
+
+				for (const std::string &path : paths)
+				{
+					std::remove(path.c_str());
+				}
+				return passed;
+			}
+
+			bool testDedupMedia()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_32 numberOfBlocks = 64;
+				media::DedupMedia dedup(blockSize, 1ull << 34); // 8 TiB
+
+				// 16 copies each of two patterns, then zeros
+				Payload patterns(2 * blockSize);
+				helpers::randomizePayload(patterns);
+				patterns.getBuffer()[0] = 1; // Neither pattern can be all zeros
+				patterns.getBuffer()[blockSize] = 2;
+				Payload expected(numberOfBlocks * blockSize);
+				for (UINT_32 i = 0; i < 32; i++)
+				{
+					memcpy(expected.getBuffer() + i * blockSize, patterns.getBuffer() + (i % 2) * blockSize, blockSize);
+				}
+				FAIL_IF(!dedup.write(0, numberOfBlocks, expected.getBuffer()), "Dedup write failed");
+
+				Payload readPayload(expected.getSize());
+				FAIL_IF(!dedup.read(0, numberOfBlocks, readPayload.getBuffer()) || readPayload != expected, "Deduplicated data did not read back");
+				logpages::DEDUP_STATISTICS_LOG statistics = dedup.getStatistics();
+				FAIL_IF(statistics.UB != 2 || statistics.MB != 32 || statistics.ZBW != 32 || statistics.DBW != 30 || statistics.DR != 16000,
+					"Expected 2 unique blocks for 32 mapped ones: " + statistics.toString());
+
+				// Overwriting one copy stores a third block. Copying shares blocks. Dropping every copy of a pattern frees it.
+				Payload unique(blockSize);
+				helpers::randomizePayload(unique);
+				unique.getBuffer()[0] = 3;
+				FAIL_IF(!dedup.write(4, 1, unique.getBuffer()), "Dedup write failed");
+				memcpy(expected.getBuffer() + 4 * blockSize, unique.getBuffer(), blockSize);
+				FAIL_IF(!dedup.copy(0, 1ull << 33, numberOfBlocks), "Dedup copy failed");
+				FAIL_IF(dedup.getStatistics().UB != 3, "A copy should not store any new blocks");
+				for (UINT_32 i = 1; i < 32; i += 2)
+				{
+					FAIL_IF(!dedup.deallocate(i, 1) || !dedup.deallocate((1ull << 33) + i, 1), "Dedup deallocate failed");
+					memset(expected.getBuffer() + i * blockSize, 0, blockSize);
+				}
+				statistics = dedup.getStatistics();
+				FAIL_IF(statistics.UB != 2 || statistics.MB != 32, "Deallocating every copy of a pattern should have freed it: " + statistics.toString());
+				FAIL_IF(!dedup.read(0, numberOfBlocks, readPayload.getBuffer()) || readPayload != expected, "Deduplicated data did not read back");
+				FAIL_IF(!dedup.read(1ull << 33, numberOfBlocks, readPayload.getBuffer()) || readPayload != expected, "Copied data did not read back");
+
+				// Overlapping copy behaves like memmove
+				FAIL_IF(!dedup.copy(0, 2, numberOfBlocks), "Dedup copy failed");
+				FAIL_IF(!dedup.read(2, numberOfBlocks, readPayload.getBuffer()) || readPayload != expected, "Overlapping copy did not read back");
+
+				FAIL_IF(!dedup.format() || dedup.getStatistics().UB != 0 || dedup.getStatistics().MB != 0, "Format should drop every stored block");
+				return true;
+			}
+
+			bool testTieredMedia()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_64 segmentBlocks = TIER_SEGMENT_SIZE / blockSize;
+				const UINT_64 numberOfBlocks = segmentBlocks * 1024;
+				media::TieredMedia* tiered = new media::TieredMedia(new media::RamMedia(blockSize, numberOfBlocks), new media::RamMedia(blockSize, numberOfBlocks), segmentBlocks * 2);
+
+				FAIL_IF(media::TieredMedia::getHint(0) != media::TIER_HINT_NONE || media::TieredMedia::getHint(0x05) != media::TIER_HINT_HOT ||
+					media::TieredMedia::getHint(0x30) != media::TIER_HINT_HOT || media::TieredMedia::getHint(0x02) != media::TIER_HINT_COLD ||
+					media::TieredMedia::getHint(0x15) != media::TIER_HINT_COLD, "Context attributes were not converted to the right hints");
+
+				// Three segments: the first two fill the fast tier, the third goes to the slow tier
+				Payload expected(segmentBlocks * 3 * blockSize);
+				helpers::randomizePayload(expected);
+				FAIL_IF(!tiered->write(0, (UINT_32)(segmentBlocks * 3), expected.getBuffer()), "Tiered write failed");
+				FAIL_IF(!tiered->isFast(0) || !tiered->isFast(segmentBlocks) || tiered->isFast(segmentBlocks * 2), "New segments should fill the fast tier first");
+
+				// Heating up the slow segment swaps it with a colder fast one
+				Payload readPayload(expected.getSize());
+				for (int i = 0; i < TIER_PROMOTION_HEAT; i++)
+				{
+					FAIL_IF(!tiered->read(segmentBlocks * 2, 1, readPayload.getBuffer()), "Tiered read failed");
+				}
+				logpages::TIERING_STATISTICS_LOG statistics = tiered->getStatistics();
+				FAIL_IF(!tiered->isFast(segmentBlocks * 2) || statistics.PS != 1 || statistics.DS != 1 || statistics.FSR != 2, "The hot segment was not promoted: " + statistics.toString());
+				FAIL_IF(!tiered->read(0, (UINT_32)(segmentBlocks * 3), readPayload.getBuffer()) || readPayload != expected, "Data changed while moving between tiers");
+
+				// Cold hints demote right away and stop promotion. Hot hints promote right away and stop demotion.
+				FAIL_IF(!tiered->hint(segmentBlocks * 2, 1, 0x02), "Tiered hint failed");
+				for (int i = 0; i < TIER_PROMOTION_HEAT * 2; i++)
+				{
+					FAIL_IF(!tiered->read(segmentBlocks * 2, 1, readPayload.getBuffer()), "Tiered read failed");
+				}
+				FAIL_IF(tiered->isFast(segmentBlocks * 2) || tiered->getStatistics().HDS != 1, "The cold hinted segment should stay in the slow tier");
+				FAIL_IF(!tiered->hint(0, segmentBlocks * 2, 0x30), "Tiered hint failed");
+				FAIL_IF(!tiered->isFast(0) || !tiered->isFast(segmentBlocks) || tiered->getStatistics().HPS != 1, "The hot hinted segments should be in the fast tier");
+				FAIL_IF(!tiered->write(segmentBlocks * 3, 1, expected.getBuffer()), "Tiered write failed");
+				for (int i = 0; i < TIER_PROMOTION_HEAT * 2; i++)
+				{
+					FAIL_IF(!tiered->read(segmentBlocks * 3, 1, readPayload.getBuffer()), "Tiered read failed");
+				}
+				FAIL_IF(tiered->isFast(segmentBlocks * 3), "Heat should never demote a hot hinted segment");
+				readPayload = Payload(expected.getSize());
+				FAIL_IF(!tiered->read(0, (UINT_32)(segmentBlocks * 3), readPayload.getBuffer()) || readPayload != expected, "Data changed while moving between tiers");
+
+				// The same through Dataset Management: clearing the hints then a cold hint on the first segment and a deallocate of the second
+				Controller controller;
+				const UINT_32 tieredNamespaceId = 2;
+				FAIL_IF(!controller.addNamespace(new Namespace(tieredNamespaceId, tiered)), "Unable to add the tiered namespace");
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				Payload rangePayload(2 * sizeof(command::DATASET_MANAGEMENT_RANGE));
+				command::PDATASET_MANAGEMENT_RANGE ranges = (command::PDATASET_MANAGEMENT_RANGE)rangePayload.getBuffer();
+				ranges[0].CATTR = 0x02;
+				ranges[0].NLB = (UINT_32)segmentBlocks;
+				ranges[0].SLBA = 0;
+				ranges[1].CATTR = 0;
+				ranges[1].NLB = (UINT_32)segmentBlocks;
+				ranges[1].SLBA = segmentBlocks;
+				PRP rangePrp(rangePayload, 4096);
+				command::NVME_COMMAND datasetManagement = helpers::makeIoCommand(constants::opcodes::nvm::DATASET_MANAGEMENT, tieredNamespaceId, 0, 1, rangePrp);
+				datasetManagement.DWord10 = 2 - 1; // NR (0-based)
+				datasetManagement.DWord11 = 0;
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				FAIL_IF(!ioQueuePair.sendCommand(datasetManagement, completion), "Dataset Management timed out");
+				FAIL_IF(completion.SF != 0, "Dataset Management failed with status " + std::to_string(completion.SF));
+				FAIL_IF(tiered->isFast(0) || !tiered->isFast(segmentBlocks), "Dataset Management context attributes were not applied");
+
+				ranges[0].NLB = 0; // Nothing
+				PRP deallocatePrp(rangePayload, 4096);
+				datasetManagement = helpers::makeIoCommand(constants::opcodes::nvm::DATASET_MANAGEMENT, tieredNamespaceId, 0, 1, deallocatePrp);
+				datasetManagement.DWord10 = 2 - 1;
+				datasetManagement.DWord11 = 1 << 2; // AD
+				FAIL_IF(!ioQueuePair.sendCommand(datasetManagement, completion), "Dataset Management timed out");
+				FAIL_IF(completion.SF != 0, "Dataset Management failed with status " + std::to_string(completion.SF));
+				memset(expected.getBuffer() + segmentBlocks * blockSize, 0, (size_t)(segmentBlocks * blockSize));
+				FAIL_IF(!tiered->read(0, (UINT_32)(segmentBlocks * 3), readPayload.getBuffer()) || readPayload != expected, "Dataset Management deallocate did not zero just the second segment");
+
+				ranges[1].SLBA = numberOfBlocks - 1;
+				PRP badRangePrp(rangePayload, 4096);
+				datasetManagement = helpers::makeIoCommand(constants::opcodes::nvm::DATASET_MANAGEMENT, tieredNamespaceId, 0, 1, badRangePrp);
+				datasetManagement.DWord10 = 2 - 1;
+				datasetManagement.DWord11 = 0;
+				FAIL_IF(!ioQueuePair.sendCommand(datasetManagement, completion), "Dataset Management timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::LBA_OUT_OF_RANGE, "A range past the end of the namespace did not fail with LBA out of range");
+
+				return true;
+			}
+
+			bool testQos()
+			{
+				const UINT_32 namespaceId = DEFAULT_NAMESPACE_ID;
+				const UINT_32 blockSize = DEFAULT_NAMESPACE_BLOCK_SIZE;
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair limitedQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, limitedQueuePair), "Unable to create the limited I/O queue pair");
+				helpers::HostQueuePair otherQueuePair(controller, 2, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, otherQueuePair), "Unable to create the other I/O queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				auto setLimits = [&](UINT_32 nsid, UINT_16 submissionQueueId, UINT_32 iops, UINT_32 kibPerSecond) {
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.NSID = nsid;
+					setFeatures.DWord10 = constants::features::QOS_LIMITS;
+					setFeatures.DWord11 = submissionQueueId;
+					setFeatures.DWord12 = iops;
+					setFeatures.DWord13 = kibPerSecond;
+					return adminQueuePair.sendCommand(setFeatures, completion) && completion.SF == 0;
+				};
+				auto getStatistics = [&](UINT_8 type, UINT_32 id) {
+					logpages::QOS_STATISTICS_ENTRY found = { 0 };
+					PRP logPrp(Payload(4096), 4096);
+					command::NVME_COMMAND getLogPage = { 0 };
+					getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+					getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+					getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+					getLogPage.DWord10 = constants::log_pages::QOS_STATISTICS | ((4096 / sizeof(UINT_32) - 1) << 16);
+					if (adminQueuePair.sendCommand(getLogPage, completion) && completion.SF == 0)
+					{
+						Payload logPayload = logPrp.getPayloadCopy();
+						logpages::PQOS_STATISTICS_LOG header = (logpages::PQOS_STATISTICS_LOG)logPayload.getBuffer();
+						logpages::PQOS_STATISTICS_ENTRY entries = (logpages::PQOS_STATISTICS_ENTRY)(header + 1);
+						for (UINT_32 i = 0; i < header->NE; i++)
+						{
+							if (entries[i].TYPE == type && entries[i].ID == id)
+							{
+								found = entries[i];
+							}
+						}
+					}
+					return found;
+				};
+				auto waitForThrottle = [&](UINT_8 type, UINT_32 id) {
+					UINT_64 deathTime = helpers::getTimeInMilliseconds() + TEST_COMMAND_TIMEOUT_MS;
+					while (getStatistics(type, id).BTC == 0 && helpers::getTimeInMilliseconds() < deathTime)
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+					return getStatistics(type, id).BTC != 0;
+				};
+
+				FAIL_IF(setLimits(0, 0, 100, 0), "The admin queue should not take limits");
+				FAIL_IF(setLimits(namespaceId + 1, 0, 100, 0) || completion.SC != constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT,
+					"Limits on a missing namespace should fail with invalid namespace");
+
+				// An IOPS limit paces a queue: the first command takes the only token, the rest wait for one each
+				const UINT_32 iops = 2;
+				const UINT_32 numberOfReads = 3;
+				FAIL_IF(!setLimits(0, 1, iops, 0), "Unable to set the IOPS limit");
+				PRP readPrp(Payload(blockSize), 4096);
+				command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, namespaceId, 0, 1, readPrp);
+				UINT_64 startTime = helpers::getTimeInMilliseconds();
+				limitedQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(numberOfReads, read));
+				for (UINT_32 i = 0; i < numberOfReads; i++)
+				{
+					FAIL_IF(!limitedQueuePair.waitForCompletion(completion) || completion.SF != 0, "Read under the IOPS limit failed");
+				}
+				FAIL_IF(helpers::getTimeInMilliseconds() - startTime < (numberOfReads - 1) * 1000 / iops * 9 / 10, "Reads went faster than the IOPS limit");
+				logpages::QOS_STATISTICS_ENTRY statistics = getStatistics(QOS_ENTRY_SUBMISSION_QUEUE, 1);
+				FAIL_IF(statistics.IOPSL != iops || statistics.DC != numberOfReads || statistics.ITC == 0 || statistics.BTC != 0 || statistics.TTD == 0 || statistics.MTD > statistics.TTD,
+					"Unexpected submission queue statistics: " + statistics.toString());
+
+				// A big write puts the queue's bandwidth bucket deep in debt, so its next command is parked.
+				// The other queue keeps going meanwhile and the parked command is only counted once.
+				FAIL_IF(!setLimits(0, 1, 0, 1), "Unable to set the bandwidth limit");
+				PRP writePrp(Payload(64 * blockSize), 4096);
+				command::NVME_COMMAND write = helpers::makeIoCommand(constants::opcodes::nvm::WRITE, namespaceId, 0, 64, writePrp);
+				FAIL_IF(!limitedQueuePair.sendCommand(write, completion) || completion.SF != 0, "Write under the bandwidth limit failed");
+				limitedQueuePair.submitCommands({ read });
+				FAIL_IF(!waitForThrottle(QOS_ENTRY_SUBMISSION_QUEUE, 1), "The read over the bandwidth limit was never held back");
+				for (UINT_32 i = 0; i < numberOfReads; i++)
+				{
+					FAIL_IF(!otherQueuePair.sendCommand(read, completion) || completion.SF != 0, "Read on the other queue failed");
+				}
+				FAIL_IF(limitedQueuePair.hasCompletion(), "The read over the bandwidth limit should still be parked");
+				FAIL_IF(getStatistics(QOS_ENTRY_SUBMISSION_QUEUE, 1).BTC != 1, "The parked read should be counted once");
+
+				// Lifting the limit lets it go on the next pass
+				FAIL_IF(!setLimits(0, 1, 0, 0), "Unable to lift the submission queue limits");
+				FAIL_IF(!limitedQueuePair.waitForCompletion(completion) || completion.SF != 0, "The parked read did not complete once the limit was lifted");
+				statistics = getStatistics(QOS_ENTRY_SUBMISSION_QUEUE, 1);
+				FAIL_IF(statistics.IOPSL != 0 || statistics.BWL != 0 || statistics.DC != numberOfReads + 2 || statistics.BTC != 1 || statistics.MTD == 0,
+					"Unexpected submission queue statistics after lifting the limits: " + statistics.toString());
+
+				// A namespace limit is shared by every queue sending to it: a big write on one queue parks a read on the other
+				FAIL_IF(!setLimits(namespaceId, 0, 0, 1), "Unable to set the namespace bandwidth limit");
+				FAIL_IF(!otherQueuePair.sendCommand(write, completion) || completion.SF != 0, "Write under the namespace limit failed");
+				limitedQueuePair.submitCommands({ read });
+				FAIL_IF(!waitForThrottle(QOS_ENTRY_NAMESPACE, namespaceId), "The read over the namespace limit was never held back");
+				FAIL_IF(limitedQueuePair.hasCompletion(), "The read over the namespace limit should still be parked");
+				FAIL_IF(!setLimits(namespaceId, 0, 0, 0), "Unable to lift the namespace limits");
+				FAIL_IF(!limitedQueuePair.waitForCompletion(completion) || completion.SF != 0, "The read held back by the namespace did not complete once the limit was lifted");
+				statistics = getStatistics(QOS_ENTRY_NAMESPACE, namespaceId);
+				FAIL_IF(statistics.DC != 2 || statistics.BTC != 1 || statistics.ITC != 0 || statistics.TTD == 0, "Unexpected namespace statistics: " + statistics.toString());
+
+				return true;
+			}
+
+			bool testAbort()
+			{
+				const UINT_32 namespaceId = DEFAULT_NAMESPACE_ID;
+				const UINT_16 queueSize = 32;
+				const UINT_8 abortRequested = constants::status::codes::generic::COMMAND_ABORT_REQUESTED;
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, queueSize);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, queueSize);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				auto makeAbort = [](UINT_16 submissionQueueId, UINT_16 commandId) {
+					command::NVME_COMMAND abort = { 0 };
+					abort.DWord0Breakdown.OPC = constants::opcodes::admin::ABORT;
+					abort.DWord10 = submissionQueueId | ((UINT_32)commandId << 16);
+					return abort;
+				};
+				auto sendAbort = [&](UINT_16 submissionQueueId, UINT_16 commandId) {
+					return adminQueuePair.sendCommand(makeAbort(submissionQueueId, commandId), completion) && completion.SF == 0;
+				};
+				auto setBandwidthLimit = [&](UINT_32 kibPerSecond) {
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.DWord10 = constants::features::QOS_LIMITS;
+					setFeatures.DWord11 = ioQueuePair.getQueueId();
+					setFeatures.DWord13 = kibPerSecond;
+					return adminQueuePair.sendCommand(setFeatures, completion) && completion.SF == 0;
+				};
+
+				// Aborts every read sent (all at once, as a host timing them out would), then checks each completed the way its Abort said
+				PRP readPrp(Payload(DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				command::NVME_COMMAND read = helpers::makeIoCommand(constants::opcodes::nvm::READ, namespaceId, 0, 1, readPrp);
+				auto abortReads = [&](UINT_16 firstCommandId, UINT_32 numberOfReads, UINT_32 &aborted) {
+					std::vector<command::NVME_COMMAND> aborts;
+					for (UINT_32 i = 0; i < numberOfReads; i++)
+					{
+						aborts.push_back(makeAbort(ioQueuePair.getQueueId(), (UINT_16)(firstCommandId + i)));
+					}
+					UINT_16 firstAbortId = adminQueuePair.getNextCommandId();
+					adminQueuePair.submitCommands(aborts);
+
+					std::map<UINT_16, bool> abortedById;
+					for (UINT_32 i = 0; i < numberOfReads; i++)
+					{
+						FAIL_IF(!adminQueuePair.waitForCompletion(completion) || completion.SF != 0, "Abort failed: " + completion.toString());
+						abortedById[(UINT_16)(firstCommandId + (UINT_16)(completion.CID - firstAbortId))] = (completion.DWord0 & 1) == 0;
+					}
+
+					aborted = 0;
+					for (UINT_32 i = 0; i < numberOfReads; i++)
+					{
+						FAIL_IF(!ioQueuePair.waitForCompletion(completion), "A read did not complete after the Aborts");
+						FAIL_IF(abortedById.find(completion.CID) == abortedById.end(), "Unexpected completion: " + completion.toString());
+						bool wasAborted = abortedById[completion.CID];
+						FAIL_IF(wasAborted && (completion.SCT != constants::status::types::GENERIC_COMMAND || completion.SC != abortRequested),
+							"An aborted read did not complete with Command Abort Requested: " + completion.toString());
+						FAIL_IF(!wasAborted && completion.SF != 0, "A read that wasn't aborted failed: " + completion.toString());
+						aborted += wasAborted;
+					}
+					return true;
+				};
+
+				// Held back by QoS: a big write puts the queue's bandwidth bucket far enough in debt that every read after it waits in the queue
+				const UINT_32 numberOfThrottledReads = 16;
+				UINT_32 aborted = 0;
+				FAIL_IF(!setBandwidthLimit(1), "Unable to set the bandwidth limit");
+				PRP writePrp(Payload(64 * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, namespaceId, 0, 64, writePrp), completion) || completion.SF != 0,
+					"Write under the bandwidth limit failed");
+				UINT_16 firstCommandId = ioQueuePair.getNextCommandId();
+				ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(numberOfThrottledReads, read));
+				FAIL_IF(!abortReads(firstCommandId, numberOfThrottledReads, aborted), "Aborting reads held back by QoS failed");
+				FAIL_IF(aborted != numberOfThrottledReads, "Only " + std::to_string(aborted) + " of the reads held back by QoS were aborted");
+				firstCommandId--; // The write, long since completed
+
+				// Nothing left to abort: a completed command, or a missing queue
+				FAIL_IF(!sendAbort(ioQueuePair.getQueueId(), firstCommandId) || (completion.DWord0 & 1) == 0, "Aborting a completed write should not abort anything");
+				FAIL_IF(!sendAbort(ioQueuePair.getQueueId() + 1, 0) || (completion.DWord0 & 1) == 0, "Aborting on a missing queue should not abort anything");
+
+				// At full queue depth, racing the pipeline: whatever the Abort says happened, happened
+				FAIL_IF(!setBandwidthLimit(0), "Unable to lift the bandwidth limit");
+				firstCommandId = ioQueuePair.getNextCommandId();
+				ioQueuePair.submitCommands(std::vector<command::NVME_COMMAND>(queueSize - 1, read));
+				FAIL_IF(!abortReads(firstCommandId, queueSize - 1, aborted), "Aborting reads at full queue depth failed");
+				FAIL_IF(!ioQueuePair.sendCommand(read, completion) || completion.SF != 0, "A read after the Aborts failed");
+
+				// A parked Asynchronous Event Request completes (aborted) before the Abort does
+				command::NVME_COMMAND asyncEventRequest = { 0 };
+				asyncEventRequest.DWord0Breakdown.OPC = constants::opcodes::admin::ASYNCHRONOUS_EVENT_REQUEST;
+				UINT_16 asyncEventRequestId = adminQueuePair.getNextCommandId();
+				adminQueuePair.submitCommands({ asyncEventRequest });
+				command::NVME_COMMAND abort = { 0 };
+				abort.DWord0Breakdown.OPC = constants::opcodes::admin::ABORT;
+				abort.DWord10 = adminQueuePair.getQueueId() | ((UINT_32)asyncEventRequestId << 16);
+				adminQueuePair.submitCommands({ abort });
+				FAIL_IF(!adminQueuePair.waitForCompletion(completion) || completion.CID != asyncEventRequestId || completion.SC != abortRequested,
+					"The Asynchronous Event Request was not aborted: " + completion.toString());
+				FAIL_IF(!adminQueuePair.waitForCompletion(completion) || completion.SF != 0 || (completion.DWord0 & 1) != 0,
+					"Abort of the Asynchronous Event Request failed: " + completion.toString());
+
+				return true;
+			}
+
+			bool testPredictableLatency()
+			{
+				using namespace constants::predictable_latency;
+				const UINT_16 nvmSetId = DEFAULT_NAMESPACE_ID; // Each namespace is its own NVM Set
+				const UINT_32 numberOfBlocks = 8; // One 4 KiB write
+
+				Controller controller;
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+				Namespace* theNamespace = controller.getNamespace(DEFAULT_NAMESPACE_ID);
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				auto setFeature = [&](UINT_8 featureIdentifier, UINT_32 dword11, UINT_32 dword12) {
+					command::NVME_COMMAND setFeatures = { 0 };
+					setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+					setFeatures.DWord10 = featureIdentifier;
+					setFeatures.DWord11 = dword11;
+					setFeatures.DWord12 = dword12;
+					return adminQueuePair.sendCommand(setFeatures, completion) && completion.SF == 0;
+				};
+				auto getFeature = [&](UINT_8 featureIdentifier) {
+					command::NVME_COMMAND getFeatures = { 0 };
+					getFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::GET_FEATURES;
+					getFeatures.DWord10 = featureIdentifier;
+					getFeatures.DWord11 = nvmSetId;
+					return adminQueuePair.sendCommand(getFeatures, completion) && completion.SF == 0 ? completion.DWord0 : 0xFFFFFFFF;
+				};
+				auto getLog = [&](UINT_8 logPageIdentifier, bool retainAsynchronousEvent) {
+					PRP logPrp(Payload(4096), 4096);
+					command::NVME_COMMAND getLogPage = { 0 };
+					getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+					getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+					getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+					getLogPage.DWord10 = logPageIdentifier | (retainAsynchronousEvent << 15) | ((4096 / sizeof(UINT_32) - 1) << 16);
+					getLogPage.DWord11 = (UINT_32)nvmSetId << 16; // LSI
+					return adminQueuePair.sendCommand(getLogPage, completion) && completion.SF == 0 ? logPrp.getPayloadCopy() : Payload();
+				};
+				auto write = [&]() {
+					PRP writePrp(Payload(numberOfBlocks * DEFAULT_NAMESPACE_BLOCK_SIZE), 4096);
+					return ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, DEFAULT_NAMESPACE_ID, 0, numberOfBlocks, writePrp), completion) && completion.SF == 0;
+				};
+
+				FAIL_IF(!setFeature(constants::features::VOLATILE_WRITE_CACHE, 1, 0), "Unable to enable the volatile write cache");
+				FAIL_IF(setFeature(constants::features::PREDICTABLE_LATENCY_MODE_CONFIG, nvmSetId + 1, 1) || completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND,
+					"Predictable Latency Mode on a missing NVM Set should fail with invalid field");
+				FAIL_IF(setFeature(constants::features::PREDICTABLE_LATENCY_MODE_WINDOW, nvmSetId, WINDOW_DETERMINISTIC) || completion.SC != constants::status::codes::generic::COMMAND_SEQUENCE_ERROR,
+					"Picking a window before enabling Predictable Latency Mode should be a command sequence error");
+
+				// Enabling starts a non-deterministic window that has to last its minimum time
+				FAIL_IF(!setFeature(constants::features::PREDICTABLE_LATENCY_MODE_CONFIG, nvmSetId, 1), "Unable to enable Predictable Latency Mode");
+				FAIL_IF(getFeature(constants::features::PREDICTABLE_LATENCY_MODE_CONFIG) != 1, "Get Features did not report Predictable Latency Mode as enabled");
+				FAIL_IF(getFeature(constants::features::PREDICTABLE_LATENCY_MODE_WINDOW) != WINDOW_NON_DETERMINISTIC, "Enabling should start a non-deterministic window");
+				FAIL_IF(setFeature(constants::features::PREDICTABLE_LATENCY_MODE_WINDOW, nvmSetId, 0), "Window select 0 should be rejected");
+				std::this_thread::sleep_for(std::chrono::milliseconds(PLM_NDWIN_TIME_MINIMUM_LOW_MS));
+				FAIL_IF(!setFeature(constants::features::PREDICTABLE_LATENCY_MODE_WINDOW, nvmSetId, WINDOW_DETERMINISTIC), "Unable to start a deterministic window");
+
+				// The destager would drain an idle cache within a few milliseconds, but not while deterministic.
+				// (If the machine is slow enough for the window to run out first, the write ends it and can be destaged.)
+				FAIL_IF(!write(), "Write in the deterministic window failed");
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+				bool drained = theNamespace->getWriteCache()->getDirtyBytes() == 0;
+				Payload logPayload = getLog(constants::log_pages::PREDICTABLE_LATENCY_PER_NVM_SET, true);
+				FAIL_IF(logPayload.getSize() == 0, "Get Log Page (Predictable Latency Per NVM Set) failed with status " + std::to_string(completion.SF));
+				logpages::PREDICTABLE_LATENCY_PER_NVM_SET_LOG log = *(logpages::PPREDICTABLE_LATENCY_PER_NVM_SET_LOG)logPayload.getBuffer();
+				if (log.STATUS == WINDOW_DETERMINISTIC)
+				{
+					FAIL_IF(drained, "The write cache was destaged during the deterministic window");
+					FAIL_IF(log.DTWINWE != log.DTWINWT - 1 || log.DTWINRE != log.DTWINRT || log.DTWINTE > log.DTWINTM || log.ET != 0,
+						"Unexpected Predictable Latency log during the deterministic window: " + log.toString());
+				}
+
+				// Back in the non-deterministic window, the deferred destaging catches up
+				FAIL_IF(!setFeature(constants::features::PREDICTABLE_LATENCY_MODE_WINDOW, nvmSetId, WINDOW_NON_DETERMINISTIC), "Unable to go back to the non-deterministic window");
+				UINT_64 deathTime = helpers::getTimeInMilliseconds() + TEST_COMMAND_TIMEOUT_MS;
+				while (theNamespace->getWriteCache()->getDirtyBytes() && helpers::getTimeInMilliseconds() < deathTime)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				FAIL_IF(theNamespace->getWriteCache()->getDirtyBytes(), "The write cache was not destaged in the non-deterministic window");
+
+				// A deterministic window past its maximum time drops back to non-deterministic and raises an event,
+				//   even with the host idle, so the deferred destaging gets to run without anyone looking.
+				// (The high minimum covers the first window having run out by itself on a slow machine.)
+				std::this_thread::sleep_for(std::chrono::milliseconds(PLM_NDWIN_TIME_MINIMUM_HIGH_MS));
+				FAIL_IF(!setFeature(constants::features::PREDICTABLE_LATENCY_MODE_WINDOW, nvmSetId, WINDOW_DETERMINISTIC), "Unable to start the second deterministic window");
+				FAIL_IF(!write(), "Write in the second deterministic window failed");
+				deathTime = helpers::getTimeInMilliseconds() + PLM_DTWIN_TIME_MAXIMUM_MS + TEST_COMMAND_TIMEOUT_MS;
+				while (theNamespace->getWriteCache()->getDirtyBytes() && helpers::getTimeInMilliseconds() < deathTime)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				FAIL_IF(theNamespace->getWriteCache()->getDirtyBytes(), "The write cache was not destaged once an idle deterministic window ran out of time");
+				logPayload = getLog(constants::log_pages::PREDICTABLE_LATENCY_PER_NVM_SET, true);
+				log = *(logpages::PPREDICTABLE_LATENCY_PER_NVM_SET_LOG)logPayload.getBuffer();
+				FAIL_IF(log.STATUS != WINDOW_NON_DETERMINISTIC || log.ET != EVENT_DTWIN_EXCEEDED, "Unexpected Predictable Latency log after the maximum time: " + log.toString());
+
+				logPayload = getLog(constants::log_pages::PREDICTABLE_LATENCY_EVENT_AGGREGATE, true);
+				logpages::PPREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG aggregate = (logpages::PPREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG)logPayload.getBuffer();
+				FAIL_IF(aggregate->NE != 1 || *(UINT_16*)(aggregate + 1) != nvmSetId, "The event aggregate log should list the NVM Set");
+
+				// Reading the NVM Set's log without retaining the event clears it
+				getLog(constants::log_pages::PREDICTABLE_LATENCY_PER_NVM_SET, false);
+				logPayload = getLog(constants::log_pages::PREDICTABLE_LATENCY_EVENT_AGGREGATE, true);
+				FAIL_IF(((logpages::PPREDICTABLE_LATENCY_EVENT_AGGREGATE_LOG)logPayload.getBuffer())->NE != 0, "The event should be cleared once the NVM Set's log was read");
+
+				FAIL_IF(!setFeature(constants::features::PREDICTABLE_LATENCY_MODE_CONFIG, nvmSetId, 0), "Unable to disable Predictable Latency Mode");
+				FAIL_IF(getFeature(constants::features::PREDICTABLE_LATENCY_MODE_WINDOW) != WINDOW_NONE, "Disabling should leave no window");
+
+				return true;
+			}
+		}
+
+		namespace zns
+		{
+			bool testZoneAppendConcurrency()
+			{
+				const UINT_32 blockSize = 512;
+				const UINT_64 zoneSize = 2048;
+				const int numberOfThreads = 4;
+				const UINT_32 bigAppendBlocks = 7; // Doesn't divide the zone, so the big appends race past capacity at the end
+				Namespace theNamespace(1, new media::RamMedia(blockSize, zoneSize), zoneSize);
+				cnvme::zns::Zone* zone = theNamespace.getZone(0);
+
+				// Half the threads append big runs until one doesn't fit. The other half append single blocks until the zone is full,
+				//   which only ends up full if a big append running past capacity never makes a single block fail while there's room.
+				std::vector<std::vector<UINT_64>> assignedLbas(numberOfThreads);
+				std::vector<UINT_8> lastStatus(numberOfThreads);
+				std::vector<std::thread> threads;
+				for (int t = 0; t < numberOfThreads; t++)
+				{
+					threads.emplace_back([&, t] {
+						UINT_32 numberOfBlocks = t % 2 ? bigAppendBlocks : 1;
+						Payload data(numberOfBlocks * blockSize);
+						memset(data.getBuffer(), t + 1, data.getSize());
+						UINT_64 assignedLba = 0;
+						while ((lastStatus[t] = theNamespace.zoneAppend(zone, numberOfBlocks, data.getBuffer(), assignedLba)) == constants::status::codes::generic::SUCCESSFUL_COMPLETION)
+						{
+							for (UINT_32 i = 0; i < numberOfBlocks; i++)
+							{
+								assignedLbas[t].push_back(assignedLba + i);
+							}
+						}
+					});
+				}
+				for (auto &thread : threads)
+				{
+					thread.join();
+				}
+
+				FAIL_IF(zone->getState() != cnvme::zns::ZONE_STATE_FULL, "Zone should be full after appending until failure");
+				FAIL_IF(zone->getWritePointer() != zoneSize, "Write pointer should be at the end of the zone");
+				for (int t = 0; t < numberOfThreads; t++)
+				{
+					FAIL_IF(t % 2 == 0 && lastStatus[t] != constants::status::codes::specific::ZONE_IS_FULL,
+						"A single block append failed with " + std::to_string(lastStatus[t]) + " before the zone was full");
+				}
+
+				std::set<UINT_64> allLbas;
+				Payload block(blockSize);
+				for (int t = 0; t < numberOfThreads; t++)
+				{
+					for (UINT_64 lba : assignedLbas[t])
+					{
+						FAIL_IF(!allLbas.insert(lba).second, "LBA " + std::to_string(lba) + " was handed out twice");
+						theNamespace.getMedia()->read(lba, 1, block.getBuffer());
+						FAIL_IF(block.getBuffer()[0] != t + 1 || block.getBuffer()[blockSize - 1] != t + 1, "LBA " + std::to_string(lba) + " does not have the appending thread's data");
+					}
+				}
+				FAIL_IF(allLbas.size() != zoneSize, "Not every LBA in the zone was handed out");
+
+				return true;
+			}
+
+			bool testZoneManagement()
+			{
+				const UINT_32 namespaceId = 2;
+				const UINT_32 blockSize = 512;
+				const UINT_64 zoneSize = 64;
+				const UINT_64 numberOfZones = 16;
+
+				Controller controller;
+				FAIL_IF(!controller.addNamespace(new Namespace(namespaceId, new media::RamMedia(blockSize, zoneSize * numberOfZones), zoneSize)), "Unable to add the zoned namespace");
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				Payload data(8 * blockSize);
+				helpers::randomizePayload(data);
+				PRP dataPrp(data, 4096);
+
+				// Regular writes have to be at the write pointer
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, namespaceId, 0, 8, dataPrp), completion), "Write timed out");
+				FAIL_IF(completion.SF != 0, "Write at the write pointer failed");
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, namespaceId, 0, 8, dataPrp), completion), "Write timed out");
+				FAIL_IF(completion.SCT != constants::status::types::COMMAND_SPECIFIC || completion.SC != constants::status::codes::specific::ZONE_INVALID_WRITE,
+					"Write behind the write pointer did not fail with Zone Invalid Write");
+
+				// A write refused for its directive leaves the write pointer alone, so it can be retried without one
+				command::NVME_COMMAND streamedWrite = helpers::makeIoCommand(constants::opcodes::nvm::WRITE, namespaceId, 2 * zoneSize, 8, dataPrp);
+				streamedWrite.DWord12 |= (UINT_32)constants::directives::TYPE_STREAMS << 20; // Streams aren't enabled
+				FAIL_IF(!ioQueuePair.sendCommand(streamedWrite, completion), "Write timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Write with a Streams directive that isn't enabled did not fail with Invalid Field");
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::WRITE, namespaceId, 2 * zoneSize, 8, dataPrp), completion), "Write timed out");
+				FAIL_IF(completion.SF != 0, "Retrying a write refused for its directive failed: " + completion.toString());
+
+				// Zone Append returns where it went
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::zns::ZONE_APPEND, namespaceId, 0, 4, dataPrp), completion), "Zone Append timed out");
+				FAIL_IF(completion.SF != 0, "Zone Append failed");
+				FAIL_IF(completion.DWord0 != 8 || completion.DWord1 != 0, "Zone Append did not return the expected LBA");
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::zns::ZONE_APPEND, namespaceId, 1, 4, dataPrp), completion), "Zone Append timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Zone Append to a non zone start LBA should fail");
+
+				// Finish zone 3
+				command::NVME_COMMAND zoneSend = { 0 };
+				zoneSend.DWord0Breakdown.OPC = constants::opcodes::zns::ZONE_MANAGEMENT_SEND;
+				zoneSend.NSID = namespaceId;
+				zoneSend.DWord10 = (UINT_32)(3 * zoneSize);
+				zoneSend.DWord13 = cnvme::zns::ZONE_SEND_ACTION_FINISH;
+				FAIL_IF(!ioQueuePair.sendCommand(zoneSend, completion) || completion.SF != 0, "Zone finish failed");
+
+				// Report all zones
+				UINT_32 reportSize = (UINT_32)(sizeof(cnvme::zns::REPORT_ZONES_HEADER) + numberOfZones * sizeof(cnvme::zns::ZONE_DESCRIPTOR));
+				PRP reportPrp(Payload(reportSize), 4096);
+				command::NVME_COMMAND zoneReceive = { 0 };
+				zoneReceive.DWord0Breakdown.OPC = constants::opcodes::zns::ZONE_MANAGEMENT_RECEIVE;
+				zoneReceive.NSID = namespaceId;
+				zoneReceive.DPTR.DPTR1 = reportPrp.getPRP1();
+				zoneReceive.DPTR.DPTR2 = reportPrp.getPRP2();
+				zoneReceive.DWord12 = reportSize / sizeof(UINT_32) - 1;
+				FAIL_IF(!ioQueuePair.sendCommand(zoneReceive, completion) || completion.SF != 0, "Report zones failed");
+
+				Payload report = reportPrp.getPayloadCopy();
+				cnvme::zns::REPORT_ZONES_HEADER* header = (cnvme::zns::REPORT_ZONES_HEADER*)report.getBuffer();
+				cnvme::zns::ZONE_DESCRIPTOR* descriptors = (cnvme::zns::ZONE_DESCRIPTOR*)(report.getBuffer() + sizeof(cnvme::zns::REPORT_ZONES_HEADER));
+				FAIL_IF(header->NZ != numberOfZones, "Report zones returned the wrong number of zones");
+				FAIL_IF(descriptors[0].WP != 12 || descriptors[0].ZS != cnvme::zns::ZONE_STATE_IMPLICITLY_OPENED, "Zone 0 descriptor is wrong");
+				FAIL_IF(descriptors[1].WP != zoneSize || descriptors[1].ZS != cnvme::zns::ZONE_STATE_EMPTY, "Zone 1 descriptor is wrong");
+				FAIL_IF(descriptors[3].ZS != cnvme::zns::ZONE_STATE_FULL, "Zone 3 should be full");
+
+				// Only full zones
+				zoneReceive.DWord13 = 5 << 8;
+				FAIL_IF(!ioQueuePair.sendCommand(zoneReceive, completion) || completion.SF != 0, "Report full zones failed");
+				report = reportPrp.getPayloadCopy();
+				header = (cnvme::zns::REPORT_ZONES_HEADER*)report.getBuffer();
+				descriptors = (cnvme::zns::ZONE_DESCRIPTOR*)(report.getBuffer() + sizeof(cnvme::zns::REPORT_ZONES_HEADER));
+				FAIL_IF(header->NZ != 1 || descriptors[0].ZSLBA != 3 * zoneSize, "Report full zones should only return zone 3");
+
+				// Reset zone 0, it should read back as zeros and be appendable from the start
+				zoneSend.DWord10 = 0;
+				zoneSend.DWord13 = cnvme::zns::ZONE_SEND_ACTION_RESET;
+				FAIL_IF(!ioQueuePair.sendCommand(zoneSend, completion) || completion.SF != 0, "Zone reset failed");
+				PRP readPrp(Payload(data.getSize()), 4096);
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::nvm::READ, namespaceId, 0, 8, readPrp), completion) || completion.SF != 0, "Read failed");
+				FAIL_IF(readPrp.getPayloadCopy() != Payload(data.getSize()), "Reset zone did not read back as zeros");
+				FAIL_IF(!ioQueuePair.sendCommand(helpers::makeIoCommand(constants::opcodes::zns::ZONE_APPEND, namespaceId, 0, 4, dataPrp), completion), "Zone Append timed out");
+				FAIL_IF(completion.SF != 0 || completion.DWord0 != 0, "Zone Append after reset did not start at the zone start");
+
+				return true;
+			}
+		}
+
+		namespace ftl
+		{
+			bool testGarbageCollection()
+			{
+				const UINT_32 namespaceId = 2;
+				const UINT_32 blockSize = 512;
+				const UINT_64 numberOfBlocks = 1024;
+
+				Controller controller;
+				FAIL_IF(!controller.addNamespace(new Namespace(namespaceId, new media::FtlMedia(blockSize, numberOfBlocks, 16, 2))), "Unable to add the FTL namespace");
+				media::MediaBackend* media = controller.getNamespace(namespaceId)->getMedia();
+
+				// Each block holds the number of the write that last wrote it
+				std::vector<UINT_32> expected((size_t)numberOfBlocks, 0);
+				Payload block(blockSize);
+				for (UINT_32 writeNumber = 1; writeNumber <= numberOfBlocks * 4; writeNumber++)
+				{
+					UINT_64 lba = writeNumber <= numberOfBlocks ? writeNumber - 1 : helpers::randInt(0, numberOfBlocks - 1);
+					memcpy(block.getBuffer(), &writeNumber, sizeof(writeNumber));
+					FAIL_IF(!media->write(lba, 1, block.getBuffer()), "FTL write failed");
+					expected[(size_t)lba] = writeNumber;
+				}
+
+				for (UINT_64 lba = 0; lba < numberOfBlocks; lba++)
+				{
+					FAIL_IF(!media->read(lba, 1, block.getBuffer()), "FTL read failed");
+					FAIL_IF(memcmp(block.getBuffer(), &expected[(size_t)lba], sizeof(UINT_32)) != 0, "LBA " + std::to_string(lba) + " lost its data across garbage collection");
+				}
+
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+
+				PRP logPrp(Payload(sizeof(logpages::FTL_STATISTICS_LOG)), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.NSID = namespaceId;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::FTL_STATISTICS | ((sizeof(logpages::FTL_STATISTICS_LOG) / sizeof(UINT_32) - 1) << 16);
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SF != 0, "Get Log Page failed with status " + std::to_string(completion.SF));
+
+				Payload logPayload = logPrp.getPayloadCopy();
+				logpages::PFTL_STATISTICS_LOG statistics = (logpages::PFTL_STATISTICS_LOG)logPayload.getBuffer();
+				FAIL_IF(statistics->HPW != numberOfBlocks * 4, "Host pages written does not match what was written");
+				FAIL_IF(statistics->NPW != statistics->HPW + statistics->GCPR, "NAND pages written should be host writes plus relocations");
+				FAIL_IF(statistics->SBE == 0, "Random overwrites of the whole namespace should have forced garbage collection");
+				FAIL_IF(statistics->WAF < 1000, "Write amplification can't be below 1");
+
+				getLogPage.NSID = DEFAULT_NAMESPACE_ID;
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion), "Get Log Page timed out");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "FTL log page for a non-FTL namespace should fail");
+
+				return true;
+			}
+
+			bool testStreams()
+			{
+				const UINT_32 namespaceId = 2;
+				const UINT_32 blockSize = 512;
+				const UINT_64 numberOfBlocks = 2048;
+				const UINT_32 blocksPerWrite = 128;
+
+				Controller controller;
+				FAIL_IF(!controller.addNamespace(new Namespace(namespaceId, new media::FtlMedia(blockSize, numberOfBlocks, 16, 2,
+					FTL_DEFAULT_OVERPROVISIONING_PERCENT, media::FTL_GC_POLICY_GREEDY, 2))), "Unable to add the FTL namespace");
+				helpers::HostQueuePair adminQueuePair(controller, 0, 8);
+				FAIL_IF(!helpers::enableController(controller, adminQueuePair), "Controller did not become ready");
+				helpers::HostQueuePair ioQueuePair(controller, 1, 16);
+				FAIL_IF(!helpers::createIoQueuePair(adminQueuePair, ioQueuePair), "Unable to create the I/O queue pair");
+
+				command::COMPLETION_QUEUE_ENTRY completion = { 0 };
+				auto sendDirective = [&](UINT_8 opcode, UINT_8 directiveType, UINT_8 directiveOperation, UINT_32 dWord12, PRP* prp) {
+					command::NVME_COMMAND directive = { 0 };
+					directive.DWord0Breakdown.OPC = opcode;
+					directive.NSID = namespaceId;
+					if (prp)
+					{
+						directive.DPTR.DPTR1 = prp->getPRP1();
+						directive.DPTR.DPTR2 = prp->getPRP2();
+						directive.DWord10 = prp->getNumBytes() / sizeof(UINT_32) - 1;
+					}
+					directive.DWord11 = directiveOperation | (directiveType << 8);
+					directive.DWord12 = dWord12;
+					return adminQueuePair.sendCommand(directive, completion) && completion.SF == 0;
+				};
+
+				// Each write is blocksPerWrite blocks of new random data, remembered for the read back at the end
+				Payload expected(numberOfBlocks * blockSize);
+				auto write = [&](UINT_64 lba, UINT_16 streamId) {
+					Payload data(blocksPerWrite * blockSize);
+					helpers::randomizePayload(data);
+					memcpy(expected.getBuffer() + lba * blockSize, data.getBuffer(), data.getSize());
+					PRP dataPrp(data, 4096);
+					command::NVME_COMMAND writeCommand = helpers::makeIoCommand(constants::opcodes::nvm::WRITE, namespaceId, lba, blocksPerWrite, dataPrp);
+					if (streamId)
+					{
+						writeCommand.DWord12 |= constants::directives::TYPE_STREAMS << 20; // DTYPE
+						writeCommand.DWord13 = streamId << 16; // DSPEC
+					}
+					return ioQueuePair.sendCommand(writeCommand, completion) && completion.SF == 0;
+				};
+				auto getOpenStreams = [&]() {
+					PRP statusPrp(Payload(4096), 4096);
+					std::vector<UINT_16> openStreams;
+					if (sendDirective(constants::opcodes::admin::DIRECTIVE_RECEIVE, constants::directives::TYPE_STREAMS, constants::directives::STREAMS_GET_STATUS, 0, &statusPrp))
+					{
+						Payload status = statusPrp.getPayloadCopy();
+						UINT_16* words = (UINT_16*)status.getBuffer();
+						openStreams.assign(words + 1, words + 1 + words[0]);
+					}
+					return openStreams;
+				};
+
+				// Streams are supported but start out disabled, so stream writes fail
+				PRP identifyPrp(Payload(sizeof(directives::IDENTIFY_RETURN_PARAMETERS)), 4096);
+				FAIL_IF(!sendDirective(constants::opcodes::admin::DIRECTIVE_RECEIVE, constants::directives::TYPE_IDENTIFY, constants::directives::IDENTIFY_RETURN_PARAMETERS, 0, &identifyPrp),
+					"Identify directive Return Parameters failed");
+				Payload identify = identifyPrp.getPayloadCopy();
+				directives::PIDENTIFY_RETURN_PARAMETERS identifyParameters = (directives::PIDENTIFY_RETURN_PARAMETERS)identify.getBuffer();
+				FAIL_IF(identifyParameters->DS[0] != 0x3 || identifyParameters->DE[0] != 0x1, "Streams should be supported but not enabled: " + identifyParameters->toString());
+				FAIL_IF(write(0, 1), "A stream write should fail while streams are disabled");
+				FAIL_IF(completion.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "A stream write while streams are disabled should fail with invalid field");
+
+				FAIL_IF(!sendDirective(constants::opcodes::admin::DIRECTIVE_SEND, constants::directives::TYPE_IDENTIFY, constants::directives::IDENTIFY_ENABLE_DIRECTIVE,
+					1 | (constants::directives::TYPE_STREAMS << 8), nullptr), "Unable to enable the Streams directive");
+				FAIL_IF(!sendDirective(constants::opcodes::admin::DIRECTIVE_RECEIVE, constants::directives::TYPE_STREAMS, constants::directives::STREAMS_ALLOCATE_RESOURCES, 2, nullptr) ||
+					completion.DWord0 != 2, "Unable to allocate 2 streams");
+
+				// Cold data once on stream 2, hot data over and over on stream 1, and some without a stream
+				for (UINT_64 lba = 0; lba < 1024; lba += blocksPerWrite)
+				{
+					FAIL_IF(!write(lba, 2), "Cold stream write failed");
+				}
+				for (int i = 0; i < 8; i++)
+				{
+					FAIL_IF(!write(1024, 1), "Hot stream write failed");
+				}
+				FAIL_IF(!write(1536, 0) || !write(1536 + blocksPerWrite, 0), "Write without a stream failed");
+				FAIL_IF(getOpenStreams() != std::vector<UINT_16>({ 1, 2 }), "Streams 1 and 2 should be open");
+
+				// Only 2 may be open, so stream 3 implicitly releases stream 2 (the least recently written)
+				FAIL_IF(!write(1152, 3), "Stream 3 write failed");
+				FAIL_IF(getOpenStreams() != std::vector<UINT_16>({ 1, 3 }), "Stream 3 should have replaced stream 2");
+				FAIL_IF(!sendDirective(constants::opcodes::admin::DIRECTIVE_SEND, constants::directives::TYPE_STREAMS, constants::directives::STREAMS_RELEASE_IDENTIFIER, 0, nullptr),
+					"Release Identifier failed");
+				FAIL_IF(getOpenStreams() != std::vector<UINT_16>({ 1, 3 }), "Releasing stream 0 should do nothing");
+
+				PRP parametersPrp(Payload(sizeof(directives::STREAMS_RETURN_PARAMETERS)), 4096);
+				FAIL_IF(!sendDirective(constants::opcodes::admin::DIRECTIVE_RECEIVE, constants::directives::TYPE_STREAMS, constants::directives::STREAMS_RETURN_PARAMETERS, 0, &parametersPrp),
+					"Streams Return Parameters failed");
+				Payload parameters = parametersPrp.getPayloadCopy();
+				directives::PSTREAMS_RETURN_PARAMETERS streamsParameters = (directives::PSTREAMS_RETURN_PARAMETERS)parameters.getBuffer();
+				FAIL_IF(streamsParameters->MSL != STREAMS_MAX_STREAMS || streamsParameters->NSSA != STREAMS_MAX_STREAMS - 2 || streamsParameters->NSA != 2 || streamsParameters->NSO != 2,
+					"Unexpected Streams parameters: " + streamsParameters->toString());
+
+				// Streams 1 and 3 share slot 1
+				PRP logPrp(Payload(sizeof(logpages::STREAM_STATISTICS_LOG)), 4096);
+				command::NVME_COMMAND getLogPage = { 0 };
+				getLogPage.DWord0Breakdown.OPC = constants::opcodes::admin::GET_LOG_PAGE;
+				getLogPage.NSID = namespaceId;
+				getLogPage.DPTR.DPTR1 = logPrp.getPRP1();
+				getLogPage.DPTR.DPTR2 = logPrp.getPRP2();
+				getLogPage.DWord10 = constants::log_pages::STREAM_STATISTICS | ((sizeof(logpages::STREAM_STATISTICS_LOG) / sizeof(UINT_32) - 1) << 16);
+				FAIL_IF(!adminQueuePair.sendCommand(getLogPage, completion) || completion.SF != 0, "Get Log Page failed");
+				Payload logPayload = logPrp.getPayloadCopy();
+				logpages::PSTREAM_STATISTICS_LOG statistics = (logpages::PSTREAM_STATISTICS_LOG)logPayload.getBuffer();
+				FAIL_IF(statistics->NSS != 2 || statistics->SE[0].HPW != 2 * blocksPerWrite || statistics->SE[1].HPW != 9 * blocksPerWrite || statistics->SE[2].HPW != 1024,
+					"Stream writes were not counted in their own slots: " + statistics->toString());
+				for (UINT_32 i = 0; i <= statistics->NSS; i++)
+				{
+					FAIL_IF(statistics->SE[i].NPW < statistics->SE[i].HPW, "A stream slot wrote fewer NAND pages than host pages: " + statistics->toString());
+				}
+
+				Payload readPayload(expected.getSize());
+				FAIL_IF(!controller.getNamespace(namespaceId)->getMedia()->read(0, (UINT_32)numberOfBlocks, readPayload.getBuffer()) || readPayload != expected,
+					"Stream writes did not read back");
+
+				// Disabling releases everything
+				FAIL_IF(!sendDirective(constants::opcodes::admin::DIRECTIVE_SEND, constants::directives::TYPE_IDENTIFY, constants::directives::IDENTIFY_ENABLE_DIRECTIVE,
+					constants::directives::TYPE_STREAMS << 8, nullptr), "Unable to disable the Streams directive");
+				FAIL_IF(sendDirective(constants::opcodes::admin::DIRECTIVE_RECEIVE, constants::directives::TYPE_STREAMS, constants::directives::STREAMS_GET_STATUS, 0, &parametersPrp),
+					"Streams operations should fail once disabled");
+				FAIL_IF(controller.getNamespace(namespaceId)->getStreams()->getAllocatedStreams() != 0, "Disabling streams should release their resources");
+
+				return true;
+			}
+		}
+
 		namespace logging
 		{
 			bool testAsserting()
@@ -9,6 +9,7 @@ Tests.h - A header file for all unit testing
 #include "Controller.h"
 #include "ControllerRegisters.h"
 #include "LoopingThread.h"
+#include "Namespace.h"
 #include "PCIe.h"
 #include "PRP.h"
 
@@ -41,6 +42,155 @@ namespace cnvme
 			/// Fills a payload with random data
 			/// </summary>
 			void randomizePayload(Payload &payload);
+
+			/// <summary>
+			/// A host's view of a submission / completion queue pair on a Controller.
+			/// Used to send a command and wait for its completion like a (very simple) driver would.
+			/// </summary>
+			class HostQueuePair
+			{
+			public:
+				/// <summary>
+				/// Constructor. Allocates the queue memory.
+				/// </summary>
+				/// <param name="controller">The controller the queues live on</param>
+				/// <param name="queueId">The queue id (0 for admin)</param>
+				/// <param name="queueSize">Number of entries in each queue</param>
+				HostQueuePair(Controller &controller, UINT_16 queueId, UINT_16 queueSize);
+
+				/// <summary>
+				/// Destructor. Disables the controller if it's still enabled, so it's done with the host's memory (the queues and any
+				///   data buffers declared after them) before that goes. Tests declare the controller first, so it would go last.
+				/// </summary>
+				~HostQueuePair();
+
+				/// <summary>
+				/// Places the command in the submission queue (with a fresh CID), rings the doorbell
+				///   and waits for the completion to show up.
+				/// </summary>
+				/// <param name="command">The command to send</param>
+				/// <param name="completion">Set to the posted completion</param>
+				/// <returns>True if the completion was seen before timing out</returns>
+				bool sendCommand(command::NVME_COMMAND command, command::COMPLETION_QUEUE_ENTRY &completion);
+
+				/// <summary>
+				/// Places the commands in the submission queue (with fresh CIDs) and rings the doorbell once, without waiting.
+				/// There must be room for them in the queue.
+				/// </summary>
+				/// <param name="commands">The commands to send</param>
+				void submitCommands(std::vector<command::NVME_COMMAND> commands);
+
+				/// <summary>
+				/// Returns true if the next completion (or the one the given number of entries past it) has been posted
+				/// </summary>
+				/// <param name="ahead">Entries past the next completion to look at</param>
+				bool hasCompletion(UINT_16 ahead = 0);
+
+				/// <summary>
+				/// Waits for the next completion to show up and consumes it.
+				/// On a time out the controller is disabled, as the test is about to give up on (and free) memory it may still be using.
+				/// </summary>
+				/// <param name="completion">Set to the posted completion</param>
+				/// <returns>True if the completion was seen before timing out</returns>
+				bool waitForCompletion(command::COMPLETION_QUEUE_ENTRY &completion);
+
+				/// <summary>
+				/// Returns the queue id
+				/// </summary>
+				UINT_16 getQueueId();
+
+				/// <summary>
+				/// Returns the number of entries in each queue
+				/// </summary>
+				UINT_16 getQueueSize();
+
+				/// <summary>
+				/// Returns the CID the next submitted command gets
+				/// </summary>
+				UINT_16 getNextCommandId();
+
+				/// <summary>
+				/// Returns the memory address of the submission queue
+				/// </summary>
+				UINT_64 getSubmissionQueueAddress();
+
+				/// <summary>
+				/// Returns the memory address of the completion queue
+				/// </summary>
+				UINT_64 getCompletionQueueAddress();
+
+			private:
+				/// <summary>
+				/// The controller the queues live on
+				/// </summary>
+				Controller &TheController;
+
+				/// <summary>
+				/// The queue id
+				/// </summary>
+				UINT_16 QueueId;
+
+				/// <summary>
+				/// Number of entries in each queue
+				/// </summary>
+				UINT_16 QueueSize;
+
+				/// <summary>
+				/// Where the next command goes
+				/// </summary>
+				UINT_16 SubmissionQueueTail;
+
+				/// <summary>
+				/// Where the next completion will show up
+				/// </summary>
+				UINT_16 CompletionQueueHead;
+
+				/// <summary>
+				/// CID for the next command
+				/// </summary>
+				UINT_16 NextCommandId;
+
+				/// <summary>
+				/// Phase tag a new completion will have
+				/// </summary>
+				bool PhaseTag;
+
+				/// <summary>
+				/// Submission queue memory
+				/// </summary>
+				Payload SubmissionQueueMemory;
+
+				/// <summary>
+				/// Completion queue memory
+				/// </summary>
+				Payload CompletionQueueMemory;
+			};
+
+			/// <summary>
+			/// Points the controller at the admin queue pair and enables it, waiting for CSTS.RDY
+			/// </summary>
+			bool enableController(Controller &controller, HostQueuePair &adminQueuePair);
+
+			/// <summary>
+			/// Clears CC.EN and waits for the reset to finish, after which the controller no longer touches host memory
+			/// </summary>
+			bool disableController(Controller &controller);
+
+			/// <summary>
+			/// Sends the create CQ / create SQ commands needed for the given I/O queue pair
+			/// </summary>
+			bool createIoQueuePair(HostQueuePair &adminQueuePair, HostQueuePair &ioQueuePair);
+
+			/// <summary>
+			/// Sends the create SQ command for just the submission queue of the given I/O queue pair, mapped to an existing
+			///   completion queue (whose pair the completions will show up in)
+			/// </summary>
+			bool createIoSubmissionQueue(HostQueuePair &adminQueuePair, HostQueuePair &ioQueuePair, UINT_16 completionQueueId);
+
+			/// <summary>
+			/// Builds a Read/Write/Zone Append style command
+			/// </summary>
+			command::NVME_COMMAND makeIoCommand(UINT_8 opcode, UINT_32 namespaceId, UINT_64 lba, UINT_32 numberOfBlocks, PRP &prp);
 		}
 
 		namespace general
@@ -49,6 +199,12 @@ namespace cnvme
 			/// Tests the LoopingThread class
 			/// </summary>
 			bool testLoopingThread();
+
+			/// <summary>
+			/// Tests that the Chase-Lev deque's owner takes the newest item and thieves the oldest, and that with thieves racing
+			///   the owner every item is taken exactly once
+			/// </summary>
+			bool testChaseLevDeque();
 		}
 
 		namespace pci
@@ -75,6 +231,37 @@ namespace cnvme
 			/// Tests the general NVMe Command parsing
 			/// </summary>
 			bool testNVMeCommandParsing();
+
+			/// <summary>
+			/// Tests the opcode dispatch tables: unregistered and duplicate opcodes, vendor specific admin and I/O
+			///   commands registered before enabling the controller, and the common namespace and PRP checks
+			/// </summary>
+			bool testCommandDispatch();
+
+			/// <summary>
+			/// Tests that plugins that don't exist or don't export the entry point fail to load and, if build.sh built it,
+			///   that the sample filter plugin's vendor specific command returns just the matching records
+			/// </summary>
+			bool testPlugins();
+
+			/// <summary>
+			/// Tests Identify Controller, Identify Namespace and the Active Namespace ID list, including that a namespace
+			///   added after the controller is enabled shows up in them
+			/// </summary>
+			bool testIdentify();
+
+			/// <summary>
+			/// Tests that Asynchronous Event Requests stay parked until a namespace is added, a temperature threshold is crossed
+			///   or a doorbell is written an invalid value, that only so many can be parked, and that an event type stays masked
+			///   until its log page is read without Retain Asynchronous Event
+			/// </summary>
+			bool testAsynchronousEvents();
+
+			/// <summary>
+			/// Tests that with an admin queue no deeper than the Asynchronous Event Request limit, parked requests don't keep
+			///   other admin commands from being fetched, that an event still completes one, and that resets don't shrink the queue
+			/// </summary>
+			bool testAsynchronousEventsInSmallAdminQueue();
 		}
 
 		namespace prp
@@ -91,6 +278,157 @@ namespace cnvme
 			bool testDataIntoExistingPRP();
 		}
 
+		namespace nvm
+		{
+			/// <summary>
+			/// Tests creating I/O queues then writing and reading back data through the controller
+			/// </summary>
+			bool testReadWrite();
+
+			/// <summary>
+			/// Tests that a full completion queue holds back further commands (instead of overwriting completions the host
+			///   hasn't consumed) until the host rings the completion queue head doorbell
+			/// </summary>
+			bool testCompletionQueueFull();
+
+			/// <summary>
+			/// Tests that a completion queue head doorbell past the tail (while completions are reserved) is rejected
+			///   and reported with an error event, and that the queue keeps working once the host rings a valid head
+			/// </summary>
+			bool testInvalidCompletionQueueHead();
+
+			/// <summary>
+			/// Tests several submission queues sharing one completion queue: every completion lands there (with the right SQID
+			///   and phase tag as it wraps), and the completion queue can't be deleted until all of them are
+			/// </summary>
+			bool testSharedCompletionQueue();
+
+			/// <summary>
+			/// Tests the Arbitration feature, and that commands are fetched in Arbitration Burst sized runs
+			///   (split at the end of the queue) by watching SQHD advance a burst at a time
+			/// </summary>
+			bool testArbitrationBurst();
+
+			/// <summary>
+			/// Tests that I/O going through the fetch, execute and complete stages comes back in order,
+			///   and that the Pipeline Statistics log page counts each command once per stage
+			/// </summary>
+			bool testPipelineStatistics();
+
+			/// <summary>
+			/// Tests the Executor Workers feature, that with every read coming from one queue (so one worker) completions still come back
+			///   in order, and that the Executor Statistics log page counts each read once and steals match commands stolen
+			/// </summary>
+			bool testWorkStealing();
+
+			/// <summary>
+			/// Tests that admin commands reading state run alongside I/O, and that deleting a submission queue (a synchronization point)
+			///   waits for the I/O already fetched from it to complete first
+			/// </summary>
+			bool testAdminBesideIo();
+
+			/// <summary>
+			/// Tests that the SMART / Health Information log page counts host reads, writes and data units across queues,
+			///   and that the Submission Queue Statistics log page splits the same counts by queue (admin queue included)
+			/// </summary>
+			bool testSmartHealthInformation();
+
+			/// <summary>
+			/// Tests the Copy command, including that a chunk shared by a copy is unshared when either side is written
+			/// </summary>
+			bool testCopy();
+
+			/// <summary>
+			/// Tests turning on the volatile write cache with Set Features, then that Flush leaves the data on the media
+			/// </summary>
+			bool testVolatileWriteCache();
+
+			/// <summary>
+			/// Tests that with the read cache turned on, a sequential read stream on an FTL namespace triggers readahead, hits in the read cache,
+			///   and that a write to a cached LBA is read back correctly
+			/// </summary>
+			bool testReadCache();
+
+			/// <summary>
+			/// Tests that Format NVM on a huge sparse namespace zeros it (leaving other namespaces alone) and its chunks are
+			///   reclaimed in the background, then that a Sanitize block erase zeros everything and shows in the Sanitize Status log
+			/// </summary>
+			bool testFormatAndSanitize();
+
+			/// <summary>
+			/// Tests that a clone of a namespace (including data still in its write cache) reads back the same and shares its chunks,
+			///   and that writes to either side stay private to that side, even after the original is destroyed
+			/// </summary>
+			bool testNamespaceClone();
+
+			/// <summary>
+			/// Tests that journaled media reads back overlapping writes and deallocates, recovers exactly the flushed records
+			///   (and not a torn one after them) from a copy of its files, group commits concurrent flushes, and checkpoints when full
+			/// </summary>
+			bool testJournaledMedia();
+
+			/// <summary>
+			/// Tests that deduplicating media stores repeated blocks once and zero blocks not at all, that copies share stored blocks,
+			///   and that a stored block is freed once nothing maps to it
+			/// </summary>
+			bool testDedupMedia();
+
+			/// <summary>
+			/// Tests that tiered media fills the fast tier first, promotes a slow segment once it's hot (demoting a colder one),
+			///   follows Dataset Management hints over heat (including ones sent as a command), and never loses data while moving it
+			/// </summary>
+			bool testTieredMedia();
+
+			/// <summary>
+			/// Tests that QoS limits pace a submission queue (IOPS) and a namespace (bandwidth), that a command over its limit is parked
+			///   without holding up other queues until its limit is lifted, and that the QoS Statistics log page counts the throttling
+			/// </summary>
+			bool testQos();
+
+			/// <summary>
+			/// Tests that Abort completes commands held back by QoS with Command Abort Requested, that commands raced at full queue depth
+			///   complete as the Abort said (aborted or not), and that a parked Asynchronous Event Request can be aborted
+			/// </summary>
+			bool testAbort();
+
+			/// <summary>
+			/// Tests that Predictable Latency Mode windows can only be picked once enabled, that background destaging waits
+			///   for the non-deterministic window, and that a deterministic window past its maximum time ends by itself
+			///   with an event in the Predictable Latency log pages
+			/// </summary>
+			bool testPredictableLatency();
+		}
+
+		namespace zns
+		{
+			/// <summary>
+			/// Tests that many threads appending to one zone each get distinct LBAs and the zone ends up full,
+			///   with appends too big for what's left failing without making smaller ones that still fit fail
+			/// </summary>
+			bool testZoneAppendConcurrency();
+
+			/// <summary>
+			/// Tests zone writes, Zone Append, Report Zones and zone reset through the controller
+			/// </summary>
+			bool testZoneManagement();
+		}
+
+		namespace ftl
+		{
+			/// <summary>
+			/// Tests that random overwrites on an FTL namespace survive garbage collection
+			///   and that the FTL statistics log page reports the extra NAND writes
+			/// </summary>
+			bool testGarbageCollection();
+
+			/// <summary>
+			/// Tests the Streams directive on an FTL namespace: enabling it, allocating resources, writes opening streams
+			///   (and releasing the least recently written one past the allocation), releasing identifiers, and that the
+			///   Stream Statistics log page counts each stream's writes in its own slot
+			/// </summary>
+			bool testStreams();
+		}
+
 		namespace logging
 		{
 			/// <summary>
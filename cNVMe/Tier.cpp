@@ -0,0 +1,345 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Tier.cpp - An implementation file for the Tiered (hot/cold) media
+*/
+
+#include "Tier.h"
+
+namespace cnvme
+{
+	namespace media
+	{
+		TieredMedia::TieredMedia(MediaBackend* fastMedia, MediaBackend* slowMedia, UINT_64 fastCapacityInBlocks) :
+			MediaBackend(slowMedia->getBlockSize(), slowMedia->getNumberOfBlocks()), FastMedia(fastMedia), SlowMedia(slowMedia)
+		{
+			ASSERT_IF(fastMedia->getBlockSize() != slowMedia->getBlockSize() || fastMedia->getNumberOfBlocks() != slowMedia->getNumberOfBlocks(),
+				"Both tiers of a TieredMedia need the same geometry");
+			SegmentBlocks = std::max<UINT_64>(1, TIER_SEGMENT_SIZE / BlockSize);
+			FastCapacityInSegments = fastCapacityInBlocks / SegmentBlocks;
+			AccessesSinceDecay = 0;
+			Statistics = { 0 };
+		}
+
+		bool TieredMedia::read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to read out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(TierMutex);
+			while (numberOfBlocks)
+			{
+				UINT_64 segmentIndex = lba / SegmentBlocks;
+				UINT_32 blocks = (UINT_32)std::min<UINT_64>(numberOfBlocks, (segmentIndex + 1) * SegmentBlocks - lba);
+
+				// Never written segments are zeros in both tiers, so there is no need to start tracking them
+				MediaBackend* tier = SlowMedia.get();
+				auto segment = Segments.find(segmentIndex);
+				if (segment != Segments.end())
+				{
+					if (!accessLocked(segmentIndex, segment->second))
+					{
+						return false;
+					}
+					tier = getTier(segment->second);
+				}
+
+				if (!tier->read(lba, blocks, buffer))
+				{
+					return false;
+				}
+				(tier == FastMedia.get() ? Statistics.FRB : Statistics.SRB) += blocks;
+
+				lba += blocks;
+				numberOfBlocks -= blocks;
+				buffer += (UINT_64)blocks * BlockSize;
+			}
+			return true;
+		}
+
+		bool TieredMedia::write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to write out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(TierMutex);
+			while (numberOfBlocks)
+			{
+				UINT_64 segmentIndex = lba / SegmentBlocks;
+				UINT_32 blocks = (UINT_32)std::min<UINT_64>(numberOfBlocks, (segmentIndex + 1) * SegmentBlocks - lba);
+
+				Segment &segment = getSegmentLocked(segmentIndex);
+				if (!accessLocked(segmentIndex, segment))
+				{
+					return false;
+				}
+
+				MediaBackend* tier = getTier(segment);
+				if (!tier->write(lba, blocks, buffer))
+				{
+					return false;
+				}
+				(segment.Fast ? Statistics.FWB : Statistics.SWB) += blocks;
+
+				lba += blocks;
+				numberOfBlocks -= blocks;
+				buffer += (UINT_64)blocks * BlockSize;
+			}
+			return true;
+		}
+
+		bool TieredMedia::deallocate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to deallocate out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(TierMutex);
+			if (!FastMedia->deallocate(lba, numberOfBlocks) || !SlowMedia->deallocate(lba, numberOfBlocks))
+			{
+				return false;
+			}
+
+			// Whole segments are zeros in both tiers again, so unhinted ones can be forgotten (freeing their fast tier space)
+			UINT_64 end = lba + numberOfBlocks;
+			for (auto segment = Segments.begin(); segment != Segments.end();)
+			{
+				UINT_64 segmentStart = segment->first * SegmentBlocks;
+				UINT_64 segmentEnd = std::min(segmentStart + SegmentBlocks, NumberOfBlocks);
+				if (segmentStart >= lba && segmentEnd <= end && segment->second.Hint == TIER_HINT_NONE)
+				{
+					if (segment->second.Fast)
+					{
+						Statistics.FSR--;
+					}
+					segment = Segments.erase(segment);
+				}
+				else
+				{
+					segment++;
+				}
+			}
+			return true;
+		}
+
+		bool TieredMedia::flush()
+		{
+			std::lock_guard<std::mutex> lock(TierMutex);
+			return FastMedia->flush() && SlowMedia->flush();
+		}
+
+		bool TieredMedia::format()
+		{
+			std::lock_guard<std::mutex> lock(TierMutex);
+			Segments.clear();
+			Statistics.FSR = 0;
+			AccessesSinceDecay = 0;
+			return FastMedia->format() && SlowMedia->format();
+		}
+
+		bool TieredMedia::hint(UINT_64 lba, UINT_64 numberOfBlocks, UINT_32 contextAttributes)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to hint out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			TIER_HINT hint = getHint(contextAttributes);
+			std::lock_guard<std::mutex> lock(TierMutex);
+			UINT_64 lastSegmentIndex = (lba + numberOfBlocks - 1) / SegmentBlocks;
+			for (UINT_64 segmentIndex = lba / SegmentBlocks; segmentIndex <= lastSegmentIndex; segmentIndex++)
+			{
+				auto found = Segments.find(segmentIndex);
+				if (found == Segments.end())
+				{
+					if (hint == TIER_HINT_NONE)
+					{
+						continue; // Nothing to clear
+					}
+					found = Segments.emplace(segmentIndex, Segment{ false, 0, TIER_HINT_NONE }).first;
+				}
+
+				Segment &segment = found->second;
+				segment.Hint = hint;
+				if (hint == TIER_HINT_HOT && !segment.Fast)
+				{
+					if (!promoteLocked(segmentIndex, segment))
+					{
+						return false;
+					}
+					if (segment.Fast)
+					{
+						Statistics.HPS++;
+					}
+				}
+				else if (hint == TIER_HINT_COLD && segment.Fast)
+				{
+					if (!migrateLocked(segmentIndex, segment))
+					{
+						return false;
+					}
+					Statistics.HDS++;
+				}
+			}
+			return true;
+		}
+
+		void TieredMedia::setDeterministic(bool deterministic)
+		{
+			FastMedia->setDeterministic(deterministic);
+			SlowMedia->setDeterministic(deterministic);
+		}
+
+		bool TieredMedia::isFast(UINT_64 lba)
+		{
+			std::lock_guard<std::mutex> lock(TierMutex);
+			auto segment = Segments.find(lba / SegmentBlocks);
+			return segment != Segments.end() && segment->second.Fast;
+		}
+
+		logpages::TIERING_STATISTICS_LOG TieredMedia::getStatistics()
+		{
+			std::lock_guard<std::mutex> lock(TierMutex);
+			logpages::TIERING_STATISTICS_LOG statistics = Statistics;
+			statistics.FSC = FastCapacityInSegments;
+			statistics.SS = (UINT_32)(SegmentBlocks * BlockSize);
+			return statistics;
+		}
+
+		TIER_HINT TieredMedia::getHint(UINT_32 contextAttributes)
+		{
+			UINT_8 accessFrequency = contextAttributes & 0xF; // AF
+			UINT_8 accessLatency = (contextAttributes >> 4) & 0x3; // AL
+
+			// Latency is the more direct ask, so it wins
+			if (accessLatency == 3) // Low latency
+			{
+				return TIER_HINT_HOT;
+			}
+			if (accessLatency == 1) // Idle: longer latency is acceptable
+			{
+				return TIER_HINT_COLD;
+			}
+
+			switch (accessFrequency)
+			{
+			case 3: // Infrequent writes and frequent reads
+			case 4: // Frequent writes and infrequent reads
+			case 5: // Frequent reads and writes
+				return TIER_HINT_HOT;
+			case 2: // Infrequent reads and writes
+			case 6: // One time read
+				return TIER_HINT_COLD;
+			default:
+				return TIER_HINT_NONE;
+			}
+		}
+
+		TieredMedia::Segment& TieredMedia::getSegmentLocked(UINT_64 segmentIndex)
+		{
+			auto segment = Segments.find(segmentIndex);
+			if (segment != Segments.end())
+			{
+				return segment->second;
+			}
+
+			// Untracked segments are zeros in both tiers, so the data can start out in either
+			bool fast = Statistics.FSR < FastCapacityInSegments;
+			if (fast)
+			{
+				Statistics.FSR++;
+			}
+			return Segments.emplace(segmentIndex, Segment{ fast, 0, TIER_HINT_NONE }).first->second;
+		}
+
+		bool TieredMedia::accessLocked(UINT_64 segmentIndex, Segment &segment)
+		{
+			segment.Heat = std::min<UINT_32>(segment.Heat + 1, TIER_MAX_HEAT);
+
+			if (++AccessesSinceDecay >= TIER_DECAY_ACCESSES)
+			{
+				AccessesSinceDecay = 0;
+				for (auto &other : Segments)
+				{
+					other.second.Heat /= 2;
+				}
+			}
+
+			if (!segment.Fast && segment.Hint != TIER_HINT_COLD && segment.Heat >= TIER_PROMOTION_HEAT)
+			{
+				return promoteLocked(segmentIndex, segment);
+			}
+			return true;
+		}
+
+		bool TieredMedia::promoteLocked(UINT_64 segmentIndex, Segment &segment)
+		{
+			if (Statistics.FSR >= FastCapacityInSegments)
+			{
+				// Hot hinted segments are never demoted for heat, and anything hot hinted beats anything that isn't
+				UINT_64 victimIndex = 0;
+				Segment* victim = nullptr;
+				for (auto &other : Segments)
+				{
+					if (other.second.Fast && other.second.Hint != TIER_HINT_HOT && (!victim || other.second.Heat < victim->Heat))
+					{
+						victimIndex = other.first;
+						victim = &other.second;
+					}
+				}
+
+				if (!victim || (segment.Hint != TIER_HINT_HOT && victim->Heat >= segment.Heat))
+				{
+					return true; // Nothing colder to make room
+				}
+				if (!migrateLocked(victimIndex, *victim))
+				{
+					return false;
+				}
+			}
+			return migrateLocked(segmentIndex, segment);
+		}
+
+		bool TieredMedia::migrateLocked(UINT_64 segmentIndex, Segment &segment)
+		{
+			UINT_64 lba = segmentIndex * SegmentBlocks;
+			UINT_32 blocks = (UINT_32)std::min(SegmentBlocks, NumberOfBlocks - lba);
+			MediaBackend* from = getTier(segment);
+			MediaBackend* to = segment.Fast ? SlowMedia.get() : FastMedia.get();
+
+			Payload data((UINT_64)blocks * BlockSize);
+			if (!from->read(lba, blocks, data.getBuffer()) || !to->write(lba, blocks, data.getBuffer()) || !from->deallocate(lba, blocks))
+			{
+				LOG_ERROR("Failed to migrate tier segment " + std::to_string(segmentIndex));
+				return false;
+			}
+
+			segment.Fast = !segment.Fast;
+			if (segment.Fast)
+			{
+				Statistics.FSR++;
+				Statistics.PS++;
+			}
+			else
+			{
+				Statistics.FSR--;
+				Statistics.DS++;
+			}
+			return true;
+		}
+
+		MediaBackend* TieredMedia::getTier(const Segment &segment)
+		{
+			return segment.Fast ? FastMedia.get() : SlowMedia.get();
+		}
+	}
+}
@@ -0,0 +1,204 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Tier.h - A header file for the Tiered (hot/cold) media
+*/
+
+#pragma once
+
+#include "LogPage.h"
+#include "Media.h"
+#include "Types.h"
+
+#include <memory>
+#include <unordered_map>
+
+#define TIER_SEGMENT_SIZE (64 * 1024) // Bytes moved between tiers at a time. Heat and hints are tracked per segment.
+#define TIER_PROMOTION_HEAT 4 // A slow segment accessed this many times (since the last decay) moves to the fast tier
+#define TIER_DECAY_ACCESSES 4096 // Every segment's heat is halved after this many accesses, so old activity fades
+#define TIER_MAX_HEAT 0xFFFF // Heat saturates here
+
+namespace cnvme
+{
+	namespace media
+	{
+		/// <summary>
+		/// What the host has told us about a segment with Dataset Management
+		/// </summary>
+		enum TIER_HINT
+		{
+			TIER_HINT_NONE = 0, // Placed by heat alone
+			TIER_HINT_HOT = 1, // Frequent access or low latency wanted: pinned in the fast tier while it fits
+			TIER_HINT_COLD = 2, // Infrequent access or latency doesn't matter: kept in the slow tier
+		};
+
+		/// <summary>
+		/// Two tier media: a small fast media (normally a RamMedia) in front of a large slow one (normally a FileMedia).
+		/// Data moves between the tiers a segment at a time and a segment is only ever in one of them, at the same LBA.
+		///   New segments go to the fast tier while it has room. Each access heats a segment up and heat decays over time;
+		///   a slow segment that gets hot enough is promoted, demoting the coldest fast segment if the fast tier is full.
+		/// Dataset Management context attributes override the heat: hot ranges are promoted straight away and are never
+		///   picked for demotion, cold ranges are demoted straight away and are never promoted.
+		/// Statistics are returned as a vendor specific log page.
+		/// </summary>
+		class TieredMedia : public MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor. Both tiers must have the same block size and number of blocks (the fast tier should be sparse).
+			/// </summary>
+			/// <param name="fastMedia">The fast tier. The tiered media takes ownership.</param>
+			/// <param name="slowMedia">The slow tier. The tiered media takes ownership.</param>
+			/// <param name="fastCapacityInBlocks">Most blocks to keep in the fast tier at once</param>
+			TieredMedia(MediaBackend* fastMedia, MediaBackend* slowMedia, UINT_64 fastCapacityInBlocks);
+
+			bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override;
+			bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) override;
+			bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) override;
+			bool flush() override;
+
+			/// <summary>
+			/// Formats both tiers and forgets all heat and hints
+			/// </summary>
+			bool format() override;
+
+			/// <summary>
+			/// Applies Dataset Management context attributes to every segment the range touches
+			/// </summary>
+			/// <param name="lba">Starting LBA</param>
+			/// <param name="numberOfBlocks">Number of blocks</param>
+			/// <param name="contextAttributes">Context attributes of the range</param>
+			/// <returns>True on success</returns>
+			bool hint(UINT_64 lba, UINT_64 numberOfBlocks, UINT_32 contextAttributes) override;
+
+			/// <summary>
+			/// Passes the window on to both tiers
+			/// </summary>
+			void setDeterministic(bool deterministic) override;
+
+			/// <summary>
+			/// Returns true if the segment holding the LBA is in the fast tier
+			/// </summary>
+			/// <param name="lba">LBA</param>
+			/// <returns>True if fast</returns>
+			bool isFast(UINT_64 lba);
+
+			/// <summary>
+			/// Returns the current statistics as the tiering log page
+			/// </summary>
+			/// <returns>TIERING_STATISTICS_LOG</returns>
+			logpages::TIERING_STATISTICS_LOG getStatistics();
+
+			/// <summary>
+			/// Converts Dataset Management context attributes to a hint
+			/// </summary>
+			/// <param name="contextAttributes">Context attributes</param>
+			/// <returns>TIER_HINT</returns>
+			static TIER_HINT getHint(UINT_32 contextAttributes);
+
+		private:
+			/// <summary>
+			/// Placement of a segment that has been written or hinted
+			/// </summary>
+			struct Segment
+			{
+				/// <summary>
+				/// True if the data is in the fast tier
+				/// </summary>
+				bool Fast;
+
+				/// <summary>
+				/// Accesses since the last decay (roughly)
+				/// </summary>
+				UINT_32 Heat;
+
+				/// <summary>
+				/// Latest hint from the host
+				/// </summary>
+				TIER_HINT Hint;
+			};
+
+			/// <summary>
+			/// Returns the segment, adding it (in the fast tier if there is room) if it isn't tracked yet.
+			/// Must be called with TierMutex held.
+			/// </summary>
+			/// <param name="segmentIndex">Segment index</param>
+			/// <returns>The segment</returns>
+			Segment& getSegmentLocked(UINT_64 segmentIndex);
+
+			/// <summary>
+			/// Heats up a segment, decaying everything if it's time, and promotes it if it's now hot enough.
+			/// Must be called with TierMutex held.
+			/// </summary>
+			/// <param name="segmentIndex">Segment index</param>
+			/// <param name="segment">The segment</param>
+			/// <returns>False if a needed migration failed</returns>
+			bool accessLocked(UINT_64 segmentIndex, Segment &segment);
+
+			/// <summary>
+			/// Moves a slow segment to the fast tier, demoting the coldest demotable fast segment if there is no room.
+			/// Does nothing if there is no room and nothing can be demoted. Must be called with TierMutex held.
+			/// </summary>
+			/// <param name="segmentIndex">Segment index</param>
+			/// <param name="segment">The segment</param>
+			/// <returns>False if a migration failed</returns>
+			bool promoteLocked(UINT_64 segmentIndex, Segment &segment);
+
+			/// <summary>
+			/// Moves a segment's data from one tier to the other and deallocates it from the first.
+			/// Must be called with TierMutex held.
+			/// </summary>
+			/// <param name="segmentIndex">Segment index</param>
+			/// <param name="segment">The segment</param>
+			/// <returns>True on success</returns>
+			bool migrateLocked(UINT_64 segmentIndex, Segment &segment);
+
+			/// <summary>
+			/// Returns the tier holding the segment
+			/// </summary>
+			/// <param name="segment">The segment</param>
+			/// <returns>The tier</returns>
+			MediaBackend* getTier(const Segment &segment);
+
+			/// <summary>
+			/// The fast tier
+			/// </summary>
+			std::unique_ptr<MediaBackend> FastMedia;
+
+			/// <summary>
+			/// The slow tier
+			/// </summary>
+			std::unique_ptr<MediaBackend> SlowMedia;
+
+			/// <summary>
+			/// Blocks per segment
+			/// </summary>
+			UINT_64 SegmentBlocks;
+
+			/// <summary>
+			/// Most segments in the fast tier at once
+			/// </summary>
+			UINT_64 FastCapacityInSegments;
+
+			/// <summary>
+			/// Segment index -> placement. Segments not in here have never been written or hinted and are in the slow tier.
+			/// </summary>
+			std::unordered_map<UINT_64, Segment> Segments;
+
+			/// <summary>
+			/// Accesses since the last decay
+			/// </summary>
+			UINT_64 AccessesSinceDecay;
+
+			/// <summary>
+			/// Counters for the log page. Residency and sizes are filled in by getStatistics().
+			/// </summary>
+			logpages::TIERING_STATISTICS_LOG Statistics;
+
+			/// <summary>
+			/// Guards everything above (and is held across tier I/O so a segment can't move mid access)
+			/// </summary>
+			std::mutex TierMutex;
+		};
+	}
+}
@@ -0,0 +1,321 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+WriteCache.cpp - An implementation file for the Volatile Write Cache
+*/
+
+#include "WriteCache.h"
+
+namespace cnvme
+{
+	namespace media
+	{
+		WriteCacheMedia::WriteCacheMedia(MediaBackend* backingMedia) : MediaBackend(backingMedia->getBlockSize(), backingMedia->getNumberOfBlocks())
+		{
+			BackingMedia = backingMedia;
+			InFlightValid = false;
+			DestageCursor = 0;
+			DirtyBytes = 0;
+			CoalescedWrites = 0;
+			WriteBacks = 0;
+			RecentWrites = 0;
+			Enabled = false;
+			Deterministic = false;
+			DestageThread = LoopingThread([&] {WriteCacheMedia::destage(); }, WRITE_CACHE_DESTAGE_SLEEP_MS);
+		}
+
+		WriteCacheMedia::~WriteCacheMedia()
+		{
+			setEnabled(false);
+		}
+
+		bool WriteCacheMedia::read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer)
+		{
+			if (!Enabled && DirtyBytes == 0)
+			{
+				return BackingMedia->read(lba, numberOfBlocks, buffer); // Nothing cached to overlay
+			}
+
+			while (true)
+			{
+				UINT_64 writeBacks;
+				{
+					std::lock_guard<std::mutex> lock(CacheMutex);
+					writeBacks = WriteBacks;
+				}
+
+				if (!BackingMedia->read(lba, numberOfBlocks, buffer))
+				{
+					return false;
+				}
+
+				// If a write back finished during the backing read, its data may be in neither buffer nor cache. Read again.
+				std::lock_guard<std::mutex> lock(CacheMutex);
+				if (WriteBacks == writeBacks)
+				{
+					overlayLocked(lba, numberOfBlocks, buffer);
+					return true;
+				}
+			}
+		}
+
+		bool WriteCacheMedia::write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer)
+		{
+			if (!isValidRange(lba, numberOfBlocks))
+			{
+				LOG_ERROR("Attempted to write out of range. LBA: " + std::to_string(lba) + ". Blocks: " + std::to_string(numberOfBlocks));
+				return false;
+			}
+
+			UINT_64 size = (UINT_64)numberOfBlocks * BlockSize;
+			if (!Enabled || size > WRITE_CACHE_MAX_EXTENT_SIZE)
+			{
+				// Write through. Anything cached for this range would be older, so it has to go first.
+				std::lock_guard<std::mutex> destageLock(DestageMutex);
+				if (getDirtyBytes())
+				{
+					writeBackAllLocked();
+				}
+				return BackingMedia->write(lba, numberOfBlocks, buffer);
+			}
+
+			while (true)
+			{
+				{
+					std::lock_guard<std::mutex> lock(CacheMutex);
+					if (DirtyBytes + size <= WRITE_CACHE_SIZE)
+					{
+						break;
+					}
+				}
+
+				// Full. Make room ourselves.
+				std::lock_guard<std::mutex> destageLock(DestageMutex);
+				destageOneLocked();
+			}
+
+			std::lock_guard<std::mutex> lock(CacheMutex);
+			UINT_64 newStart = lba;
+			UINT_64 newEnd = lba + numberOfBlocks;
+
+			// Find every extent that overlaps the new data, plus ones that just touch it if the result stays small enough
+			auto first = Extents.upper_bound(newStart);
+			if (first != Extents.begin())
+			{
+				auto previous = std::prev(first);
+				UINT_64 previousEnd = previous->first + previous->second.size() / BlockSize;
+				if (previousEnd > newStart || (previousEnd == newStart && (newEnd - previous->first) * BlockSize <= WRITE_CACHE_MAX_EXTENT_SIZE))
+				{
+					first = previous;
+				}
+			}
+
+			UINT_64 mergedStart = first != Extents.end() ? std::min(newStart, first->first) : newStart;
+			UINT_64 mergedEnd = newEnd;
+			auto last = first;
+			for (; last != Extents.end() && last->first < newEnd; last++)
+			{
+				mergedEnd = std::max<UINT_64>(mergedEnd, last->first + last->second.size() / BlockSize);
+			}
+			if (last != Extents.end() && last->first == newEnd &&
+				(last->first + last->second.size() / BlockSize - mergedStart) * BlockSize <= WRITE_CACHE_MAX_EXTENT_SIZE)
+			{
+				mergedEnd = last->first + last->second.size() / BlockSize;
+				last++;
+			}
+
+			if (first == last)
+			{
+				Extents.emplace(newStart, std::vector<BYTE>(buffer, buffer + size));
+				DirtyBytes += size;
+			}
+			else if (std::next(first) == last && first->first == mergedStart && first->first + first->second.size() / BlockSize == newStart)
+			{
+				// Sequential append onto one extent
+				first->second.insert(first->second.end(), buffer, buffer + size);
+				DirtyBytes += size;
+				CoalescedWrites++;
+			}
+			else
+			{
+				std::vector<BYTE> merged((size_t)((mergedEnd - mergedStart) * BlockSize));
+				for (auto extent = first; extent != last; extent++)
+				{
+					memcpy(merged.data() + (extent->first - mergedStart) * BlockSize, extent->second.data(), extent->second.size());
+					DirtyBytes -= extent->second.size();
+				}
+				memcpy(merged.data() + (newStart - mergedStart) * BlockSize, buffer, (size_t)size);
+				DirtyBytes += merged.size();
+				CoalescedWrites++;
+
+				Extents.erase(first, last);
+				Extents.emplace(mergedStart, std::move(merged));
+			}
+
+			RecentWrites++;
+			return true;
+		}
+
+		bool WriteCacheMedia::deallocate(UINT_64 lba, UINT_64 numberOfBlocks)
+		{
+			std::lock_guard<std::mutex> destageLock(DestageMutex);
+			if (getDirtyBytes())
+			{
+				writeBackAllLocked();
+			}
+			return BackingMedia->deallocate(lba, numberOfBlocks);
+		}
+
+		bool WriteCacheMedia::copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks)
+		{
+			std::lock_guard<std::mutex> destageLock(DestageMutex);
+			if (getDirtyBytes())
+			{
+				writeBackAllLocked();
+			}
+			return BackingMedia->copy(sourceLba, destinationLba, numberOfBlocks);
+		}
+
+		bool WriteCacheMedia::flush()
+		{
+			std::lock_guard<std::mutex> destageLock(DestageMutex);
+			return writeBackAllLocked() && BackingMedia->flush();
+		}
+
+		bool WriteCacheMedia::format()
+		{
+			std::lock_guard<std::mutex> destageLock(DestageMutex); // Nothing is in flight while this is held
+			{
+				std::lock_guard<std::mutex> lock(CacheMutex);
+				Extents.clear();
+				DirtyBytes = 0;
+				WriteBacks++;
+			}
+			return BackingMedia->format();
+		}
+
+		void WriteCacheMedia::setEnabled(bool enabled)
+		{
+			if (enabled == Enabled)
+			{
+				return;
+			}
+
+			Enabled = enabled;
+			if (enabled)
+			{
+				DestageThread.start();
+			}
+			else
+			{
+				DestageThread.end();
+				flush();
+			}
+		}
+
+		bool WriteCacheMedia::isEnabled()
+		{
+			return Enabled;
+		}
+
+		UINT_64 WriteCacheMedia::getDirtyBytes()
+		{
+			std::lock_guard<std::mutex> lock(CacheMutex);
+			return DirtyBytes;
+		}
+
+		UINT_64 WriteCacheMedia::getCoalescedWrites()
+		{
+			std::lock_guard<std::mutex> lock(CacheMutex);
+			return CoalescedWrites;
+		}
+
+		void WriteCacheMedia::setDeterministic(bool deterministic)
+		{
+			Deterministic = deterministic;
+		}
+
+		void WriteCacheMedia::destage()
+		{
+			// Drain to the threshold while the host is busy (leaving room to coalesce), or completely once it goes idle
+			bool idle = RecentWrites.exchange(0) == 0;
+			UINT_64 target = idle ? 0 : WRITE_CACHE_DESTAGE_THRESHOLD;
+
+			std::lock_guard<std::mutex> destageLock(DestageMutex);
+			while (!Deterministic && getDirtyBytes() > target && destageOneLocked())
+			{
+			}
+		}
+
+		bool WriteCacheMedia::destageOneLocked()
+		{
+			{
+				std::lock_guard<std::mutex> lock(CacheMutex);
+				if (Extents.empty())
+				{
+					return false;
+				}
+
+				auto extent = Extents.lower_bound(DestageCursor);
+				if (extent == Extents.end())
+				{
+					extent = Extents.begin(); // Wrap around
+				}
+
+				InFlightExtent.first = extent->first;
+				InFlightExtent.second.swap(extent->second);
+				InFlightValid = true;
+				Extents.erase(extent);
+				DestageCursor = InFlightExtent.first + InFlightExtent.second.size() / BlockSize;
+			}
+
+			bool written = BackingMedia->write(InFlightExtent.first, (UINT_32)(InFlightExtent.second.size() / BlockSize), InFlightExtent.second.data());
+			ASSERT_IF(!written, "Write back of a cached extent failed");
+
+			std::lock_guard<std::mutex> lock(CacheMutex);
+			DirtyBytes -= InFlightExtent.second.size();
+			InFlightValid = false;
+			InFlightExtent.second.clear();
+			WriteBacks++;
+			return true;
+		}
+
+		bool WriteCacheMedia::writeBackAllLocked()
+		{
+			while (destageOneLocked())
+			{
+			}
+			return getDirtyBytes() == 0;
+		}
+
+		void WriteCacheMedia::overlayLocked(UINT_64 lba, UINT_64 numberOfBlocks, BYTE* buffer)
+		{
+			UINT_64 end = lba + numberOfBlocks;
+			auto overlay = [&](UINT_64 extentStart, const std::vector<BYTE> &data) {
+				UINT_64 extentEnd = extentStart + data.size() / BlockSize;
+				UINT_64 start = std::max(lba, extentStart);
+				UINT_64 stop = std::min(end, extentEnd);
+				if (start < stop)
+				{
+					memcpy(buffer + (start - lba) * BlockSize, data.data() + (start - extentStart) * BlockSize, (size_t)((stop - start) * BlockSize));
+				}
+			};
+
+			// In flight data is older than anything in Extents, so it goes first
+			if (InFlightValid)
+			{
+				overlay(InFlightExtent.first, InFlightExtent.second);
+			}
+
+			auto extent = Extents.upper_bound(lba);
+			if (extent != Extents.begin())
+			{
+				extent--;
+			}
+			for (; extent != Extents.end() && extent->first < end; extent++)
+			{
+				overlay(extent->first, extent->second);
+			}
+		}
+	}
+}
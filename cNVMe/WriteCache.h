@@ -0,0 +1,188 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+WriteCache.h - A header file for the Volatile Write Cache
+*/
+
+#pragma once
+
+#include "LoopingThread.h"
+#include "Media.h"
+#include "Types.h"
+
+#define WRITE_CACHE_SIZE (16 * 1024 * 1024) // Bytes of dirty data the cache can hold
+#define WRITE_CACHE_DESTAGE_THRESHOLD (WRITE_CACHE_SIZE / 4) // The destager drains down to this while writes keep coming
+#define WRITE_CACHE_MAX_EXTENT_SIZE (1024 * 1024) // Adjacent writes stop coalescing once an extent is this big
+#define WRITE_CACHE_DESTAGE_SLEEP_MS 1
+
+namespace cnvme
+{
+	namespace media
+	{
+		/// <summary>
+		/// Controller side DRAM write cache in front of another MediaBackend.
+		/// When enabled, a write completes as soon as it is in the cache. Overlapping and adjacent writes
+		///   coalesce into extents, and a background destager drains extents (in LBA order) to the backing media.
+		///   flush() returns once everything cached has been written and the backing media has been flushed.
+		/// When disabled, everything passes straight through.
+		/// </summary>
+		class WriteCacheMedia : public MediaBackend
+		{
+		public:
+			/// <summary>
+			/// Constructor. Starts disabled.
+			/// </summary>
+			/// <param name="backingMedia">Media to cache. Not owned.</param>
+			WriteCacheMedia(MediaBackend* backingMedia);
+
+			/// <summary>
+			/// Destructor. Writes back anything still cached.
+			/// </summary>
+			~WriteCacheMedia();
+
+			bool read(UINT_64 lba, UINT_32 numberOfBlocks, BYTE* buffer) override;
+			bool write(UINT_64 lba, UINT_32 numberOfBlocks, const BYTE* buffer) override;
+			bool deallocate(UINT_64 lba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Writes back the cache then lets the backing media copy
+			/// </summary>
+			bool copy(UINT_64 sourceLba, UINT_64 destinationLba, UINT_64 numberOfBlocks) override;
+
+			/// <summary>
+			/// Writes back everything cached then flushes the backing media
+			/// </summary>
+			bool flush() override;
+
+			/// <summary>
+			/// Drops everything cached (there's no point writing back data being erased) then formats the backing media
+			/// </summary>
+			bool format() override;
+
+			/// <summary>
+			/// Turns caching on or off. Turning it off writes back everything first.
+			/// </summary>
+			/// <param name="enabled">True to cache writes</param>
+			void setEnabled(bool enabled);
+
+			/// <summary>
+			/// Returns true if writes are being cached
+			/// </summary>
+			/// <returns>True if enabled</returns>
+			bool isEnabled();
+
+			/// <summary>
+			/// Returns the number of dirty bytes in the cache (including any being written back)
+			/// </summary>
+			/// <returns>Dirty bytes</returns>
+			UINT_64 getDirtyBytes();
+
+			/// <summary>
+			/// Returns the number of host writes that were merged with data already in the cache
+			/// </summary>
+			/// <returns>Coalesced writes</returns>
+			UINT_64 getCoalescedWrites();
+
+			/// <summary>
+			/// Pauses the destager while deterministic. Writes that don't fit are still written back on the spot.
+			/// </summary>
+			void setDeterministic(bool deterministic) override;
+
+		private:
+			/// <summary>
+			/// Background destager step. Called by DestageThread.
+			/// </summary>
+			void destage();
+
+			/// <summary>
+			/// Writes one extent back to the backing media. Must be called with DestageMutex held (and CacheMutex not held).
+			/// </summary>
+			/// <returns>False if the cache was empty</returns>
+			bool destageOneLocked();
+
+			/// <summary>
+			/// Writes everything back. Must be called with DestageMutex held.
+			/// </summary>
+			/// <returns>True if every extent was written back</returns>
+			bool writeBackAllLocked();
+
+			/// <summary>
+			/// Copies any cached data for the given range over buffer. Must be called with CacheMutex held.
+			/// </summary>
+			/// <param name="lba">Starting LBA of buffer</param>
+			/// <param name="numberOfBlocks">Number of blocks in buffer</param>
+			/// <param name="buffer">Data read from the backing media</param>
+			void overlayLocked(UINT_64 lba, UINT_64 numberOfBlocks, BYTE* buffer);
+
+			/// <summary>
+			/// The media being cached
+			/// </summary>
+			MediaBackend* BackingMedia;
+
+			/// <summary>
+			/// Dirty extents: starting LBA -> data. Extents never overlap.
+			/// </summary>
+			std::map<UINT_64, std::vector<BYTE>> Extents;
+
+			/// <summary>
+			/// The extent being written back (if InFlightValid). Still readable until the write completes.
+			/// </summary>
+			std::pair<UINT_64, std::vector<BYTE>> InFlightExtent;
+
+			/// <summary>
+			/// True while InFlightExtent is being written back
+			/// </summary>
+			bool InFlightValid;
+
+			/// <summary>
+			/// LBA the destager continues from (elevator order)
+			/// </summary>
+			UINT_64 DestageCursor;
+
+			/// <summary>
+			/// Bytes in Extents and InFlightExtent. Atomic so an idle cache can be read past without CacheMutex.
+			/// </summary>
+			std::atomic<UINT_64> DirtyBytes;
+
+			/// <summary>
+			/// Writes merged with cached data
+			/// </summary>
+			UINT_64 CoalescedWrites;
+
+			/// <summary>
+			/// Bumped whenever cached data leaves the cache. Reads use it to notice their backing read raced a write back.
+			/// </summary>
+			UINT_64 WriteBacks;
+
+			/// <summary>
+			/// Writes since the destager last looked. If none, the host is idle and the destager drains everything.
+			/// </summary>
+			std::atomic<UINT_64> RecentWrites;
+
+			/// <summary>
+			/// True if caching
+			/// </summary>
+			std::atomic<bool> Enabled;
+
+			/// <summary>
+			/// True while the destager is paused for a deterministic window
+			/// </summary>
+			std::atomic<bool> Deterministic;
+
+			/// <summary>
+			/// Guards Extents, InFlightExtent, InFlightValid, DestageCursor, DirtyBytes (when changing), CoalescedWrites and WriteBacks
+			/// </summary>
+			std::mutex CacheMutex;
+
+			/// <summary>
+			/// Held by whoever is writing extents back, so only one write back is ever in flight
+			/// </summary>
+			std::mutex DestageMutex;
+
+			/// <summary>
+			/// Runs destage() while enabled
+			/// </summary>
+			LoopingThread DestageThread;
+		};
+	}
+}
@@ -0,0 +1,214 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Zone.cpp - An implementation file for the Zoned Namespace (ZNS) zones
+*/
+
+#include "Constants.h"
+#include "Strings.h"
+#include "Zone.h"
+
+using namespace cnvme::constants::status::codes;
+
+namespace cnvme
+{
+	namespace zns
+	{
+		std::string ZONE_DESCRIPTOR::toString() const
+		{
+			std::string retStr;
+			retStr += "Zone Descriptor:\n";
+			retStr += strings::toString(ToStringParams(ZT, "Zone Type"));
+			retStr += strings::toString(ToStringParams(ZS, "Zone State"));
+			retStr += strings::toString(ToStringParams(ZA, "Zone Attributes"));
+			retStr += strings::toString(ToStringParams(ZCAP, "Zone Capacity"));
+			retStr += strings::toString(ToStringParams(ZSLBA, "Zone Start Logical Block Address"));
+			retStr += strings::toString(ToStringParams(WP, "Write Pointer"));
+			return retStr;
+		}
+
+		std::string REPORT_ZONES_HEADER::toString() const
+		{
+			std::string retStr;
+			retStr += "Report Zones Header:\n";
+			retStr += strings::toString(ToStringParams(NZ, "Number of Zones"));
+			return retStr;
+		}
+
+		Zone::Zone(UINT_64 zoneStartLba, UINT_64 zoneCapacity)
+		{
+			ZoneStartLba = zoneStartLba;
+			ZoneCapacity = zoneCapacity;
+			WritePointerOffset = 0;
+			State = ZONE_STATE_EMPTY;
+		}
+
+		UINT_8 Zone::append(UINT_32 numberOfBlocks, UINT_64 &assignedLba)
+		{
+			UINT_8 status = getWriteStateError();
+			if (status)
+			{
+				return status;
+			}
+
+			if (numberOfBlocks > ZoneCapacity)
+			{
+				return specific::ZONE_BOUNDARY_ERROR;
+			}
+
+			// The whole point: no lock, just claim the next numberOfBlocks. The write pointer only moves if they fit,
+			//   so it never goes past capacity, and a reset or finish is never undone.
+			UINT_64 offset = WritePointerOffset;
+			do
+			{
+				if (offset + numberOfBlocks > ZoneCapacity)
+				{
+					return offset >= ZoneCapacity ? specific::ZONE_IS_FULL : specific::ZONE_BOUNDARY_ERROR;
+				}
+			} while (!WritePointerOffset.compare_exchange_weak(offset, offset + numberOfBlocks));
+
+			transitionAfterWrite(offset + numberOfBlocks);
+			assignedLba = ZoneStartLba + offset;
+			return generic::SUCCESSFUL_COMPLETION;
+		}
+
+		UINT_8 Zone::write(UINT_64 lba, UINT_32 numberOfBlocks)
+		{
+			UINT_8 status = getWriteStateError();
+			if (status)
+			{
+				return status;
+			}
+
+			if (lba < ZoneStartLba || (lba - ZoneStartLba) + numberOfBlocks > ZoneCapacity)
+			{
+				return specific::ZONE_BOUNDARY_ERROR;
+			}
+
+			// A regular write must land exactly on the write pointer
+			UINT_64 expectedOffset = lba - ZoneStartLba;
+			if (!WritePointerOffset.compare_exchange_strong(expectedOffset, expectedOffset + numberOfBlocks))
+			{
+				return specific::ZONE_INVALID_WRITE;
+			}
+
+			transitionAfterWrite(expectedOffset + numberOfBlocks);
+			return generic::SUCCESSFUL_COMPLETION;
+		}
+
+		UINT_8 Zone::performAction(UINT_8 action)
+		{
+			std::lock_guard<std::mutex> lock(ActionMutex);
+			UINT_8 state = State;
+
+			if (state == ZONE_STATE_OFFLINE)
+			{
+				return action == ZONE_SEND_ACTION_OFFLINE ? generic::SUCCESSFUL_COMPLETION : specific::ZONE_IS_OFFLINE;
+			}
+
+			if (state == ZONE_STATE_READ_ONLY && action != ZONE_SEND_ACTION_OFFLINE)
+			{
+				return specific::ZONE_IS_READ_ONLY;
+			}
+
+			switch (action)
+			{
+			case ZONE_SEND_ACTION_OPEN:
+				if (state == ZONE_STATE_FULL)
+				{
+					return specific::INVALID_ZONE_STATE_TRANSITION;
+				}
+				State = ZONE_STATE_EXPLICITLY_OPENED;
+				break;
+			case ZONE_SEND_ACTION_CLOSE:
+				if (state == ZONE_STATE_EMPTY || state == ZONE_STATE_FULL)
+				{
+					return specific::INVALID_ZONE_STATE_TRANSITION;
+				}
+				// A zone that was opened but never written goes back to empty
+				State = WritePointerOffset == 0 ? ZONE_STATE_EMPTY : ZONE_STATE_CLOSED;
+				break;
+			case ZONE_SEND_ACTION_FINISH:
+				WritePointerOffset = ZoneCapacity;
+				State = ZONE_STATE_FULL;
+				break;
+			case ZONE_SEND_ACTION_RESET:
+				WritePointerOffset = 0;
+				State = ZONE_STATE_EMPTY;
+				break;
+			case ZONE_SEND_ACTION_OFFLINE:
+				if (state != ZONE_STATE_READ_ONLY)
+				{
+					return specific::INVALID_ZONE_STATE_TRANSITION;
+				}
+				State = ZONE_STATE_OFFLINE;
+				break;
+			default:
+				ASSERT("Unknown zone send action: " + std::to_string(action) + ". The caller should have validated it.");
+				return specific::INVALID_ZONE_STATE_TRANSITION;
+			}
+
+			return generic::SUCCESSFUL_COMPLETION;
+		}
+
+		ZONE_DESCRIPTOR Zone::getDescriptor()
+		{
+			ZONE_DESCRIPTOR descriptor = { 0 };
+			descriptor.ZT = ZONE_TYPE_SEQUENTIAL_WRITE_REQUIRED;
+			descriptor.ZS = getState();
+			descriptor.ZCAP = ZoneCapacity;
+			descriptor.ZSLBA = ZoneStartLba;
+			descriptor.WP = getWritePointer();
+			return descriptor;
+		}
+
+		UINT_8 Zone::getState()
+		{
+			return State;
+		}
+
+		UINT_64 Zone::getStartLba() const
+		{
+			return ZoneStartLba;
+		}
+
+		UINT_64 Zone::getCapacity() const
+		{
+			return ZoneCapacity;
+		}
+
+		UINT_64 Zone::getWritePointer()
+		{
+			return ZoneStartLba + WritePointerOffset;
+		}
+
+		UINT_8 Zone::getWriteStateError()
+		{
+			switch (State)
+			{
+			case ZONE_STATE_FULL:
+				return specific::ZONE_IS_FULL;
+			case ZONE_STATE_READ_ONLY:
+				return specific::ZONE_IS_READ_ONLY;
+			case ZONE_STATE_OFFLINE:
+				return specific::ZONE_IS_OFFLINE;
+			}
+			return generic::SUCCESSFUL_COMPLETION;
+		}
+
+		void Zone::transitionAfterWrite(UINT_64 newOffset)
+		{
+			if (newOffset == ZoneCapacity)
+			{
+				State = ZONE_STATE_FULL;
+				return;
+			}
+
+			// Empty / Closed -> Implicitly Opened. Only one racing writer needs to win this.
+			UINT_8 state = State;
+			while ((state == ZONE_STATE_EMPTY || state == ZONE_STATE_CLOSED) && !State.compare_exchange_weak(state, ZONE_STATE_IMPLICITLY_OPENED))
+			{
+			}
+		}
+	}
+}
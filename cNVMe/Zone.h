@@ -0,0 +1,193 @@
+/*
+This file is part of cNVMe and is released under the MIT License
+(C) - Charles Machalow - 2017
+Zone.h - A header file for the Zoned Namespace (ZNS) zones
+*/
+
+#pragma once
+
+#include "Types.h"
+
+namespace cnvme
+{
+	namespace zns
+	{
+		/// <summary>
+		/// Zone states (ZS field of a zone descriptor)
+		/// </summary>
+		enum ZONE_STATE
+		{
+			ZONE_STATE_EMPTY = 0x1,
+			ZONE_STATE_IMPLICITLY_OPENED = 0x2,
+			ZONE_STATE_EXPLICITLY_OPENED = 0x3,
+			ZONE_STATE_CLOSED = 0x4,
+			ZONE_STATE_READ_ONLY = 0xD,
+			ZONE_STATE_FULL = 0xE,
+			ZONE_STATE_OFFLINE = 0xF,
+		};
+
+		/// <summary>
+		/// Zone Send Action (Zone Management Send CDW13 bits 7:0)
+		/// </summary>
+		enum ZONE_SEND_ACTION
+		{
+			ZONE_SEND_ACTION_CLOSE = 0x1,
+			ZONE_SEND_ACTION_FINISH = 0x2,
+			ZONE_SEND_ACTION_OPEN = 0x3,
+			ZONE_SEND_ACTION_RESET = 0x4,
+			ZONE_SEND_ACTION_OFFLINE = 0x5,
+		};
+
+		/// <summary>
+		/// Zone Receive Action (Zone Management Receive CDW13 bits 7:0)
+		/// </summary>
+		enum ZONE_RECEIVE_ACTION
+		{
+			ZONE_RECEIVE_ACTION_REPORT_ZONES = 0x0,
+		};
+
+		/// <summary>
+		/// Zone type for a sequential write required zone (the only kind we have)
+		/// </summary>
+		const UINT_8 ZONE_TYPE_SEQUENTIAL_WRITE_REQUIRED = 0x2;
+
+		/// <summary>
+		/// Zone Descriptor as returned by Report Zones
+		/// </summary>
+		typedef struct ZONE_DESCRIPTOR
+		{
+			UINT_8 ZT : 4; // Zone Type
+			UINT_8 RSVD0 : 4; // Reserved
+			UINT_8 RSVD1 : 4; // Reserved
+			UINT_8 ZS : 4; // Zone State
+			UINT_8 ZA; // Zone Attributes
+			UINT_8 RSVD2[5]; // Reserved
+			UINT_64 ZCAP; // Zone Capacity
+			UINT_64 ZSLBA; // Zone Start Logical Block Address
+			UINT_64 WP; // Write Pointer
+			UINT_8 RSVD3[32]; // Reserved
+
+			std::string toString() const;
+		}ZONE_DESCRIPTOR, *PZONE_DESCRIPTOR;
+		static_assert(sizeof(ZONE_DESCRIPTOR) == 64, "ZONE_DESCRIPTOR should be 64 byte(s) in size.");
+
+		/// <summary>
+		/// Header of the Report Zones data structure. Followed by ZONE_DESCRIPTORs.
+		/// </summary>
+		typedef struct REPORT_ZONES_HEADER
+		{
+			UINT_64 NZ; // Number of Zones
+			UINT_8 RSVD0[56]; // Reserved
+
+			std::string toString() const;
+		}REPORT_ZONES_HEADER, *PREPORT_ZONES_HEADER;
+		static_assert(sizeof(REPORT_ZONES_HEADER) == 64, "REPORT_ZONES_HEADER should be 64 byte(s) in size.");
+
+		/// <summary>
+		/// A single sequential write required zone.
+		/// Blocks are claimed by a compare-exchange loop that only moves the write pointer if the whole append fits, so any
+		///   number of threads can Zone Append into the same zone without any other coordination, and it never passes capacity.
+		/// All methods returning UINT_8 return a command specific status code (0 on success).
+		/// </summary>
+		class Zone
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			/// <param name="zoneStartLba">First LBA of the zone</param>
+			/// <param name="zoneCapacity">Number of writable blocks in the zone</param>
+			Zone(UINT_64 zoneStartLba, UINT_64 zoneCapacity);
+
+			/// <summary>
+			/// Reserves numberOfBlocks at the write pointer.
+			/// </summary>
+			/// <param name="numberOfBlocks">Number of blocks to append</param>
+			/// <param name="assignedLba">Set to the first LBA reserved for this append on success</param>
+			/// <returns>Status code</returns>
+			UINT_8 append(UINT_32 numberOfBlocks, UINT_64 &assignedLba);
+
+			/// <summary>
+			/// Reserves numberOfBlocks for a regular write, which must start exactly at the write pointer
+			/// </summary>
+			/// <param name="lba">LBA the host asked to write</param>
+			/// <param name="numberOfBlocks">Number of blocks to write</param>
+			/// <returns>Status code</returns>
+			UINT_8 write(UINT_64 lba, UINT_32 numberOfBlocks);
+
+			/// <summary>
+			/// Performs the given Zone Send Action
+			/// </summary>
+			/// <param name="action">ZONE_SEND_ACTION</param>
+			/// <returns>Status code</returns>
+			UINT_8 performAction(UINT_8 action);
+
+			/// <summary>
+			/// Returns the Zone Descriptor for this zone
+			/// </summary>
+			/// <returns>ZONE_DESCRIPTOR</returns>
+			ZONE_DESCRIPTOR getDescriptor();
+
+			/// <summary>
+			/// Returns the current zone state
+			/// </summary>
+			/// <returns>ZONE_STATE</returns>
+			UINT_8 getState();
+
+			/// <summary>
+			/// Returns the first LBA of the zone
+			/// </summary>
+			/// <returns>LBA</returns>
+			UINT_64 getStartLba() const;
+
+			/// <summary>
+			/// Returns the number of writable blocks in the zone
+			/// </summary>
+			/// <returns>Capacity in blocks</returns>
+			UINT_64 getCapacity() const;
+
+			/// <summary>
+			/// Returns the absolute LBA of the write pointer
+			/// </summary>
+			/// <returns>LBA</returns>
+			UINT_64 getWritePointer();
+
+		private:
+			/// <summary>
+			/// Status code for writing in the current state, or 0 if writes are allowed
+			/// </summary>
+			UINT_8 getWriteStateError();
+
+			/// <summary>
+			/// Moves the zone to implicitly opened (if empty/closed) and to full once the write pointer reaches capacity
+			/// </summary>
+			/// <param name="newOffset">Write pointer offset after the write</param>
+			void transitionAfterWrite(UINT_64 newOffset);
+
+			/// <summary>
+			/// First LBA of the zone
+			/// </summary>
+			UINT_64 ZoneStartLba;
+
+			/// <summary>
+			/// Number of writable blocks in the zone
+			/// </summary>
+			UINT_64 ZoneCapacity;
+
+			/// <summary>
+			/// Write pointer as an offset from ZoneStartLba. Never past ZoneCapacity: appends only move it once they fit.
+			/// </summary>
+			std::atomic<UINT_64> WritePointerOffset;
+
+			/// <summary>
+			/// Current ZONE_STATE
+			/// </summary>
+			std::atomic<UINT_8> State;
+
+			/// <summary>
+			/// Serializes Zone Send Actions. Not taken on the write path.
+			/// </summary>
+			std::mutex ActionMutex;
+		};
+	}
+}
@@ -1,3 +1,4 @@
 g++ --version
 printf "Starting build!\n"
-g++ *.h *.cpp -w -fpermissive -o cNVMe.out -pthread -std=c++11
\ No newline at end of file
+g++ *.h *.cpp -w -fpermissive -o cNVMe.out -pthread -std=c++11 -rdynamic -ldl # Plugins resolve controller symbols from the executable
+g++ Plugins/FilterPlugin.cpp -shared -fPIC -w -fpermissive -o cNVMeFilterPlugin.so -pthread -std=c++11
\ No newline at end of file